@@ -8,7 +8,7 @@ the reason is that the api does not fit the sensor well.
 And the driver is implemented out of tree, modifying the sensor.h
 is not an option.
 
-Only wakeup mode and forced readout is supported.
+Forced readout and wakeup mode are supported, interrupt readout with CONFIG_PYD1598_INTERRUPT_READOUT.
 
 Author: Casper Augustsson Savinov
 mail: casper9429@gmail.com
@@ -22,7 +22,7 @@ mail: casper9429@gmail.com
 // The push, get and set always write to the desired buffer to not allow noise to corrupt the config over time.
 // The fetch always reads config to the actual buffer to make sure the sensor does not get corrupted by noise. 
 //
-// Make examples of how to use the sensor in wake-up mode, and in forced readout mode. Make it impossible to use interrupt readout mode. 
+// Make examples of how to use the sensor in wake-up mode, and in forced readout mode. Interrupt readout mode is only possible with CONFIG_PYD1598_INTERRUPT_READOUT.
 //
 // Instead of returning raw adc count: split it into BPF, LPF and Temperature sensor. And if possible make interpertation of the data.
 //
@@ -97,65 +97,9 @@ mail: casper9429@gmail.com
 #include <stdint.h>
 #include <stdbool.h>
 #include <pyd1598.h>
+#include "pyd1598_internal.h"
 
-LOG_MODULE_REGISTER(PYD1598, CONFIG_SENSOR_LOG_LEVEL);
-
-// Define macros for configuration
-#define PYD1598_THRESHOLD_SHIFT 17
-#define PYD1598_THRESHOLD_MASK ((uint32_t)0b11111111)
-
-#define PYD1598_BLIND_TIME_SHIFT 13
-#define PYD1598_BLIND_TIME_MASK ((uint32_t)0b1111)
-
-#define PYD1598_PULSE_COUNTER_SHIFT 11
-#define PYD1598_PULSE_COUNTER_MASK ((uint32_t)0b11)
-
-#define PYD1598_WINDOW_TIME_SHIFT 9
-#define PYD1598_WINDOW_TIME_MASK ((uint32_t)0b11)
-
-#define PYD1598_OPERATION_MODE_SHIFT 7
-#define PYD1598_OPERATION_MODE_MASK ((uint32_t)0b11)
-
-#define PYD1598_SIGNAL_SOURCE_SHIFT 5
-#define PYD1598_SIGNAL_SOURCE_MASK ((uint32_t)0b11)
-
-#define PYD1598_RESERVED_2_SHIFT 3
-#define PYD1598_RESERVED_2_MASK ((uint32_t)0b11)
-#define PYD1598_RESERVED_2_DEC_VALUE ((uint32_t)2)
-
-
-#define PYD1598_HPF_CUT_OFF_SHIFT 2
-#define PYD1598_HPF_CUT_OFF_MASK ((uint32_t)0b1)
-
-#define PYD1598_RESERVED_1_SHIFT 1
-#define PYD1598_RESERVED_1_MASK ((uint32_t)0b1)
-#define PYD1598_RESERVED_1_DEC_VALUE ((uint32_t)0)
-
-#define PYD1598_COUNT_MODE_SHIFT 0
-#define PYD1598_COUNT_MODE_MASK ((uint32_t)0b1)
-
-// Define macros for measurement
-#define PYD1598_OUT_OF_RANGE_MASK ((uint32_t)0b1)
-#define PYD1598_OUT_OF_RANGE_SHIFT 14
-
-#define PYD1598_ADC_COUNTS_MASK ((uint32_t)0b11111111111111)
-#define PYD1598_ADC_COUNTS_SHIFT 0
-
-
-
-struct pyd1598_data {
-    uint32_t sensor_conf; // Desired configuration of the sensor
-    uint32_t measurement; // Measurement data from the sensor
-};
-
-
-// Read only after configuration: https://docs.zephyrproject.org/latest/kernel/drivers/index.html
-struct pyd1598_config {
-	int instance;
-	struct gpio_dt_spec serial_in;
-	struct gpio_dt_spec direct_link;
-};
-
+LOG_MODULE_REGISTER(PYD1598, PYD1598_LOG_LEVEL);
 
 // Initialize the sensor device, do not configure the sensor here
 static int pyd1598_init(const struct device *dev)
@@ -165,6 +109,7 @@ static int pyd1598_init(const struct device *dev)
     struct pyd1598_data *data;
     uint32_t sensor_conf = 0;
     uint32_t measurement = 0;
+    uint32_t init_start;
     int ret = 0;
 
     // Check that the device is not null, and that the data and configuration is not null
@@ -176,6 +121,7 @@ static int pyd1598_init(const struct device *dev)
     // Define the variables
     cfg = dev->config;
     data = dev->data; 
+    init_start = k_cycle_get_32();
 
     // Check if the GPIO pins are ready
     if (!gpio_is_ready_dt(&cfg->serial_in)) {
@@ -200,64 +146,125 @@ static int pyd1598_init(const struct device *dev)
         return ret;
     }
 
+    // Serial in backend
+    if (cfg->bus->init != NULL) {
+        ret = cfg->bus->init(dev);
+        if (ret != 0) {
+            LOG_ERR("Failed to initialise the serial in backend");
+            return ret;
+        }
+    }
+
     // Set reserved bits in desired configuration, to allow for user to not set them even if encouraged 
-    sensor_conf = (sensor_conf & ~(PYD1598_RESERVED_2_MASK << PYD1598_RESERVED_2_SHIFT)) | (PYD1598_RESERVED_2_DEC_VALUE << PYD1598_RESERVED_2_SHIFT);
-    sensor_conf = (sensor_conf & ~(PYD1598_RESERVED_1_MASK << PYD1598_RESERVED_1_SHIFT)) | (PYD1598_RESERVED_1_DEC_VALUE << PYD1598_RESERVED_1_SHIFT);
+    sensor_conf = pyd1598_core_conf_reserved(sensor_conf);
 
     // Set the sensor configuration and measurement data in ram
     data->sensor_conf = sensor_conf;
     data->measurement = measurement;
+    data->sensor_conf_readback = 0;
+    data->timestamp_us = 0;
+    data->dev = dev;
+    k_mutex_init(&data->run_lock);
+
+    // Optional modules, no-ops when disabled in Kconfig
+    ret = pyd1598_emul_init(dev);
+    if (ret != 0) {
+        LOG_ERR("Failed to initialise the sensor emulator");
+        return ret;
+    }
+    ret = pyd1598_energy_init(dev);
+    if (ret != 0) {
+        LOG_ERR("Failed to initialise energy accounting");
+        return ret;
+    }
+    ret = pyd1598_cache_init(dev);
+    if (ret != 0) {
+        LOG_ERR("Failed to initialise the fetch cache");
+        return ret;
+    }
+    ret = pyd1598_trigger_init(dev);
+    if (ret != 0) {
+        LOG_ERR("Failed to initialise wake-up trigger");
+        return ret;
+    }
+    ret = pyd1598_stream_init(dev);
+    if (ret != 0) {
+        LOG_ERR("Failed to initialise streaming");
+        return ret;
+    }
+    ret = pyd1598_sched_init(dev);
+    if (ret != 0) {
+        LOG_ERR("Failed to initialise the signal source scheduler");
+        return ret;
+    }
+    ret = pyd1598_hybrid_init(dev);
+    if (ret != 0) {
+        LOG_ERR("Failed to initialise the hybrid mode");
+        return ret;
+    }
+    ret = pyd1598_occupancy_init(dev);
+    if (ret != 0) {
+        LOG_ERR("Failed to initialise occupancy aggregation");
+        return ret;
+    }
+    ret = pyd1598_capture_init(dev);
+    if (ret != 0) {
+        LOG_ERR("Failed to initialise burst capture");
+        return ret;
+    }
+    ret = pyd1598_interrupt_init(dev);
+    if (ret != 0) {
+        LOG_ERR("Failed to initialise interrupt readout");
+        return ret;
+    }
+    ret = pyd1598_calib_init(dev);
+    if (ret != 0) {
+        LOG_ERR("Failed to initialise calibration");
+        return ret;
+    }
+
+#ifdef CONFIG_PM_DEVICE_RUNTIME
+    // Suspended until the first transaction
+    ret = pm_device_runtime_enable(dev);
+    if (ret != 0) {
+        LOG_ERR("Failed to enable runtime pm");
+        return ret;
+    }
+#endif
+
+    // Init time per instance, to see how boot grows with the cluster
+#ifdef CONFIG_PYD1598_STATS
+    data->stats.init_us = k_cyc_to_us_ceil32(k_cycle_get_32() - init_start);
+#else
+    ARG_UNUSED(init_start);
+#endif
 
 	return 0;
 }
 
 
-/**
- * @brief Pushes config from internal buffer to sensor. 
- * Write configuration to the internal buffer using set_config.
- * 
- * @param dev Pointer to the sensor device
- *
- * @return 0 if successful, negative errno code if failure.
- */
-int pyd1598_push(const struct device *dev){
+// Bit banged serial in, irq locked for the 25 bits and the latch time
+static int pyd1598_bus_gpio_push(const struct device *dev, uint32_t sensor_conf){
     // Variables
     const struct pyd1598_config *cfg; // Get the configuration
-    struct pyd1598_data *data; // pyd1598_data
-    uint32_t sensor_conf; // Raw bits of the configuration
     uint32_t reg_mask; // Reg mask 
     int key = 0; // Interupt key
     int bit = 0; // Each bit
     int ret = 0; // Return value
 
-    // Check if the device is null
-    LOG_DBG("pyd1598_push");
-    if (dev == NULL || dev->data == NULL) {
-        return -EINVAL;
-    }
-
     // Declare the variables
     cfg = dev->config;
-    data = dev->data;
-    sensor_conf = data->sensor_conf;
     key = irq_lock();
 
-    // beggining condition 
-    // Set both direct link and serial in to output value 0
+    // beggining condition, serial in to output value 0
     ret = gpio_pin_configure_dt(&cfg->serial_in, GPIO_OUTPUT);
     if (ret != 0) {
         irq_unlock(key);
         LOG_ERR("Failed to configure serial in GPIO pin %d", cfg->serial_in.pin);
         return ret;
     }
-    ret = gpio_pin_configure_dt(&cfg->direct_link, GPIO_OUTPUT);
-    if (ret != 0) {
-        irq_unlock(key);
-        LOG_ERR("Failed to configure direct link GPIO pin %d", cfg->direct_link.pin);
-        return ret;
-    }
     gpio_pin_set_dt(&cfg->serial_in, 0);
-    gpio_pin_set_dt(&cfg->direct_link, 0);
+    pyd1598_timing_mark(cfg, PYD1598_TIMING_SERIAL_IN, PYD1598_TIMING_LEVEL, 0);
 
     // Sleep for 200 ns - 2000 ns
     k_busy_wait(1);
@@ -267,101 +274,185 @@ int pyd1598_push(const struct device *dev){
         reg_mask = (uint32_t)(1) << i;
         bit = ((sensor_conf & reg_mask) != 0) ? 1 : 0;    
         gpio_pin_set_dt(&cfg->serial_in, 0);
+        pyd1598_timing_mark(cfg, PYD1598_TIMING_SERIAL_IN, PYD1598_TIMING_LEVEL, 0);
         k_busy_wait(1);
         gpio_pin_set_dt(&cfg->serial_in, 1);
+        pyd1598_timing_mark(cfg, PYD1598_TIMING_SERIAL_IN, PYD1598_TIMING_LEVEL, 1);
         k_busy_wait(1);
         gpio_pin_set_dt(&cfg->serial_in, bit);
+        pyd1598_timing_mark(cfg, PYD1598_TIMING_SERIAL_IN, PYD1598_TIMING_LEVEL, (uint8_t)bit);
 
         //sleep for atleast 80 us + 20%
         k_busy_wait(96);        
     } 
-    // pull the pin low for 650 us + 20%
-    gpio_pin_set_dt(&cfg->direct_link, 0);
+    // latch time, 650 us + 20%
     k_busy_wait(780);
 
-    // after condition, set both direct link and serial in to input
+    // after condition, set serial in to input
     ret = gpio_pin_configure_dt(&cfg->serial_in, GPIO_INPUT);
     if (ret != 0) {
         irq_unlock(key);
         LOG_ERR("Failed to configure serial in GPIO pin %d", cfg->serial_in.pin);
         return ret;
     }
-    ret = gpio_pin_configure_dt(&cfg->direct_link, GPIO_INPUT);
+    pyd1598_timing_mark(cfg, PYD1598_TIMING_SERIAL_IN, PYD1598_TIMING_RELEASE, 0);
+
+    // Unlock irq
+    irq_unlock(key);
+
+    return 0;
+}
+
+const struct pyd1598_bus_api pyd1598_bus_gpio = {
+    .init = NULL,
+    .push = pyd1598_bus_gpio_push,
+    .irq_locked = true,
+};
+
+
+// Push transaction, the device must be resumed
+static int pyd1598_push_transaction(const struct device *dev){
+    // Variables
+    const struct pyd1598_config *cfg; // Get the configuration
+    struct pyd1598_data *data; // pyd1598_data
+    uint32_t sensor_conf; // Raw bits of the configuration
+    struct pyd1598_energy_span span = {0}; // Cycles of the push, CONFIG_PYD1598_ENERGY
+    uint32_t energy_start; // Cycle count when the push started
+    uint32_t energy_mark; // Cycle count when a line was driven
+    int ret = 0; // Return value
+    int ret_release = 0; // Return value of the release
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_push");
+    if (dev == NULL || dev->data == NULL) {
+        return -EINVAL;
+    }
+    if (pyd1598_interrupt_running(dev) || pyd1598_sync_running(dev)) {
+        return -EBUSY;
+    }
+
+    // Declare the variables
+    cfg = dev->config;
+    data = dev->data;
+    sensor_conf = data->sensor_conf;
+
+    // Never push a word with a not allowed field value to the sensor
+    ret = pyd1598_core_conf_validate(sensor_conf);
     if (ret != 0) {
-        irq_unlock(key);
+        LOG_ERR("Configuration 0x%07x is not valid", sensor_conf);
+        return ret;
+    }
+    pyd1598_partial_reset(data); // Verify the pushed configuration on the next fetch
+    PYD1598_STATS_INC(data, push_count);
+    energy_start = pyd1598_energy_cycles();
+    pyd1598_trigger_pause(dev);
+
+    // Direct link is held low for the whole push
+    ret = gpio_pin_configure_dt(&cfg->direct_link, GPIO_OUTPUT_LOW);
+    if (ret != 0) {
+        pyd1598_trigger_resume(dev);
         LOG_ERR("Failed to configure direct link GPIO pin %d", cfg->direct_link.pin);
         return ret;
     }
+    pyd1598_timing_mark(cfg, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_LEVEL, 0);
+    energy_mark = pyd1598_energy_cycles();
 
-    // Unlock irq
-    irq_unlock(key);
+    // The 25 bits and the latch time on serial in
+    ret = cfg->bus->push(dev, sensor_conf);
+    span.serial_in = pyd1598_energy_cycles() - energy_mark;
+
+    // after condition, set direct link to input
+    ret_release = gpio_pin_configure_dt(&cfg->direct_link, GPIO_INPUT);
+    if (ret_release != 0) {
+        pyd1598_trigger_resume(dev);
+        LOG_ERR("Failed to configure direct link GPIO pin %d", cfg->direct_link.pin);
+        return ret_release;
+    }
+    pyd1598_timing_mark(cfg, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_RELEASE, 0);
+
+    // The gpio backends lock irq for the whole push, the spi backend sleeps in the transfer
+    span.direct_link = pyd1598_energy_cycles() - energy_mark;
+    span.active = pyd1598_energy_cycles() - energy_start;
+    span.irq_locked = cfg->bus->irq_locked ? span.serial_in : 0;
+    pyd1598_energy_account(dev, PYD1598_ENERGY_PUSH, &span);
+    if (ret != 0) {
+        pyd1598_trigger_resume(dev);
+        return ret;
+    }
+
+    // Only wake-up mode signals triggers on direct link, enabled by the resume
+    pyd1598_trigger_arm(dev, PYD1598_FIELD_GET(sensor_conf, OPERATION_MODE) == PYD1598_WAKE_UP);
+    pyd1598_trigger_resume(dev);
     
     return 0;
 }
 
+
 /**
- * @brief Fetch out_of_range,measurement,config from sensor to internal buffer. 
+ * @brief Pushes config from internal buffer to sensor. 
+ * Write configuration to the internal buffer using set_config.
  * 
  * @param dev Pointer to the sensor device
  *
- * @return 0 if successful, negative errno code if failure.
+ * @return 0 if successful, -EBUSY during interrupt readout or synchronized sampling, negative errno code if failure.
  */
-int pyd1598_fetch(const struct device *dev){
-
+int pyd1598_push(const struct device *dev){
     // Variables
-    const struct pyd1598_config *cfg; // Get the configuration
-    struct pyd1598_data *data; // pyd1598_data
-    uint32_t bit = 0; // bit value, will endure bit shifts up to 25 bits
-    uint32_t sensor_conf_desired = 0; // Raw bits of the configuration
-    uint32_t sensor_conf = 0; // Raw bits of the configuration
-    uint32_t measurement = 0; // Raw bits of the measurement
-    int key = 0; // Interupt key
-    int ret = 0; // return value
+    int ret;
 
     // Check if the device is null
-    LOG_DBG("pyd1598_fetch");
     if (dev == NULL || dev->data == NULL) {
         return -EINVAL;
     }
 
-    // Declare the variables
-    cfg = dev->config; // Get the configuration
-    data = dev->data; // pyd1598_data
-    sensor_conf_desired = data->sensor_conf; // Desired configuration
-    key = irq_lock(); // Lock irq
-    
-
-    // low to high transition on direct link pin, high for at least 120 us
-    ret = gpio_pin_configure_dt(&cfg->direct_link, GPIO_OUTPUT_LOW); // initalize to low
-    if (ret != 0) {
-        irq_unlock(key);
-        LOG_ERR("Failed to configure direct link GPIO pin %d", cfg->direct_link.pin);
+    // Resume the device for the transaction, no-op without runtime pm
+    ret = pm_device_runtime_get(dev);
+    if (ret < 0) {
         return ret;
     }
-    gpio_pin_set_dt(&cfg->direct_link, 1); 
-    // set to high for at least 120 us + 20%
-    k_busy_wait(168);
+    pyd1598_trace(dev, PYD1598_TRACE_PUSH_BEGIN, 0, ((struct pyd1598_data *)dev->data)->sensor_conf);
+    ret = pyd1598_push_transaction(dev);
+    pyd1598_trace(dev, PYD1598_TRACE_PUSH_END, (uint16_t)ret, 0);
+    if (ret == 0) {
+        pyd1598_pm_restored(dev);
+    }
+    pm_device_runtime_put(dev);
 
+    return ret;
+}
 
-    // Readout the measurement data
-    for (int i = 39; i >= 0; i--) {
+/**
+ * @brief Clock the bits of a readout out of the sensor, once direct link is high.
+ * Call with irq locked, also used from the interrupt readout isr.
+ *
+ * @param cfg Configuration of the sensor device
+ * @param measurement Pointer to where the 15 measurement bits should be stored
+ * @param sensor_conf Pointer to where the 25 configuration bits should be stored, 0 if not read
+ * @param bits PYD1598_READOUT_BITS, or PYD1598_MEASUREMENT_BITS to stop after the measurement
+ *
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_readout_bits(const struct pyd1598_config *cfg, uint32_t *measurement, uint32_t *sensor_conf, int bits){
+
+    // Variables
+    uint64_t raw = 0; // Sampled bits, the first one most significant
+    uint32_t bit = 0; // bit value
+    int ret = 0; // return value
+
+    for (int i = PYD1598_READOUT_BITS - 1; i >= PYD1598_READOUT_BITS - bits; i--) {
 
         // force low for 200 ns - 2000ns
         ret = gpio_pin_configure_dt(&cfg->direct_link, GPIO_OUTPUT_LOW); // initalize to low
         if (ret != 0) {
-            irq_unlock(key);
             LOG_ERR("Failed to configure direct link GPIO pin %d", cfg->direct_link.pin);
             return ret;
         }
+        pyd1598_timing_mark(cfg, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_LEVEL, 0);
         // // force low for 200 ns - 2000ns
         // Done by assembly
         
         gpio_pin_set_dt(&cfg->direct_link, 1);
-        if (ret != 0) {
-            irq_unlock(key);
-            LOG_ERR("Failed to configure direct link GPIO pin %d", cfg->direct_link.pin);
-            return ret;
-        }
+        pyd1598_timing_mark(cfg, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_LEVEL, 1);
         // // force high for 200 ns - 2000ns
         // Done by assembly
 
@@ -369,63 +460,327 @@ int pyd1598_fetch(const struct device *dev){
         // release the pin, wait for less than 22 us => 5 us
         ret = gpio_pin_configure_dt(&cfg->direct_link, GPIO_INPUT); 
         if (ret != 0) {
-            irq_unlock(key);
             LOG_ERR("Failed to configure direct link GPIO pin %d", cfg->direct_link.pin);
             return ret;
         }
+        pyd1598_timing_mark(cfg, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_RELEASE, 0);
         k_busy_wait(3);
 
-        // read the bit, uint32_t because it might be shifted up to 25 bits, and code should not compile if not 32 bits
+        // read the bit, the frame is split after the last bit
         bit = (uint32_t)(gpio_pin_get_dt(&cfg->direct_link));
+        pyd1598_timing_mark(cfg, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_SAMPLE, (uint8_t)bit);
+        raw = (raw << 1) | (bit & 1U);
+    }
 
-        // save the bit in the measurement data
-        if (i >= 25) {
-            measurement = (measurement) | (bit << (i-25));
-        }
-        else { // bits 24-0 
-            sensor_conf = (sensor_conf) | (bit << i);
+    pyd1598_core_decode_readout(raw, bits, measurement, sensor_conf);
+
+    return 0;
+}
+
+
+/**
+ * @brief Check a readout against the desired configuration, save it to the internal buffer
+ * and hand it to the optional modules. Used by fetch and by interrupt readout.
+ *
+ * @param dev Pointer to the sensor device
+ * @param frame Frame read from the sensor, a partial frame carries the desired configuration
+ * @param full True if the configuration bits were read from the sensor
+ *
+ * @return 0 if successful, -EIO if the read back configuration does not match.
+ */
+int pyd1598_accept_frame(const struct device *dev, const struct pyd1598_frame *frame, bool full){
+
+    // Variables
+    struct pyd1598_data *data; // pyd1598_data
+
+    // Declare the variables
+    data = dev->data; // pyd1598_data
+
+    if (full) {
+        // Keep what the sensor reported, also when it does not match
+        data->sensor_conf_readback = frame->sensor_conf;
+
+        // Check if bits_configuration is the same as bits_configuration_desired
+        if (frame->sensor_conf != data->sensor_conf) {
+            PYD1598_STATS_INC(data, conf_mismatch);
+            pyd1598_trace(dev, PYD1598_TRACE_MISMATCH, 0, frame->sensor_conf);
+            pyd1598_partial_reset(data);
+            LOG_ERR("Configuration read from the sensor does not match desired configuration");
+            return -EIO;
         }
+        pyd1598_partial_verified(data);
+    }
+    else {
+        PYD1598_STATS_INC(data, fetch_partial);
+    }
+    PYD1598_STATS_INC(data, fetch_ok);
+    pyd1598_pm_frame(data, frame);
+
+    // Save readout data to internal buffer
+    data->measurement = frame->measurement;
+    data->timestamp_us = frame->timestamp_us;
+
+    // Hand the frame to the optional modules
+    pyd1598_cache_frame(dev, frame);
+    pyd1598_zbus_publish_frame(dev, frame);
+    pyd1598_logger_frame(dev, frame);
+    pyd1598_fusion_frame(dev, frame);
+    pyd1598_capture_frame(dev, frame);
+
+    return 0;
+}
+
+
+// Fetch transaction, the device must be resumed
+static int pyd1598_fetch_transaction(const struct device *dev){
+
+    // Variables
+    const struct pyd1598_config *cfg; // Get the configuration
+    struct pyd1598_data *data; // pyd1598_data
+    uint32_t sensor_conf_desired = 0; // Raw bits of the configuration
+    uint32_t sensor_conf = 0; // Raw bits of the configuration
+    uint32_t measurement = 0; // Raw bits of the measurement
+    int64_t timestamp_us = 0; // Uptime when the measurement was sampled
+    struct pyd1598_frame frame; // Decoded frame, handed to the optional modules
+    struct pyd1598_energy_span span = {0}; // Cycles of the fetch, CONFIG_PYD1598_ENERGY
+    uint32_t energy_start; // Cycle count when the fetch started
+    uint32_t energy_lock; // Cycle count when irq was locked
+    uint32_t energy_mark; // Cycle count when direct link was driven
+    int key = 0; // Interupt key
+    int ret = 0; // return value
+    bool full = true; // Read the configuration bits too
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_fetch");
+    if (dev == NULL || dev->data == NULL) {
+        return -EINVAL;
+    }
+    if (pyd1598_interrupt_running(dev) || pyd1598_sync_running(dev)) {
+        return -EBUSY;
+    }
+
+    // Declare the variables
+    cfg = dev->config; // Get the configuration
+    data = dev->data; // pyd1598_data
+    sensor_conf_desired = data->sensor_conf; // Desired configuration
+    full = !pyd1598_partial_take(data); // Measurement only while the configuration is recently verified
+    PYD1598_STATS_INC(data, fetch_count);
+    energy_start = pyd1598_energy_cycles();
+    pyd1598_trigger_pause(dev);
+    key = irq_lock(); // Lock irq
+    energy_lock = pyd1598_energy_cycles();
+    
+
+    // low to high transition on direct link pin, high for at least 120 us
+    ret = gpio_pin_configure_dt(&cfg->direct_link, GPIO_OUTPUT_LOW); // initalize to low
+    if (ret != 0) {
+        irq_unlock(key);
+        pyd1598_trigger_resume(dev);
+        LOG_ERR("Failed to configure direct link GPIO pin %d", cfg->direct_link.pin);
+        return ret;
+    }
+    pyd1598_timing_mark(cfg, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_LEVEL, 0);
+    energy_mark = pyd1598_energy_cycles();
+    gpio_pin_set_dt(&cfg->direct_link, 1); 
+    pyd1598_timing_mark(cfg, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_LEVEL, 1);
+    // set to high for at least 120 us + 20%
+    k_busy_wait(168);
+
+    // The sensor latches the sample when the readout starts
+    timestamp_us = k_ticks_to_us_floor64(k_uptime_ticks());
+    span.direct_link = pyd1598_energy_cycles() - energy_mark;
+
+
+    // Readout the measurement data, and the configuration if due
+    ret = pyd1598_readout(cfg, &measurement, &sensor_conf, full ? PYD1598_READOUT_BITS : PYD1598_MEASUREMENT_BITS);
+    if (ret != 0) {
+        irq_unlock(key);
+        pyd1598_trigger_resume(dev);
+        return ret;
     }
 
     // Force direct link low for at least 1250 us + 20%
     ret = gpio_pin_configure_dt(&cfg->direct_link, GPIO_OUTPUT_LOW); // initalize to low
     if (ret != 0) {
         irq_unlock(key);
+        pyd1598_trigger_resume(dev);
         LOG_ERR("Failed to configure direct link GPIO pin %d", cfg->direct_link.pin);
         return ret;
     }
+    pyd1598_timing_mark(cfg, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_LEVEL, 0);
+    energy_mark = pyd1598_energy_cycles();
     k_busy_wait(1500);
     
     // Release the direct link pin
     ret = gpio_pin_configure_dt(&cfg->direct_link, GPIO_INPUT); // initalize to low
     if (ret != 0) {
         irq_unlock(key);
+        pyd1598_trigger_resume(dev);
         LOG_ERR("Failed to configure direct link GPIO pin %d", cfg->direct_link.pin);
         return ret;
     }
+    pyd1598_timing_mark(cfg, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_RELEASE, 0);
 
     // Unlock irq once for all
+    span.direct_link += pyd1598_energy_cycles() - energy_mark;
     irq_unlock(key);
+    pyd1598_trigger_resume(dev);
+    span.irq_locked = pyd1598_energy_cycles() - energy_lock;
+    span.active = pyd1598_energy_cycles() - energy_start;
+    pyd1598_energy_account(dev, PYD1598_ENERGY_FETCH, &span);
 
-    // for (int i = 24 ; i >= 0; i--) {
-    //     // Plot sensor_conf and sensor_conf_desired
-    //     LOG_INF("Bit %d| conf: %d| des: %d ", i, (sensor_conf & (1 << i)) >> i, (sensor_conf_desired & (1 << i)) >> i);
-    // }
-    LOG_INF("conf %d| des %d", sensor_conf, sensor_conf_desired);
-    LOG_INF("\n");
+    // One binary record for all sampled bits, nothing is formatted on the hot path
+    pyd1598_trace(dev, PYD1598_TRACE_READOUT, (uint16_t)measurement,
+                  sensor_conf | ((uint32_t)(full ? PYD1598_READOUT_BITS : PYD1598_MEASUREMENT_BITS) << 25));
 
 
-    // Check if bits_configuration is the same as bits_configuration_desired
-    if (sensor_conf != sensor_conf_desired) {
-        LOG_ERR("Configuration read from the sensor does not match desired configuration");
-        return -EIO;
+    // Check, save and publish the frame
+    frame.timestamp_us = timestamp_us;
+    frame.sensor_conf = full ? sensor_conf : sensor_conf_desired;
+    frame.measurement = (uint16_t)measurement;
+
+    return pyd1598_accept_frame(dev, &frame, full);
+}
+
+
+// Fetch transaction that pushes the configuration again if it was lost while suspended, the device must be resumed
+static int pyd1598_fetch_restore_transaction(const struct device *dev){
+    // Variables
+    int ret;
+
+    pyd1598_trace(dev, PYD1598_TRACE_FETCH_BEGIN, 0, 0);
+    ret = pyd1598_fetch_transaction(dev);
+    if (ret == -EIO && pyd1598_pm_restore_pending(dev)) {
+        // The sensor lost its configuration while suspended, restore it and read again
+        LOG_WRN("Configuration lost while suspended, pushing it again");
+        pyd1598_trace(dev, PYD1598_TRACE_PUSH_BEGIN, 0, ((struct pyd1598_data *)dev->data)->sensor_conf);
+        ret = pyd1598_push_transaction(dev);
+        pyd1598_trace(dev, PYD1598_TRACE_PUSH_END, (uint16_t)ret, 0);
+        if (ret == 0) {
+            ret = pyd1598_fetch_transaction(dev);
+        }
+    }
+    pyd1598_trace(dev, PYD1598_TRACE_FETCH_END, (uint16_t)ret, 0);
+    if (ret == 0) {
+        pyd1598_pm_restored(dev);
     }
 
-    // Save readout data to internal buffer
-    data->sensor_conf = sensor_conf;
-    data->measurement = measurement;
+    return ret;
+}
+
+
+/**
+ * @brief Fetch out_of_range,measurement,config from sensor to internal buffer. 
+ * 
+ * @param dev Pointer to the sensor device
+ *
+ * @return 0 if successful, -EBUSY during interrupt readout or synchronized sampling, negative errno code if failure.
+ */
+int pyd1598_fetch(const struct device *dev){
+    // Variables
+    int ret;
+
+    // Check if the device is null
+    if (dev == NULL || dev->data == NULL) {
+        return -EINVAL;
+    }
+
+    // Resume the device for the transaction, no-op without runtime pm
+    ret = pm_device_runtime_get(dev);
+    if (ret < 0) {
+        return ret;
+    }
+    ret = pyd1598_fetch_restore_transaction(dev);
+    pm_device_runtime_put(dev);
+
+    return ret;
+}
+
 
-    return 0;    
+#ifdef CONFIG_PYD1598_STATS
+/**
+ * @brief Get the transaction counters of the sensor.
+ * 
+ * @param dev Pointer to the sensor device
+ * @param stats Pointer to where the counters should be stored
+ * 
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_get_stats(const struct device *dev, struct pyd1598_stats *stats){
+    // Variables
+    struct pyd1598_data *data;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_get_stats");
+    if (dev == NULL || dev->data == NULL || stats == NULL) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+
+    *stats = data->stats;
+
+    return 0;
+}
+
+
+/**
+ * @brief Clear the transaction counters of the sensor.
+ * 
+ * @param dev Pointer to the sensor device
+ * 
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_reset_stats(const struct device *dev){
+    // Variables
+    struct pyd1598_data *data;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_reset_stats");
+    if (dev == NULL || dev->data == NULL) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+
+    data->stats = (struct pyd1598_stats){
+        .init_us = data->stats.init_us,
+    };
+
+    return 0;
+}
+#endif
+
+
+/**
+ * @brief Get the last fetched frame from the internal buffer.
+ * 
+ * @param dev Pointer to the sensor device
+ * @param frame Pointer to where the frame should be stored
+ * 
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_get_frame(const struct device *dev, struct pyd1598_frame *frame){
+    // Variables
+    struct pyd1598_data *data;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_get_frame");
+    if (dev == NULL || dev->data == NULL || frame == NULL) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+
+    // Copy the frame from the internal buffer
+    frame->timestamp_us = data->timestamp_us;
+    frame->sensor_conf = data->sensor_conf;
+    frame->measurement = (uint16_t)data->measurement;
+
+    return 0;
 }
 
 
@@ -454,8 +809,7 @@ int pyd1598_set_reserved_bits(const struct device *dev){
     sensor_conf = data->sensor_conf;
 
     // Set reserved bits in desired configuration, to allow for user to not set them even if encouraged
-    sensor_conf = (sensor_conf & ~(PYD1598_RESERVED_2_MASK << PYD1598_RESERVED_2_SHIFT)) | (PYD1598_RESERVED_2_DEC_VALUE << PYD1598_RESERVED_2_SHIFT);
-    sensor_conf = (sensor_conf & ~(PYD1598_RESERVED_1_MASK << PYD1598_RESERVED_1_SHIFT)) | (PYD1598_RESERVED_1_DEC_VALUE << PYD1598_RESERVED_1_SHIFT);
+    sensor_conf = pyd1598_core_conf_reserved(sensor_conf);
 
     // Save the configuration to the internal buffer
     data->sensor_conf = sensor_conf;
@@ -464,6 +818,9 @@ int pyd1598_set_reserved_bits(const struct device *dev){
 }
 
 
+// Field accessors, pyd1598_compact.c has table driven ones without log strings
+#ifndef CONFIG_PYD1598_COMPACT
+
 /**
 * @brief Set pyd1598 threshold configuration to the internal buffer. 
 *
@@ -490,7 +847,7 @@ int pyd1598_set_threshold(const struct device *dev, uint8_t threshold){
     sensor_conf = data->sensor_conf;
 
     // Set raw bits in configuration at 24-17 to threshold, leave the rest of the bits as they are
-    sensor_conf = (sensor_conf & ~(PYD1598_THRESHOLD_MASK << PYD1598_THRESHOLD_SHIFT)) | ((uint32_t)(threshold) << PYD1598_THRESHOLD_SHIFT);
+    sensor_conf = PYD1598_FIELD_SET(sensor_conf, THRESHOLD, threshold);
 
     // Save the configuration to the internal buffer
     data->sensor_conf = sensor_conf;
@@ -521,7 +878,7 @@ int pyd1598_get_threshold(const struct device *dev, uint8_t *threshold){
     sensor_conf = data->sensor_conf;
 
     // Get the threshold from the internal buffer
-    *threshold = (sensor_conf & (PYD1598_THRESHOLD_MASK << PYD1598_THRESHOLD_SHIFT)) >> PYD1598_THRESHOLD_SHIFT;
+    *threshold = PYD1598_FIELD_GET(sensor_conf, THRESHOLD);
 
     return 0;
 }
@@ -553,7 +910,7 @@ int pyd1598_set_blind_time(const struct device *dev, uint8_t blind_time){
     sensor_conf = data->sensor_conf;
 
     // Set raw bits in configuration at 16-13 to blind time, leave the rest of the bits as they are
-    sensor_conf = (sensor_conf & ~(PYD1598_BLIND_TIME_MASK << PYD1598_BLIND_TIME_SHIFT)) | ((uint32_t)(blind_time) << PYD1598_BLIND_TIME_SHIFT);
+    sensor_conf = PYD1598_FIELD_SET(sensor_conf, BLIND_TIME, blind_time);
 
     // Save the configuration to the internal buffer
     data->sensor_conf = sensor_conf;
@@ -586,7 +943,7 @@ int pyd1598_get_blind_time(const struct device *dev, uint8_t *blind_time){
     sensor_conf = data->sensor_conf;
 
     // Get the blind time from the internal buffer
-    *blind_time = (sensor_conf & (PYD1598_BLIND_TIME_MASK << PYD1598_BLIND_TIME_SHIFT)) >> PYD1598_BLIND_TIME_SHIFT;
+    *blind_time = PYD1598_FIELD_GET(sensor_conf, BLIND_TIME);
 
     return 0;
 }
@@ -618,7 +975,7 @@ int pyd1598_set_pulse_counter(const struct device *dev, uint8_t pulse_counter){
     sensor_conf = data->sensor_conf;
 
     // Set raw bits in configuration at 12-11 to pulse counter, leave the rest of the bits as they are
-    sensor_conf = (sensor_conf & ~(PYD1598_PULSE_COUNTER_MASK << PYD1598_PULSE_COUNTER_SHIFT)) | ((uint32_t)(pulse_counter) << PYD1598_PULSE_COUNTER_SHIFT);
+    sensor_conf = PYD1598_FIELD_SET(sensor_conf, PULSE_COUNTER, pulse_counter);
 
     // Save the configuration to the internal buffer
     data->sensor_conf = sensor_conf;
@@ -651,7 +1008,7 @@ int pyd1598_get_pulse_counter(const struct device *dev, uint8_t *pulse_counter){
     sensor_conf = data->sensor_conf;
 
     // Get the pulse counter from the internal buffer
-    *pulse_counter = (sensor_conf & (PYD1598_PULSE_COUNTER_MASK << PYD1598_PULSE_COUNTER_SHIFT)) >> PYD1598_PULSE_COUNTER_SHIFT;
+    *pulse_counter = PYD1598_FIELD_GET(sensor_conf, PULSE_COUNTER);
 
     return 0;
 }
@@ -683,7 +1040,7 @@ int pyd1598_set_window_time(const struct device *dev, uint8_t window_time){
     sensor_conf = data->sensor_conf;
 
     // Set raw bits in configuration at 10-9 to window time, leave the rest of the bits as they are
-    sensor_conf = (sensor_conf & ~(PYD1598_WINDOW_TIME_MASK << PYD1598_WINDOW_TIME_SHIFT)) | ((uint32_t)(window_time) << PYD1598_WINDOW_TIME_SHIFT);
+    sensor_conf = PYD1598_FIELD_SET(sensor_conf, WINDOW_TIME, window_time);
 
     // Save the configuration to the internal buffer
     data->sensor_conf = sensor_conf;
@@ -716,7 +1073,7 @@ int pyd1598_get_window_time(const struct device *dev, uint8_t *window_time){
     sensor_conf = data->sensor_conf;
 
     // Get the window time from the internal buffer
-    *window_time = (sensor_conf & (PYD1598_WINDOW_TIME_MASK << PYD1598_WINDOW_TIME_SHIFT)) >> PYD1598_WINDOW_TIME_SHIFT;
+    *window_time = PYD1598_FIELD_GET(sensor_conf, WINDOW_TIME);
 
     return 0;
 }
@@ -726,9 +1083,9 @@ int pyd1598_get_window_time(const struct device *dev, uint8_t *window_time){
  * @brief Set pyd1598 operation mode configuration to the internal buffer.
  * 
  * @param dev Pointer to the sensor device
- * @param operation_mode Operation mode (PYD1598_FORCED_READOUT, PYD1598_WAKE_UP)
+ * @param operation_mode Operation mode (PYD1598_FORCED_READOUT, PYD1598_INTERRUPT_READOUT, PYD1598_WAKE_UP)
  * 
- * @return 0 if successful, negative errno code if failure.
+ * @return 0 if successful, -ENOTSUP for interrupt readout without CONFIG_PYD1598_INTERRUPT_READOUT, negative errno code if failure.
  */
 int pyd1598_set_operation_mode(const struct device *dev, enum pyd1598_operation_mode operation_mode){
     // Variables
@@ -741,6 +1098,12 @@ int pyd1598_set_operation_mode(const struct device *dev, enum pyd1598_operation_
     if (dev == NULL || dev->data == NULL) {
         return -EINVAL;
     }
+#ifndef CONFIG_PYD1598_INTERRUPT_READOUT
+    // Nothing would read the samples the sensor signals
+    if (operation_mode == PYD1598_INTERRUPT_READOUT) {
+        return -ENOTSUP;
+    }
+#endif
 
     // Declare the variables
     cfg = dev->config;
@@ -748,7 +1111,7 @@ int pyd1598_set_operation_mode(const struct device *dev, enum pyd1598_operation_
     sensor_conf = data->sensor_conf;
 
     // Set raw bits in configuration at 8-7 to operation mode, leave the rest of the bits as they are
-    sensor_conf = (sensor_conf & ~(PYD1598_OPERATION_MODE_MASK << PYD1598_OPERATION_MODE_SHIFT)) | ((uint32_t)(operation_mode) << PYD1598_OPERATION_MODE_SHIFT);
+    sensor_conf = PYD1598_FIELD_SET(sensor_conf, OPERATION_MODE, operation_mode);
     // se
 
     // Save the configuration to the internal buffer
@@ -783,10 +1146,13 @@ int pyd1598_get_operation_mode(const struct device *dev, enum pyd1598_operation_
     sensor_conf = data->sensor_conf;
 
     // Get the operation mode from the internal buffer
-    operation_mode_internal = (sensor_conf & (PYD1598_OPERATION_MODE_MASK << PYD1598_OPERATION_MODE_SHIFT)) >> PYD1598_OPERATION_MODE_SHIFT;
+    operation_mode_internal = PYD1598_FIELD_GET(sensor_conf, OPERATION_MODE);
     if (operation_mode_internal == PYD1598_FORCED_READOUT) {
         *operation_mode = PYD1598_FORCED_READOUT;
     }
+    else if (operation_mode_internal == PYD1598_INTERRUPT_READOUT) {
+        *operation_mode = PYD1598_INTERRUPT_READOUT;
+    }
     else if (operation_mode_internal == PYD1598_WAKE_UP) {
         *operation_mode = PYD1598_WAKE_UP;
     }
@@ -825,7 +1191,7 @@ int pyd1598_set_signal_source(const struct device *dev, enum pyd1598_signal_sour
     sensor_conf = data->sensor_conf;
 
     // Set raw bits in configuration at 6-5 to signal source, leave the rest of the bits as they are
-    sensor_conf = (sensor_conf & ~(PYD1598_SIGNAL_SOURCE_MASK << PYD1598_SIGNAL_SOURCE_SHIFT)) | ((uint32_t)(signal_source) << PYD1598_SIGNAL_SOURCE_SHIFT);
+    sensor_conf = PYD1598_FIELD_SET(sensor_conf, SIGNAL_SOURCE, signal_source);
 
     // Save the configuration to the internal buffer
     data->sensor_conf = sensor_conf;
@@ -859,7 +1225,7 @@ int pyd1598_get_signal_source(const struct device *dev, enum pyd1598_signal_sour
     sensor_conf = data->sensor_conf;
 
     // Get the signal source from the internal buffer
-    signal_source_internal = (sensor_conf & (PYD1598_SIGNAL_SOURCE_MASK << PYD1598_SIGNAL_SOURCE_SHIFT)) >> PYD1598_SIGNAL_SOURCE_SHIFT;
+    signal_source_internal = PYD1598_FIELD_GET(sensor_conf, SIGNAL_SOURCE);
     if (signal_source_internal == PYD1598_PIR_BPF) {
         *signal_source = PYD1598_PIR_BPF;
     }
@@ -904,7 +1270,7 @@ int pyd1598_set_hpf_cutoff(const struct device *dev, enum pyd1598_hpf_cutoff hpf
     sensor_conf = data->sensor_conf;
 
     // Set raw bits in configuration at 2 to hpf cut off, leave the rest of the bits as they are
-    sensor_conf = (sensor_conf & ~(PYD1598_HPF_CUT_OFF_MASK << PYD1598_HPF_CUT_OFF_SHIFT)) | ((uint32_t)(hpf_cut_off) << PYD1598_HPF_CUT_OFF_SHIFT);
+    sensor_conf = PYD1598_FIELD_SET(sensor_conf, HPF_CUT_OFF, hpf_cut_off);
 
     // Save the configuration to the internal buffer
     data->sensor_conf = sensor_conf;
@@ -938,7 +1304,7 @@ int pyd1598_get_hpf_cutoff(const struct device *dev, enum pyd1598_hpf_cutoff *hp
     sensor_conf = data->sensor_conf;
 
     // Get the HPF Cut Off from the internal buffer
-    hpf_cut_off_internal = (sensor_conf & (PYD1598_HPF_CUT_OFF_MASK << PYD1598_HPF_CUT_OFF_SHIFT)) >> PYD1598_HPF_CUT_OFF_SHIFT;
+    hpf_cut_off_internal = PYD1598_FIELD_GET(sensor_conf, HPF_CUT_OFF);
     if (hpf_cut_off_internal == PYD1598_HPF_CUTOFF_0_4HZ) {
         *hpf_cut_off = PYD1598_HPF_CUTOFF_0_4HZ;
     }
@@ -980,7 +1346,7 @@ int pyd1598_set_count_mode(const struct device *dev, enum pyd1598_count_mode cou
     sensor_conf = data->sensor_conf;
 
     // Set raw bits in configuration at 0 to count mode, leave the rest of the bits as they are
-    sensor_conf = (sensor_conf & ~(PYD1598_COUNT_MODE_MASK << PYD1598_COUNT_MODE_SHIFT)) | ((uint32_t)(count_mode) << PYD1598_COUNT_MODE_SHIFT);
+    sensor_conf = PYD1598_FIELD_SET(sensor_conf, COUNT_MODE, count_mode);
 
     // Save the configuration to the internal buffer
     data->sensor_conf = sensor_conf;
@@ -1014,7 +1380,7 @@ int pyd1598_get_count_mode(const struct device *dev, enum pyd1598_count_mode *co
     sensor_conf = data->sensor_conf;
 
     // Get the Count Mode from the internal buffer
-    count_mode_internal = (sensor_conf & (PYD1598_COUNT_MODE_MASK << PYD1598_COUNT_MODE_SHIFT)) >> PYD1598_COUNT_MODE_SHIFT;
+    count_mode_internal = PYD1598_FIELD_GET(sensor_conf, COUNT_MODE);
     if (count_mode_internal == PYD1598_COUNT_SIGN_CHANGE) {
         *count_mode = PYD1598_COUNT_SIGN_CHANGE;
     }
@@ -1029,6 +1395,8 @@ int pyd1598_get_count_mode(const struct device *dev, enum pyd1598_count_mode *co
     return 0;
 }
 
+#endif // CONFIG_PYD1598_COMPACT
+
 
 // Default config
 /**
@@ -1039,7 +1407,7 @@ int pyd1598_get_count_mode(const struct device *dev, enum pyd1598_count_mode *co
  * - blind_time: 6 (0.5 s + 0.5 s * blind_time, range 0-15)
  * - pulse_counter: 0 (1 + pulse_counter, range 0-3)
  * - window_time: 0 (2s + 2s * window_time, range 0-3)
- * - operation_mode: 2 (0: Forced Readout, 1: Interrupt Readout, 2: Wake-up Mode): Only Wake-up Mode is supported
+ * - operation_mode: 2 (0: Forced Readout, 1: Interrupt Readout, 2: Wake-up Mode): Interrupt Readout needs CONFIG_PYD1598_INTERRUPT_READOUT
  * - signal_source: 1 (0: PIR(BRF), 1: PIR(LPF), 2: Not Allowed, 3: Temperature Sensor)
  * - HPF_Cut_Off: 0 (0: 0.4 Hz, 1: 0.2 Hz)
  * - Count_Mode: 1 (0: count with (0), or without (1) BPF sign change)
@@ -1051,32 +1419,27 @@ int pyd1598_get_count_mode(const struct device *dev, enum pyd1598_count_mode *co
  * @return 0 if successful, negative errno code if failure.
  */
 int pyd1598_set_default_config(const struct device *dev) {    
-    // access configuration in pyd1598_data and set all values to default
+    // Variables
+    struct pyd1598_data *data;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_set_default_config");
     if (dev == NULL || dev->data == NULL) {
         return -EINVAL;
     }
-    pyd1598_set_threshold(dev, 31);
-    pyd1598_set_blind_time(dev, 6);
-    pyd1598_set_pulse_counter(dev, 0);
-    pyd1598_set_window_time(dev, 0);
-    pyd1598_set_operation_mode(dev, PYD1598_WAKE_UP);
-    pyd1598_set_signal_source(dev, PYD1598_PIR_LPF);
-    pyd1598_set_hpf_cutoff(dev, PYD1598_HPF_CUTOFF_0_4HZ);
-    pyd1598_set_count_mode(dev, PYD1598_COUNT_ALL);
-    pyd1598_set_reserved_bits(dev);
+
+    // Declare the variables
+    data = dev->data;
+
+    // access configuration in pyd1598_data and set all values to default
+    data->sensor_conf = pyd1598_core_conf_default();
 
     return 0;
 }
 
 
-/**
- * @brief Reset the sensor, only allowed in wake-up mode.
- * 
- * @param dev Pointer to the sensor device
- * 
- * @return 0 if successful, negative errno code if failure.
-*/
-int pyd1598_reset(const struct device *dev) {
+// Reset transaction, the device must be resumed
+static int pyd1598_reset_transaction(const struct device *dev) {
     // Variables
     const struct pyd1598_config *cfg;
     struct pyd1598_data *data;
@@ -1101,8 +1464,10 @@ int pyd1598_reset(const struct device *dev) {
     }
 
     // Configure the direct link pin to output and push direct link pin low for at least 160 us + 20%
+    pyd1598_trigger_pause(dev);
     ret = gpio_pin_configure_dt(&cfg->direct_link, GPIO_OUTPUT_LOW);
     if (ret != 0) {
+        pyd1598_trigger_resume(dev);
         LOG_ERR("Failed to configure direct link GPIO pin %d", cfg->direct_link.pin);
         return ret;
     }
@@ -1110,6 +1475,7 @@ int pyd1598_reset(const struct device *dev) {
 
     // Release the direct link pin
     ret = gpio_pin_configure_dt(&cfg->direct_link, GPIO_INPUT);
+    pyd1598_trigger_resume(dev);
     if (ret != 0) {
         LOG_ERR("Failed to configure direct link GPIO pin %d", cfg->direct_link.pin);
         return ret;
@@ -1120,13 +1486,35 @@ int pyd1598_reset(const struct device *dev) {
 
 
 /**
- * @brief Reset the sensor and fetch new data to the internal buffer, only allowed in wake-up mode.
+ * @brief Reset the sensor, only allowed in wake-up mode.
  * 
  * @param dev Pointer to the sensor device
  * 
  * @return 0 if successful, negative errno code if failure.
 */
-int pyd1598_reset_and_fetch(const struct device *dev) {
+int pyd1598_reset(const struct device *dev) {
+    // Variables
+    int ret;
+
+    // Check if the device is null
+    if (dev == NULL || dev->data == NULL) {
+        return -EINVAL;
+    }
+
+    // Resume the device for the transaction, no-op without runtime pm
+    ret = pm_device_runtime_get(dev);
+    if (ret < 0) {
+        return ret;
+    }
+    ret = pyd1598_reset_transaction(dev);
+    pm_device_runtime_put(dev);
+
+    return ret;
+}
+
+
+// Reset and fetch transaction, the device must be resumed
+static int pyd1598_reset_and_fetch_transaction(const struct device *dev) {
     // Variables
     int ret;
     enum pyd1598_operation_mode operation_mode;
@@ -1150,23 +1538,29 @@ int pyd1598_reset_and_fetch(const struct device *dev) {
         return -EIO;
     }
 
+    // No trigger from the reset edge or from the fetch, until direct link is released
+    pyd1598_trigger_pause(dev);
+
     // Configure the direct link pin to output and push direct link pin low for at least 160 us + 20%
     ret = gpio_pin_configure_dt(&cfg->direct_link, GPIO_OUTPUT_LOW);
     if (ret != 0) {
+        pyd1598_trigger_resume(dev);
         LOG_ERR("Failed to configure direct link GPIO pin %d", cfg->direct_link.pin);
         return ret;
     }
     k_busy_wait(192);
 
-    // Fetch the new data to the internal buffer
-    ret = pyd1598_fetch(dev);
+    // Fetch the new data to the internal buffer, the device is already resumed
+    ret = pyd1598_fetch_restore_transaction(dev);
     if (ret != 0) {
+        pyd1598_trigger_resume(dev);
         LOG_ERR("Failed to fetch new data after reset");
         return ret;
     }
 
     // Set the direct link pin to input, it might already be input
     ret = gpio_pin_configure_dt(&cfg->direct_link, GPIO_INPUT);
+    pyd1598_trigger_resume(dev);
     if (ret != 0) {
         LOG_ERR("Failed to configure direct link GPIO pin %d", cfg->direct_link.pin);
         return ret;
@@ -1176,6 +1570,34 @@ int pyd1598_reset_and_fetch(const struct device *dev) {
 }
 
 
+/**
+ * @brief Reset the sensor and fetch new data to the internal buffer, only allowed in wake-up mode.
+ * 
+ * @param dev Pointer to the sensor device
+ * 
+ * @return 0 if successful, negative errno code if failure.
+*/
+int pyd1598_reset_and_fetch(const struct device *dev) {
+    // Variables
+    int ret;
+
+    // Check if the device is null
+    if (dev == NULL || dev->data == NULL) {
+        return -EINVAL;
+    }
+
+    // Resume the device for the transaction, no-op without runtime pm
+    ret = pm_device_runtime_get(dev);
+    if (ret < 0) {
+        return ret;
+    }
+    ret = pyd1598_reset_and_fetch_transaction(dev);
+    pm_device_runtime_put(dev);
+
+    return ret;
+}
+
+
 /**
  * @brief Check if the sensor has triggered, only allowed in wake-up mode.
  * 
@@ -1269,10 +1691,10 @@ int pyd1598_get_temperature_readout(const struct device *dev, uint16_t *adc_coun
     }
 
     // Get the measurement from the internal buffer
-    adc_counts_internal = (uint16_t)((measurement & (PYD1598_ADC_COUNTS_MASK << PYD1598_ADC_COUNTS_SHIFT)) >> PYD1598_ADC_COUNTS_SHIFT);
+    adc_counts_internal = pyd1598_adc_counts(measurement);
 
     // Get the out of range from the internal buffer
-    out_of_range_internal = (bool)((measurement & (PYD1598_OUT_OF_RANGE_MASK << PYD1598_OUT_OF_RANGE_SHIFT)) >> PYD1598_OUT_OF_RANGE_SHIFT);
+    out_of_range_internal = pyd1598_out_of_range(measurement);
 
     // Save the values to the pointers
     *adc_counts = adc_counts_internal;
@@ -1325,10 +1747,11 @@ int pyd1598_get_bpf_readout(const struct device *dev, int16_t *adc_counts, bool
     }
 
     // Get the measurement from the internal buffer
-    adc_counts_internal = (int16_t)((measurement & (PYD1598_ADC_COUNTS_MASK << PYD1598_ADC_COUNTS_SHIFT)) >> PYD1598_ADC_COUNTS_SHIFT);
+    // BPF counts are 14 bit two's complement
+    adc_counts_internal = pyd1598_bpf_counts(measurement);
 
     // Get the out of range from the internal buffer
-    out_of_range_internal = (bool)((measurement & (PYD1598_OUT_OF_RANGE_MASK << PYD1598_OUT_OF_RANGE_SHIFT)) >> PYD1598_OUT_OF_RANGE_SHIFT);
+    out_of_range_internal = pyd1598_out_of_range(measurement);
 
     // Save the values to the pointers
     *adc_counts = adc_counts_internal;
@@ -1382,10 +1805,10 @@ int pyd1598_get_lpf_readout(const struct device *dev, uint16_t *adc_counts, bool
     }
 
     // Get the measurement from the internal buffer
-    adc_counts_internal = (uint16_t)((measurement & (PYD1598_ADC_COUNTS_MASK << PYD1598_ADC_COUNTS_SHIFT)) >> PYD1598_ADC_COUNTS_SHIFT);
+    adc_counts_internal = pyd1598_adc_counts(measurement);
 
     // Get the out of range from the internal buffer
-    out_of_range_internal = (bool)((measurement & (PYD1598_OUT_OF_RANGE_MASK << PYD1598_OUT_OF_RANGE_SHIFT)) >> PYD1598_OUT_OF_RANGE_SHIFT);
+    out_of_range_internal = pyd1598_out_of_range(measurement);
 
     // Save the values to the pointers
     *adc_counts = adc_counts_internal;
@@ -1395,13 +1818,150 @@ int pyd1598_get_lpf_readout(const struct device *dev, uint16_t *adc_counts, bool
 }
 
 
+#ifdef CONFIG_PM_DEVICE
+// Disconnect a pin to stop leakage, a plain input where the controller can not
+static int pyd1598_pin_disconnect(const struct gpio_dt_spec *spec)
+{
+    // Variables
+    int ret;
+
+    ret = gpio_pin_configure_dt(spec, GPIO_DISCONNECTED);
+    if (ret == -ENOTSUP) {
+        ret = gpio_pin_configure_dt(spec, GPIO_INPUT);
+    }
+
+    return ret;
+}
+
+
+/**
+ * @brief Suspend or resume the sensor device, called by the pm subsystem.
+ *
+ * Suspend stops streaming, the scheduler and hybrid bursts and disconnects serial in, and
+ * direct link unless the sensor is in wake-up mode where a trigger on it is what wakes
+ * the host. The sensor keeps running. Resume reconnects the pins and restarts streaming,
+ * the scheduler and a paused burst. The first fetch after resume reads the full configuration and pushes
+ * it again if the sensor lost it, for boards that power the sensor down.
+ *
+ * @param dev Pointer to the sensor device
+ * @param action Pm action
+ *
+ * @return 0 if successful, -EBUSY during interrupt readout or synchronized sampling, negative errno code if failure.
+ */
+static int pyd1598_pm_action(const struct device *dev, enum pm_device_action action)
+{
+    // Variables
+    const struct pyd1598_config *cfg;
+    struct pyd1598_data *data;
+    enum pyd1598_operation_mode operation_mode = PYD1598_FORCED_READOUT;
+    int ret = 0;
+
+    // Declare the variables
+    cfg = dev->config;
+    data = dev->data;
+
+    switch (action) {
+    case PM_DEVICE_ACTION_SUSPEND:
+        // The interrupt readout isr and the sync timer drive direct link on their own
+        if (pyd1598_interrupt_running(dev) || pyd1598_sync_running(dev)) {
+            return -EBUSY;
+        }
+        pyd1598_stream_pm(dev, true);
+        pyd1598_sched_pm(dev, true);
+        pyd1598_hybrid_pm(dev, true);
+
+        ret = pyd1598_pin_disconnect(&cfg->serial_in);
+        if (ret != 0) {
+            LOG_ERR("Failed to disconnect serial in GPIO pin %d", cfg->serial_in.pin);
+            return ret;
+        }
+        pyd1598_get_operation_mode(dev, &operation_mode);
+        if (operation_mode != PYD1598_WAKE_UP) {
+            ret = pyd1598_pin_disconnect(&cfg->direct_link);
+            if (ret != 0) {
+                LOG_ERR("Failed to disconnect direct link GPIO pin %d", cfg->direct_link.pin);
+                return ret;
+            }
+        }
+        return 0;
+
+    case PM_DEVICE_ACTION_RESUME:
+        ret = gpio_pin_configure_dt(&cfg->serial_in, GPIO_INPUT | cfg->serial_in.dt_flags);
+        if (ret != 0) {
+            LOG_ERR("Failed to configure serial in GPIO pin %d", cfg->serial_in.pin);
+            return ret;
+        }
+        ret = gpio_pin_configure_dt(&cfg->direct_link, GPIO_INPUT | cfg->direct_link.dt_flags);
+        if (ret != 0) {
+            LOG_ERR("Failed to configure direct link GPIO pin %d", cfg->direct_link.pin);
+            return ret;
+        }
+        pyd1598_trigger_resume(dev);
+
+        // Verify the configuration lazily, on the first fetch
+        data->pm_restore = true;
+        data->pm_resume_us = k_ticks_to_us_floor64(k_uptime_ticks());
+        pyd1598_partial_reset(data);
+
+        pyd1598_stream_pm(dev, false);
+        pyd1598_sched_pm(dev, false);
+        pyd1598_hybrid_pm(dev, false);
+        return 0;
+
+    default:
+        return -ENOTSUP;
+    }
+}
+#endif
+
+
+// Pin access of an instance, the generated routines of pyd1598_fast.c or the GPIO API
+#ifdef CONFIG_PYD1598_FAST_GPIO
+#define PYD1598_FAST_DECLARE(index)                                            \
+	int pyd1598_fast_readout_##index(const struct pyd1598_config *cfg,     \
+					 uint32_t *measurement, uint32_t *sensor_conf, int bits); \
+	extern const struct pyd1598_bus_api pyd1598_bus_fast_##index;
+
+DT_INST_FOREACH_STATUS_OKAY(PYD1598_FAST_DECLARE)
+
+#define PYD1598_BUS_GPIO(index) (&pyd1598_bus_fast_##index)
+#define PYD1598_READOUT_INIT(index) .readout = pyd1598_fast_readout_##index,
+#else
+#define PYD1598_BUS_GPIO(index) (&pyd1598_bus_gpio)
+#define PYD1598_READOUT_INIT(index)
+#endif
+
+// Serial in backend of an instance, spi if it has a serial_in-spi controller
+#ifdef CONFIG_PYD1598_BUS_SPI
+#define PYD1598_BUS_SPI_INIT(index)                                            \
+	.bus = &pyd1598_bus_spi,                                               \
+	.spi = DEVICE_DT_GET(DT_INST_PHANDLE(index, serial_in_spi)),           \
+	.spi_cfg = {                                                           \
+		.frequency = DT_INST_PROP(index, serial_in_spi_frequency),     \
+		.operation = SPI_OP_MODE_MASTER | SPI_TRANSFER_MSB | SPI_WORD_SET(8), \
+	},
+#else
+#define PYD1598_BUS_SPI_INIT(index) .bus = PYD1598_BUS_GPIO(index),
+#endif
+
+#define PYD1598_BUS_INIT(index)                                                \
+	COND_CODE_1(DT_INST_NODE_HAS_PROP(index, serial_in_spi),               \
+		    (PYD1598_BUS_SPI_INIT(index)), (.bus = PYD1598_BUS_GPIO(index),))
+
+
 #define pyd1598_INIT(index)                                                      \
+	BUILD_ASSERT(!DT_INST_NODE_HAS_PROP(index, serial_in_spi) ||           \
+		     IS_ENABLED(CONFIG_PYD1598_BUS_SPI),                          \
+		     "serial_in-spi needs CONFIG_PYD1598_BUS_SPI");               \
 	static struct pyd1598_data pyd1598_data_##index = {0};                        \
 	static const struct pyd1598_config pyd1598_config_##index = {              \
 		.instance = index,                                             \
         .serial_in = GPIO_DT_SPEC_INST_GET(index, serial_in_gpios),        \
-        .direct_link = GPIO_DT_SPEC_INST_GET(index, direct_link_gpios)};      \
+        .direct_link = GPIO_DT_SPEC_INST_GET(index, direct_link_gpios),      \
+		PYD1598_READOUT_INIT(index)                                    \
+		PYD1598_BUS_INIT(index)};                                      \
                                                                                \
+	PM_DEVICE_DT_INST_DEFINE(index, pyd1598_pm_action);                        \
                                                                                \
 	DEVICE_DT_INST_DEFINE(index, pyd1598_init, PM_DEVICE_DT_INST_GET(index), \
 			      &pyd1598_data_##index, &pyd1598_config_##index,      \
@@ -7,11 +7,16 @@ extern "C" {
 
 #include <zephyr/device.h>
 #include <zephyr/drivers/sensor.h>
+#include <zephyr/kernel.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pyd1598_timing.h>
 
 
 // Enums
 enum pyd1598_operation_mode {
     PYD1598_FORCED_READOUT = 0,
+    PYD1598_INTERRUPT_READOUT = 1, // Needs CONFIG_PYD1598_INTERRUPT_READOUT
     PYD1598_WAKE_UP = 2
 };
 
@@ -33,7 +38,41 @@ enum pyd1598_count_mode {
 };
 
 
-const int TEST = 22;
+// Frame, one decoded 40 bit readout
+struct pyd1598_frame {
+    int64_t timestamp_us; // Uptime in us when the sensor was sampled
+    uint32_t sensor_conf; // Configuration read back from the sensor (25 bits)
+    uint16_t measurement; // Out of range flag and adc counts (15 bits)
+};
+
+// Stats, transaction counters kept per instance (CONFIG_PYD1598_STATS)
+struct pyd1598_stats {
+    uint32_t push_count; // Pushes started
+    uint32_t fetch_count; // Fetches started
+    uint32_t fetch_ok; // Fetches where the read back config matched the desired config, or was not read
+    uint32_t fetch_partial; // Fetches that read the measurement only (CONFIG_PYD1598_PARTIAL_READOUT)
+    uint32_t conf_mismatch; // Fetches where the read back config did not match
+    uint32_t trigger_count; // Wake-up triggers seen by the direct link interrupt
+    uint32_t readout_dropped; // Interrupt readouts lost to a full sample queue
+    uint32_t resume_latency_us; // From the last pm resume to its first frame (CONFIG_PM_DEVICE)
+    uint32_t init_us; // Time pyd1598_init took for this instance, kept by pyd1598_reset_stats()
+};
+
+// Energy, transaction time and estimated charge kept per instance (CONFIG_PYD1598_ENERGY)
+#ifdef CONFIG_PYD1598_ENERGY
+struct pyd1598_energy_stats {
+    uint32_t pushes; // Pushes accounted
+    uint32_t fetches; // Forced readouts accounted
+    uint32_t readouts; // Interrupt and synchronized readouts accounted
+    uint64_t active_us; // CPU running for the transactions, mostly busy waits
+    uint64_t irq_locked_us; // Part of active_us with interrupts locked
+    uint64_t serial_in_us; // Serial in driven
+    uint64_t direct_link_us; // Direct link driven by the host
+    uint32_t elapsed_ms; // Since init or the last reset
+    uint64_t charge_nah; // Estimated with the currents of the devicetree node
+    uint32_t nah_per_hour; // charge_nah per hour of elapsed_ms, the average current in nA
+};
+#endif
 
 // Functions
 // push and fetch functions are used to push and fetch data from the sensor to internal buffer of the driver
@@ -76,6 +115,381 @@ int pyd1598_poll_triggered(const struct device *dev,bool *triggered);
 int pyd1598_get_temperature_readout(const struct device *dev, uint16_t *adc_counts, bool *out_of_range);
 int pyd1598_get_bpf_readout(const struct device *dev, int16_t *adc_counts, bool *out_of_range);
 int pyd1598_get_lpf_readout(const struct device *dev, uint16_t *adc_counts, bool *out_of_range);
+int pyd1598_get_frame(const struct device *dev, struct pyd1598_frame *frame);
+
+#ifdef CONFIG_PYD1598_STATS
+int pyd1598_get_stats(const struct device *dev, struct pyd1598_stats *stats);
+int pyd1598_reset_stats(const struct device *dev);
+#endif
+
+// freshness bounded fetch, concurrent consumers share one transaction (CONFIG_PYD1598_CACHE)
+#ifdef CONFIG_PYD1598_CACHE
+struct pyd1598_cache_stats {
+    uint32_t hits; // Calls answered with a fresh frame
+    uint32_t fetches; // Calls that fetched
+    uint32_t coalesced; // Calls that waited for the fetch of another caller
+    uint32_t errors; // Fetches that failed, their waiters get the same error
+};
+
+int pyd1598_fetch_if_older_than(const struct device *dev, uint32_t max_age_us, struct pyd1598_frame *frame);
+int pyd1598_cache_get_stats(const struct device *dev, struct pyd1598_cache_stats *stats);
+#endif
+
+#ifdef CONFIG_PYD1598_ENERGY
+int pyd1598_energy_get(const struct device *dev, struct pyd1598_energy_stats *stats);
+int pyd1598_energy_reset(const struct device *dev);
+#endif
+
+// streaming functions, fetch from a work item at a fixed period (CONFIG_PYD1598_STREAM)
+#ifdef CONFIG_PYD1598_STREAM
+int pyd1598_stream_start(const struct device *dev, k_timeout_t period);
+int pyd1598_stream_stop(const struct device *dev);
+#endif
+
+// automatic threshold calibration from the measured noise floor (CONFIG_PYD1598_CALIB)
+#ifdef CONFIG_PYD1598_CALIB
+struct pyd1598_calib_result {
+    uint16_t samples; // BPF readouts evaluated
+    int16_t offset; // Mean of the BPF counts
+    uint16_t noise; // Standard deviation of the BPF counts
+    uint16_t peak; // Largest magnitude of a BPF count
+    int16_t drift; // Offset of the second half of the samples minus that of the first half
+    uint16_t temperature_start; // Temperature sensor counts before sampling
+    uint16_t temperature_end; // Temperature sensor counts after sampling
+    uint16_t false_pulses; // Noise excursions above the chosen threshold while sampling
+    uint8_t threshold; // Chosen threshold
+    uint8_t pulse_counter; // Chosen pulse counter
+    uint8_t window_time; // Chosen window time
+};
+
+int pyd1598_calibrate(const struct device *dev, struct pyd1598_calib_result *result);
+int pyd1598_calibrate_periodic(const struct device *dev, k_timeout_t period);
+int pyd1598_get_calib_result(const struct device *dev, struct pyd1598_calib_result *result);
+#endif
+
+// wake-up trigger callback, called from the direct link interrupt (CONFIG_PYD1598_TRIGGER)
+#ifdef CONFIG_PYD1598_TRIGGER
+typedef void (*pyd1598_trigger_callback_t)(const struct device *dev, int64_t timestamp_us, void *user_data);
+
+int pyd1598_trigger_set_callback(const struct device *dev, pyd1598_trigger_callback_t callback, void *user_data);
+#endif
+
+// interrupt readout, the sensor paces the readouts into a sample queue (CONFIG_PYD1598_INTERRUPT_READOUT)
+#ifdef CONFIG_PYD1598_INTERRUPT_READOUT
+int pyd1598_interrupt_readout_start(const struct device *dev);
+int pyd1598_interrupt_readout_stop(const struct device *dev);
+int pyd1598_interrupt_readout_read(const struct device *dev, struct pyd1598_frame *frame, k_timeout_t timeout);
+#endif
+
+// signal source scheduler, samples every signal source at its own period (CONFIG_PYD1598_SCHED)
+#ifdef CONFIG_PYD1598_SCHED
+struct pyd1598_sample {
+    int64_t timestamp_us; // Uptime in us when the sensor was sampled
+    enum pyd1598_signal_source source; // Signal source of adc_counts
+    int16_t adc_counts; // Signed for PIR BPF, 0 to 16383 otherwise
+    bool out_of_range;
+};
+
+struct pyd1598_sched_stats {
+    uint32_t samples; // Samples delivered
+    uint32_t switches; // Pushes to change the signal source
+    uint32_t missed; // Samples skipped because the scheduler fell behind
+};
+
+typedef void (*pyd1598_sample_callback_t)(const struct device *dev, const struct pyd1598_sample *sample, void *user_data);
+
+int pyd1598_sched_set_period(const struct device *dev, enum pyd1598_signal_source source, uint32_t period_ms);
+int pyd1598_sched_start(const struct device *dev, pyd1598_sample_callback_t callback, void *user_data);
+int pyd1598_sched_stop(const struct device *dev);
+int pyd1598_sched_get_stats(const struct device *dev, struct pyd1598_sched_stats *stats);
+#endif
+
+// adaptive hybrid mode, wake-up mode with forced readout bursts after triggers (CONFIG_PYD1598_HYBRID)
+#ifdef CONFIG_PYD1598_HYBRID
+struct pyd1598_hybrid_config {
+    uint32_t period_ms; // Time between two fetches of a burst
+    uint32_t window_ms; // Shortest burst
+    uint32_t quiet_ms; // Time below the threshold before wake-up mode is pushed again
+    uint16_t threshold; // |BPF| counts that keep a burst going
+};
+
+struct pyd1598_hybrid_stats {
+    uint32_t triggers; // Wake-up triggers that started a burst
+    uint32_t bursts; // Switches to forced readout
+    uint32_t frames; // Frames fetched in bursts
+    uint32_t switches; // Mode pushes that succeeded, both directions
+    uint32_t switch_errors; // Mode pushes or verifications that failed
+    uint32_t verify_errors; // Readouts after a mode push that did not match
+    uint32_t switch_us; // Time spent pushing and verifying the modes
+    uint64_t wake_up_ms; // Time in wake-up mode
+    uint64_t streaming_ms; // Time in forced readout mode
+};
+
+int pyd1598_hybrid_start(const struct device *dev, const struct pyd1598_hybrid_config *config);
+int pyd1598_hybrid_stop(const struct device *dev);
+int pyd1598_hybrid_get_stats(const struct device *dev, struct pyd1598_hybrid_stats *stats);
+#endif
+
+// wake-up occupancy aggregation, one summary per reporting period instead of every trigger (CONFIG_PYD1598_OCCUPANCY)
+#ifdef CONFIG_PYD1598_OCCUPANCY
+struct pyd1598_occupancy_summary {
+    int64_t start_us; // Uptime in us the period started
+    int64_t end_us; // Uptime in us the period ended
+    int64_t first_us; // First trigger of the period, valid if triggers > 0
+    int64_t last_us; // Last trigger of the period, valid if triggers > 0
+    uint32_t triggers; // Wake-up triggers
+    uint32_t visits; // Runs of triggers started in the period
+    uint32_t dwell_ms; // Time covered by visits
+    uint32_t reset_errors; // Resets after a trigger that failed
+    bool occupied; // A visit was still going at the end of the period
+};
+
+typedef void (*pyd1598_occupancy_callback_t)(const struct device *dev,
+                                             const struct pyd1598_occupancy_summary *summary, void *user_data);
+
+int pyd1598_occupancy_start(const struct device *dev, uint32_t period_ms,
+                            pyd1598_occupancy_callback_t callback, void *user_data);
+int pyd1598_occupancy_stop(const struct device *dev);
+int pyd1598_occupancy_get(const struct device *dev, struct pyd1598_occupancy_summary *summary);
+#endif
+
+// synchronized sampling, one timebase for a group of sensors (CONFIG_PYD1598_SYNC)
+#ifdef CONFIG_PYD1598_SYNC
+struct pyd1598_sync_sample {
+    const struct device *dev;
+    struct pyd1598_frame frame; // timestamp_us is the sample point of this sensor
+    int ret; // 0, or negative errno code if the readout failed or did not match
+};
+
+struct pyd1598_sync_stats {
+    uint32_t samples; // Sample points of this sensor
+    uint32_t errors; // Readouts that failed or did not match the configuration
+    uint32_t overruns; // Ticks skipped because the readout of the previous one was still running
+    uint32_t late; // Readouts with a bit sampled more than 22 us after its release
+    uint32_t sample_delay_max_ns; // Longest time from the release of a bit to its sample
+    int32_t skew_ns; // Sample point relative to the first sensor of the group, last tick
+    int32_t skew_max_ns; // Largest skew
+    uint32_t readout_latency_us; // Sample point to the start of the readout of this sensor, last tick
+    uint32_t readout_latency_max_us; // Largest readout latency, setup time and work queue latency included
+    int32_t jitter_min_ns; // Smallest deviation of a sample interval from the period
+    int32_t jitter_max_ns; // Largest deviation of a sample interval from the period
+    uint64_t jitter_abs_ns; // Sum of the absolute deviations, over samples - 1 intervals
+};
+
+typedef void (*pyd1598_sync_callback_t)(const struct pyd1598_sync_sample *samples, size_t count, void *user_data);
+
+int pyd1598_sync_start(const struct device *const *devs, size_t count, uint32_t period_us,
+                       pyd1598_sync_callback_t callback, void *user_data);
+int pyd1598_sync_stop(void);
+int pyd1598_sync_get_stats(const struct device *dev, struct pyd1598_sync_stats *stats);
+#endif
+
+// zone and direction of travel fusion across all instances (CONFIG_PYD1598_FUSION)
+#ifdef CONFIG_PYD1598_FUSION
+enum pyd1598_fusion_type {
+    PYD1598_FUSION_ZONES, // The set of occupied zones changed
+    PYD1598_FUSION_TRAVEL, // Motion went from one sensor to another
+};
+
+struct pyd1598_fusion_event {
+    int64_t timestamp_us; // Uptime in us of the frame or trigger that caused the event
+    enum pyd1598_fusion_type type;
+    uint32_t zones; // Occupied zones, bit n for zone n
+    uint8_t from_instance; // Travel: sensor that saw the motion first
+    uint8_t to_instance; // Travel: sensor that saw it next
+    uint8_t from_zone;
+    uint8_t to_zone;
+    int32_t dx_mm; // Travel: position of to_instance minus position of from_instance
+    int32_t dy_mm;
+    uint32_t delay_us; // Travel: time from the first sensor to the next
+    uint32_t speed_mm_s; // Travel: distance over delay, 0 if the sensors share a position
+    uint16_t confidence; // Travel: waveform correlation in Q15, 0 if only the onset order was known
+};
+
+typedef void (*pyd1598_fusion_callback_t)(const struct pyd1598_fusion_event *event, void *user_data);
+
+int pyd1598_fusion_set_callback(pyd1598_fusion_callback_t callback, void *user_data);
+int pyd1598_fusion_get_zones(uint32_t *zones);
+int pyd1598_fusion_get_travel(struct pyd1598_fusion_event *event);
+#endif
+
+// pre/post-trigger burst capture, the frames around a trigger in one block (CONFIG_PYD1598_CAPTURE)
+#ifdef CONFIG_PYD1598_CAPTURE
+struct pyd1598_capture_config {
+    uint16_t pre_frames; // Frames kept before the trigger, including the triggering frame
+    uint16_t post_frames; // Frames recorded after the trigger
+    bool detect; // Trigger on the wake-up detection model with the desired configuration
+};
+
+struct pyd1598_capture_sample {
+    int32_t offset_us; // Sampled at trigger_us + offset_us
+    uint16_t measurement; // Out of range flag and adc counts (15 bits)
+    uint8_t signal_source; // enum pyd1598_signal_source of the frame
+    uint8_t reserved;
+};
+
+struct pyd1598_capture_burst {
+    const struct device *dev;
+    int64_t trigger_us; // Uptime in us of the trigger
+    uint16_t pre; // Frames before the trigger, fewer than configured if the ring was not full
+    uint16_t post; // Frames after the trigger
+    bool detected; // Triggered by the detection model, not by pyd1598_capture_trigger()
+    struct pyd1598_capture_sample samples[]; // pre + post frames, oldest first
+};
+
+struct pyd1598_capture_stats {
+    uint32_t frames; // Frames seen while started
+    uint32_t triggers; // Detected and requested triggers
+    uint32_t bursts; // Bursts handed to the callback
+    uint32_t dropped; // Triggers and bursts lost, no free block or a burst still recording
+    uint16_t capacity; // Pre + post frames that fit one block
+    uint16_t free_blocks; // Blocks neither recording nor held by the application
+};
+
+typedef void (*pyd1598_capture_callback_t)(const struct device *dev, struct pyd1598_capture_burst *burst,
+                                           void *user_data);
+
+int pyd1598_capture_start(const struct device *dev, const struct pyd1598_capture_config *config,
+                          pyd1598_capture_callback_t callback, void *user_data);
+int pyd1598_capture_stop(const struct device *dev);
+int pyd1598_capture_trigger(const struct device *dev);
+void pyd1598_capture_release(struct pyd1598_capture_burst *burst);
+int pyd1598_capture_get_stats(const struct device *dev, struct pyd1598_capture_stats *stats);
+#endif
+
+// persistent logger, appends the frames of all instances to a littlefs file (CONFIG_PYD1598_LOGGER)
+#ifdef CONFIG_PYD1598_LOGGER
+struct pyd1598_logger_stats {
+    uint32_t frames_logged; // Frames encoded into a block
+    uint32_t frames_dropped; // Frames lost because both blocks were busy
+    uint32_t blocks_written; // Blocks appended to the file
+    uint32_t bytes_written; // Bytes appended to the file, blocks_written * block size
+    uint32_t write_errors; // Blocks lost to file system errors
+    uint32_t files_rotated; // Times the log file reached CONFIG_PYD1598_LOGGER_FILE_SIZE
+};
+
+int pyd1598_logger_start(void);
+int pyd1598_logger_flush(void);
+int pyd1598_logger_stop(void);
+int pyd1598_logger_get_stats(struct pyd1598_logger_stats *stats);
+#endif
+
+// batch encoder, packs frames and triggers into a compact uplink payload (CONFIG_PYD1598_ENCODER)
+#ifdef CONFIG_PYD1598_ENCODER
+struct pyd1598_encoder {
+    uint8_t *buf; // Record stream
+    size_t size; // Size of buf
+    size_t len; // Bytes used in buf
+    int64_t base_timestamp_us; // Timestamp of the first record in the batch
+    uint32_t count; // Frames and triggers in the batch
+    uint32_t seen; // Bit per instance with a record in the batch
+    uint32_t has_conf; // Bit per instance with a config record in the batch
+    int64_t last_timestamp_us[CONFIG_PYD1598_ENCODER_MAX_INSTANCES]; // Of the last frame
+    int64_t last_period_us[CONFIG_PYD1598_ENCODER_MAX_INSTANCES]; // Between the last two frames
+    uint32_t last_conf[CONFIG_PYD1598_ENCODER_MAX_INSTANCES];
+    uint16_t last_measurement[CONFIG_PYD1598_ENCODER_MAX_INSTANCES];
+};
+
+int pyd1598_encoder_init(struct pyd1598_encoder *enc, uint8_t *buf, size_t size);
+int pyd1598_encoder_add_frame(struct pyd1598_encoder *enc, uint8_t instance, const struct pyd1598_frame *frame);
+int pyd1598_encoder_add_trigger(struct pyd1598_encoder *enc, uint8_t instance, int64_t timestamp_us);
+int pyd1598_encoder_finish(struct pyd1598_encoder *enc, uint8_t *out, size_t out_size, size_t *out_len);
+#endif
+
+// binary transaction trace, the pin event ids are always defined (CONFIG_PYD1598_TRACE)
+enum pyd1598_trace_id {
+    PYD1598_TRACE_LOST = 0, // arg32 records overwritten before this read
+    PYD1598_TRACE_PUSH_BEGIN = 1, // arg32 desired configuration
+    PYD1598_TRACE_PUSH_END = 2, // arg16 return value
+    PYD1598_TRACE_FETCH_BEGIN = 3,
+    PYD1598_TRACE_FETCH_END = 4, // arg16 return value
+    PYD1598_TRACE_READOUT = 5, // arg16 measurement bits, arg32 configuration bits | bit count << 25
+    PYD1598_TRACE_MISMATCH = 6, // arg32 read back configuration
+    PYD1598_TRACE_TRIGGER = 7,
+    PYD1598_TRACE_IDS,
+};
+
+#ifdef CONFIG_PYD1598_TRACE
+struct pyd1598_trace_record {
+    uint32_t timestamp; // k_cycle_get_32()
+    uint8_t id; // enum pyd1598_trace_id
+    uint8_t instance;
+    uint16_t arg16;
+    uint32_t arg32;
+};
+
+extern const char *const pyd1598_trace_names[PYD1598_TRACE_IDS];
+
+int pyd1598_trace_read(struct pyd1598_trace_record *records, size_t size);
+#endif
+
+// protocol timing recorder (CONFIG_PYD1598_TIMING_CHECK), the transactions mark their pin actions,
+// the events and their conformance checker are in pyd1598_timing.h
+#ifdef CONFIG_PYD1598_TIMING_CHECK
+int pyd1598_timing_record_start(const struct device *dev);
+int pyd1598_timing_record_stop(const struct pyd1598_timing_event **events, size_t *count);
+#endif
+
+// offline replay of recorded traces through the wake-up detection model (CONFIG_PYD1598_REPLAY)
+#ifdef CONFIG_PYD1598_REPLAY
+struct pyd1598_replay_report {
+    uint32_t samples; // Frames replayed
+    uint32_t pulses; // Threshold crossings seen by the detection model
+    uint32_t triggers; // Wake-up decisions
+    int64_t span_us; // Recorded time from the first to the last frame
+    uint32_t latency_min_us; // First counted pulse to the trigger, over all triggers
+    uint32_t latency_max_us;
+    uint64_t latency_sum_us;
+    uint64_t cycles; // Detection and publishing of all frames
+    uint32_t cycles_max; // Slowest frame
+};
+
+// Called for every wake-up decision, latency_us since the first counted pulse
+typedef void (*pyd1598_replay_callback_t)(const struct device *dev, int64_t timestamp_us,
+                                          uint32_t latency_us, void *user_data);
+
+int pyd1598_replay_start(const struct device *dev, pyd1598_replay_callback_t callback, void *user_data);
+int pyd1598_replay_feed(const struct pyd1598_frame *frames, size_t count);
+int pyd1598_replay_stop(struct pyd1598_replay_report *report);
+int pyd1598_replay_parse_csv(const char *line, struct pyd1598_frame *frames, size_t size, size_t *count);
+int pyd1598_replay_parse_log(const uint8_t *block, size_t len, int instance,
+                             struct pyd1598_frame *frames, size_t size, size_t *count);
+#endif
+
+// zbus channels shared by all instances (CONFIG_PYD1598_ZBUS)
+#ifdef CONFIG_PYD1598_ZBUS
+#include <zephyr/zbus/zbus.h>
+
+struct pyd1598_frame_msg {
+    const struct device *dev;
+    struct pyd1598_frame frame;
+};
+
+struct pyd1598_trigger_msg {
+    const struct device *dev;
+    int64_t timestamp_us; // Uptime in us when direct link went high
+};
+
+ZBUS_CHAN_DECLARE(pyd1598_frame_chan, pyd1598_trigger_chan);
+#ifdef CONFIG_PYD1598_FUSION
+ZBUS_CHAN_DECLARE(pyd1598_fusion_chan);
+#endif
+#ifdef CONFIG_PYD1598_OCCUPANCY
+struct pyd1598_occupancy_msg {
+    const struct device *dev;
+    struct pyd1598_occupancy_summary summary;
+};
+
+ZBUS_CHAN_DECLARE(pyd1598_occupancy_chan);
+#endif
+#endif
+
+// sensor emulator behind gpio_emul pins, for native_sim (CONFIG_PYD1598_EMUL)
+#ifdef CONFIG_PYD1598_EMUL
+int pyd1598_emul_set_measurement(const struct device *dev, uint16_t measurement);
+int pyd1598_emul_get_conf(const struct device *dev, uint32_t *sensor_conf);
+int pyd1598_emul_trigger(const struct device *dev);
+#endif
 
 // Fill in with functions when implemented
 
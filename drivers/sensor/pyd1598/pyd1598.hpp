@@ -0,0 +1,359 @@
+/*
+PYD1598 C++20 coroutine facade
+
+Header only. Push, fetch, reset and fetch, waiting for a wake-up trigger and sleeping
+are awaitables, so a sensor is driven by a coroutine instead of a thread and a loop:
+
+  static pyd1598::task watch(const struct device *dev)
+  {
+      int ret = co_await pyd1598::push(dev);
+      while (ret == 0) {
+          int64_t timestamp_us = co_await pyd1598::trigger(dev);
+          pyd1598::fetch_result result = co_await pyd1598::reset_and_fetch(dev);
+          ...
+      }
+  }
+
+  pyd1598::executor exec;          // system work queue, construct it from a thread
+  exec.spawn(watch(dev));
+
+All coroutines of an executor run on its work queue, one step at a time, and the queue
+is handed back to other work between two steps. A suspended coroutine is only its
+frame, a few hundred bytes from k_malloc, not a stack, so one queue thread drives
+dozens of sensors.
+
+Coroutines are resumed from completion callbacks: the wake-up trigger callback of the
+driver from the direct link interrupt, and a k_timer per coroutine for sleep. A push or
+a fetch clocks the sensor with irq locked and has no completion interrupt, the
+awaitable queues it behind the coroutines that are ready and runs it on the queue
+thread before resuming, so it is a fair scheduling point and never blocks the thread
+that awaits it.
+
+Needs CONFIG_PYD1598_CORO.
+*/
+
+#ifndef ZEPHYR_INCLUDE_DRIVERS_SENSOR_PYD1598_HPP_
+#define ZEPHYR_INCLUDE_DRIVERS_SENSOR_PYD1598_HPP_
+
+#include <zephyr/device.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <errno.h>
+#include <pyd1598.h>
+
+#ifndef CONFIG_PYD1598_CORO
+#error "pyd1598.hpp needs CONFIG_PYD1598_CORO"
+#endif
+
+namespace pyd1598 {
+
+class executor;
+
+
+// Scheduling state of one coroutine, the first word is reserved for the ready fifo
+struct ready_node {
+    void *fifo_reserved;
+    std::coroutine_handle<> handle;
+    void (*run)(void *arg); // Runs on the queue before the coroutine is resumed, may be nullptr
+    void *arg;
+};
+
+
+// Coroutine return type, started and owned by executor::spawn(), freed when it returns
+class task {
+public:
+    struct promise_type {
+        ready_node node{};
+        executor *exec = nullptr;
+        struct k_timer timer; // Resumes the coroutine after a sleep
+
+        // Frames come from the kernel heap, a failed allocation is an empty task
+        static void *operator new(std::size_t size) noexcept { return k_malloc(size); }
+        static void operator delete(void *ptr) noexcept { k_free(ptr); }
+        static task get_return_object_on_allocation_failure() noexcept { return task{}; }
+
+        task get_return_object() noexcept { return task{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept { k_panic(); }
+    };
+
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    task(task &&other) noexcept : handle(other.handle) { other.handle = nullptr; }
+    task(const task &) = delete;
+    task &operator=(const task &) = delete;
+    task &operator=(task &&) = delete;
+
+    // Never spawned, never started
+    ~task()
+    {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+private:
+    friend class executor;
+
+    task() noexcept = default;
+    explicit task(handle_type h) noexcept : handle(h) {}
+
+    handle_type handle = nullptr;
+};
+
+
+// Runs coroutines on a work queue, resumed from work items, timers and interrupts
+class executor {
+public:
+    explicit executor(struct k_work_q *queue = &k_sys_work_q) noexcept : queue(queue)
+    {
+        k_fifo_init(&ready);
+        k_work_init(&work, drain);
+    }
+
+    executor(const executor &) = delete;
+    executor &operator=(const executor &) = delete;
+
+    /**
+     * @brief Start a coroutine, it runs on the work queue until it returns.
+     *
+     * @param t Coroutine to start
+     *
+     * @return 0 if successful, -ENOMEM if its frame could not be allocated.
+     */
+    int spawn(task t) noexcept
+    {
+        task::promise_type *promise;
+
+        if (!t.handle) {
+            return -ENOMEM;
+        }
+
+        promise = &t.handle.promise();
+        promise->exec = this;
+        promise->node.handle = t.handle;
+        k_timer_init(&promise->timer, timer_expired, nullptr);
+        k_timer_user_data_set(&promise->timer, promise);
+
+        // The coroutine owns its frame from now on
+        t.handle = nullptr;
+        schedule(*promise, nullptr, nullptr);
+
+        return 0;
+    }
+
+    /**
+     * @brief Queue a suspended coroutine, callable from interrupt context.
+     *
+     * @param promise Promise of the coroutine
+     * @param run Called on the queue before the coroutine is resumed, may be nullptr
+     * @param arg Passed to run
+     */
+    void schedule(task::promise_type &promise, void (*run)(void *arg), void *arg) noexcept
+    {
+        promise.node.run = run;
+        promise.node.arg = arg;
+        k_fifo_put(&ready, &promise.node);
+        k_work_submit_to_queue(queue, &work);
+    }
+
+private:
+    // One coroutine step per work item run, other work of the queue gets in between
+    static void drain(struct k_work *item)
+    {
+        executor *self = CONTAINER_OF(item, executor, work);
+        ready_node *node;
+
+        node = static_cast<ready_node *>(k_fifo_get(&self->ready, K_NO_WAIT));
+        if (node == nullptr) {
+            return;
+        }
+        if (!k_fifo_is_empty(&self->ready)) {
+            k_work_submit_to_queue(self->queue, &self->work);
+        }
+
+        if (node->run != nullptr) {
+            node->run(node->arg);
+        }
+        node->handle.resume();
+    }
+
+    static void timer_expired(struct k_timer *timer)
+    {
+        auto *promise = static_cast<task::promise_type *>(k_timer_user_data_get(timer));
+
+        promise->exec->schedule(*promise, nullptr, nullptr);
+    }
+
+    struct k_work_q *queue;
+    struct k_fifo ready;
+    struct k_work work;
+};
+
+
+// Result of a fetch, frame is valid if ret is 0
+struct fetch_result {
+    int ret;
+    struct pyd1598_frame frame;
+};
+
+
+// Driver call queued on the executor, the coroutine resumes with its result
+template <typename Result, Result (*Call)(const struct device *dev)>
+class transaction {
+public:
+    explicit transaction(const struct device *dev) noexcept : dev(dev) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(task::handle_type h) noexcept
+    {
+        h.promise().exec->schedule(h.promise(), run, this);
+    }
+
+    Result await_resume() const noexcept { return result; }
+
+private:
+    static void run(void *arg)
+    {
+        auto *self = static_cast<transaction *>(arg);
+
+        self->result = Call(self->dev);
+    }
+
+    const struct device *dev;
+    Result result{};
+};
+
+
+inline fetch_result fetch_call(const struct device *dev)
+{
+    fetch_result result{};
+
+    result.ret = pyd1598_fetch(dev);
+    if (result.ret == 0) {
+        result.ret = pyd1598_get_frame(dev, &result.frame);
+    }
+
+    return result;
+}
+
+inline fetch_result reset_and_fetch_call(const struct device *dev)
+{
+    fetch_result result{};
+
+    result.ret = pyd1598_reset_and_fetch(dev);
+    if (result.ret == 0) {
+        result.ret = pyd1598_get_frame(dev, &result.frame);
+    }
+
+    return result;
+}
+
+
+/**
+ * @brief Push the desired configuration, resumes with 0 or a negative errno code.
+ */
+inline transaction<int, pyd1598_push> push(const struct device *dev) noexcept
+{
+    return transaction<int, pyd1598_push>(dev);
+}
+
+/**
+ * @brief Fetch one frame, resumes with a fetch_result.
+ */
+inline transaction<fetch_result, fetch_call> fetch(const struct device *dev) noexcept
+{
+    return transaction<fetch_result, fetch_call>(dev);
+}
+
+/**
+ * @brief Reset a triggered sensor in wake-up mode and fetch, resumes with a fetch_result.
+ */
+inline transaction<fetch_result, reset_and_fetch_call> reset_and_fetch(const struct device *dev) noexcept
+{
+    return transaction<fetch_result, reset_and_fetch_call>(dev);
+}
+
+
+// Resumed from the trigger callback of the driver, one waiting coroutine per device
+class trigger_wait {
+public:
+    explicit trigger_wait(const struct device *dev) noexcept : dev(dev) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(task::handle_type h) noexcept
+    {
+        promise = &h.promise();
+        ret = pyd1598_trigger_set_callback(dev, fired, this);
+
+        // Resume at once with the error
+        return ret == 0;
+    }
+
+    int64_t await_resume() const noexcept { return (ret != 0) ? ret : timestamp_us; }
+
+private:
+    // Runs in interrupt context
+    static void fired(const struct device *dev, int64_t timestamp_us, void *user_data)
+    {
+        auto *self = static_cast<trigger_wait *>(user_data);
+
+        pyd1598_trigger_set_callback(dev, nullptr, nullptr);
+        self->timestamp_us = timestamp_us;
+        self->promise->exec->schedule(*self->promise, nullptr, nullptr);
+    }
+
+    const struct device *dev;
+    task::promise_type *promise = nullptr;
+    int64_t timestamp_us = 0;
+    int ret = 0;
+};
+
+/**
+ * @brief Wait for the next wake-up trigger, resumes with its uptime in us or a negative
+ * errno code.
+ *
+ * The sensor must have been pushed in wake-up mode, reset it after every trigger.
+ */
+inline trigger_wait trigger(const struct device *dev) noexcept
+{
+    return trigger_wait(dev);
+}
+
+
+// Resumed from the timer of the coroutine
+class sleep_wait {
+public:
+    explicit sleep_wait(k_timeout_t timeout) noexcept : timeout(timeout) {}
+
+    bool await_ready() const noexcept { return K_TIMEOUT_EQ(timeout, K_NO_WAIT); }
+
+    void await_suspend(task::handle_type h) noexcept
+    {
+        k_timer_start(&h.promise().timer, timeout, K_NO_WAIT);
+    }
+
+    void await_resume() const noexcept {}
+
+private:
+    k_timeout_t timeout;
+};
+
+/**
+ * @brief Suspend the coroutine for a time, the queue thread keeps running the others.
+ */
+inline sleep_wait sleep(k_timeout_t timeout) noexcept
+{
+    return sleep_wait(timeout);
+}
+
+} // namespace pyd1598
+
+#endif /* ZEPHYR_INCLUDE_DRIVERS_SENSOR_PYD1598_HPP_ */
@@ -0,0 +1,102 @@
+/*
+PYD1598 spi serial in backend
+
+Serial in is a one way stream at a fixed rate: per bit a low and a high pulse of
+200 - 2000 ns, then the bit value for at least 80 us, then a latch time of 650 us.
+That is a bit pattern on the MOSI line of an spi controller clocked at 0.6 - 4 MHz,
+one spi bit per pulse of 250 - 1667 ns:
+
+  per configuration bit  0 1 d d d ... d   96 us, d the bit value
+  latch                  0 0 0 ... 0       780 us
+
+The bytes are built by pyd1598_core_spi_waveform(), the host tests in tests/host check
+the exact MOSI pattern and the sensor emulator decodes it on native_sim. The whole
+push is one spi transfer from a RAM buffer, sent by DMA on controllers that have it.
+The calling thread sleeps during the transfer instead of busy waiting with irq locked
+for 25 bit slots. SCK and CS are not connected to the sensor, the
+serial_in-gpios pin of the instance is the MOSI pin and stays an input.
+*/
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/spi.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/kernel.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pyd1598.h>
+#include "pyd1598_internal.h"
+
+LOG_MODULE_DECLARE(PYD1598, PYD1598_LOG_LEVEL);
+
+
+// Waveform of one push, shared by all instances
+static uint8_t spi_waveform[CONFIG_PYD1598_BUS_SPI_BUF_SIZE];
+static K_MUTEX_DEFINE(spi_waveform_lock);
+
+
+static int pyd1598_bus_spi_init(const struct device *dev)
+{
+    // Variables
+    const struct pyd1598_config *cfg;
+    uint32_t frequency;
+
+    // Declare the variables
+    cfg = dev->config;
+    frequency = cfg->spi_cfg.frequency;
+
+    if (!device_is_ready(cfg->spi)) {
+        LOG_ERR("Serial in spi controller %s is not ready", cfg->spi->name);
+        return -ENODEV;
+    }
+    if (frequency < PYD1598_SPI_FREQUENCY_MIN || frequency > PYD1598_SPI_FREQUENCY_MAX) {
+        LOG_ERR("Serial in spi frequency %u is outside %u - %u", frequency,
+                PYD1598_SPI_FREQUENCY_MIN, PYD1598_SPI_FREQUENCY_MAX);
+        return -EINVAL;
+    }
+    if (pyd1598_core_spi_waveform_len(frequency) > sizeof(spi_waveform)) {
+        LOG_ERR("Serial in waveform needs %u bytes, CONFIG_PYD1598_BUS_SPI_BUF_SIZE is %u",
+                (unsigned int)pyd1598_core_spi_waveform_len(frequency), (unsigned int)sizeof(spi_waveform));
+        return -ENOMEM;
+    }
+
+    return 0;
+}
+
+
+static int pyd1598_bus_spi_push(const struct device *dev, uint32_t sensor_conf)
+{
+    // Variables
+    const struct pyd1598_config *cfg;
+    struct spi_buf buf;
+    struct spi_buf_set tx;
+    int ret;
+
+    // Declare the variables
+    cfg = dev->config;
+
+    k_mutex_lock(&spi_waveform_lock, K_FOREVER);
+
+    // Low pulse, high pulse, then the bit value per slot, checked against the buffer at init
+    buf.buf = spi_waveform;
+    buf.len = pyd1598_core_spi_waveform(spi_waveform, sizeof(spi_waveform), cfg->spi_cfg.frequency, sensor_conf);
+    tx.buffers = &buf;
+    tx.count = 1;
+
+    ret = spi_write(cfg->spi, &cfg->spi_cfg, &tx);
+
+    k_mutex_unlock(&spi_waveform_lock);
+
+    if (ret != 0) {
+        LOG_ERR("Serial in spi transfer failed: %d", ret);
+    }
+
+    return ret;
+}
+
+
+const struct pyd1598_bus_api pyd1598_bus_spi = {
+    .init = pyd1598_bus_spi_init,
+    .push = pyd1598_bus_spi_push,
+    .irq_locked = false,
+};
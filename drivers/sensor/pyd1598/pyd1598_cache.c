@@ -0,0 +1,179 @@
+/*
+PYD1598 freshness bounded fetch
+
+Consumers that each fetch before they read cost one 2 ms forced readout per consumer
+even when another one fetched a moment ago. pyd1598_fetch_if_older_than() takes the
+age a consumer can live with and only reads the sensor when the last accepted frame is
+older:
+
+  fresh      the last accepted frame, from any fetch, stream, scheduler, interrupt
+             readout or synchronized tick, is at most max_age_us old, it is returned
+  in flight  another caller is fetching, wait for its transaction and return its frame
+             or its error, even if the sample is a little older than max_age_us, it is
+             the freshest the sensor can give without a second transaction
+  stale      fetch, the callers that come in meanwhile wait for this transaction
+
+So the bus runs at the rate of the most demanding consumer, not at the sum of all of
+them. Every accepted frame is copied into the cache under its lock, the age check and
+the frame returned read that copy under the same lock, never the 64 bit timestamp a
+fetch on another thread may be writing. Called from threads only, a waiter blocks on a
+condition variable of the instance.
+*/
+
+#include <zephyr/device.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/kernel.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pyd1598.h>
+#include "pyd1598_internal.h"
+
+LOG_MODULE_DECLARE(PYD1598, PYD1598_LOG_LEVEL);
+
+
+int pyd1598_cache_init(const struct device *dev)
+{
+    // Variables
+    struct pyd1598_data *data;
+
+    // Declare the variables
+    data = dev->data;
+    memset(&data->cache, 0, sizeof(data->cache));
+
+    k_mutex_init(&data->cache.lock);
+    k_condvar_init(&data->cache.done);
+
+    return 0;
+}
+
+
+/**
+ * @brief Keep a copy of an accepted frame, called for every frame of any path, from threads.
+ *
+ * @param dev Pointer to the sensor device
+ * @param frame Accepted frame
+ */
+void pyd1598_cache_frame(const struct device *dev, const struct pyd1598_frame *frame)
+{
+    // Variables
+    struct pyd1598_cache *cache;
+
+    // Declare the variables
+    cache = &((struct pyd1598_data *)dev->data)->cache;
+
+    k_mutex_lock(&cache->lock, K_FOREVER);
+    cache->frame = *frame;
+    k_mutex_unlock(&cache->lock);
+}
+
+
+/**
+ * @brief Get a frame that is at most max_age_us old, fetch only if the last one is older.
+ *
+ * Concurrent callers with a stale frame share one fetch. Not for interrupt context.
+ *
+ * @param dev Pointer to the sensor device
+ * @param max_age_us Oldest sample the caller accepts, 0 always fetches or joins a running fetch
+ * @param frame Pointer to where the frame should be stored
+ *
+ * @return 0 if successful, the error of pyd1598_fetch() if the shared fetch failed, negative errno code if failure.
+ */
+int pyd1598_fetch_if_older_than(const struct device *dev, uint32_t max_age_us, struct pyd1598_frame *frame)
+{
+    // Variables
+    struct pyd1598_data *data;
+    struct pyd1598_cache *cache;
+    uint32_t generation;
+    int64_t now_us;
+    int ret;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_fetch_if_older_than");
+    if (dev == NULL || dev->data == NULL || frame == NULL) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+    cache = &data->cache;
+
+    k_mutex_lock(&cache->lock, K_FOREVER);
+
+    // No frame was accepted yet while the timestamp is 0
+    now_us = k_ticks_to_us_floor64(k_uptime_ticks());
+    if (cache->frame.timestamp_us != 0 && now_us - cache->frame.timestamp_us <= (int64_t)max_age_us) {
+        cache->stats.hits++;
+        *frame = cache->frame;
+        k_mutex_unlock(&cache->lock);
+        return 0;
+    }
+
+    // Join the running fetch
+    if (cache->in_flight) {
+        cache->stats.coalesced++;
+        generation = cache->generation;
+        while (generation == cache->generation) {
+            k_condvar_wait(&cache->done, &cache->lock, K_FOREVER);
+        }
+        ret = cache->ret;
+        if (ret == 0) {
+            *frame = cache->frame;
+        }
+        k_mutex_unlock(&cache->lock);
+        return ret;
+    }
+
+    // Fetch without the lock, callers that come in meanwhile wait for it
+    cache->in_flight = true;
+    cache->stats.fetches++;
+    k_mutex_unlock(&cache->lock);
+
+    ret = pyd1598_fetch(dev);
+
+    k_mutex_lock(&cache->lock, K_FOREVER);
+    cache->in_flight = false;
+    cache->ret = ret;
+    cache->generation++;
+    if (ret != 0) {
+        cache->stats.errors++;
+    }
+    else {
+        *frame = cache->frame;
+    }
+    k_condvar_broadcast(&cache->done);
+    k_mutex_unlock(&cache->lock);
+
+    return ret;
+}
+
+
+/**
+ * @brief Get the counters of the freshness bounded fetch of the sensor.
+ *
+ * @param dev Pointer to the sensor device
+ * @param stats Pointer to where the counters should be stored
+ *
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_cache_get_stats(const struct device *dev, struct pyd1598_cache_stats *stats)
+{
+    // Variables
+    struct pyd1598_data *data;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_cache_get_stats");
+    if (dev == NULL || dev->data == NULL || stats == NULL) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+
+    k_mutex_lock(&data->cache.lock, K_FOREVER);
+    *stats = data->cache.stats;
+    k_mutex_unlock(&data->cache.lock);
+
+    return 0;
+}
@@ -0,0 +1,475 @@
+/*
+PYD1598 automatic threshold calibration
+
+The sensor is switched to forced readout and the PIR BPF signal is sampled for a
+short while with nobody in view. From the samples the noise floor is estimated:
+
+  offset  mean of the BPF counts
+  noise   standard deviation of the BPF counts
+  peak    largest magnitude of a BPF count
+  drift   offset of the second half minus offset of the first half, the baseline
+          wander while the temperature changes, reported with the temperature
+          counts read before and after
+
+and the wake-up parameters are derived from it:
+
+  threshold      |offset| + |drift| + CONFIG_PYD1598_CALIB_NOISE_FACTOR / 10 * noise,
+                 at least CONFIG_PYD1598_CALIB_MIN_THRESHOLD
+  pulse_counter  noise excursions above the threshold during calibration are scaled
+                 to the shortest window time (2 s), the sensor then has to count one
+                 pulse more than that expected number of false pulses
+  window_time    always 0, a short window collects the fewest false pulses
+
+When more than 3 false pulses per window are expected the threshold is raised above
+the peak instead. Finally the previous configuration is restored with the derived
+values and pushed in wake-up mode.
+
+Calibrations run one at a time, they share the sample buffer. Periodic re-tuning
+runs on a work queue of its own as a calibration sleeps for a few seconds.
+*/
+
+#include <zephyr/device.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/pm/device_runtime.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pyd1598.h>
+#include "pyd1598_internal.h"
+
+LOG_MODULE_DECLARE(PYD1598, PYD1598_LOG_LEVEL);
+
+
+// Highest pulse_counter value, 1 + pulse_counter pulses are counted
+#define PYD1598_CALIB_PULSE_COUNTER_MAX 3
+
+// Length of the shortest window, window_time 0
+#define PYD1598_CALIB_WINDOW_MS 2000
+
+// BPF samples of the running calibration, shared by all instances
+static int16_t calib_samples[CONFIG_PYD1598_CALIB_SAMPLES];
+static K_MUTEX_DEFINE(calib_lock);
+
+// Periodic re-tuning, shared by all instances
+static K_THREAD_STACK_DEFINE(calib_stack, CONFIG_PYD1598_CALIB_STACK_SIZE);
+static struct k_work_q calib_work_q;
+
+
+// Number of times the signal rises above +- threshold, as the sensor compares it
+static uint16_t calib_count_excursions(uint32_t threshold)
+{
+    uint16_t count = 0;
+    bool above = false;
+
+    for (int i = 0; i < CONFIG_PYD1598_CALIB_SAMPLES; i++) {
+        int32_t sample = calib_samples[i];
+        bool now_above = (uint32_t)(sample < 0 ? -sample : sample) > threshold;
+
+        if (now_above && !above) {
+            count++;
+        }
+        above = now_above;
+    }
+
+    return count;
+}
+
+
+// Push the desired configuration and fetch one settled frame
+static int calib_push_and_fetch(const struct device *dev, enum pyd1598_signal_source signal_source)
+{
+    // Variables
+    int ret;
+
+    ret = pyd1598_set_operation_mode(dev, PYD1598_FORCED_READOUT);
+    if (ret != 0) {
+        return ret;
+    }
+    ret = pyd1598_set_signal_source(dev, signal_source);
+    if (ret != 0) {
+        return ret;
+    }
+    ret = pyd1598_push(dev);
+    if (ret != 0) {
+        return ret;
+    }
+
+    // The filters need time to settle after a change of the signal source
+    k_msleep(CONFIG_PYD1598_CALIB_SETTLE_MS);
+
+    return pyd1598_fetch(dev);
+}
+
+
+static int calib_read_temperature(const struct device *dev, uint16_t *temperature)
+{
+    // Variables
+    bool out_of_range;
+    int ret;
+
+    ret = calib_push_and_fetch(dev, PYD1598_TEMPERATURE_SENSOR);
+    if (ret != 0) {
+        return ret;
+    }
+
+    return pyd1598_get_temperature_readout(dev, temperature, &out_of_range);
+}
+
+
+// Sample the BPF signal into calib_samples
+static int calib_sample_bpf(const struct device *dev)
+{
+    // Variables
+    struct pyd1598_data *data;
+    int ret;
+
+    // Declare the variables
+    data = dev->data;
+
+    ret = calib_push_and_fetch(dev, PYD1598_PIR_BPF);
+    if (ret != 0) {
+        return ret;
+    }
+
+    for (int i = 0; i < CONFIG_PYD1598_CALIB_SAMPLES; i++) {
+        k_msleep(CONFIG_PYD1598_CALIB_PERIOD_MS);
+
+        ret = pyd1598_fetch(dev);
+        if (ret != 0) {
+            return ret;
+        }
+
+        calib_samples[i] = pyd1598_bpf_counts(data->measurement);
+    }
+
+    return 0;
+}
+
+
+// Noise floor and wake-up parameters from calib_samples
+static void calib_evaluate(struct pyd1598_calib_result *result)
+{
+    // Variables
+    const int half = CONFIG_PYD1598_CALIB_SAMPLES / 2;
+    int64_t sum = 0;
+    int64_t sum_first = 0;
+    int64_t square_sum = 0;
+    int32_t offset;
+    int32_t drift;
+    uint32_t peak = 0;
+    uint32_t threshold;
+    uint32_t expected_pulses;
+    uint16_t excursions;
+
+    for (int i = 0; i < CONFIG_PYD1598_CALIB_SAMPLES; i++) {
+        sum += calib_samples[i];
+        if (i < half) {
+            sum_first += calib_samples[i];
+        }
+    }
+    offset = (int32_t)(sum / CONFIG_PYD1598_CALIB_SAMPLES);
+    drift = (int32_t)((sum - sum_first) / (CONFIG_PYD1598_CALIB_SAMPLES - half) - sum_first / half);
+
+    for (int i = 0; i < CONFIG_PYD1598_CALIB_SAMPLES; i++) {
+        int32_t sample = calib_samples[i];
+        int32_t deviation = sample - offset;
+        uint32_t magnitude = (uint32_t)(sample < 0 ? -sample : sample);
+
+        square_sum += (int64_t)deviation * deviation;
+        if (magnitude > peak) {
+            peak = magnitude;
+        }
+    }
+
+    result->samples = CONFIG_PYD1598_CALIB_SAMPLES;
+    result->offset = (int16_t)offset;
+    result->noise = (uint16_t)pyd1598_core_isqrt64((uint64_t)square_sum / CONFIG_PYD1598_CALIB_SAMPLES);
+    result->peak = (uint16_t)peak;
+    result->drift = (int16_t)drift;
+
+    // Threshold above the offset, the baseline wander and the noise
+    threshold = (uint32_t)(offset < 0 ? -offset : offset) + (uint32_t)(drift < 0 ? -drift : drift) +
+                (result->noise * CONFIG_PYD1598_CALIB_NOISE_FACTOR + 9) / 10;
+    threshold = CLAMP(threshold, CONFIG_PYD1598_CALIB_MIN_THRESHOLD, PYD1598_THRESHOLD_MASK);
+
+    // False pulses the noise would produce in one window, rounded up
+    excursions = calib_count_excursions(threshold);
+    expected_pulses = ((uint32_t)excursions * PYD1598_CALIB_WINDOW_MS + CONFIG_PYD1598_CALIB_SAMPLES * CONFIG_PYD1598_CALIB_PERIOD_MS - 1) /
+                      (CONFIG_PYD1598_CALIB_SAMPLES * CONFIG_PYD1598_CALIB_PERIOD_MS);
+
+    if (expected_pulses > PYD1598_CALIB_PULSE_COUNTER_MAX) {
+        // Counting pulses does not help, get above the noise
+        threshold = MIN(peak + 1, PYD1598_THRESHOLD_MASK);
+        excursions = calib_count_excursions(threshold);
+        expected_pulses = excursions > 0 ? PYD1598_CALIB_PULSE_COUNTER_MAX : 0;
+    }
+
+    result->false_pulses = excursions;
+    result->threshold = (uint8_t)threshold;
+    result->pulse_counter = (uint8_t)expected_pulses;
+    result->window_time = 0;
+}
+
+
+// Mark the device as calibrating if no other mode runs on it
+static int calib_claim(const struct device *dev)
+{
+    // Variables
+    struct pyd1598_data *data;
+    bool busy;
+
+    // Declare the variables
+    data = dev->data;
+
+    k_mutex_lock(&data->run_lock, K_FOREVER);
+    busy = data->calib_active || pyd1598_interrupt_running(dev) || pyd1598_sync_running(dev);
+#ifdef CONFIG_PYD1598_STREAM
+    busy = busy || data->stream_active;
+#endif
+#ifdef CONFIG_PYD1598_SCHED
+    busy = busy || data->sched.active;
+#endif
+#ifdef CONFIG_PYD1598_HYBRID
+    busy = busy || data->hybrid.active;
+#endif
+#ifdef CONFIG_PYD1598_OCCUPANCY
+    busy = busy || data->occupancy.active;
+#endif
+    if (!busy) {
+        data->calib_active = true;
+    }
+    k_mutex_unlock(&data->run_lock);
+
+    return busy ? -EBUSY : 0;
+}
+
+
+static void calib_unclaim(const struct device *dev)
+{
+    // Variables
+    struct pyd1598_data *data;
+
+    // Declare the variables
+    data = dev->data;
+
+    k_mutex_lock(&data->run_lock, K_FOREVER);
+    data->calib_active = false;
+    k_mutex_unlock(&data->run_lock);
+}
+
+
+/**
+ * @brief Calibrate the wake-up threshold from the measured noise floor.
+ *
+ * Blocks for about CONFIG_PYD1598_CALIB_SAMPLES * CONFIG_PYD1598_CALIB_PERIOD_MS plus
+ * three settle times. Nobody should be in view of the sensor meanwhile. The derived
+ * threshold, pulse counter and window time replace those of the desired configuration,
+ * which is then pushed in wake-up mode. The other fields are kept.
+ *
+ * @param dev Pointer to the sensor device
+ * @param result Pointer to where the result should be stored, can be NULL
+ *
+ * @return 0 if successful, -EBUSY if the device is already calibrating, streaming, scheduled,
+ * in hybrid mode, aggregating occupancy, in interrupt readout or a sync group, negative errno
+ * code if failure.
+ */
+int pyd1598_calibrate(const struct device *dev, struct pyd1598_calib_result *result)
+{
+    // Variables
+    struct pyd1598_data *data;
+    struct pyd1598_calib_result calib = {0};
+    uint32_t sensor_conf;
+    int ret;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_calibrate");
+    if (dev == NULL || dev->data == NULL) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+
+    // Claim the device, the other modes would fetch in between or push another configuration
+    if (calib_claim(dev) != 0) {
+        return -EBUSY;
+    }
+
+    // Stay resumed across the settle times instead of per transaction
+    ret = pm_device_runtime_get(dev);
+    if (ret < 0) {
+        calib_unclaim(dev);
+        return ret;
+    }
+
+    k_mutex_lock(&calib_lock, K_FOREVER);
+
+    // Restored at the end, with or without a result
+    sensor_conf = data->sensor_conf;
+
+    ret = calib_read_temperature(dev, &calib.temperature_start);
+    if (ret == 0) {
+        ret = calib_sample_bpf(dev);
+    }
+    if (ret == 0) {
+        ret = calib_read_temperature(dev, &calib.temperature_end);
+    }
+    if (ret == 0) {
+        calib_evaluate(&calib);
+    }
+
+    data->sensor_conf = sensor_conf;
+    if (ret == 0) {
+        pyd1598_set_threshold(dev, calib.threshold);
+        pyd1598_set_pulse_counter(dev, calib.pulse_counter);
+        pyd1598_set_window_time(dev, calib.window_time);
+        pyd1598_set_operation_mode(dev, PYD1598_WAKE_UP);
+        data->calib = calib;
+        data->calib_valid = true;
+    } else {
+        LOG_ERR("Calibration failed: %d", ret);
+    }
+
+    // Back to wake-up mode or to the previous configuration
+    if (pyd1598_push(dev) != 0 && ret == 0) {
+        ret = -EIO;
+    }
+
+    k_mutex_unlock(&calib_lock);
+    pm_device_runtime_put(dev);
+    calib_unclaim(dev);
+
+    if (ret == 0 && result != NULL) {
+        *result = calib;
+    }
+
+    return ret;
+}
+
+
+/**
+ * @brief Get the result of the last successful calibration.
+ *
+ * @param dev Pointer to the sensor device
+ * @param result Pointer to where the result should be stored
+ *
+ * Waits while a calibration is running.
+ *
+ * @return 0 if successful, -ENODATA if the device was never calibrated, negative errno code if failure.
+ */
+int pyd1598_get_calib_result(const struct device *dev, struct pyd1598_calib_result *result)
+{
+    // Variables
+    struct pyd1598_data *data;
+    int ret = 0;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_get_calib_result");
+    if (dev == NULL || dev->data == NULL || result == NULL) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+
+    k_mutex_lock(&calib_lock, K_FOREVER);
+    if (data->calib_valid) {
+        *result = data->calib;
+    } else {
+        ret = -ENODATA;
+    }
+    k_mutex_unlock(&calib_lock);
+
+    return ret;
+}
+
+
+static void pyd1598_calib_work_handler(struct k_work *work)
+{
+    // Variables
+    struct k_work_delayable *dwork;
+    struct pyd1598_data *data;
+    int ret;
+
+    // Declare the variables
+    dwork = k_work_delayable_from_work(work);
+    data = CONTAINER_OF(dwork, struct pyd1598_data, calib_work);
+
+    ret = pyd1598_calibrate(data->dev, NULL);
+    if (ret != 0) {
+        LOG_WRN("%s: periodic calibration failed: %d", data->dev->name, ret);
+    }
+
+    // The period counts from the end of the calibration
+    k_work_schedule_for_queue(&calib_work_q, dwork, data->calib_period);
+}
+
+
+/**
+ * @brief Calibrate now and then again after every period.
+ *
+ * @param dev Pointer to the sensor device
+ * @param period Time between two calibrations, K_FOREVER stops re-tuning
+ *
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_calibrate_periodic(const struct device *dev, k_timeout_t period)
+{
+    // Variables
+    struct pyd1598_data *data;
+    struct k_work_sync sync;
+    int ret;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_calibrate_periodic");
+    if (dev == NULL || dev->data == NULL || K_TIMEOUT_EQ(period, K_NO_WAIT)) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+
+    if (K_TIMEOUT_EQ(period, K_FOREVER)) {
+        k_work_cancel_delayable_sync(&data->calib_work, &sync);
+        return 0;
+    }
+
+    data->calib_period = period;
+    ret = k_work_reschedule_for_queue(&calib_work_q, &data->calib_work, K_NO_WAIT);
+    if (ret < 0) {
+        return ret;
+    }
+
+    return 0;
+}
+
+
+int pyd1598_calib_init(const struct device *dev)
+{
+    // Variables
+    struct pyd1598_data *data;
+
+    // Declare the variables
+    data = dev->data;
+    data->calib_valid = false;
+    data->calib_period = K_FOREVER;
+
+    k_work_init_delayable(&data->calib_work, pyd1598_calib_work_handler);
+
+    return 0;
+}
+
+
+static int pyd1598_calib_queue_init(void)
+{
+    k_work_queue_init(&calib_work_q);
+    k_work_queue_start(&calib_work_q, calib_stack, K_THREAD_STACK_SIZEOF(calib_stack),
+                       CONFIG_PYD1598_CALIB_THREAD_PRIORITY, NULL);
+
+    return 0;
+}
+
+// Before the sensor instances, so the queue exists once they are initialised
+SYS_INIT(pyd1598_calib_queue_init, POST_KERNEL, 0);
@@ -0,0 +1,443 @@
+/*
+PYD1598 pre/post-trigger burst capture
+
+Keeps the last frames of a sensor in forced readout mode, like the pre-trigger buffer
+of an oscilloscope, and on a trigger records a post-trigger window behind them. The
+whole burst goes to the application in the block it was recorded in:
+
+  armed      every accepted frame overwrites the oldest one of the pre-trigger ring
+  trigger    the ring is frozen, the triggering frame is the last pre-trigger frame
+  post       frames are appended behind the ring until the post-trigger depth is reached
+  done       a fresh block is armed in the frame path, the work queue puts the ring in
+             order in place and hands the block to the callback
+
+A sensor in forced readout mode does not trigger itself, the trigger is the wake-up
+detection model of the driver core run on the BPF frames with the desired
+configuration, the decision the sensor would take in wake-up mode, and
+pyd1598_capture_trigger() from the application, e.g. on the wake-up trigger of a
+neighbour. Frames of other signal sources, from the signal source scheduler, are
+recorded with their source and do not run the detection.
+
+Blocks come from one memory slab of CONFIG_PYD1598_CAPTURE_BLOCKS blocks of
+CONFIG_PYD1598_CAPTURE_BLOCK_SIZE bytes for all instances, the memory budget. A
+running capture holds one block, the application holds the blocks it was handed
+until pyd1598_capture_release(). A burst that completes while no block is free is
+dropped and counted, recording starts again once a block is released, as is a burst
+that completes before the work queue handed over the last one. Samples are 8
+bytes, the uptime is kept in 32 bits while recording and turned into the offset to
+the trigger when the burst is handed over.
+*/
+
+#include <zephyr/device.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/kernel.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pyd1598.h>
+#include "pyd1598_internal.h"
+
+LOG_MODULE_DECLARE(PYD1598, PYD1598_LOG_LEVEL);
+
+
+BUILD_ASSERT(CONFIG_PYD1598_CAPTURE_BLOCK_SIZE % 8 == 0, "Capture blocks are 8 byte aligned");
+BUILD_ASSERT(CONFIG_PYD1598_CAPTURE_BLOCK_SIZE >= sizeof(struct pyd1598_capture_burst) + 2 * sizeof(struct pyd1598_capture_sample),
+             "Capture blocks hold at least one pre and one post-trigger frame");
+
+// Frames one block holds behind its header
+#define PYD1598_CAPTURE_CAPACITY                                                                             \
+    MIN((CONFIG_PYD1598_CAPTURE_BLOCK_SIZE - sizeof(struct pyd1598_capture_burst)) / sizeof(struct pyd1598_capture_sample), \
+        UINT16_MAX)
+
+K_MEM_SLAB_DEFINE_STATIC(pyd1598_capture_slab, CONFIG_PYD1598_CAPTURE_BLOCK_SIZE, CONFIG_PYD1598_CAPTURE_BLOCKS, 8);
+
+
+// Arm a fresh block, call with the lock held, false if none is free
+static bool capture_arm(struct pyd1598_capture *cap)
+{
+    // Variables
+    void *block;
+
+    if (k_mem_slab_alloc(&pyd1598_capture_slab, &block, K_NO_WAIT) != 0) {
+        cap->block = NULL;
+        return false;
+    }
+    cap->block = block;
+    cap->head = 0;
+    cap->filled = 0;
+    cap->post = 0;
+    cap->triggered = false;
+
+    return true;
+}
+
+
+// Freeze the ring at trigger_us, call with the lock held
+static void capture_freeze(struct pyd1598_capture *cap, int64_t trigger_us, bool detected)
+{
+    cap->stats.triggers++;
+    if (cap->block == NULL || cap->triggered) {
+        cap->stats.dropped++;
+        return;
+    }
+    cap->triggered = true;
+    cap->block->trigger_us = trigger_us;
+    cap->block->detected = detected;
+}
+
+
+// Reverse samples [from, to)
+static void capture_reverse(struct pyd1598_capture_sample *samples, uint16_t from, uint16_t to)
+{
+    // Variables
+    struct pyd1598_capture_sample tmp;
+
+    while (from + 1 < to) {
+        to--;
+        tmp = samples[from];
+        samples[from] = samples[to];
+        samples[to] = tmp;
+        from++;
+    }
+}
+
+
+// Put the pre-trigger ring in order and the post-trigger frames right behind it
+static void capture_finish(struct pyd1598_capture_burst *burst, uint16_t head, uint16_t filled, uint16_t depth)
+{
+    // Variables
+    uint32_t trigger;
+
+    // Oldest first, a full ring starts at head
+    if (filled == depth) {
+        capture_reverse(burst->samples, 0, head);
+        capture_reverse(burst->samples, head, depth);
+        capture_reverse(burst->samples, 0, depth);
+    }
+    else if (burst->post > 0) {
+        memmove(&burst->samples[filled], &burst->samples[depth], burst->post * sizeof(burst->samples[0]));
+    }
+    burst->pre = filled;
+
+    trigger = (uint32_t)burst->trigger_us;
+    for (uint32_t i = 0; i < (uint32_t)burst->pre + burst->post; i++) {
+        burst->samples[i].offset_us = (int32_t)((uint32_t)burst->samples[i].offset_us - trigger);
+    }
+}
+
+
+static void pyd1598_capture_work_handler(struct k_work *work)
+{
+    // Variables
+    struct pyd1598_data *data;
+    struct pyd1598_capture *cap;
+    struct pyd1598_capture_burst *burst;
+    k_spinlock_key_t key;
+    uint16_t head;
+    uint16_t filled;
+    uint16_t depth;
+
+    // Declare the variables
+    data = CONTAINER_OF(work, struct pyd1598_data, capture.work);
+    cap = &data->capture;
+
+    key = k_spin_lock(&cap->lock);
+    burst = cap->done;
+    head = cap->done_head;
+    filled = cap->done_filled;
+    depth = cap->config.pre_frames;
+    cap->done = NULL;
+    k_spin_unlock(&cap->lock, key);
+
+    if (burst == NULL) {
+        return;
+    }
+
+    capture_finish(burst, head, filled, depth);
+    cap->callback(data->dev, burst, cap->user_data);
+}
+
+
+int pyd1598_capture_init(const struct device *dev)
+{
+    // Variables
+    struct pyd1598_data *data;
+
+    // Declare the variables
+    data = dev->data;
+    memset(&data->capture, 0, sizeof(data->capture));
+
+    k_work_init(&data->capture.work, pyd1598_capture_work_handler);
+
+    return 0;
+}
+
+
+/**
+ * @brief Record an accepted frame, called from fetch, interrupt readout and synchronized sampling.
+ *
+ * @param dev Pointer to the sensor device
+ * @param frame Accepted frame
+ */
+void pyd1598_capture_frame(const struct device *dev, const struct pyd1598_frame *frame)
+{
+    // Variables
+    struct pyd1598_data *data;
+    struct pyd1598_capture *cap;
+    struct pyd1598_capture_sample *sample;
+    k_spinlock_key_t key;
+    uint32_t signal_source;
+
+    // Declare the variables
+    data = dev->data;
+    cap = &data->capture;
+
+    if (!cap->active) {
+        return;
+    }
+
+    key = k_spin_lock(&cap->lock);
+    cap->stats.frames++;
+
+    // Wait for a released block, the frames in between are lost
+    if (cap->block == NULL && !capture_arm(cap)) {
+        k_spin_unlock(&cap->lock, key);
+        return;
+    }
+
+    signal_source = PYD1598_FIELD_GET(frame->sensor_conf, SIGNAL_SOURCE);
+    if (!cap->triggered) {
+        sample = &cap->block->samples[cap->head];
+        cap->head = (cap->head + 1 == cap->config.pre_frames) ? 0 : cap->head + 1;
+        cap->filled = MIN(cap->filled + 1, cap->config.pre_frames);
+    }
+    else {
+        sample = &cap->block->samples[cap->config.pre_frames + cap->post];
+        cap->post++;
+    }
+    sample->offset_us = (int32_t)(uint32_t)frame->timestamp_us;
+    sample->measurement = frame->measurement;
+    sample->signal_source = (uint8_t)signal_source;
+    sample->reserved = 0;
+
+    if (!cap->triggered && cap->config.detect && signal_source == PYD1598_PIR_BPF &&
+        pyd1598_core_detect_sample(&cap->detect, frame->timestamp_us, pyd1598_bpf_counts(frame->measurement))) {
+        capture_freeze(cap, frame->timestamp_us, true);
+    }
+
+    // Post-trigger window complete, hand the block over and keep recording in a new one,
+    // or in the same one while the last burst was not handed over yet
+    if (cap->triggered && cap->post == cap->config.post_frames) {
+        if (cap->done != NULL) {
+            cap->stats.dropped++;
+            cap->triggered = false;
+            cap->post = 0;
+            k_spin_unlock(&cap->lock, key);
+            return;
+        }
+        cap->block->dev = dev;
+        cap->block->post = cap->post;
+        cap->done = cap->block;
+        cap->done_head = cap->head;
+        cap->done_filled = cap->filled;
+        cap->stats.bursts++;
+        capture_arm(cap);
+        k_work_submit(&cap->work);
+    }
+    k_spin_unlock(&cap->lock, key);
+}
+
+
+/**
+ * @brief Keep a pre-trigger ring of frames and hand every trigger with its post-trigger frames to a callback.
+ *
+ * Frames are recorded as they are accepted, from fetch, streaming, the signal source
+ * scheduler, interrupt readout or synchronized sampling, the capture reads none itself.
+ * The callback runs on the system work queue and owns the burst until it is passed to
+ * pyd1598_capture_release().
+ *
+ * @param dev Pointer to the sensor device
+ * @param config Pre and post-trigger depth in frames and the trigger source
+ * @param callback Called with every burst
+ * @param user_data Passed to callback
+ *
+ * @return 0 if successful, -EINVAL if the depths do not fit a block, -ENOMEM if no block is free, negative errno code if failure.
+ */
+int pyd1598_capture_start(const struct device *dev, const struct pyd1598_capture_config *config,
+                          pyd1598_capture_callback_t callback, void *user_data)
+{
+    // Variables
+    struct pyd1598_data *data;
+    struct pyd1598_capture *cap;
+    k_spinlock_key_t key;
+    int ret;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_capture_start");
+    if (dev == NULL || dev->data == NULL || config == NULL || callback == NULL ||
+        config->pre_frames == 0 || config->post_frames == 0 ||
+        (uint32_t)config->pre_frames + config->post_frames > PYD1598_CAPTURE_CAPACITY) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+    cap = &data->capture;
+
+    // A new depth starts over in a new block
+    ret = pyd1598_capture_stop(dev);
+    if (ret != 0) {
+        return ret;
+    }
+
+    key = k_spin_lock(&cap->lock);
+    cap->config = *config;
+    cap->callback = callback;
+    cap->user_data = user_data;
+    pyd1598_core_detect_init(&cap->detect, data->sensor_conf);
+    if (!capture_arm(cap)) {
+        k_spin_unlock(&cap->lock, key);
+        LOG_ERR("No free capture block");
+        return -ENOMEM;
+    }
+    cap->active = true;
+    k_spin_unlock(&cap->lock, key);
+
+    return 0;
+}
+
+
+/**
+ * @brief Stop the capture, the frames of a burst that is not complete are dropped.
+ *
+ * Bursts handed to the callback stay valid until they are released.
+ *
+ * @param dev Pointer to the sensor device
+ *
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_capture_stop(const struct device *dev)
+{
+    // Variables
+    struct pyd1598_data *data;
+    struct pyd1598_capture *cap;
+    struct k_work_sync sync;
+    k_spinlock_key_t key;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_capture_stop");
+    if (dev == NULL || dev->data == NULL) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+    cap = &data->capture;
+
+    key = k_spin_lock(&cap->lock);
+    cap->active = false;
+    k_spin_unlock(&cap->lock, key);
+
+    // A completed burst is still handed over
+    k_work_flush(&cap->work, &sync);
+
+    key = k_spin_lock(&cap->lock);
+    if (cap->block != NULL) {
+        k_mem_slab_free(&pyd1598_capture_slab, cap->block);
+        cap->block = NULL;
+    }
+    k_spin_unlock(&cap->lock, key);
+
+    return 0;
+}
+
+
+/**
+ * @brief Trigger the capture now, the last accepted frame is the last pre-trigger frame.
+ *
+ * Can be called from an interrupt. A trigger during the post-trigger window of a burst
+ * or while no block is free is counted as dropped.
+ *
+ * @param dev Pointer to the sensor device
+ *
+ * @return 0 if successful, -ENODATA if the capture is not started, -EBUSY if the trigger was dropped, negative errno code if failure.
+ */
+int pyd1598_capture_trigger(const struct device *dev)
+{
+    // Variables
+    struct pyd1598_data *data;
+    struct pyd1598_capture *cap;
+    k_spinlock_key_t key;
+    int ret = 0;
+
+    // Check if the device is null
+    if (dev == NULL || dev->data == NULL) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+    cap = &data->capture;
+
+    key = k_spin_lock(&cap->lock);
+    if (!cap->active) {
+        ret = -ENODATA;
+    }
+    else if (cap->block == NULL || cap->triggered) {
+        capture_freeze(cap, 0, false);
+        ret = -EBUSY;
+    }
+    else {
+        capture_freeze(cap, k_ticks_to_us_floor64(k_uptime_ticks()), false);
+    }
+    k_spin_unlock(&cap->lock, key);
+
+    return ret;
+}
+
+
+/**
+ * @brief Give a burst back to the capture.
+ *
+ * @param burst Burst handed to the callback
+ */
+void pyd1598_capture_release(struct pyd1598_capture_burst *burst)
+{
+    if (burst != NULL) {
+        k_mem_slab_free(&pyd1598_capture_slab, burst);
+    }
+}
+
+
+/**
+ * @brief Get the capture counters of the sensor.
+ *
+ * @param dev Pointer to the sensor device
+ * @param stats Pointer to where the counters should be stored
+ *
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_capture_get_stats(const struct device *dev, struct pyd1598_capture_stats *stats)
+{
+    // Variables
+    struct pyd1598_data *data;
+    k_spinlock_key_t key;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_capture_get_stats");
+    if (dev == NULL || dev->data == NULL || stats == NULL) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+
+    key = k_spin_lock(&data->capture.lock);
+    *stats = data->capture.stats;
+    stats->capacity = PYD1598_CAPTURE_CAPACITY;
+    stats->free_blocks = k_mem_slab_num_free_get(&pyd1598_capture_slab);
+    k_spin_unlock(&data->capture.lock, key);
+
+    return 0;
+}
@@ -0,0 +1,97 @@
+/*
+PYD1598 compact field accessors
+
+The set and get functions of the public api, built from the field descriptor table of
+the driver core instead of one body per field. Every accessor is a call into the two
+generic ones, there are no log strings, and a value that does not fit its field is
+refused with -EINVAL when it is set instead of when it is pushed.
+
+Replaces the accessors of pyd1598.c with CONFIG_PYD1598_COMPACT, which also compiles
+the log strings of the whole driver out.
+*/
+
+#include <zephyr/device.h>
+#include <zephyr/kernel.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pyd1598.h>
+#include "pyd1598_internal.h"
+
+
+static int pyd1598_field_set(const struct device *dev, enum pyd1598_core_field field, uint32_t value)
+{
+    // Check if the device is null
+    if (dev == NULL || dev->data == NULL) {
+        return -EINVAL;
+    }
+
+    return pyd1598_core_field_set(&((struct pyd1598_data *)dev->data)->sensor_conf, field, value);
+}
+
+
+static int pyd1598_field_get(const struct device *dev, enum pyd1598_core_field field, uint32_t *value)
+{
+    // Check if the device is null
+    if (dev == NULL || dev->data == NULL) {
+        return -EINVAL;
+    }
+
+    return pyd1598_core_field_get(((struct pyd1598_data *)dev->data)->sensor_conf, field, value);
+}
+
+
+// Setter and getter of one field, type is the public type of the value
+#define PYD1598_COMPACT_SET(name, type, field)                                               \
+    int pyd1598_set_##name(const struct device *dev, type value)                             \
+    {                                                                                        \
+        return pyd1598_field_set(dev, field, (uint32_t)value);                               \
+    }
+
+#define PYD1598_COMPACT_GET(name, type, field)                                               \
+    int pyd1598_get_##name(const struct device *dev, type *value)                            \
+    {                                                                                        \
+        uint32_t raw;                                                                        \
+        int ret;                                                                             \
+                                                                                             \
+        if (value == NULL) {                                                                 \
+            return -EINVAL;                                                                  \
+        }                                                                                    \
+        ret = pyd1598_field_get(dev, field, &raw);                                           \
+        if (ret == 0) {                                                                      \
+            *value = (type)raw;                                                              \
+        }                                                                                    \
+        return ret;                                                                          \
+    }
+
+#define PYD1598_COMPACT_ACCESSORS(name, type, field)                                         \
+    PYD1598_COMPACT_SET(name, type, field)                                                   \
+    PYD1598_COMPACT_GET(name, type, field)
+
+PYD1598_COMPACT_ACCESSORS(threshold, uint8_t, PYD1598_CORE_THRESHOLD)
+PYD1598_COMPACT_ACCESSORS(blind_time, uint8_t, PYD1598_CORE_BLIND_TIME)
+PYD1598_COMPACT_ACCESSORS(pulse_counter, uint8_t, PYD1598_CORE_PULSE_COUNTER)
+PYD1598_COMPACT_ACCESSORS(window_time, uint8_t, PYD1598_CORE_WINDOW_TIME)
+PYD1598_COMPACT_GET(operation_mode, enum pyd1598_operation_mode, PYD1598_CORE_OPERATION_MODE)
+PYD1598_COMPACT_ACCESSORS(signal_source, enum pyd1598_signal_source, PYD1598_CORE_SIGNAL_SOURCE)
+PYD1598_COMPACT_ACCESSORS(hpf_cutoff, enum pyd1598_hpf_cutoff, PYD1598_CORE_HPF_CUT_OFF)
+PYD1598_COMPACT_ACCESSORS(count_mode, enum pyd1598_count_mode, PYD1598_CORE_COUNT_MODE)
+
+
+/**
+ * @brief Set pyd1598 operation mode configuration to the internal buffer.
+ *
+ * @param dev Pointer to the sensor device
+ * @param operation_mode Operation mode (PYD1598_FORCED_READOUT, PYD1598_INTERRUPT_READOUT, PYD1598_WAKE_UP)
+ *
+ * @return 0 if successful, -ENOTSUP for interrupt readout without CONFIG_PYD1598_INTERRUPT_READOUT, negative errno code if failure.
+ */
+int pyd1598_set_operation_mode(const struct device *dev, enum pyd1598_operation_mode operation_mode)
+{
+    // Nothing would read the samples the sensor signals
+    if (!IS_ENABLED(CONFIG_PYD1598_INTERRUPT_READOUT) && operation_mode == PYD1598_INTERRUPT_READOUT) {
+        return -ENOTSUP;
+    }
+
+    return pyd1598_field_set(dev, PYD1598_CORE_OPERATION_MODE, (uint32_t)operation_mode);
+}
@@ -0,0 +1,1091 @@
+/*
+PYD1598 driver core
+
+The hardware independent functions of pyd1598_core.h, used by pyd1598.c, the
+scheduler, the spi backend, the batch encoder, the frame logger and replay and the
+sensor emulator. Only the C library is included, keep it that way: the core is what
+can be compiled and exercised on a host without a board or a kernel.
+*/
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "pyd1598_core.h"
+
+
+// Channel of every signal source, -1 for the not allowed value 2
+static const int8_t sched_channel[] = {
+    [0] = 0, // PIR BPF
+    [1] = 1, // PIR LPF
+    [2] = -1,
+    [3] = 2, // Temperature
+};
+
+static const uint8_t sched_source[PYD1598_SCHED_CHANNELS] = {
+    0, // PIR BPF
+    1, // PIR LPF
+    3, // Temperature
+};
+
+
+/**
+ * @brief Split the bits of a readout into the measurement and the configuration.
+ *
+ * @param raw Sampled bits, the first sampled bit most significant
+ * @param bits Number of sampled bits, PYD1598_READOUT_BITS or PYD1598_MEASUREMENT_BITS
+ * @param measurement Pointer to where the 15 measurement bits should be stored
+ * @param sensor_conf Pointer to where the 25 configuration bits should be stored, 0 if not read
+ */
+void pyd1598_core_decode_readout(uint64_t raw, int bits, uint32_t *measurement, uint32_t *sensor_conf)
+{
+    // Bits that were not sampled are 0, as if the readout continued with low bits
+    raw <<= (PYD1598_READOUT_BITS - bits);
+
+    *measurement = (uint32_t)(raw >> (PYD1598_READOUT_BITS - PYD1598_MEASUREMENT_BITS)) &
+                   ((1U << PYD1598_MEASUREMENT_BITS) - 1U);
+    *sensor_conf = (uint32_t)raw & PYD1598_CONF_MASK;
+}
+
+
+/**
+ * @brief Default configuration word, see pyd1598_set_default_config().
+ *
+ * @return Configuration with the reserved bits set.
+ */
+uint32_t pyd1598_core_conf_default(void)
+{
+    // Variables
+    uint32_t sensor_conf = 0;
+
+    sensor_conf = PYD1598_FIELD_SET(sensor_conf, THRESHOLD, 31);
+    sensor_conf = PYD1598_FIELD_SET(sensor_conf, BLIND_TIME, 6);
+    sensor_conf = PYD1598_FIELD_SET(sensor_conf, PULSE_COUNTER, 0);
+    sensor_conf = PYD1598_FIELD_SET(sensor_conf, WINDOW_TIME, 0);
+    sensor_conf = PYD1598_FIELD_SET(sensor_conf, OPERATION_MODE, 2); // Wake-up
+    sensor_conf = PYD1598_FIELD_SET(sensor_conf, SIGNAL_SOURCE, 1); // PIR LPF
+    sensor_conf = PYD1598_FIELD_SET(sensor_conf, HPF_CUT_OFF, 0); // 0.4 Hz
+    sensor_conf = PYD1598_FIELD_SET(sensor_conf, COUNT_MODE, 1); // Count all
+
+    return pyd1598_core_conf_reserved(sensor_conf);
+}
+
+
+/**
+ * @brief Set the reserved bits of a configuration word to the values the datasheet requires.
+ *
+ * @param sensor_conf Configuration word
+ *
+ * @return Configuration with the reserved bits set.
+ */
+uint32_t pyd1598_core_conf_reserved(uint32_t sensor_conf)
+{
+    sensor_conf = PYD1598_FIELD_SET(sensor_conf, RESERVED_2, PYD1598_RESERVED_2_DEC_VALUE);
+    sensor_conf = PYD1598_FIELD_SET(sensor_conf, RESERVED_1, PYD1598_RESERVED_1_DEC_VALUE);
+
+    return sensor_conf;
+}
+
+
+/**
+ * @brief Check that a configuration word can be pushed to the sensor.
+ *
+ * @param sensor_conf Configuration word
+ *
+ * @return 0 if valid, -EINVAL if it has bits above the 25 configuration bits, wrong
+ * reserved bits or a not allowed operation mode or signal source.
+ */
+int pyd1598_core_conf_validate(uint32_t sensor_conf)
+{
+    if ((sensor_conf & ~PYD1598_CONF_MASK) != 0) {
+        return -EINVAL;
+    }
+    if (pyd1598_core_conf_reserved(sensor_conf) != sensor_conf) {
+        return -EINVAL;
+    }
+    if (PYD1598_FIELD_GET(sensor_conf, OPERATION_MODE) == PYD1598_OPERATION_MODE_INVALID) {
+        return -EINVAL;
+    }
+    if (PYD1598_FIELD_GET(sensor_conf, SIGNAL_SOURCE) == PYD1598_SIGNAL_SOURCE_INVALID) {
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+
+#define PYD1598_CORE_FIELD(name, invalid_value)                                              \
+    [PYD1598_CORE_##name] = {                                                                \
+        .shift = PYD1598_##name##_SHIFT,                                                     \
+        .mask = PYD1598_##name##_MASK,                                                       \
+        .invalid = (invalid_value),                                                          \
+    }
+
+const struct pyd1598_core_field_desc pyd1598_core_fields[PYD1598_CORE_FIELDS] = {
+    PYD1598_CORE_FIELD(THRESHOLD, 0),
+    PYD1598_CORE_FIELD(BLIND_TIME, 0),
+    PYD1598_CORE_FIELD(PULSE_COUNTER, 0),
+    PYD1598_CORE_FIELD(WINDOW_TIME, 0),
+    PYD1598_CORE_FIELD(OPERATION_MODE, PYD1598_OPERATION_MODE_INVALID),
+    PYD1598_CORE_FIELD(SIGNAL_SOURCE, PYD1598_SIGNAL_SOURCE_INVALID),
+    PYD1598_CORE_FIELD(HPF_CUT_OFF, 0),
+    PYD1598_CORE_FIELD(COUNT_MODE, 0),
+};
+
+
+/**
+ * @brief Replace one field of a configuration word, the rest of the bits as they are.
+ *
+ * @param sensor_conf Configuration word to change
+ * @param field Field to set
+ * @param value New value of the field
+ *
+ * @return 0 if successful, -EINVAL if the value does not fit or is not allowed.
+ */
+int pyd1598_core_field_set(uint32_t *sensor_conf, enum pyd1598_core_field field, uint32_t value)
+{
+    // Variables
+    const struct pyd1598_core_field_desc *desc;
+
+    if ((unsigned int)field >= PYD1598_CORE_FIELDS) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    desc = &pyd1598_core_fields[field];
+
+    if (value > desc->mask || (desc->invalid != 0 && value == desc->invalid)) {
+        return -EINVAL;
+    }
+    *sensor_conf = (*sensor_conf & ~((uint32_t)desc->mask << desc->shift)) | (value << desc->shift);
+
+    return 0;
+}
+
+
+/**
+ * @brief Get one field of a configuration word.
+ *
+ * @param sensor_conf Configuration word
+ * @param field Field to get
+ * @param value Pointer to where the value should be stored
+ *
+ * @return 0 if successful, -EIO if the word holds a not allowed value, -EINVAL for an unknown field.
+ */
+int pyd1598_core_field_get(uint32_t sensor_conf, enum pyd1598_core_field field, uint32_t *value)
+{
+    // Variables
+    const struct pyd1598_core_field_desc *desc;
+
+    if ((unsigned int)field >= PYD1598_CORE_FIELDS) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    desc = &pyd1598_core_fields[field];
+
+    *value = (sensor_conf >> desc->shift) & desc->mask;
+    if (desc->invalid != 0 && *value == desc->invalid) {
+        return -EIO;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Parse a time in seconds with an optional fraction, as csv exports write it.
+ *
+ * @param str Text starting with the time
+ * @param time_ns Pointer to where the time in ns should be stored
+ *
+ * @return Pointer to the first character after the time, NULL if str does not start
+ * with a number.
+ */
+const char *pyd1598_core_parse_seconds(const char *str, int64_t *time_ns)
+{
+    // Variables
+    int64_t value = 0;
+    int64_t scale = PYD1598_NSEC_PER_SEC;
+    bool negative = false;
+    bool digits = false;
+
+    if (*str == '-') {
+        negative = true;
+        str++;
+    }
+    for (; *str >= '0' && *str <= '9'; str++) {
+        value = value * 10 + (*str - '0') * PYD1598_NSEC_PER_SEC;
+        digits = true;
+    }
+    if (*str == '.') {
+        for (str++; *str >= '0' && *str <= '9'; str++) {
+            scale /= 10;
+            value += (*str - '0') * scale;
+            digits = true;
+        }
+    }
+    if (!digits) {
+        return NULL;
+    }
+
+    *time_ns = negative ? -value : value;
+
+    return str;
+}
+
+
+// Bytes of a bit slot or of the latch time at frequency, rounded up
+static size_t spi_bytes(uint32_t frequency, uint32_t time_us)
+{
+    return (size_t)(((uint64_t)frequency * time_us + 8ULL * 1000000 - 1) / (8ULL * 1000000));
+}
+
+
+/**
+ * @brief Length of the serial in spi waveform of one push.
+ *
+ * @param frequency Spi clock in Hz
+ *
+ * @return Bytes of the 25 bit slots and the latch time.
+ */
+size_t pyd1598_core_spi_waveform_len(uint32_t frequency)
+{
+    return PYD1598_SPI_PUSH_BITS * spi_bytes(frequency, PYD1598_SPI_SLOT_US) +
+           spi_bytes(frequency, PYD1598_SPI_LATCH_US);
+}
+
+
+/**
+ * @brief Build the MOSI bytes of a push, sent MSB first.
+ *
+ * Every bit slot starts with 0x40 for a 0 bit or 0x7f for a 1 bit, a low and a high
+ * pulse and then the bit value, and is filled with the bit value. The latch time is 0.
+ *
+ * @param out Buffer for the waveform
+ * @param size Size of out
+ * @param frequency Spi clock in Hz, PYD1598_SPI_FREQUENCY_MIN - PYD1598_SPI_FREQUENCY_MAX
+ * @param sensor_conf Configuration word, the 25 bits are sent most significant first
+ *
+ * @return Length of the waveform, 0 if the frequency is out of range or out is too small.
+ */
+size_t pyd1598_core_spi_waveform(uint8_t *out, size_t size, uint32_t frequency, uint32_t sensor_conf)
+{
+    // Variables
+    size_t slot_bytes;
+    size_t len;
+    uint8_t fill;
+
+    // Declare the variables
+    slot_bytes = spi_bytes(frequency, PYD1598_SPI_SLOT_US);
+    len = pyd1598_core_spi_waveform_len(frequency);
+
+    if (frequency < PYD1598_SPI_FREQUENCY_MIN || frequency > PYD1598_SPI_FREQUENCY_MAX || len > size) {
+        return 0;
+    }
+
+    for (int i = PYD1598_SPI_PUSH_BITS - 1; i >= 0; i--) {
+        fill = ((sensor_conf >> i) & 1U) ? 0xff : 0x00;
+
+        // Low pulse, high pulse, then the bit value
+        out[0] = 0x40 | (fill & 0x3f);
+        memset(out + 1, fill, slot_bytes - 1);
+        out += slot_bytes;
+    }
+    memset(out, 0x00, spi_bytes(frequency, PYD1598_SPI_LATCH_US));
+
+    return len;
+}
+
+
+/**
+ * @brief Read the configuration word back from the MOSI bytes of a push, like the
+ * sensor would. Only the exact waveform of pyd1598_core_spi_waveform() is accepted.
+ *
+ * @param in MOSI bytes of the push
+ * @param len Length of in
+ * @param frequency Spi clock in Hz the bytes were sent with
+ * @param sensor_conf Pointer to where the 25 bit configuration should be stored
+ *
+ * @return 0 if successful, -EINVAL if len does not match the frequency, -EIO if a
+ * slot or the latch time has other bytes.
+ */
+int pyd1598_core_spi_decode(const uint8_t *in, size_t len, uint32_t frequency, uint32_t *sensor_conf)
+{
+    // Variables
+    size_t slot_bytes;
+    uint32_t word = 0;
+    uint8_t fill;
+
+    // Declare the variables
+    slot_bytes = spi_bytes(frequency, PYD1598_SPI_SLOT_US);
+
+    if (frequency < PYD1598_SPI_FREQUENCY_MIN || frequency > PYD1598_SPI_FREQUENCY_MAX ||
+        len != pyd1598_core_spi_waveform_len(frequency)) {
+        return -EINVAL;
+    }
+
+    for (int i = 0; i < PYD1598_SPI_PUSH_BITS; i++) {
+        if (in[0] != 0x40 && in[0] != 0x7f) {
+            return -EIO;
+        }
+        fill = (in[0] == 0x7f) ? 0xff : 0x00;
+        for (size_t j = 1; j < slot_bytes; j++) {
+            if (in[j] != fill) {
+                return -EIO;
+            }
+        }
+        word = (word << 1) | (fill & 1U);
+        in += slot_bytes;
+    }
+    for (size_t j = 0; j < spi_bytes(frequency, PYD1598_SPI_LATCH_US); j++) {
+        if (in[j] != 0x00) {
+            return -EIO;
+        }
+    }
+
+    *sensor_conf = word;
+
+    return 0;
+}
+
+
+/**
+ * @brief Write a CBOR head, the major type and the shortest encoding of value.
+ *
+ * @param buf Buffer for at least 9 bytes
+ * @param major CBOR major type
+ * @param value Argument of the head
+ *
+ * @return Bytes written.
+ */
+size_t pyd1598_core_cbor_head(uint8_t *buf, uint8_t major, uint64_t value)
+{
+    major = (uint8_t)(major << 5);
+
+    if (value < 24) {
+        buf[0] = major | (uint8_t)value;
+        return 1;
+    }
+    if (value <= UINT8_MAX) {
+        buf[0] = major | 24;
+        buf[1] = (uint8_t)value;
+        return 2;
+    }
+    if (value <= UINT16_MAX) {
+        buf[0] = major | 25;
+        buf[1] = (uint8_t)(value >> 8);
+        buf[2] = (uint8_t)value;
+        return 3;
+    }
+    if (value <= UINT32_MAX) {
+        buf[0] = major | 26;
+        for (int i = 0; i < 4; i++) {
+            buf[1 + i] = (uint8_t)(value >> (24 - 8 * i));
+        }
+        return 5;
+    }
+    buf[0] = major | 27;
+    for (int i = 0; i < 8; i++) {
+        buf[1 + i] = (uint8_t)(value >> (56 - 8 * i));
+    }
+    return 9;
+}
+
+
+static size_t cbor_put_uint_pair(uint8_t *buf, uint64_t key, uint64_t value)
+{
+    size_t len;
+
+    len = pyd1598_core_cbor_head(buf, PYD1598_CBOR_MAJOR_UINT, key);
+    len += pyd1598_core_cbor_head(&buf[len], PYD1598_CBOR_MAJOR_UINT, value);
+
+    return len;
+}
+
+
+/**
+ * @brief Write a config record of the batch record stream.
+ *
+ * @param out Buffer for at least 1 + PYD1598_VARINT32_MAX bytes
+ * @param instance Sensor instance, below 64
+ * @param sensor_conf Configuration of the frames that follow
+ *
+ * @return Bytes written.
+ */
+size_t pyd1598_core_encode_config(uint8_t *out, uint8_t instance, uint32_t sensor_conf)
+{
+    out[0] = PYD1598_ENCODER_TAG(PYD1598_ENCODER_TYPE_CONFIG, instance);
+
+    return 1 + pyd1598_put_varint(&out[1], sensor_conf);
+}
+
+
+/**
+ * @brief Write a frame record of the batch record stream.
+ *
+ * @param out Buffer for at least 1 + PYD1598_VARINT64_MAX + PYD1598_VARINT32_MAX bytes
+ * @param instance Sensor instance, below 64
+ * @param period_change_us Period to the previous frame minus the period before it
+ * @param measurement_delta Measurement minus the previous measurement
+ *
+ * @return Bytes written.
+ */
+size_t pyd1598_core_encode_frame(uint8_t *out, uint8_t instance, int64_t period_change_us, int64_t measurement_delta)
+{
+    // Variables
+    size_t len;
+
+    out[0] = PYD1598_ENCODER_TAG(PYD1598_ENCODER_TYPE_FRAME, instance);
+    len = 1 + pyd1598_put_svarint(&out[1], period_change_us);
+    len += pyd1598_put_svarint(&out[len], measurement_delta);
+
+    return len;
+}
+
+
+/**
+ * @brief Write a trigger record of the batch record stream.
+ *
+ * @param out Buffer for at least 1 + PYD1598_VARINT64_MAX bytes
+ * @param instance Sensor instance, below 64
+ * @param delta_us Time since the previous frame of the instance
+ *
+ * @return Bytes written.
+ */
+size_t pyd1598_core_encode_trigger(uint8_t *out, uint8_t instance, int64_t delta_us)
+{
+    out[0] = PYD1598_ENCODER_TAG(PYD1598_ENCODER_TYPE_TRIGGER, instance);
+
+    return 1 + pyd1598_put_svarint(&out[1], delta_us);
+}
+
+
+/**
+ * @brief Wrap a record stream into the CBOR map of a batch payload.
+ *
+ * The stream is compressed when compress is set and that makes the payload smaller.
+ * stream must not overlap out.
+ *
+ * @param out Buffer for the payload
+ * @param out_size Size of out
+ * @param base_timestamp_us Timestamp the first records of the instances are relative to
+ * @param count Frames and triggers in the stream
+ * @param stream Record stream
+ * @param stream_len Length of the record stream
+ * @param compress Compressor, NULL to store the stream as it is
+ * @param out_len Pointer to where the payload length should be stored
+ *
+ * @return 0 if successful, -ENOMEM if out is too small.
+ */
+int pyd1598_core_encode_payload(uint8_t *out, size_t out_size, int64_t base_timestamp_us, uint32_t count,
+                                const uint8_t *stream, size_t stream_len, pyd1598_core_compress_t compress,
+                                size_t *out_len)
+{
+    // Variables
+    uint8_t header[PYD1598_ENCODER_HEADER_MAX];
+    const uint8_t *body;
+    size_t body_len;
+    size_t header_len;
+    bool compressed = false;
+
+    // Declare the variables
+    body = stream;
+    body_len = stream_len;
+
+    // Compress behind the largest possible header, then move it in place
+    if (compress != NULL && out_size > PYD1598_ENCODER_HEADER_MAX && stream_len > 0) {
+        size_t len = compress(stream, stream_len, &out[PYD1598_ENCODER_HEADER_MAX], out_size - PYD1598_ENCODER_HEADER_MAX);
+        if (len > 0 && len < stream_len) {
+            body = &out[PYD1598_ENCODER_HEADER_MAX];
+            body_len = len;
+            compressed = true;
+        }
+    }
+
+    header_len = pyd1598_core_cbor_head(header, PYD1598_CBOR_MAJOR_MAP, compressed ? 5 : 4);
+    header_len += cbor_put_uint_pair(&header[header_len], 0, PYD1598_ENCODER_VERSION);
+    header_len += cbor_put_uint_pair(&header[header_len], 1, (uint64_t)base_timestamp_us);
+    header_len += cbor_put_uint_pair(&header[header_len], 2, count);
+    if (compressed) {
+        header_len += cbor_put_uint_pair(&header[header_len], 3, stream_len);
+    }
+    header_len += pyd1598_core_cbor_head(&header[header_len], PYD1598_CBOR_MAJOR_UINT, 4);
+    header_len += pyd1598_core_cbor_head(&header[header_len], PYD1598_CBOR_MAJOR_BSTR, body_len);
+
+    if (header_len + body_len > out_size) {
+        return -ENOMEM;
+    }
+
+    memmove(&out[header_len], body, body_len);
+    memcpy(out, header, header_len);
+    *out_len = header_len + body_len;
+
+    return 0;
+}
+
+
+static void put_le(uint8_t *out, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+
+static uint64_t get_le(const uint8_t *in, int bytes)
+{
+    uint64_t value = 0;
+
+    for (int i = bytes - 1; i >= 0; i--) {
+        value = (value << 8) | in[i];
+    }
+
+    return value;
+}
+
+
+/**
+ * @brief Write the header of a frame logger block.
+ *
+ * @param block Block, at least PYD1598_LOG_HEADER_SIZE bytes
+ * @param sequence Sequence number of the block
+ *
+ * @return Bytes written, PYD1598_LOG_HEADER_SIZE.
+ */
+size_t pyd1598_core_log_begin(uint8_t *block, uint32_t sequence)
+{
+    block[0] = 'P';
+    block[1] = 'Y';
+    block[2] = PYD1598_LOG_VERSION;
+    block[3] = 0;
+    put_le(&block[4], sequence, 4);
+
+    return PYD1598_LOG_HEADER_SIZE;
+}
+
+
+/**
+ * @brief Write the records of one frame into a frame logger block.
+ *
+ * A time and a config record go first when the instance is new in the block or the
+ * delta to its last frame does not fit, a config record alone when the config changed.
+ *
+ * @param out Buffer for at least PYD1598_LOG_RECORD_MAX bytes
+ * @param state Delta state of the instance, in_block cleared at every block start
+ * @param instance Sensor instance, below PYD1598_LOG_INSTANCES
+ * @param timestamp_us Timestamp of the frame
+ * @param sensor_conf Configuration read back with the frame
+ * @param measurement Measurement of the frame
+ *
+ * @return Bytes written.
+ */
+size_t pyd1598_core_log_frame(uint8_t *out, struct pyd1598_core_log_instance *state, uint8_t instance,
+                              int64_t timestamp_us, uint32_t sensor_conf, uint16_t measurement)
+{
+    // Variables
+    int64_t delta_us;
+    size_t len = 0;
+
+    // Declare the variables
+    delta_us = timestamp_us - state->last_timestamp_us;
+
+    if (!state->in_block || delta_us < 0 || delta_us > UINT32_MAX) {
+        out[len++] = PYD1598_LOG_TAG(PYD1598_LOG_TYPE_TIME, instance);
+        put_le(&out[len], (uint64_t)timestamp_us, 8);
+        len += 8;
+        out[len++] = PYD1598_LOG_TAG(PYD1598_LOG_TYPE_CONFIG, instance);
+        put_le(&out[len], sensor_conf, 4);
+        len += 4;
+        state->in_block = true;
+        state->last_conf = sensor_conf;
+        delta_us = 0;
+    }
+    else if (sensor_conf != state->last_conf) {
+        out[len++] = PYD1598_LOG_TAG(PYD1598_LOG_TYPE_CONFIG, instance);
+        put_le(&out[len], sensor_conf, 4);
+        len += 4;
+        state->last_conf = sensor_conf;
+    }
+
+    out[len++] = PYD1598_LOG_TAG(PYD1598_LOG_TYPE_FRAME, instance);
+    len += pyd1598_put_varint(&out[len], (uint32_t)delta_us);
+    put_le(&out[len], measurement, 2);
+    len += 2;
+
+    state->last_timestamp_us = timestamp_us;
+
+    return len;
+}
+
+
+/**
+ * @brief Start reading the frames of one instance from a frame logger block.
+ *
+ * @param rd Reader state
+ * @param block Block as written by the logger
+ * @param len Length of the block
+ * @param instance Instance whose frames are read, 0-62
+ *
+ * @return 0 if successful, -EINVAL if the block is not a log block.
+ */
+int pyd1598_core_log_open(struct pyd1598_core_log_reader *rd, const uint8_t *block, size_t len, int instance)
+{
+    if (instance < 0 || instance >= PYD1598_LOG_INSTANCES || len < PYD1598_LOG_HEADER_SIZE ||
+        block[0] != 'P' || block[1] != 'Y' || block[2] != PYD1598_LOG_VERSION) {
+        return -EINVAL;
+    }
+
+    memset(rd, 0, sizeof(*rd));
+    rd->block = block;
+    rd->len = len;
+    rd->pos = PYD1598_LOG_HEADER_SIZE;
+    rd->instance = instance;
+
+    return 0;
+}
+
+
+/**
+ * @brief Read the next frame of the instance.
+ *
+ * @param rd Reader state
+ * @param timestamp_us Pointer to where the timestamp should be stored
+ * @param sensor_conf Pointer to where the configuration should be stored
+ * @param measurement Pointer to where the measurement should be stored
+ *
+ * @return 1 if a frame was read, 0 at the end of the block, -EINVAL if the block is corrupt.
+ */
+int pyd1598_core_log_next(struct pyd1598_core_log_reader *rd, int64_t *timestamp_us, uint32_t *sensor_conf,
+                          uint16_t *measurement)
+{
+    // Variables
+    const uint8_t *block = rd->block;
+    size_t len = rd->len;
+    uint64_t delta_us;
+    size_t used;
+    bool own;
+    uint8_t tag;
+
+    while (rd->pos < len && block[rd->pos] != PYD1598_LOG_PAD) {
+        tag = block[rd->pos++];
+        own = (tag & 0x3f) == rd->instance;
+
+        switch (tag >> 6) {
+        case PYD1598_LOG_TYPE_TIME:
+            if (len - rd->pos < 8) {
+                return -EINVAL;
+            }
+            if (own) {
+                rd->timestamp_us = (int64_t)get_le(&block[rd->pos], 8);
+                rd->based = true;
+            }
+            rd->pos += 8;
+            break;
+        case PYD1598_LOG_TYPE_CONFIG:
+            if (len - rd->pos < 4) {
+                return -EINVAL;
+            }
+            if (own) {
+                rd->sensor_conf = (uint32_t)get_le(&block[rd->pos], 4);
+            }
+            rd->pos += 4;
+            break;
+        case PYD1598_LOG_TYPE_FRAME:
+            used = pyd1598_get_varint(&block[rd->pos], len - rd->pos, &delta_us);
+            if (used == 0 || len - rd->pos - used < 2) {
+                return -EINVAL;
+            }
+            rd->pos += used + 2;
+            if (!own) {
+                break;
+            }
+            if (!rd->based) {
+                return -EINVAL;
+            }
+            rd->timestamp_us += (int64_t)delta_us;
+            *timestamp_us = rd->timestamp_us;
+            *sensor_conf = rd->sensor_conf;
+            *measurement = (uint16_t)get_le(&block[rd->pos - 2], 2);
+            return 1;
+        default:
+            return -EINVAL;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Set up the wake-up detection model for a configuration word.
+ *
+ * @param det Detection state
+ * @param sensor_conf Configuration word, threshold, blind time, pulse counter, window
+ * time and count mode are used
+ */
+void pyd1598_core_detect_init(struct pyd1598_core_detect *det, uint32_t sensor_conf)
+{
+    det->threshold = PYD1598_FIELD_GET(sensor_conf, THRESHOLD);
+    det->window_us = 2000000LL * (1 + PYD1598_FIELD_GET(sensor_conf, WINDOW_TIME));
+    det->blind_us = 500000LL * (1 + PYD1598_FIELD_GET(sensor_conf, BLIND_TIME));
+    det->pulses_needed = (uint8_t)(1 + PYD1598_FIELD_GET(sensor_conf, PULSE_COUNTER));
+    det->sign_change = (PYD1598_FIELD_GET(sensor_conf, COUNT_MODE) == 0);
+    det->pulses = 0;
+    det->last_sign = 0;
+    det->above = false;
+    det->window_start_us = 0;
+    det->blind_end_us = INT64_MIN;
+    det->latency_us = 0;
+    det->counted = 0;
+}
+
+
+/**
+ * @brief Run one BPF sample through the wake-up detection model.
+ *
+ * @param det Detection state
+ * @param timestamp_us Time of the sample, not decreasing
+ * @param bpf PIR BPF counts
+ *
+ * @return True if the sample triggers a wake-up, latency_us then holds the time since
+ * the first pulse that counted towards it.
+ */
+bool pyd1598_core_detect_sample(struct pyd1598_core_detect *det, int64_t timestamp_us, int16_t bpf)
+{
+    // Variables
+    int32_t magnitude;
+    int8_t sign;
+    bool above;
+
+    // Declare the variables
+    magnitude = (bpf < 0) ? -(int32_t)bpf : (int32_t)bpf;
+    sign = (bpf < 0) ? -1 : 1;
+    above = (uint32_t)magnitude > det->threshold;
+
+    // Only the rise above the threshold is a pulse
+    if (!above || det->above) {
+        det->above = above;
+        return false;
+    }
+    det->above = true;
+
+    if (timestamp_us < det->blind_end_us) {
+        return false;
+    }
+    if (det->pulses > 0 && timestamp_us - det->window_start_us > det->window_us) {
+        det->pulses = 0;
+        det->last_sign = 0;
+    }
+    if (det->sign_change && det->last_sign == sign) {
+        return false;
+    }
+
+    if (det->pulses == 0) {
+        det->window_start_us = timestamp_us;
+    }
+    det->pulses++;
+    det->counted++;
+    det->last_sign = sign;
+    if (det->pulses < det->pulses_needed) {
+        return false;
+    }
+
+    det->latency_us = (uint32_t)(timestamp_us - det->window_start_us);
+    det->pulses = 0;
+    det->last_sign = 0;
+    det->blind_end_us = timestamp_us + det->blind_us;
+
+    return true;
+}
+
+
+/**
+ * @brief Integer square root, rounded down.
+ *
+ * @param value Radicand
+ *
+ * @return Largest root whose square is not above value.
+ */
+uint32_t pyd1598_core_isqrt64(uint64_t value)
+{
+    // Variables
+    uint64_t root = 0;
+    uint64_t bit = (uint64_t)1 << 62;
+
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return (uint32_t)root;
+}
+
+
+/**
+ * @brief Lag at which b follows a best, by normalized cross-correlation.
+ *
+ * Only lags where b trails a are searched, sum over i of a[i - lag] * b[i] for lag
+ * 0 to max_lag, each normalized by the energy of the overlapping parts.
+ *
+ * @param a Earlier waveform, oldest sample first
+ * @param b Later waveform, same length and sample times as a
+ * @param len Number of samples
+ * @param max_lag Largest lag in samples, below len
+ * @param lag Pointer to where the lag of the peak should be stored
+ *
+ * @return Normalized correlation at the peak in Q15, 0 if there is no positive peak.
+ */
+int32_t pyd1598_core_xcorr(const int16_t *a, const int16_t *b, int len, int max_lag, int *lag)
+{
+    // Variables
+    int64_t sum;
+    uint64_t energy_a;
+    uint64_t energy_b;
+    uint32_t norm_a;
+    uint32_t norm_b;
+    int32_t score;
+    int32_t best = 0;
+
+    *lag = 0;
+    for (int k = 0; k <= max_lag && k < len; k++) {
+        sum = 0;
+        energy_a = 0;
+        energy_b = 0;
+        for (int i = k; i < len; i++) {
+            sum += (int32_t)a[i - k] * b[i];
+            energy_a += (uint32_t)((int32_t)a[i - k] * a[i - k]);
+            energy_b += (uint32_t)((int32_t)b[i] * b[i]);
+        }
+        if (sum <= 0) {
+            continue;
+        }
+        norm_a = pyd1598_core_isqrt64(energy_a);
+        norm_b = pyd1598_core_isqrt64(energy_b);
+
+        // sum / (|a| |b|) in Q15
+        score = (int32_t)((sum << 15) / ((int64_t)norm_a * norm_b + 1));
+        if (score > INT16_MAX) {
+            score = INT16_MAX; // The roots are rounded down
+        }
+        if (score > best) {
+            best = score;
+            *lag = k;
+        }
+    }
+
+    return best;
+}
+
+
+/**
+ * @brief Scheduler channel of a signal source.
+ *
+ * @param signal_source Signal source field value
+ *
+ * @return Channel, -1 if the signal source is not allowed.
+ */
+int pyd1598_core_sched_channel(uint32_t signal_source)
+{
+    if (signal_source >= sizeof(sched_channel)) {
+        return -1;
+    }
+
+    return sched_channel[signal_source];
+}
+
+
+/**
+ * @brief Signal source field value of a scheduler channel.
+ *
+ * @param ch Channel, 0 to PYD1598_SCHED_CHANNELS - 1
+ *
+ * @return Signal source field value.
+ */
+uint32_t pyd1598_core_sched_source(int ch)
+{
+    return sched_source[ch];
+}
+
+
+/**
+ * @brief Enabled channel with the shortest period, the scheduler stays on it between visits.
+ *
+ * @param plan Scheduler state
+ *
+ * @return Channel, -1 if no channel has a period.
+ */
+int pyd1598_core_sched_home(const struct pyd1598_core_sched *plan)
+{
+    int home = -1;
+
+    for (int ch = 0; ch < PYD1598_SCHED_CHANNELS; ch++) {
+        if (plan->period_ms[ch] == 0) {
+            continue;
+        }
+        if (home < 0 || plan->period_ms[ch] < plan->period_ms[home]) {
+            home = ch;
+        }
+    }
+
+    return home;
+}
+
+
+/**
+ * @brief Make every channel due right away, the first run pushes home.
+ *
+ * @param plan Scheduler state
+ * @param now_ms Current time
+ */
+void pyd1598_core_sched_start(struct pyd1598_core_sched *plan, int64_t now_ms)
+{
+    for (int ch = 0; ch < PYD1598_SCHED_CHANNELS; ch++) {
+        plan->next_ms[ch] = now_ms;
+    }
+    plan->current = -1;
+}
+
+
+/**
+ * @brief Check if the pushed signal source has settled and its sample is due.
+ *
+ * @param plan Scheduler state
+ * @param now_ms Current time
+ *
+ * @return True if a sample of the current channel should be taken.
+ */
+bool pyd1598_core_sched_sample_due(const struct pyd1598_core_sched *plan, int64_t now_ms)
+{
+    return plan->current >= 0 && now_ms >= plan->ready_ms && now_ms >= plan->next_ms[plan->current];
+}
+
+
+/**
+ * @brief Move the current channel to its next sample, samples that can not be caught
+ * up with are skipped instead of bursting.
+ *
+ * @param plan Scheduler state
+ * @param now_ms Current time
+ *
+ * @return True if samples were skipped.
+ */
+bool pyd1598_core_sched_sampled(struct pyd1598_core_sched *plan, int64_t now_ms)
+{
+    // Variables
+    int ch;
+
+    // Declare the variables
+    ch = plan->current;
+
+    plan->next_ms[ch] += plan->period_ms[ch];
+    if (plan->next_ms[ch] <= now_ms) {
+        plan->next_ms[ch] = now_ms + plan->period_ms[ch];
+        return true;
+    }
+
+    return false;
+}
+
+
+/**
+ * @brief Channel to push next: the most overdue other channel, or home once the visit
+ * is done. Never leaves a channel that is still settling for its due sample.
+ *
+ * @param plan Scheduler state
+ * @param now_ms Current time
+ *
+ * @return Channel to switch to, -1 to stay on the current one.
+ */
+int pyd1598_core_sched_next(const struct pyd1598_core_sched *plan, int64_t now_ms)
+{
+    // Variables
+    int home;
+    int next = -1;
+    int ch;
+
+    // Declare the variables
+    home = pyd1598_core_sched_home(plan);
+    ch = plan->current;
+
+    if (ch < 0) {
+        return home;
+    }
+    if (plan->next_ms[ch] <= now_ms) {
+        return -1;
+    }
+    for (int i = 0; i < PYD1598_SCHED_CHANNELS; i++) {
+        if (i == ch || plan->period_ms[i] == 0 || plan->next_ms[i] > now_ms) {
+            continue;
+        }
+        if (next < 0 || plan->next_ms[i] < plan->next_ms[next]) {
+            next = i;
+        }
+    }
+    if (next < 0 && ch != home) {
+        next = home;
+    }
+
+    return next;
+}
+
+
+/**
+ * @brief Record a successful push of a channel, its samples are valid after the settle time.
+ *
+ * @param plan Scheduler state
+ * @param ch Channel that was pushed
+ * @param now_ms Current time
+ * @param settle_ms Settle time of the sensor after a switch
+ */
+void pyd1598_core_sched_switched(struct pyd1598_core_sched *plan, int ch, int64_t now_ms, uint32_t settle_ms)
+{
+    plan->current = (int8_t)ch;
+    plan->ready_ms = now_ms + settle_ms;
+}
+
+
+/**
+ * @brief Time of the next run: when the current channel is due, or when another
+ * channel is due once the current one is served.
+ *
+ * @param plan Scheduler state
+ * @param now_ms Current time
+ * @param settle_ms Settle time of the sensor after a switch
+ *
+ * @return Time of the next run.
+ */
+int64_t pyd1598_core_sched_wake(const struct pyd1598_core_sched *plan, int64_t now_ms, uint32_t settle_ms)
+{
+    // Variables
+    int64_t wake_ms;
+    int ch;
+
+    // Declare the variables
+    ch = plan->current;
+
+    if (ch < 0) {
+        return now_ms + settle_ms;
+    }
+
+    wake_ms = (plan->next_ms[ch] > plan->ready_ms) ? plan->next_ms[ch] : plan->ready_ms;
+    if (plan->next_ms[ch] > now_ms) {
+        for (int i = 0; i < PYD1598_SCHED_CHANNELS; i++) {
+            if (i != ch && plan->period_ms[i] != 0 && plan->next_ms[i] < wake_ms) {
+                wake_ms = plan->next_ms[i];
+            }
+        }
+    }
+
+    return wake_ms;
+}
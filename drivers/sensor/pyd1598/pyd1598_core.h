@@ -0,0 +1,363 @@
+/*
+PYD1598 driver core, the hardware independent part of the driver.
+
+Register layout, field packing and the field descriptor table, readout decoding,
+configuration checks, the serial in spi waveform, varints, the batch encoder payload and
+the frame logger file, a model of the wake-up detection of the sensor, waveform correlation and the decisions
+of the measurement only readouts and the signal source scheduler. Nothing in here touches a pin, a clock or a kernel object, and the header
+and pyd1598_core.c only include the C library, so the core compiles with any host C
+compiler as well as with the driver.
+
+Not part of the public api, applications should include pyd1598.h.
+*/
+
+#ifndef ZEPHYR_DRIVERS_SENSOR_PYD1598_PYD1598_CORE_H_
+#define ZEPHYR_DRIVERS_SENSOR_PYD1598_PYD1598_CORE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Define macros for configuration
+#define PYD1598_THRESHOLD_SHIFT 17
+#define PYD1598_THRESHOLD_MASK ((uint32_t)0b11111111)
+
+#define PYD1598_BLIND_TIME_SHIFT 13
+#define PYD1598_BLIND_TIME_MASK ((uint32_t)0b1111)
+
+#define PYD1598_PULSE_COUNTER_SHIFT 11
+#define PYD1598_PULSE_COUNTER_MASK ((uint32_t)0b11)
+
+#define PYD1598_WINDOW_TIME_SHIFT 9
+#define PYD1598_WINDOW_TIME_MASK ((uint32_t)0b11)
+
+#define PYD1598_OPERATION_MODE_SHIFT 7
+#define PYD1598_OPERATION_MODE_MASK ((uint32_t)0b11)
+
+#define PYD1598_SIGNAL_SOURCE_SHIFT 5
+#define PYD1598_SIGNAL_SOURCE_MASK ((uint32_t)0b11)
+
+#define PYD1598_RESERVED_2_SHIFT 3
+#define PYD1598_RESERVED_2_MASK ((uint32_t)0b11)
+#define PYD1598_RESERVED_2_DEC_VALUE ((uint32_t)2)
+
+
+#define PYD1598_HPF_CUT_OFF_SHIFT 2
+#define PYD1598_HPF_CUT_OFF_MASK ((uint32_t)0b1)
+
+#define PYD1598_RESERVED_1_SHIFT 1
+#define PYD1598_RESERVED_1_MASK ((uint32_t)0b1)
+#define PYD1598_RESERVED_1_DEC_VALUE ((uint32_t)0)
+
+#define PYD1598_COUNT_MODE_SHIFT 0
+#define PYD1598_COUNT_MODE_MASK ((uint32_t)0b1)
+
+// Not allowed field values
+#define PYD1598_OPERATION_MODE_INVALID ((uint32_t)3)
+#define PYD1598_SIGNAL_SOURCE_INVALID ((uint32_t)2)
+
+// 25 configuration bits
+#define PYD1598_CONF_MASK ((uint32_t)0x1ffffff)
+
+// Define macros for measurement
+#define PYD1598_OUT_OF_RANGE_MASK ((uint32_t)0b1)
+#define PYD1598_OUT_OF_RANGE_SHIFT 14
+
+#define PYD1598_ADC_COUNTS_MASK ((uint32_t)0b11111111111111)
+#define PYD1598_ADC_COUNTS_SHIFT 0
+
+// Define macros for readout, 15 measurement bits followed by 25 configuration bits
+#define PYD1598_READOUT_BITS 40
+#define PYD1598_MEASUREMENT_BITS 15
+
+// Field of a configuration or measurement word, by name of its SHIFT/MASK pair
+#define PYD1598_FIELD_GET(word, name) (((uint32_t)(word) >> PYD1598_##name##_SHIFT) & PYD1598_##name##_MASK)
+
+// Word with one field replaced, the rest of the bits as they are
+#define PYD1598_FIELD_SET(word, name, value)                                                 \
+    (((uint32_t)(word) & ~(PYD1598_##name##_MASK << PYD1598_##name##_SHIFT)) |               \
+     (((uint32_t)(value) & PYD1598_##name##_MASK) << PYD1598_##name##_SHIFT))
+
+
+// Adc counts of a measurement, BPF counts are 14 bit two's complement
+static inline uint16_t pyd1598_adc_counts(uint32_t measurement)
+{
+    return (uint16_t)PYD1598_FIELD_GET(measurement, ADC_COUNTS);
+}
+
+static inline int16_t pyd1598_bpf_counts(uint32_t measurement)
+{
+    return (int16_t)((int32_t)((uint32_t)pyd1598_adc_counts(measurement) << 18) >> 18);
+}
+
+// Counts of a measurement of a signal source, signed for PIR BPF (signal source 0)
+static inline int16_t pyd1598_signal_counts(uint32_t measurement, uint32_t signal_source)
+{
+    return (signal_source == 0) ? pyd1598_bpf_counts(measurement) : (int16_t)pyd1598_adc_counts(measurement);
+}
+
+static inline bool pyd1598_out_of_range(uint32_t measurement)
+{
+    return (bool)PYD1598_FIELD_GET(measurement, OUT_OF_RANGE);
+}
+
+
+// Readout, raw holds the sampled bits in order, the first one most significant
+void pyd1598_core_decode_readout(uint64_t raw, int bits, uint32_t *measurement, uint32_t *sensor_conf);
+
+// Configuration words
+uint32_t pyd1598_core_conf_default(void);
+uint32_t pyd1598_core_conf_reserved(uint32_t sensor_conf);
+int pyd1598_core_conf_validate(uint32_t sensor_conf);
+
+
+// Settable configuration fields, one descriptor each, for the table driven accessors
+enum pyd1598_core_field {
+    PYD1598_CORE_THRESHOLD = 0,
+    PYD1598_CORE_BLIND_TIME,
+    PYD1598_CORE_PULSE_COUNTER,
+    PYD1598_CORE_WINDOW_TIME,
+    PYD1598_CORE_OPERATION_MODE,
+    PYD1598_CORE_SIGNAL_SOURCE,
+    PYD1598_CORE_HPF_CUT_OFF,
+    PYD1598_CORE_COUNT_MODE,
+    PYD1598_CORE_FIELDS,
+};
+
+struct pyd1598_core_field_desc {
+    uint8_t shift;
+    uint8_t mask;
+    uint8_t invalid; // Not allowed value, 0 if every value fits, 0 is always allowed
+};
+
+extern const struct pyd1598_core_field_desc pyd1598_core_fields[PYD1598_CORE_FIELDS];
+
+int pyd1598_core_field_set(uint32_t *sensor_conf, enum pyd1598_core_field field, uint32_t value);
+int pyd1598_core_field_get(uint32_t sensor_conf, enum pyd1598_core_field field, uint32_t *value);
+
+
+// Csv captures, time in seconds
+#define PYD1598_NSEC_PER_SEC 1000000000LL
+
+const char *pyd1598_core_parse_seconds(const char *str, int64_t *time_ns);
+
+
+// Serial in as an spi waveform on MOSI, one spi bit per 200 - 2000 ns pulse, same margins
+// as the bit banged push: per bit 0 1 d d d ... d for 96 us, then 0 for the 780 us latch.
+// The clock range keeps a pulse at 250 - 1667 ns, off the datasheet limits by more than
+// the clock tolerance of a controller
+#define PYD1598_SPI_SLOT_US 96
+#define PYD1598_SPI_LATCH_US 780
+#define PYD1598_SPI_PUSH_BITS 25
+#define PYD1598_SPI_FREQUENCY_MIN 600000
+#define PYD1598_SPI_FREQUENCY_MAX 4000000
+
+size_t pyd1598_core_spi_waveform_len(uint32_t frequency);
+size_t pyd1598_core_spi_waveform(uint8_t *out, size_t size, uint32_t frequency, uint32_t sensor_conf);
+int pyd1598_core_spi_decode(const uint8_t *in, size_t len, uint32_t frequency, uint32_t *sensor_conf);
+
+
+// Variable length integers of the logger, the batch encoder and replay. Unsigned values
+// are LEB128, 7 bits per byte with the high bit set on all but the last byte. Signed
+// values are zigzag mapped first so small negative deltas stay short.
+#define PYD1598_VARINT32_MAX 5
+#define PYD1598_VARINT64_MAX 10
+
+static inline size_t pyd1598_put_varint(uint8_t *buf, uint64_t value)
+{
+    size_t len = 0;
+    uint8_t byte;
+
+    do {
+        byte = (uint8_t)(value & 0x7f);
+        value >>= 7;
+        if (value != 0) {
+            byte |= 0x80;
+        }
+        buf[len++] = byte;
+    } while (value != 0);
+
+    return len;
+}
+
+static inline uint64_t pyd1598_zigzag(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline size_t pyd1598_put_svarint(uint8_t *buf, int64_t value)
+{
+    return pyd1598_put_varint(buf, pyd1598_zigzag(value));
+}
+
+// Bytes read, 0 if buf ends before the last byte or the value does not fit
+static inline size_t pyd1598_get_varint(const uint8_t *buf, size_t len, uint64_t *value)
+{
+    uint64_t result = 0;
+
+    for (size_t i = 0; i < len && i < PYD1598_VARINT64_MAX; i++) {
+        result |= (uint64_t)(buf[i] & 0x7f) << (7 * i);
+        if ((buf[i] & 0x80) == 0) {
+            *value = result;
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+
+// Batch encoder payload, a CBOR map with unsigned keys:
+//   0: version, 1: base timestamp us, 2: number of frames and triggers,
+//   3: length of the record stream, only present when 4 is compressed,
+//   4: record stream as byte string, raw or compressed
+// Records of the stream, tag = type << 6 | instance:
+//   frame    zigzag varint change of the frame period us, zigzag varint measurement delta
+//   config   varint sensor_conf
+//   trigger  zigzag varint timestamp delta us
+#define PYD1598_ENCODER_VERSION 1
+
+#define PYD1598_ENCODER_TYPE_FRAME 0
+#define PYD1598_ENCODER_TYPE_CONFIG 1
+#define PYD1598_ENCODER_TYPE_TRIGGER 2
+#define PYD1598_ENCODER_TAG(type, instance) ((uint8_t)(((type) << 6) | (instance)))
+
+// Worst case for one frame: config record, frame record with a 64 bit timestamp delta
+#define PYD1598_ENCODER_RECORD_MAX ((1 + PYD1598_VARINT32_MAX) + (1 + PYD1598_VARINT64_MAX + PYD1598_VARINT32_MAX))
+
+// Worst case CBOR map header: map head and five key/value heads
+#define PYD1598_ENCODER_HEADER_MAX (1 + 5 + (1 + 9) + (1 + 9) + (1 + 9) + (1 + 9))
+
+#define PYD1598_CBOR_MAJOR_UINT 0
+#define PYD1598_CBOR_MAJOR_BSTR 2
+#define PYD1598_CBOR_MAJOR_MAP 5
+
+// Compresses len bytes of src into dst, the compressed length or 0 if it does not fit in size
+typedef size_t (*pyd1598_core_compress_t)(const uint8_t *src, size_t len, uint8_t *dst, size_t size);
+
+size_t pyd1598_core_cbor_head(uint8_t *buf, uint8_t major, uint64_t value);
+size_t pyd1598_core_encode_config(uint8_t *out, uint8_t instance, uint32_t sensor_conf);
+size_t pyd1598_core_encode_frame(uint8_t *out, uint8_t instance, int64_t period_change_us, int64_t measurement_delta);
+size_t pyd1598_core_encode_trigger(uint8_t *out, uint8_t instance, int64_t delta_us);
+int pyd1598_core_encode_payload(uint8_t *out, size_t out_size, int64_t base_timestamp_us, uint32_t count,
+                                const uint8_t *stream, size_t stream_len, pyd1598_core_compress_t compress,
+                                size_t *out_len);
+
+
+// Frame logger file, written by the logger and read by replay, a sequence of blocks:
+//   block header  'P' 'Y' version reserved(0) sequence(u32 le)
+//   records       tag = type << 6 | instance (instance 0-62, 63 is reserved for padding)
+//     frame       varint delta timestamp us, measurement u16 le
+//     config      sensor_conf u32 le
+//     time        absolute timestamp us u64 le
+//   padding       0xff until the end of the block
+// The first record of an instance in a block is a time record followed by a config
+// record, so every block is self contained.
+#define PYD1598_LOG_VERSION 1
+#define PYD1598_LOG_HEADER_SIZE 8
+#define PYD1598_LOG_PAD 0xff
+#define PYD1598_LOG_INSTANCES 63
+
+#define PYD1598_LOG_TYPE_FRAME 0
+#define PYD1598_LOG_TYPE_CONFIG 1
+#define PYD1598_LOG_TYPE_TIME 2
+#define PYD1598_LOG_TAG(type, instance) ((uint8_t)(((type) << 6) | (instance)))
+
+// Worst case for one frame: time record, config record, frame record with a 5 byte varint
+#define PYD1598_LOG_RECORD_MAX ((1 + 8) + (1 + 4) + (1 + PYD1598_VARINT32_MAX + 2))
+
+// Delta state of an instance in the block being written
+struct pyd1598_core_log_instance {
+    int64_t last_timestamp_us;
+    uint32_t last_conf;
+    bool in_block; // Has a time record in the block
+};
+
+// Frames of one instance read back from a block
+struct pyd1598_core_log_reader {
+    const uint8_t *block;
+    size_t len;
+    size_t pos;
+    int instance;
+    int64_t timestamp_us;
+    uint32_t sensor_conf;
+    bool based; // A time record of the instance was read
+};
+
+size_t pyd1598_core_log_begin(uint8_t *block, uint32_t sequence);
+size_t pyd1598_core_log_frame(uint8_t *out, struct pyd1598_core_log_instance *state, uint8_t instance,
+                              int64_t timestamp_us, uint32_t sensor_conf, uint16_t measurement);
+int pyd1598_core_log_open(struct pyd1598_core_log_reader *rd, const uint8_t *block, size_t len, int instance);
+int pyd1598_core_log_next(struct pyd1598_core_log_reader *rd, int64_t *timestamp_us, uint32_t *sensor_conf,
+                          uint16_t *measurement);
+
+
+// Measurement only readouts, left counts the readouts before the next full one
+static inline bool pyd1598_core_partial_take(uint16_t *left)
+{
+    if (*left == 0) {
+        return false;
+    }
+    (*left)--;
+    return true;
+}
+
+
+// Wake-up detection as the sensor runs it on the PIR BPF signal: a pulse is counted when
+// the signal rises above +- threshold, 1 + pulse_counter pulses within the window time
+// are a trigger, and pulses are ignored for the blind time after a trigger
+struct pyd1598_core_detect {
+    uint32_t threshold;
+    int64_t window_us; // 2 s + 2 s * window_time
+    int64_t blind_us; // 0.5 s + 0.5 s * blind_time
+    uint8_t pulses_needed; // 1 + pulse_counter
+    bool sign_change; // Count mode 0, only pulses of the other sign are counted
+    uint8_t pulses; // Counted in the running window
+    int8_t last_sign; // Sign of the last counted pulse, 0 before the first
+    bool above; // Signal above the threshold at the last sample
+    int64_t window_start_us; // First counted pulse of the running window
+    int64_t blind_end_us; // Pulses before this time are ignored
+    uint32_t latency_us; // First counted pulse to the last trigger
+    uint32_t counted; // Pulses counted since init
+};
+
+void pyd1598_core_detect_init(struct pyd1598_core_detect *det, uint32_t sensor_conf);
+bool pyd1598_core_detect_sample(struct pyd1598_core_detect *det, int64_t timestamp_us, int16_t bpf);
+
+
+// Waveform comparison of two sensors, fixed point
+uint32_t pyd1598_core_isqrt64(uint64_t value);
+int32_t pyd1598_core_xcorr(const int16_t *a, const int16_t *b, int len, int max_lag, int *lag);
+
+
+// Signal source scheduler, one channel per allowed signal source: PIR BPF, PIR LPF, temperature
+#define PYD1598_SCHED_CHANNELS 3
+
+struct pyd1598_core_sched {
+    uint32_t period_ms[PYD1598_SCHED_CHANNELS]; // 0 for channels not sampled
+    int64_t next_ms[PYD1598_SCHED_CHANNELS]; // Time when the next sample is due
+    int64_t ready_ms; // Time when the pushed signal source has settled
+    int8_t current; // Channel of the pushed signal source, -1 before the first push
+};
+
+int pyd1598_core_sched_channel(uint32_t signal_source);
+uint32_t pyd1598_core_sched_source(int ch);
+int pyd1598_core_sched_home(const struct pyd1598_core_sched *plan);
+void pyd1598_core_sched_start(struct pyd1598_core_sched *plan, int64_t now_ms);
+bool pyd1598_core_sched_sample_due(const struct pyd1598_core_sched *plan, int64_t now_ms);
+bool pyd1598_core_sched_sampled(struct pyd1598_core_sched *plan, int64_t now_ms);
+int pyd1598_core_sched_next(const struct pyd1598_core_sched *plan, int64_t now_ms);
+void pyd1598_core_sched_switched(struct pyd1598_core_sched *plan, int ch, int64_t now_ms, uint32_t settle_ms);
+int64_t pyd1598_core_sched_wake(const struct pyd1598_core_sched *plan, int64_t now_ms, uint32_t settle_ms);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZEPHYR_DRIVERS_SENSOR_PYD1598_PYD1598_CORE_H_ */
@@ -0,0 +1,326 @@
+/*
+PYD1598 sensor emulator on gpio_emul
+
+On native_sim the pins of every instance are emulated gpio pins with nothing behind
+them, a readout samples whatever the input happens to be and the configuration check
+fails. The emulator answers the host like a sensor, from the pin actions the
+transactions already report to the timing recorder, so pushes, fetches, interrupt and
+synchronized readouts run their success path:
+
+  push      the serial in levels are collected, every bit is a low and a high pulse
+            and then its value, the 25 bit word is latched when serial in is released
+  readout   direct link driven low and then high starts a readout. Every release
+            after a high level puts the next bit of measurement and latched
+            configuration on the input of the pin, most significant first. A release
+            after a low level ends the transaction, direct link reads low again
+  trigger   pyd1598_emul_trigger() raises the input of direct link, like a wake-up
+            trigger or an interrupt readout sample that is ready
+  spi push  an excelitas,pyd1598-serial-in-emul node on a zephyr,spi-emul-controller
+            bus decodes the MOSI bytes of a push through the spi backend with
+            pyd1598_core_spi_decode() and latches the word of the sensor it points
+            to. Any other byte pattern fails the transfer with -EIO
+
+The measurement is set with pyd1598_emul_set_measurement(), it is 0 until then. Levels
+are physical, the pins must be active high.
+*/
+
+#define DT_DRV_COMPAT excelitas_pyd1598
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/gpio/gpio_emul.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/drivers/spi.h>
+#include <zephyr/drivers/spi_emul.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/kernel.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pyd1598.h>
+#include "pyd1598_internal.h"
+
+LOG_MODULE_DECLARE(PYD1598, PYD1598_LOG_LEVEL);
+
+
+#define PYD1598_EMUL_INSTANCES DT_NUM_INST_STATUS_OKAY(DT_DRV_COMPAT)
+#define PYD1598_EMUL_PUSH_BITS 25
+
+// Direct link level last driven by the host
+#define PYD1598_EMUL_RELEASED 0xFF
+
+struct emul_sensor {
+    uint32_t sensor_conf; // Latched by the last push
+    uint32_t shift; // Serial in bits of the running push
+    uint8_t serial_in_levels; // Serial in levels since the push started
+    uint8_t push_bits; // Bits of the running push
+    uint16_t measurement;
+    uint64_t readout; // Word of the running readout, measurement first
+    uint8_t readout_bit; // Next bit of the readout
+    bool readout_active;
+    uint8_t direct_link; // Last level driven, PYD1598_EMUL_RELEASED while the sensor has the line
+};
+
+static struct emul_sensor emul_sensors[PYD1598_EMUL_INSTANCES];
+
+
+// Serial in, the initial low and then a low, high and value level per bit
+static void emul_serial_in(struct emul_sensor *sensor, uint8_t action, uint8_t level)
+{
+    if (action == PYD1598_TIMING_RELEASE) {
+        if (sensor->push_bits == PYD1598_EMUL_PUSH_BITS) {
+            sensor->sensor_conf = sensor->shift;
+        }
+        sensor->serial_in_levels = 0;
+        sensor->push_bits = 0;
+        sensor->shift = 0;
+        return;
+    }
+    if (action != PYD1598_TIMING_LEVEL) {
+        return;
+    }
+
+    sensor->serial_in_levels++;
+    if (sensor->serial_in_levels > 1 && (sensor->serial_in_levels - 1) % 3 == 0 &&
+        sensor->push_bits < PYD1598_EMUL_PUSH_BITS) {
+        sensor->shift = (sensor->shift << 1) | (level & 1U);
+        sensor->push_bits++;
+    }
+}
+
+
+// Direct link, readout start, bit releases and the end of the transaction
+static void emul_direct_link(const struct pyd1598_config *cfg, struct emul_sensor *sensor, uint8_t action, uint8_t level)
+{
+    // Variables
+    uint32_t bit;
+
+    switch (action) {
+    case PYD1598_TIMING_LEVEL:
+        if (!sensor->readout_active && sensor->direct_link == 0 && level == 1) {
+            sensor->readout_active = true;
+            sensor->readout_bit = 0;
+            sensor->readout = ((uint64_t)sensor->measurement << (PYD1598_READOUT_BITS - PYD1598_MEASUREMENT_BITS)) |
+                              sensor->sensor_conf;
+        }
+        sensor->direct_link = level;
+        break;
+
+    case PYD1598_TIMING_RELEASE:
+        if (sensor->readout_active && sensor->direct_link == 1) {
+            bit = 0;
+            if (sensor->readout_bit < PYD1598_READOUT_BITS) {
+                bit = (uint32_t)(sensor->readout >> (PYD1598_READOUT_BITS - 1 - sensor->readout_bit)) & 1U;
+                sensor->readout_bit++;
+            }
+            gpio_emul_input_set(cfg->direct_link.port, cfg->direct_link.pin, (int)bit);
+        }
+        else {
+            sensor->readout_active = false;
+            gpio_emul_input_set(cfg->direct_link.port, cfg->direct_link.pin, 0);
+        }
+        sensor->direct_link = PYD1598_EMUL_RELEASED;
+        break;
+
+    default:
+        break;
+    }
+}
+
+
+/**
+ * @brief Answer a pin action of the host like the sensor would, called with every
+ * timing mark, also with irq locked and from interrupts.
+ *
+ * @param cfg Configuration of the sensor device
+ * @param line PYD1598_TIMING_SERIAL_IN or PYD1598_TIMING_DIRECT_LINK
+ * @param action PYD1598_TIMING_LEVEL, PYD1598_TIMING_RELEASE or PYD1598_TIMING_SAMPLE
+ * @param level Level driven or sampled
+ */
+void pyd1598_emul_pin(const struct pyd1598_config *cfg, uint8_t line, uint8_t action, uint8_t level)
+{
+    // Variables
+    struct emul_sensor *sensor;
+
+    // Declare the variables
+    sensor = &emul_sensors[cfg->instance];
+
+    if (line == PYD1598_TIMING_SERIAL_IN) {
+        emul_serial_in(sensor, action, level);
+    }
+    else {
+        emul_direct_link(cfg, sensor, action, level);
+    }
+}
+
+
+#if defined(CONFIG_SPI_EMUL) && DT_HAS_COMPAT_STATUS_OKAY(excelitas_pyd1598_serial_in_emul)
+struct emul_serial_in_config {
+    const struct device *sensor; // Instance whose serial in is the MOSI line
+};
+
+
+// Spi push, the MOSI bytes of one transfer are a whole push
+static int emul_serial_in_io(const struct emul *target, const struct spi_config *config,
+                             const struct spi_buf_set *tx_bufs, const struct spi_buf_set *rx_bufs)
+{
+    // Variables
+    const struct emul_serial_in_config *emul_cfg;
+    const struct pyd1598_config *cfg;
+    uint32_t sensor_conf;
+    int key;
+    int ret;
+
+    // Declare the variables
+    ARG_UNUSED(rx_bufs);
+    emul_cfg = target->cfg;
+    cfg = emul_cfg->sensor->config;
+
+    if (tx_bufs == NULL || tx_bufs->count != 1) {
+        return -EINVAL;
+    }
+
+    ret = pyd1598_core_spi_decode(tx_bufs->buffers[0].buf, tx_bufs->buffers[0].len, config->frequency,
+                                  &sensor_conf);
+    if (ret != 0) {
+        LOG_ERR("%s: serial in waveform not accepted: %d", emul_cfg->sensor->name, ret);
+        return ret;
+    }
+
+    key = irq_lock();
+    emul_sensors[cfg->instance].sensor_conf = sensor_conf;
+    irq_unlock(key);
+
+    return 0;
+}
+
+
+static int emul_serial_in_init(const struct emul *target, const struct device *parent)
+{
+    ARG_UNUSED(target);
+    ARG_UNUSED(parent);
+
+    return 0;
+}
+
+
+static const struct spi_emul_api emul_serial_in_api = {
+    .io = emul_serial_in_io,
+};
+
+
+#define PYD1598_EMUL_SERIAL_IN_DEFINE(node_id)                                                      \
+    static const struct emul_serial_in_config _CONCAT(emul_serial_in_config_, DT_DEP_ORD(node_id)) = { \
+        .sensor = DEVICE_DT_GET(DT_PHANDLE(node_id, sensor)),                                       \
+    };                                                                                              \
+    DEVICE_DT_DEFINE(node_id, NULL, NULL, NULL, NULL, POST_KERNEL, CONFIG_SPI_INIT_PRIORITY, NULL); \
+    EMUL_DT_DEFINE(node_id, emul_serial_in_init, NULL, &_CONCAT(emul_serial_in_config_, DT_DEP_ORD(node_id)), \
+                   &emul_serial_in_api, NULL);
+
+DT_FOREACH_STATUS_OKAY(excelitas_pyd1598_serial_in_emul, PYD1598_EMUL_SERIAL_IN_DEFINE)
+#endif
+
+
+int pyd1598_emul_init(const struct device *dev)
+{
+    // Variables
+    const struct pyd1598_config *cfg;
+
+    // Declare the variables
+    cfg = dev->config;
+    emul_sensors[cfg->instance] = (struct emul_sensor){
+        .direct_link = PYD1598_EMUL_RELEASED,
+    };
+
+    return 0;
+}
+
+
+/**
+ * @brief Set the measurement the emulated sensor returns from the next readout on.
+ *
+ * @param dev Pointer to the sensor device
+ * @param measurement 15 bit measurement
+ *
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_emul_set_measurement(const struct device *dev, uint16_t measurement)
+{
+    // Variables
+    const struct pyd1598_config *cfg;
+    int key;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_emul_set_measurement");
+    if (dev == NULL || dev->config == NULL || measurement >= BIT(PYD1598_MEASUREMENT_BITS)) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    cfg = dev->config;
+
+    key = irq_lock();
+    emul_sensors[cfg->instance].measurement = measurement;
+    irq_unlock(key);
+
+    return 0;
+}
+
+
+/**
+ * @brief Get the configuration the emulated sensor latched from the last push.
+ *
+ * @param dev Pointer to the sensor device
+ * @param sensor_conf Pointer to where the configuration should be stored
+ *
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_emul_get_conf(const struct device *dev, uint32_t *sensor_conf)
+{
+    // Variables
+    const struct pyd1598_config *cfg;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_emul_get_conf");
+    if (dev == NULL || dev->config == NULL || sensor_conf == NULL) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    cfg = dev->config;
+    *sensor_conf = emul_sensors[cfg->instance].sensor_conf;
+
+    return 0;
+}
+
+
+/**
+ * @brief Raise direct link like the sensor does on a wake-up trigger or a ready sample.
+ *
+ * The interrupt of the pin fires if it is enabled, the next transaction resets the line.
+ *
+ * @param dev Pointer to the sensor device
+ *
+ * @return 0 if successful, -EBUSY while the host drives direct link, negative errno code if failure.
+ */
+int pyd1598_emul_trigger(const struct device *dev)
+{
+    // Variables
+    const struct pyd1598_config *cfg;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_emul_trigger");
+    if (dev == NULL || dev->config == NULL) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    cfg = dev->config;
+
+    if (emul_sensors[cfg->instance].direct_link != PYD1598_EMUL_RELEASED) {
+        return -EBUSY;
+    }
+
+    return gpio_emul_input_set(cfg->direct_link.port, cfg->direct_link.pin, 1);
+}
@@ -0,0 +1,187 @@
+/*
+PYD1598 binary batch encoder for uplink payloads
+
+Frames and wake-up triggers of several instances are collected into a record stream,
+pyd1598_encoder_finish() wraps the stream into a small CBOR map and optionally LZ4
+compresses it. The record and payload layout and their encoding are in the driver
+core, this file keeps the per instance state the deltas are taken against.
+
+All timestamps of an instance are relative to its previous frame, or to the batch base
+timestamp before its first frame. Frames store how much the period since the previous
+frame differs from the period before it, so a steady stream costs one byte of time
+per frame. Measurement deltas are taken to the previous frame of the same instance,
+or to 0 for its first frame. A config record precedes the first frame of an instance
+and is repeated only when the config changes.
+*/
+
+#include <zephyr/kernel.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pyd1598.h>
+#include "pyd1598_core.h"
+#ifdef CONFIG_PYD1598_ENCODER_LZ4
+#include <lz4.h>
+#endif
+
+
+#ifdef CONFIG_PYD1598_ENCODER_LZ4
+// One LZ4 block
+static size_t pyd1598_encoder_lz4(const uint8_t *src, size_t len, uint8_t *dst, size_t size)
+{
+    int lz4_len = LZ4_compress_default((const char *)src, (char *)dst, (int)len, (int)size);
+
+    return lz4_len > 0 ? (size_t)lz4_len : 0;
+}
+#endif
+
+
+/**
+ * @brief Start an empty batch.
+ *
+ * @param enc Encoder state
+ * @param buf Buffer for the record stream
+ * @param size Size of buf
+ *
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_encoder_init(struct pyd1598_encoder *enc, uint8_t *buf, size_t size)
+{
+    if (enc == NULL || buf == NULL || size < PYD1598_ENCODER_RECORD_MAX) {
+        return -EINVAL;
+    }
+
+    memset(enc, 0, sizeof(*enc));
+    enc->buf = buf;
+    enc->size = size;
+
+    return 0;
+}
+
+
+// Time since the previous frame of the instance, the first record of the batch sets the base
+static int64_t pyd1598_encoder_delta(struct pyd1598_encoder *enc, uint8_t instance, int64_t timestamp_us)
+{
+    if (enc->count == 0) {
+        enc->base_timestamp_us = timestamp_us;
+    }
+    if ((enc->seen & BIT(instance)) == 0) {
+        enc->last_timestamp_us[instance] = enc->base_timestamp_us;
+        enc->last_period_us[instance] = 0;
+        enc->seen |= BIT(instance);
+    }
+
+    return timestamp_us - enc->last_timestamp_us[instance];
+}
+
+
+/**
+ * @brief Add a frame to the batch.
+ *
+ * @param enc Encoder state
+ * @param instance Sensor instance, below CONFIG_PYD1598_ENCODER_MAX_INSTANCES
+ * @param frame Frame to add
+ *
+ * @return 0 if successful, -ENOMEM if the batch is full, negative errno code if failure.
+ */
+int pyd1598_encoder_add_frame(struct pyd1598_encoder *enc, uint8_t instance, const struct pyd1598_frame *frame)
+{
+    uint8_t *out;
+    int64_t period_us;
+    int64_t measurement_delta;
+
+    if (enc == NULL || frame == NULL || instance >= CONFIG_PYD1598_ENCODER_MAX_INSTANCES) {
+        return -EINVAL;
+    }
+    if (enc->size - enc->len < PYD1598_ENCODER_RECORD_MAX) {
+        return -ENOMEM;
+    }
+
+    out = &enc->buf[enc->len];
+
+    if ((enc->has_conf & BIT(instance)) == 0 || enc->last_conf[instance] != frame->sensor_conf) {
+        out += pyd1598_core_encode_config(out, instance, frame->sensor_conf);
+        enc->last_conf[instance] = frame->sensor_conf;
+        enc->has_conf |= BIT(instance);
+    }
+
+    period_us = pyd1598_encoder_delta(enc, instance, frame->timestamp_us);
+    measurement_delta = (int64_t)frame->measurement - (int64_t)enc->last_measurement[instance];
+
+    out += pyd1598_core_encode_frame(out, instance, period_us - enc->last_period_us[instance], measurement_delta);
+
+    enc->last_timestamp_us[instance] = frame->timestamp_us;
+    enc->last_period_us[instance] = period_us;
+    enc->last_measurement[instance] = frame->measurement;
+    enc->len = (size_t)(out - enc->buf);
+    enc->count++;
+
+    return 0;
+}
+
+
+/**
+ * @brief Add a wake-up trigger to the batch.
+ *
+ * @param enc Encoder state
+ * @param instance Sensor instance, below CONFIG_PYD1598_ENCODER_MAX_INSTANCES
+ * @param timestamp_us Uptime in us of the trigger
+ *
+ * @return 0 if successful, -ENOMEM if the batch is full, negative errno code if failure.
+ */
+int pyd1598_encoder_add_trigger(struct pyd1598_encoder *enc, uint8_t instance, int64_t timestamp_us)
+{
+    uint8_t *out;
+
+    if (enc == NULL || instance >= CONFIG_PYD1598_ENCODER_MAX_INSTANCES) {
+        return -EINVAL;
+    }
+    if (enc->size - enc->len < PYD1598_ENCODER_RECORD_MAX) {
+        return -ENOMEM;
+    }
+
+    out = &enc->buf[enc->len];
+    out += pyd1598_core_encode_trigger(out, instance, pyd1598_encoder_delta(enc, instance, timestamp_us));
+
+    enc->len = (size_t)(out - enc->buf);
+    enc->count++;
+
+    return 0;
+}
+
+
+/**
+ * @brief Write the batch as one payload and start a new empty batch.
+ *
+ * With CONFIG_PYD1598_ENCODER_LZ4 the record stream is compressed when that makes
+ * the payload smaller.
+ *
+ * @param enc Encoder state
+ * @param out Buffer for the payload
+ * @param out_size Size of out
+ * @param out_len Pointer to where the payload length should be stored
+ *
+ * @return 0 if successful, -ENOMEM if out is too small, negative errno code if failure.
+ */
+int pyd1598_encoder_finish(struct pyd1598_encoder *enc, uint8_t *out, size_t out_size, size_t *out_len)
+{
+    pyd1598_core_compress_t compress = NULL;
+    int ret;
+
+    if (enc == NULL || out == NULL || out_len == NULL) {
+        return -EINVAL;
+    }
+
+#ifdef CONFIG_PYD1598_ENCODER_LZ4
+    compress = pyd1598_encoder_lz4;
+#endif
+
+    ret = pyd1598_core_encode_payload(out, out_size, enc->base_timestamp_us, enc->count, enc->buf, enc->len,
+                                      compress, out_len);
+    if (ret != 0) {
+        return ret;
+    }
+
+    return pyd1598_encoder_init(enc, enc->buf, enc->size);
+}
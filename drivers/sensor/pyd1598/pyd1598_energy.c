@@ -0,0 +1,189 @@
+/*
+PYD1598 energy accounting
+
+Every push, fetch, interrupt readout and synchronized readout reports a span, cycles of
+k_cycle_get_32 taken next to the pin actions it already does:
+
+  active       the transaction from its start to the end of the readout or the latch,
+               the CPU is running, most of it in busy waits
+  irq locked   part of active with interrupts locked, the gpio backend locks them for
+               the whole push, a fetch for the whole readout
+  serial in    the 25 bit slots and the latch time
+  direct link  driven by the host, the start pulse and the hold time after a readout,
+               the pulses of the readout bits are too short to count, the hold time of
+               interrupt readout and synchronized sampling is timed, not measured
+
+A synchronized readout clocks the whole group at once, its active and irq locked
+cycles are shared out over the members.
+
+The currents belong to the board, not to a sensor, and are set once in its Kconfig
+fragment: CONFIG_PYD1598_ENERGY_CPU_ACTIVE_UA while the CPU runs for the driver and
+CONFIG_PYD1598_ENERGY_PIN_DRIVE_UA into a driven line. Charge is kept in time and
+converted on read:
+
+  charge nAh  = (active us * cpu uA + (serial in us + direct link us) * pin uA) / 3600000
+  per hour    = charge nAh * 3600 s / elapsed time, the average current in nA
+
+so the cost of a sample rate, a mode or a push frequency can be read off one number.
+The sleep current of the board and the supply current of the sensor do not depend on
+the driver and are not included.
+*/
+
+#include <zephyr/device.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/kernel.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pyd1598.h>
+#include "pyd1598_internal.h"
+
+LOG_MODULE_DECLARE(PYD1598, PYD1598_LOG_LEVEL);
+
+
+// us * uA per nAh
+#define PYD1598_ENERGY_US_UA_PER_NAH 3600000ULL
+
+
+int pyd1598_energy_init(const struct device *dev)
+{
+    // Variables
+    struct pyd1598_data *data;
+
+    // Declare the variables
+    data = dev->data;
+    memset(&data->energy, 0, sizeof(data->energy));
+    data->energy.since_ms = k_uptime_get();
+
+    return 0;
+}
+
+
+/**
+ * @brief Add the span of a transaction to the counters of the device, any context.
+ *
+ * @param dev Pointer to the sensor device
+ * @param kind PYD1598_ENERGY_PUSH, PYD1598_ENERGY_FETCH or PYD1598_ENERGY_READOUT
+ * @param span Cycles of the transaction
+ */
+void pyd1598_energy_account(const struct device *dev, uint8_t kind, const struct pyd1598_energy_span *span)
+{
+    // Variables
+    struct pyd1598_data *data;
+    struct pyd1598_energy *energy;
+    k_spinlock_key_t key;
+
+    // Declare the variables
+    data = dev->data;
+    energy = &data->energy;
+
+    key = k_spin_lock(&energy->lock);
+    switch (kind) {
+    case PYD1598_ENERGY_PUSH:
+        energy->pushes++;
+        break;
+    case PYD1598_ENERGY_FETCH:
+        energy->fetches++;
+        break;
+    default:
+        energy->readouts++;
+        break;
+    }
+    energy->active_cycles += span->active;
+    energy->irq_locked_cycles += span->irq_locked;
+    energy->serial_in_cycles += span->serial_in;
+    energy->direct_link_cycles += span->direct_link;
+    k_spin_unlock(&energy->lock, key);
+}
+
+
+/**
+ * @brief Get the energy counters of the sensor since init or the last reset.
+ *
+ * @param dev Pointer to the sensor device
+ * @param stats Pointer to where the counters and the charge estimate should be stored
+ *
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_energy_get(const struct device *dev, struct pyd1598_energy_stats *stats)
+{
+    // Variables
+    struct pyd1598_data *data;
+    struct pyd1598_energy energy;
+    k_spinlock_key_t key;
+    int64_t elapsed_ms;
+    uint64_t us_ua;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_energy_get");
+    if (dev == NULL || dev->data == NULL || stats == NULL) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+
+    key = k_spin_lock(&data->energy.lock);
+    energy = data->energy;
+    k_spin_unlock(&data->energy.lock, key);
+
+    stats->pushes = energy.pushes;
+    stats->fetches = energy.fetches;
+    stats->readouts = energy.readouts;
+    stats->active_us = k_cyc_to_us_floor64(energy.active_cycles);
+    stats->irq_locked_us = k_cyc_to_us_floor64(energy.irq_locked_cycles);
+    stats->serial_in_us = k_cyc_to_us_floor64(energy.serial_in_cycles);
+    stats->direct_link_us = k_cyc_to_us_floor64(energy.direct_link_cycles);
+
+    elapsed_ms = k_uptime_get() - energy.since_ms;
+    stats->elapsed_ms = (uint32_t)MIN(elapsed_ms, UINT32_MAX);
+
+    us_ua = stats->active_us * CONFIG_PYD1598_ENERGY_CPU_ACTIVE_UA +
+            (stats->serial_in_us + stats->direct_link_us) * CONFIG_PYD1598_ENERGY_PIN_DRIVE_UA;
+    stats->charge_nah = us_ua / PYD1598_ENERGY_US_UA_PER_NAH;
+
+    // nAh per hour is the average current in nA, us * uA / ms
+    stats->nah_per_hour = (elapsed_ms > 0) ? (uint32_t)MIN(us_ua / (uint64_t)elapsed_ms, UINT32_MAX) : 0;
+
+    return 0;
+}
+
+
+/**
+ * @brief Clear the energy counters of the sensor and start a new accounting period.
+ *
+ * @param dev Pointer to the sensor device
+ *
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_energy_reset(const struct device *dev)
+{
+    // Variables
+    struct pyd1598_data *data;
+    struct pyd1598_energy *energy;
+    k_spinlock_key_t key;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_energy_reset");
+    if (dev == NULL || dev->data == NULL) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+    energy = &data->energy;
+
+    key = k_spin_lock(&energy->lock);
+    energy->pushes = 0;
+    energy->fetches = 0;
+    energy->readouts = 0;
+    energy->active_cycles = 0;
+    energy->irq_locked_cycles = 0;
+    energy->serial_in_cycles = 0;
+    energy->direct_link_cycles = 0;
+    energy->since_ms = k_uptime_get();
+    k_spin_unlock(&energy->lock, key);
+
+    return 0;
+}
@@ -0,0 +1,190 @@
+/*
+PYD1598 compile time specialized pin access
+
+pyd1598_readout_bits() and the gpio push take the pins from the gpio_dt_spec of the
+config, every edge is a call into the GPIO driver API that looks up the port, applies
+the flags and configures the pin. The 200 ns - 2000 ns pulses are whatever that
+overhead happens to be. With CONFIG_PYD1598_FAST_GPIO a readout and a push routine is
+generated for every instance from the devicetree, port register addresses and pin
+masks are constants, the pin actions are single stores:
+
+  drive low   OUTCLR then DIRSET, the output latch is low before the pin is driven
+  high, low   OUTSET, OUTCLR
+  release     DIRCLR, the input buffer stays connected
+  sample      a load of IN
+
+The pulses are PYD1598_FAST_PULSE_NS of straight nops counted from the clock-frequency
+of the cpu node, the stores add a few cycles. Slot, latch and hold times stay
+k_busy_wait as in the generic routines. With CONFIG_PYD1598_FAST_GPIO_RAMFUNC the
+routines are placed in RAM, a bit has no flash wait states in it.
+
+nRF GPIO only, the pins must be active high. Pull and sense of direct link are left
+to the GPIO driver, only its input buffer is connected when a readout starts, the
+driver disconnects it when it drives the pin. An instance with a serial_in-spi
+controller keeps the spi push and uses the generated readout. Synchronized readout
+clocks the group through its own routine and is not specialized.
+
+The generated code can be inspected with west build -t pyd1598_disasm.
+*/
+
+#define DT_DRV_COMPAT excelitas_pyd1598
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/irq.h>
+#include <zephyr/kernel.h>
+#include <zephyr/linker/section_tags.h>
+#include <zephyr/toolchain.h>
+#include <hal/nrf_gpio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pyd1598.h>
+#include "pyd1598_internal.h"
+
+
+#ifdef CONFIG_PYD1598_FAST_GPIO_RAMFUNC
+#define PYD1598_FAST_SECTION __ramfunc
+#else
+#define PYD1598_FAST_SECTION
+#endif
+
+// Pulse of 200 ns - 2000 ns, nominal 300 ns plus the store
+#define PYD1598_FAST_CPU_HZ DT_PROP_OR(DT_PATH(cpus, cpu_0), clock_frequency, 64000000)
+#define PYD1598_FAST_PULSE_NS 300
+#define PYD1598_FAST_PULSE_NOPS ((PYD1598_FAST_CPU_HZ / 1000000) * PYD1598_FAST_PULSE_NS / 1000)
+
+#define PYD1598_FAST_PORT(index, prop) ((NRF_GPIO_Type *)DT_REG_ADDR(DT_INST_GPIO_CTLR(index, prop)))
+
+
+static ALWAYS_INLINE void fast_pulse(void)
+{
+    __asm__ volatile (".rept %c0\n\tnop\n\t.endr" : : "i" (PYD1598_FAST_PULSE_NOPS));
+}
+
+
+// Same waveform as pyd1598_readout_bits(), port and pin are constants of the instance
+static ALWAYS_INLINE int fast_readout(NRF_GPIO_Type *port, uint32_t pin, const struct pyd1598_config *cfg,
+                                      uint32_t *measurement, uint32_t *sensor_conf, int bits)
+{
+    // Variables
+    uint64_t raw = 0; // Sampled bits, the first one most significant
+    uint32_t mask; // Pin mask
+    uint32_t bit; // bit value
+
+    // Declare the variables
+    mask = BIT(pin);
+
+    // Driven high by the GPIO driver with the input disconnected, connect it for the samples
+    port->PIN_CNF[pin] &= ~GPIO_PIN_CNF_INPUT_Msk;
+
+    for (int i = PYD1598_READOUT_BITS - 1; i >= PYD1598_READOUT_BITS - bits; i--) {
+
+        // force low, then high, for 200 ns - 2000 ns each
+        port->OUTCLR = mask;
+        port->DIRSET = mask;
+        pyd1598_timing_mark(cfg, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_LEVEL, 0);
+        fast_pulse();
+        port->OUTSET = mask;
+        pyd1598_timing_mark(cfg, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_LEVEL, 1);
+        fast_pulse();
+
+        // release the pin, sample within 22 us
+        port->DIRCLR = mask;
+        pyd1598_timing_mark(cfg, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_RELEASE, 0);
+        k_busy_wait(3);
+
+        bit = (port->IN & mask) ? 1U : 0U;
+        pyd1598_timing_mark(cfg, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_SAMPLE, (uint8_t)bit);
+        raw = (raw << 1) | bit;
+    }
+
+    pyd1598_core_decode_readout(raw, bits, measurement, sensor_conf);
+
+    return 0;
+}
+
+
+// Same waveform as the gpio bus push, irq locked for the 25 bits and the latch time
+static ALWAYS_INLINE int fast_push(NRF_GPIO_Type *port, uint32_t pin, const struct device *dev, uint32_t sensor_conf)
+{
+    // Variables
+    const struct pyd1598_config *cfg; // Get the configuration
+    uint32_t mask; // Pin mask
+    int key; // Interupt key
+
+    // Declare the variables
+    cfg = dev->config;
+    mask = BIT(pin);
+    key = irq_lock();
+
+    // beggining condition, serial in driven low
+    port->OUTCLR = mask;
+    port->DIRSET = mask;
+    pyd1598_timing_mark(cfg, PYD1598_TIMING_SERIAL_IN, PYD1598_TIMING_LEVEL, 0);
+    fast_pulse();
+
+    for (int i = 24; i >= 0; i--) {
+        port->OUTCLR = mask;
+        pyd1598_timing_mark(cfg, PYD1598_TIMING_SERIAL_IN, PYD1598_TIMING_LEVEL, 0);
+        fast_pulse();
+        port->OUTSET = mask;
+        pyd1598_timing_mark(cfg, PYD1598_TIMING_SERIAL_IN, PYD1598_TIMING_LEVEL, 1);
+        fast_pulse();
+
+        // The bit stays on the line for the slot, one store
+        if ((sensor_conf & BIT(i)) != 0) {
+            port->OUTSET = mask;
+        }
+        else {
+            port->OUTCLR = mask;
+        }
+        pyd1598_timing_mark(cfg, PYD1598_TIMING_SERIAL_IN, PYD1598_TIMING_LEVEL, (uint8_t)((sensor_conf >> i) & 1U));
+
+        //sleep for atleast 80 us + 20%
+        k_busy_wait(96);
+    }
+    // latch time, 650 us + 20%
+    k_busy_wait(780);
+
+    // after condition, release serial in
+    port->DIRCLR = mask;
+    pyd1598_timing_mark(cfg, PYD1598_TIMING_SERIAL_IN, PYD1598_TIMING_RELEASE, 0);
+
+    irq_unlock(key);
+
+    return 0;
+}
+
+
+#define PYD1598_FAST_DEFINE(index)                                                                  \
+    BUILD_ASSERT(DT_NODE_HAS_COMPAT(DT_INST_GPIO_CTLR(index, serial_in_gpios), nordic_nrf_gpio) &&  \
+                 DT_NODE_HAS_COMPAT(DT_INST_GPIO_CTLR(index, direct_link_gpios), nordic_nrf_gpio), \
+                 "CONFIG_PYD1598_FAST_GPIO needs nRF GPIO pins");                                   \
+    BUILD_ASSERT(((DT_INST_GPIO_FLAGS(index, serial_in_gpios) |                                     \
+                   DT_INST_GPIO_FLAGS(index, direct_link_gpios)) & GPIO_ACTIVE_LOW) == 0,           \
+                 "CONFIG_PYD1598_FAST_GPIO needs active high pins");                                \
+                                                                                                    \
+    PYD1598_FAST_SECTION int pyd1598_fast_readout_##index(const struct pyd1598_config *cfg,         \
+                                                          uint32_t *measurement,                    \
+                                                          uint32_t *sensor_conf, int bits)          \
+    {                                                                                               \
+        return fast_readout(PYD1598_FAST_PORT(index, direct_link_gpios),                            \
+                            DT_INST_GPIO_PIN(index, direct_link_gpios),                             \
+                            cfg, measurement, sensor_conf, bits);                                   \
+    }                                                                                               \
+                                                                                                    \
+    PYD1598_FAST_SECTION static int pyd1598_fast_push_##index(const struct device *dev,             \
+                                                              uint32_t sensor_conf)                 \
+    {                                                                                               \
+        return fast_push(PYD1598_FAST_PORT(index, serial_in_gpios),                                 \
+                         DT_INST_GPIO_PIN(index, serial_in_gpios), dev, sensor_conf);               \
+    }                                                                                               \
+                                                                                                    \
+    const struct pyd1598_bus_api pyd1598_bus_fast_##index = {                                       \
+        .init = NULL,                                                                               \
+        .push = pyd1598_fast_push_##index,                                                          \
+        .irq_locked = true,                                                                         \
+    };
+
+DT_INST_FOREACH_STATUS_OKAY(PYD1598_FAST_DEFINE)
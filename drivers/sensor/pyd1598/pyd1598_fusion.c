@@ -0,0 +1,537 @@
+/*
+PYD1598 zone and direction of travel fusion
+
+Every instance declares where it is in the devicetree, a zone 0 - 31 and a position in
+mm, and the fusion turns the frames and triggers of the whole cluster into occupied
+zones and travel events, on the device, so only events leave the gateway.
+
+Per instance, at stream rate and in fixed point:
+
+  history   the last CONFIG_PYD1598_FUSION_WINDOW PIR BPF samples, a ring
+  level     moving average of |BPF|, 1/8 per frame, in 1/16 counts
+  active    level above CONFIG_PYD1598_FUSION_THRESHOLD, left below half of it
+  onset     time the sensor became active, or of a wake-up trigger while idle
+
+A zone is occupied while one of its sensors is active or was within the last
+CONFIG_PYD1598_FUSION_HOLD_MS. A travel event is an onset on one sensor after an
+onset on another sensor at a different position within CONFIG_PYD1598_FUSION_TRAVEL_MS.
+The direction is the vector between the positions. The travel time is the lag at the
+peak of the normalized cross-correlation of the two BPF windows if the peak reaches
+CONFIG_PYD1598_FUSION_CORRELATION, the onset order only says which one was first.
+Correlation compares sample indexes, it is exact with synchronized sampling and a
+good estimate with streams at the same period.
+
+Memory is a fixed array per instance, a correlation costs window * (max lag + 1)
+multiply-adds once per onset. Frames of other signal sources are ignored, triggers
+come from the direct link interrupt and only touch the onset and the zones. An onset
+that starts a travel takes a slot of a small ring, with both windows copied only when
+they will be correlated, and the correlation and every event of a trigger run on the
+system work queue, never in the interrupt.
+*/
+
+#define DT_DRV_COMPAT excelitas_pyd1598
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pyd1598.h>
+#include "pyd1598_internal.h"
+
+LOG_MODULE_DECLARE(PYD1598, PYD1598_LOG_LEVEL);
+
+
+#define PYD1598_FUSION_INSTANCES DT_NUM_INST_STATUS_OKAY(DT_DRV_COMPAT)
+#define PYD1598_FUSION_MASK (CONFIG_PYD1598_FUSION_WINDOW - 1)
+#define PYD1598_FUSION_HOLD_US ((int64_t)CONFIG_PYD1598_FUSION_HOLD_MS * USEC_PER_MSEC)
+#define PYD1598_FUSION_TRAVEL_US ((int64_t)CONFIG_PYD1598_FUSION_TRAVEL_MS * USEC_PER_MSEC)
+
+// Level in 1/16 counts
+#define PYD1598_FUSION_LEVEL_SHIFT 4
+#define PYD1598_FUSION_ENTER (CONFIG_PYD1598_FUSION_THRESHOLD << PYD1598_FUSION_LEVEL_SHIFT)
+#define PYD1598_FUSION_LEAVE (PYD1598_FUSION_ENTER / 2)
+
+// Onset pairs waiting for the work queue, a power of two
+#define PYD1598_FUSION_PAIRS 2
+
+BUILD_ASSERT(IS_POWER_OF_TWO(CONFIG_PYD1598_FUSION_WINDOW), "CONFIG_PYD1598_FUSION_WINDOW must be a power of two");
+BUILD_ASSERT(CONFIG_PYD1598_FUSION_MAX_LAG < CONFIG_PYD1598_FUSION_WINDOW, "The lag must stay inside the window");
+
+#define PYD1598_FUSION_ZONE_CHECK(index)                                                   \
+    BUILD_ASSERT(DT_INST_PROP(index, zone) < 32, "pyd1598 zone must be 0 - 31");          \
+    BUILD_ASSERT(DT_INST_PROP_LEN(index, position) == 2, "pyd1598 position must be <x y>");
+
+DT_INST_FOREACH_STATUS_OKAY(PYD1598_FUSION_ZONE_CHECK)
+
+// Where every instance is, from the devicetree
+struct fusion_place {
+    uint8_t zone;
+    int32_t x_mm;
+    int32_t y_mm;
+};
+
+#define PYD1598_FUSION_PLACE(index)                                                        \
+    [index] = {                                                                            \
+        .zone = DT_INST_PROP(index, zone),                                                 \
+        .x_mm = DT_INST_PROP_BY_IDX(index, position, 0),                                   \
+        .y_mm = DT_INST_PROP_BY_IDX(index, position, 1),                                   \
+    },
+
+static const struct fusion_place fusion_places[PYD1598_FUSION_INSTANCES] = {
+    DT_INST_FOREACH_STATUS_OKAY(PYD1598_FUSION_PLACE)
+};
+
+struct fusion_state {
+    int16_t history[CONFIG_PYD1598_FUSION_WINDOW]; // BPF counts, ring
+    uint32_t head; // Free running, samples written
+    int32_t level; // Moving average of |BPF| in 1/16 counts
+    uint32_t interval_us; // Moving average of the sample interval
+    int64_t last_us; // Last frame
+    int64_t onset_us; // Start of the current or last activity, 0 before the first
+    int64_t active_us; // Last frame or trigger with activity, 0 before the first
+    bool active;
+};
+
+// Onset of a sensor while another one had one shortly before, correlated from work
+struct fusion_pair {
+    uint8_t from;
+    uint8_t to;
+    int64_t timestamp_us;
+    uint32_t onset_delay_us;
+    uint32_t interval_us;
+    bool waveforms; // Both windows are full
+    int16_t from_history[CONFIG_PYD1598_FUSION_WINDOW]; // Oldest first
+    int16_t to_history[CONFIG_PYD1598_FUSION_WINDOW];
+};
+
+static struct fusion_state fusion_states[PYD1598_FUSION_INSTANCES];
+static struct fusion_pair fusion_pairs[PYD1598_FUSION_PAIRS];
+static uint32_t fusion_pairs_head; // Free running, next pair to correlate
+static uint32_t fusion_pairs_tail; // Free running, next free slot
+static struct k_spinlock fusion_lock;
+static uint32_t fusion_zones;
+static struct pyd1598_fusion_event fusion_travel;
+static bool fusion_travel_valid;
+static pyd1598_fusion_callback_t fusion_callback;
+static void *fusion_user_data;
+
+static void pyd1598_fusion_expire(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(fusion_expire_work, pyd1598_fusion_expire);
+static void pyd1598_fusion_process(struct k_work *work);
+static K_WORK_DEFINE(fusion_work, pyd1598_fusion_process);
+
+
+static void pyd1598_fusion_emit(const struct pyd1598_fusion_event *event)
+{
+    // Variables
+    pyd1598_fusion_callback_t callback;
+    void *user_data;
+    k_spinlock_key_t key;
+
+    key = k_spin_lock(&fusion_lock);
+    callback = fusion_callback;
+    user_data = fusion_user_data;
+    k_spin_unlock(&fusion_lock, key);
+
+    pyd1598_zbus_publish_fusion(event);
+    if (callback != NULL) {
+        callback(event, user_data);
+    }
+}
+
+
+// Occupied zones at a time, call with the lock held
+static uint32_t pyd1598_fusion_zones_at(int64_t now_us)
+{
+    // Variables
+    const struct fusion_state *st;
+    uint32_t zones = 0;
+
+    for (int i = 0; i < PYD1598_FUSION_INSTANCES; i++) {
+        st = &fusion_states[i];
+        if (st->active || (st->active_us != 0 && now_us - st->active_us < PYD1598_FUSION_HOLD_US)) {
+            zones |= BIT(fusion_places[i].zone);
+        }
+    }
+
+    return zones;
+}
+
+
+// New zones, true if they changed, call with the lock held
+static bool pyd1598_fusion_update_zones(int64_t now_us, struct pyd1598_fusion_event *event)
+{
+    // Variables
+    uint32_t zones;
+
+    zones = pyd1598_fusion_zones_at(now_us);
+    if (zones == fusion_zones) {
+        return false;
+    }
+    fusion_zones = zones;
+
+    memset(event, 0, sizeof(*event));
+    event->timestamp_us = now_us;
+    event->type = PYD1598_FUSION_ZONES;
+    event->zones = zones;
+
+    return true;
+}
+
+
+// Latest onset of a sensor at another position within the travel time, -1 if none
+static int pyd1598_fusion_source(int to, int64_t onset_us)
+{
+    // Variables
+    const struct fusion_state *st;
+    int from = -1;
+
+    for (int i = 0; i < PYD1598_FUSION_INSTANCES; i++) {
+        st = &fusion_states[i];
+        if (i == to || st->onset_us == 0 || st->onset_us > onset_us ||
+            onset_us - st->onset_us > PYD1598_FUSION_TRAVEL_US) {
+            continue;
+        }
+        if (fusion_places[i].x_mm == fusion_places[to].x_mm && fusion_places[i].y_mm == fusion_places[to].y_mm) {
+            continue;
+        }
+        if (from < 0 || st->onset_us > fusion_states[from].onset_us) {
+            from = i;
+        }
+    }
+
+    return from;
+}
+
+
+// Oldest first copy of the window of a sensor
+static void pyd1598_fusion_window(const struct fusion_state *st, int16_t *out)
+{
+    for (uint32_t i = 0; i < CONFIG_PYD1598_FUSION_WINDOW; i++) {
+        out[i] = st->history[(st->head + i) & PYD1598_FUSION_MASK];
+    }
+}
+
+
+// Onset of a sensor, call with the lock held, true if it queued a travel for fusion_work.
+// Trigger onsets have no waveform of their own, their windows are not copied.
+static bool pyd1598_fusion_onset(int to, int64_t onset_us, bool waveforms)
+{
+    // Variables
+    const struct fusion_state *from_st;
+    const struct fusion_state *to_st;
+    struct fusion_pair *pair;
+    int from;
+
+    from = pyd1598_fusion_source(to, onset_us);
+    fusion_states[to].onset_us = onset_us;
+    if (from < 0) {
+        return false;
+    }
+    if (fusion_pairs_tail - fusion_pairs_head >= PYD1598_FUSION_PAIRS) {
+        LOG_WRN("Fusion travel %d -> %d dropped, the work queue is behind", from, to);
+        return false;
+    }
+
+    pair = &fusion_pairs[fusion_pairs_tail % PYD1598_FUSION_PAIRS];
+    fusion_pairs_tail++;
+    from_st = &fusion_states[from];
+    to_st = &fusion_states[to];
+    pair->from = (uint8_t)from;
+    pair->to = (uint8_t)to;
+    pair->timestamp_us = onset_us;
+    pair->onset_delay_us = (uint32_t)(onset_us - from_st->onset_us);
+    pair->interval_us = to_st->interval_us;
+    pair->waveforms = (waveforms && from_st->head >= CONFIG_PYD1598_FUSION_WINDOW &&
+                       to_st->head >= CONFIG_PYD1598_FUSION_WINDOW && from_st->active);
+    if (pair->waveforms) {
+        pyd1598_fusion_window(from_st, pair->from_history);
+        pyd1598_fusion_window(to_st, pair->to_history);
+    }
+
+    return true;
+}
+
+
+// Travel event of an onset pair, the correlation runs here without the lock, the slot
+// of the pair is not reused before the head moves past it
+static void pyd1598_fusion_travel(const struct fusion_pair *pair, struct pyd1598_fusion_event *event)
+{
+    // Variables
+    const struct fusion_place *from;
+    const struct fusion_place *to;
+    k_spinlock_key_t key;
+    uint32_t distance_mm;
+    int32_t score = 0;
+    int lag = 0;
+
+    // Declare the variables
+    from = &fusion_places[pair->from];
+    to = &fusion_places[pair->to];
+
+    memset(event, 0, sizeof(*event));
+    event->timestamp_us = pair->timestamp_us;
+    event->type = PYD1598_FUSION_TRAVEL;
+    event->from_instance = pair->from;
+    event->to_instance = pair->to;
+    event->from_zone = from->zone;
+    event->to_zone = to->zone;
+    event->dx_mm = to->x_mm - from->x_mm;
+    event->dy_mm = to->y_mm - from->y_mm;
+    event->delay_us = pair->onset_delay_us;
+
+    if (pair->waveforms) {
+        score = pyd1598_core_xcorr(pair->from_history, pair->to_history, CONFIG_PYD1598_FUSION_WINDOW,
+                                   CONFIG_PYD1598_FUSION_MAX_LAG, &lag);
+    }
+    if (score >= CONFIG_PYD1598_FUSION_CORRELATION && lag > 0) {
+        event->delay_us = (uint32_t)lag * pair->interval_us;
+        event->confidence = (uint16_t)score;
+    }
+
+    distance_mm = pyd1598_core_isqrt64((uint64_t)((int64_t)event->dx_mm * event->dx_mm) +
+                                       (uint64_t)((int64_t)event->dy_mm * event->dy_mm));
+    if (event->delay_us > 0) {
+        event->speed_mm_s = (uint32_t)(((uint64_t)distance_mm * USEC_PER_SEC) / event->delay_us);
+    }
+
+    key = k_spin_lock(&fusion_lock);
+    event->zones = fusion_zones;
+    fusion_travel = *event;
+    fusion_travel_valid = true;
+    k_spin_unlock(&fusion_lock, key);
+}
+
+
+/**
+ * @brief Feed an accepted frame into the fusion.
+ *
+ * @param dev Pointer to the sensor device
+ * @param frame Frame, only PIR BPF frames are used
+ */
+void pyd1598_fusion_frame(const struct device *dev, const struct pyd1598_frame *frame)
+{
+    // Variables
+    const struct pyd1598_config *cfg;
+    struct fusion_state *st;
+    struct pyd1598_fusion_event zones_event;
+    k_spinlock_key_t key;
+    int32_t magnitude;
+    int64_t delta_us;
+    int16_t bpf;
+    bool travel = false;
+    bool zones_changed;
+
+    // Declare the variables
+    cfg = dev->config;
+    if (PYD1598_FIELD_GET(frame->sensor_conf, SIGNAL_SOURCE) != PYD1598_PIR_BPF) {
+        return;
+    }
+    bpf = pyd1598_bpf_counts(frame->measurement);
+    magnitude = (bpf < 0) ? -(int32_t)bpf : (int32_t)bpf;
+
+    key = k_spin_lock(&fusion_lock);
+    st = &fusion_states[cfg->instance];
+
+    st->history[st->head & PYD1598_FUSION_MASK] = bpf;
+    st->head++;
+    if (st->last_us != 0) {
+        delta_us = CLAMP(frame->timestamp_us - st->last_us, 0, (int64_t)UINT32_MAX / 2);
+        st->interval_us = (st->interval_us == 0) ? (uint32_t)delta_us :
+                          (uint32_t)((int64_t)st->interval_us + ((delta_us - (int64_t)st->interval_us) >> 3));
+    }
+    st->last_us = frame->timestamp_us;
+    st->level += ((magnitude << PYD1598_FUSION_LEVEL_SHIFT) - st->level) >> 3;
+
+    if (!st->active && st->level >= PYD1598_FUSION_ENTER) {
+        st->active = true;
+        travel = pyd1598_fusion_onset(cfg->instance, frame->timestamp_us, true);
+    }
+    else if (st->active && st->level < PYD1598_FUSION_LEAVE) {
+        st->active = false;
+    }
+    if (st->active) {
+        st->active_us = frame->timestamp_us;
+    }
+    zones_changed = pyd1598_fusion_update_zones(frame->timestamp_us, &zones_event);
+    k_spin_unlock(&fusion_lock, key);
+
+    if (travel) {
+        k_work_submit(&fusion_work);
+    }
+    if (zones_changed) {
+        pyd1598_fusion_emit(&zones_event);
+        k_work_reschedule(&fusion_expire_work, K_MSEC(CONFIG_PYD1598_FUSION_HOLD_MS));
+    }
+}
+
+
+/**
+ * @brief Feed a wake-up trigger into the fusion, called from the direct link interrupt.
+ *
+ * A trigger marks the sensor active and is an onset if it was idle, there is no
+ * waveform to correlate. The travel and zone events follow from the system work queue.
+ *
+ * @param dev Pointer to the sensor device
+ * @param timestamp_us Uptime of the trigger
+ */
+void pyd1598_fusion_trigger(const struct device *dev, int64_t timestamp_us)
+{
+    // Variables
+    const struct pyd1598_config *cfg;
+    struct fusion_state *st;
+    k_spinlock_key_t key;
+
+    // Declare the variables
+    cfg = dev->config;
+
+    key = k_spin_lock(&fusion_lock);
+    st = &fusion_states[cfg->instance];
+    if (!st->active && (st->active_us == 0 || timestamp_us - st->active_us >= PYD1598_FUSION_HOLD_US)) {
+        pyd1598_fusion_onset(cfg->instance, timestamp_us, false);
+    }
+    st->active_us = timestamp_us;
+    k_spin_unlock(&fusion_lock, key);
+
+    // The queued travel and the zones are reported from work
+    k_work_submit(&fusion_work);
+}
+
+
+// Correlates the queued onset pairs and reports the zones a trigger changed
+static void pyd1598_fusion_process(struct k_work *work)
+{
+    // Variables
+    struct pyd1598_fusion_event event;
+    k_spinlock_key_t key;
+    bool pending;
+
+    key = k_spin_lock(&fusion_lock);
+    pending = fusion_pairs_head != fusion_pairs_tail;
+    k_spin_unlock(&fusion_lock, key);
+
+    while (pending) {
+        pyd1598_fusion_travel(&fusion_pairs[fusion_pairs_head % PYD1598_FUSION_PAIRS], &event);
+
+        key = k_spin_lock(&fusion_lock);
+        fusion_pairs_head++;
+        pending = fusion_pairs_head != fusion_pairs_tail;
+        k_spin_unlock(&fusion_lock, key);
+
+        pyd1598_fusion_emit(&event);
+    }
+
+    pyd1598_fusion_expire(work);
+}
+
+
+// Reports the zones, clears those whose sensors went quiet, nothing else would call in wake-up mode
+static void pyd1598_fusion_expire(struct k_work *work)
+{
+    // Variables
+    struct pyd1598_fusion_event event;
+    k_spinlock_key_t key;
+    bool changed;
+    uint32_t zones;
+
+    ARG_UNUSED(work);
+
+    key = k_spin_lock(&fusion_lock);
+    changed = pyd1598_fusion_update_zones(k_ticks_to_us_floor64(k_uptime_ticks()), &event);
+    zones = fusion_zones;
+    k_spin_unlock(&fusion_lock, key);
+
+    if (changed) {
+        pyd1598_fusion_emit(&event);
+    }
+    if (zones != 0) {
+        k_work_reschedule(&fusion_expire_work, K_MSEC(CONFIG_PYD1598_FUSION_HOLD_MS));
+    }
+}
+
+
+/**
+ * @brief Set the function called for every zone and travel event.
+ *
+ * Called from the readout path or the system work queue, keep it short.
+ *
+ * @param callback Called with the event, NULL to clear it
+ * @param user_data Passed to callback
+ *
+ * @return 0 if successful.
+ */
+int pyd1598_fusion_set_callback(pyd1598_fusion_callback_t callback, void *user_data)
+{
+    // Variables
+    k_spinlock_key_t key;
+
+    key = k_spin_lock(&fusion_lock);
+    fusion_callback = callback;
+    fusion_user_data = user_data;
+    k_spin_unlock(&fusion_lock, key);
+
+    return 0;
+}
+
+
+/**
+ * @brief Get the occupied zones.
+ *
+ * @param zones Pointer to where the zones should be stored, bit n for zone n
+ *
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_fusion_get_zones(uint32_t *zones)
+{
+    // Variables
+    k_spinlock_key_t key;
+
+    // Check if the zones are null
+    LOG_DBG("pyd1598_fusion_get_zones");
+    if (zones == NULL) {
+        return -EINVAL;
+    }
+
+    key = k_spin_lock(&fusion_lock);
+    *zones = fusion_zones;
+    k_spin_unlock(&fusion_lock, key);
+
+    return 0;
+}
+
+
+/**
+ * @brief Get the last travel event.
+ *
+ * @param event Pointer to where the event should be stored
+ *
+ * @return 0 if successful, -ENODATA if there was no travel yet, negative errno code if failure.
+ */
+int pyd1598_fusion_get_travel(struct pyd1598_fusion_event *event)
+{
+    // Variables
+    k_spinlock_key_t key;
+    int ret = 0;
+
+    // Check if the event is null
+    LOG_DBG("pyd1598_fusion_get_travel");
+    if (event == NULL) {
+        return -EINVAL;
+    }
+
+    key = k_spin_lock(&fusion_lock);
+    if (fusion_travel_valid) {
+        *event = fusion_travel;
+    }
+    else {
+        ret = -ENODATA;
+    }
+    k_spin_unlock(&fusion_lock, key);
+
+    return ret;
+}
@@ -0,0 +1,385 @@
+/*
+PYD1598 adaptive hybrid mode
+
+Wake-up mode costs nothing on the host until the sensor triggers, but only reports
+the edge. Forced readout streaming gives the waveform but keeps the work queue and
+direct link busy. The hybrid mode idles in wake-up mode and streams around events:
+
+  wake-up    direct link interrupt armed, no readouts
+  trigger    push forced readout, stream at the period, the first fetch verifies it
+  streaming  until the window has passed and |BPF| stayed below the threshold for
+             the quiet time, any louder sample restarts the quiet time
+  quiet      push wake-up mode, one fetch verifies it and resets direct link
+
+The window and the quiet time are the hysteresis, a burst is never shorter than the
+window and a room with motion in it keeps streaming instead of toggling the mode.
+Every mode switch is a push and a verifying readout, their count, failures and time
+are kept with the time spent in each mode, so the cost of the bursts can be weighed
+against streaming all the time.
+
+Runs on the system work queue like streaming and the scheduler and excludes both.
+Like them it keeps the device resumed while started, only the streaming part pauses
+while the device is suspended, a trigger still wakes the host.
+*/
+
+#include <zephyr/device.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/kernel.h>
+#include <zephyr/pm/device_runtime.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pyd1598.h>
+#include "pyd1598_internal.h"
+
+LOG_MODULE_DECLARE(PYD1598, PYD1598_LOG_LEVEL);
+
+
+// Time since the last switch goes to the mode the sensor was in
+static void hybrid_account(struct pyd1598_hybrid *hybrid, int64_t now_ms)
+{
+    if (hybrid->streaming) {
+        hybrid->stats.streaming_ms += (uint64_t)(now_ms - hybrid->mode_ms);
+    }
+    else {
+        hybrid->stats.wake_up_ms += (uint64_t)(now_ms - hybrid->mode_ms);
+    }
+    hybrid->mode_ms = now_ms;
+}
+
+
+// Push a mode and verify wake-up mode with a fetch, forced readout is verified by the
+// first streamed fetch
+static int hybrid_switch(struct pyd1598_data *data, enum pyd1598_operation_mode mode, int64_t now_ms)
+{
+    // Variables
+    struct pyd1598_hybrid *hybrid;
+    uint32_t start;
+    int ret;
+
+    // Declare the variables
+    hybrid = &data->hybrid;
+    start = k_cycle_get_32();
+
+    pyd1598_set_operation_mode(data->dev, mode);
+    ret = pyd1598_push(data->dev);
+    if (ret == 0 && mode == PYD1598_WAKE_UP) {
+        ret = pyd1598_fetch(data->dev);
+        if (ret != 0) {
+            hybrid->stats.verify_errors++;
+        }
+    }
+    hybrid->stats.switch_us += k_cyc_to_us_floor32(k_cycle_get_32() - start);
+
+    if (ret != 0) {
+        LOG_DBG("Hybrid switch to mode %d failed: %d", mode, ret);
+        hybrid->stats.switch_errors++;
+        return ret;
+    }
+
+    hybrid->stats.switches++;
+    hybrid_account(hybrid, now_ms);
+    hybrid->streaming = (mode == PYD1598_FORCED_READOUT);
+
+    return 0;
+}
+
+
+static void pyd1598_hybrid_work_handler(struct k_work *work)
+{
+    // Variables
+    struct k_work_delayable *dwork;
+    struct pyd1598_data *data;
+    struct pyd1598_hybrid *hybrid;
+    int64_t now_ms;
+    int16_t bpf;
+    int ret;
+
+    // Declare the variables
+    dwork = k_work_delayable_from_work(work);
+    data = CONTAINER_OF(dwork, struct pyd1598_data, hybrid.work);
+    hybrid = &data->hybrid;
+    now_ms = k_uptime_get();
+
+    // Triggered in wake-up mode, start a burst, a failed push is tried again next period
+    if (!hybrid->streaming) {
+        if (!hybrid->triggered) {
+            return;
+        }
+        ret = hybrid_switch(data, PYD1598_FORCED_READOUT, now_ms);
+        if (ret != 0) {
+            k_work_schedule(dwork, K_MSEC(hybrid->config.period_ms));
+            return;
+        }
+        hybrid->triggered = false;
+        hybrid->verify = true;
+        hybrid->burst_ms = now_ms;
+        hybrid->active_ms = now_ms;
+        hybrid->stats.bursts++;
+        k_work_schedule(dwork, K_MSEC(hybrid->config.period_ms));
+        return;
+    }
+
+    // Reschedule first so the period does not drift with the transaction time
+    k_work_schedule(dwork, K_MSEC(hybrid->config.period_ms));
+
+    // The frame is handed to the optional modules by fetch
+    ret = pyd1598_fetch(data->dev);
+    if (ret == 0) {
+        hybrid->stats.frames++;
+        bpf = pyd1598_bpf_counts(data->measurement);
+        if (PYD1598_FIELD_GET(data->sensor_conf, SIGNAL_SOURCE) == PYD1598_PIR_BPF &&
+            (bpf >= (int16_t)hybrid->config.threshold || bpf <= -(int16_t)hybrid->config.threshold)) {
+            hybrid->active_ms = now_ms;
+        }
+    }
+    else if (hybrid->verify && ret == -EIO) {
+        // The sensor did not take forced readout, push it again
+        hybrid->stats.verify_errors++;
+        hybrid->triggered = true;
+        hybrid_account(hybrid, now_ms);
+        hybrid->streaming = false;
+        return;
+    }
+    hybrid->verify = false;
+
+    if (now_ms - hybrid->burst_ms < hybrid->config.window_ms ||
+        now_ms - hybrid->active_ms < hybrid->config.quiet_ms) {
+        return;
+    }
+
+    // Quiet, back to wake-up mode, on failure keep streaming and try again next period
+    ret = hybrid_switch(data, PYD1598_WAKE_UP, now_ms);
+    if (ret == 0) {
+        k_work_cancel_delayable(dwork);
+    }
+}
+
+
+int pyd1598_hybrid_init(const struct device *dev)
+{
+    // Variables
+    struct pyd1598_data *data;
+
+    // Declare the variables
+    data = dev->data;
+    memset(&data->hybrid, 0, sizeof(data->hybrid));
+
+    k_work_init_delayable(&data->hybrid.work, pyd1598_hybrid_work_handler);
+
+    return 0;
+}
+
+
+/**
+ * @brief Start a burst on a wake-up trigger, called from the direct link interrupt.
+ *
+ * @param dev Pointer to the sensor device
+ */
+void pyd1598_hybrid_trigger(const struct device *dev)
+{
+    // Variables
+    struct pyd1598_data *data;
+
+    // Declare the variables
+    data = dev->data;
+
+    if (!data->hybrid.active || data->hybrid.streaming) {
+        return;
+    }
+    data->hybrid.triggered = true;
+    data->hybrid.stats.triggers++;
+    k_work_reschedule(&data->hybrid.work, K_NO_WAIT);
+}
+
+
+/**
+ * @brief Idle in wake-up mode and stream in forced readout mode around every trigger.
+ *
+ * Pushes wake-up mode with the other fields of the desired configuration, streamed
+ * frames are handed to zbus and the other modules like fetched ones.
+ *
+ * @param dev Pointer to the sensor device
+ * @param config Period, window, quiet time and threshold of the bursts
+ *
+ * @return 0 if successful, -EBUSY if the device is streaming, scheduled, aggregating occupancy, in interrupt readout, a sync group or calibrating, negative errno code if failure.
+ */
+int pyd1598_hybrid_start(const struct device *dev, const struct pyd1598_hybrid_config *config)
+{
+    // Variables
+    struct pyd1598_data *data;
+    struct pyd1598_hybrid *hybrid;
+    struct k_work_sync sync;
+    int64_t now_ms;
+    int ret;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_hybrid_start");
+    if (dev == NULL || dev->data == NULL || config == NULL || config->period_ms == 0 ||
+        config->threshold == 0 || config->threshold > INT16_MAX) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+    hybrid = &data->hybrid;
+
+    // The modules that read the sensor out on their own, checked and claimed under the lock
+    k_mutex_lock(&data->run_lock, K_FOREVER);
+#ifdef CONFIG_PYD1598_STREAM
+    if (data->stream_active) {
+        k_mutex_unlock(&data->run_lock);
+        return -EBUSY;
+    }
+#endif
+#ifdef CONFIG_PYD1598_SCHED
+    if (data->sched.active) {
+        k_mutex_unlock(&data->run_lock);
+        return -EBUSY;
+    }
+#endif
+#ifdef CONFIG_PYD1598_OCCUPANCY
+    // It resets the sensor on every trigger
+    if (data->occupancy.active) {
+        k_mutex_unlock(&data->run_lock);
+        return -EBUSY;
+    }
+#endif
+    if (pyd1598_interrupt_running(dev) || pyd1598_sync_running(dev) || pyd1598_calib_running(dev)) {
+        k_mutex_unlock(&data->run_lock);
+        return -EBUSY;
+    }
+
+    // Restart from wake-up mode with the new configuration
+    k_work_cancel_delayable_sync(&hybrid->work, &sync);
+    now_ms = k_uptime_get();
+    if (hybrid->active) {
+        hybrid_account(hybrid, now_ms);
+    }
+    else {
+        ret = pm_device_runtime_get(dev);
+        if (ret < 0) {
+            k_mutex_unlock(&data->run_lock);
+            return ret;
+        }
+        hybrid->mode_ms = now_ms;
+    }
+    hybrid->config = *config;
+    hybrid->triggered = false;
+
+    ret = hybrid_switch(data, PYD1598_WAKE_UP, now_ms);
+    if (ret != 0) {
+        hybrid->active = false;
+        pm_device_runtime_put(dev);
+        k_mutex_unlock(&data->run_lock);
+        return ret;
+    }
+
+    // Triggers are taken from here on
+    hybrid->active = true;
+    k_mutex_unlock(&data->run_lock);
+
+    return 0;
+}
+
+
+/**
+ * @brief Stop the hybrid mode, waits for a running burst step to complete.
+ *
+ * The sensor stays in the mode that was pushed last.
+ *
+ * @param dev Pointer to the sensor device
+ *
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_hybrid_stop(const struct device *dev)
+{
+    // Variables
+    struct pyd1598_data *data;
+    struct pyd1598_hybrid *hybrid;
+    struct k_work_sync sync;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_hybrid_stop");
+    if (dev == NULL || dev->data == NULL) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+    hybrid = &data->hybrid;
+
+    k_mutex_lock(&data->run_lock, K_FOREVER);
+    if (!hybrid->active) {
+        k_mutex_unlock(&data->run_lock);
+        return 0;
+    }
+    hybrid->active = false;
+    k_work_cancel_delayable_sync(&hybrid->work, &sync);
+
+    hybrid_account(hybrid, k_uptime_get());
+    pm_device_runtime_put(dev);
+    k_mutex_unlock(&data->run_lock);
+
+    return 0;
+}
+
+
+void pyd1598_hybrid_pm(const struct device *dev, bool suspend)
+{
+    // Variables
+    struct pyd1598_data *data;
+
+    // Declare the variables
+    data = dev->data;
+
+    if (!data->hybrid.active) {
+        return;
+    }
+    if (suspend) {
+        k_work_cancel_delayable(&data->hybrid.work);
+    }
+    else if (data->hybrid.streaming || data->hybrid.triggered) {
+        k_work_reschedule(&data->hybrid.work, K_NO_WAIT);
+    }
+}
+
+
+/**
+ * @brief Get the hybrid mode counters of the sensor.
+ *
+ * @param dev Pointer to the sensor device
+ * @param stats Pointer to where the counters should be stored, the time of the current
+ * mode is included
+ *
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_hybrid_get_stats(const struct device *dev, struct pyd1598_hybrid_stats *stats)
+{
+    // Variables
+    struct pyd1598_data *data;
+    int64_t running_ms;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_hybrid_get_stats");
+    if (dev == NULL || dev->data == NULL || stats == NULL) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+    *stats = data->hybrid.stats;
+
+    if (data->hybrid.active) {
+        running_ms = k_uptime_get() - data->hybrid.mode_ms;
+        if (data->hybrid.streaming) {
+            stats->streaming_ms += (uint64_t)running_ms;
+        }
+        else {
+            stats->wake_up_ms += (uint64_t)running_ms;
+        }
+    }
+
+    return 0;
+}
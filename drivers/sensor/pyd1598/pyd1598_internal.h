@@ -0,0 +1,540 @@
+/*
+PYD1598 driver internals shared between pyd1598.c and the optional driver modules.
+
+Applications should include pyd1598.h, this header is not part of the public api.
+*/
+
+#ifndef ZEPHYR_DRIVERS_SENSOR_PYD1598_PYD1598_INTERNAL_H_
+#define ZEPHYR_DRIVERS_SENSOR_PYD1598_PYD1598_INTERNAL_H_
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/gpio.h>
+#ifdef CONFIG_PYD1598_BUS_SPI
+#include <zephyr/drivers/spi.h>
+#endif
+#include <zephyr/kernel.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pyd1598.h>
+#include "pyd1598_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Log level of every driver file, the compact build drops the log strings from flash
+#ifdef CONFIG_PYD1598_COMPACT
+#define PYD1598_LOG_LEVEL LOG_LEVEL_NONE
+#else
+#define PYD1598_LOG_LEVEL CONFIG_SENSOR_LOG_LEVEL
+#endif
+
+
+#ifdef CONFIG_PYD1598_CACHE
+struct pyd1598_cache {
+    struct k_mutex lock;
+    struct k_condvar done; // Signalled when the fetch in flight completes
+    uint32_t generation; // Fetches completed
+    int ret; // Result of the last fetch, handed to its waiters
+    bool in_flight;
+    struct pyd1598_frame frame; // Last accepted frame from any path, timestamp 0 until the first
+    struct pyd1598_cache_stats stats;
+};
+#endif
+
+#ifdef CONFIG_PYD1598_ENERGY
+struct pyd1598_energy {
+    struct k_spinlock lock; // Interrupt readouts account from the isr
+    uint32_t pushes;
+    uint32_t fetches;
+    uint32_t readouts;
+    uint64_t active_cycles;
+    uint64_t irq_locked_cycles;
+    uint64_t serial_in_cycles;
+    uint64_t direct_link_cycles;
+    int64_t since_ms; // Uptime of init or the last reset
+};
+#endif
+
+#ifdef CONFIG_PYD1598_SCHED
+struct pyd1598_sched {
+    struct k_work_delayable work; // Samples and switches the signal source
+    pyd1598_sample_callback_t callback;
+    void *user_data;
+    struct pyd1598_core_sched plan; // Periods and due times, in uptime ms
+    bool active; // Started, holds a pm reference
+    struct pyd1598_sched_stats stats;
+};
+#endif
+
+
+#ifdef CONFIG_PYD1598_HYBRID
+struct pyd1598_hybrid {
+    struct k_work_delayable work; // Switches the mode and fetches while streaming
+    struct pyd1598_hybrid_config config;
+    int64_t mode_ms; // Uptime of the last mode switch
+    int64_t burst_ms; // Uptime the current burst started
+    int64_t active_ms; // Uptime of the last sample above the threshold
+    bool active; // Started, holds a pm reference
+    bool streaming; // Forced readout is pushed
+    bool triggered; // A trigger is waiting for its burst
+    bool verify; // The next fetch is the first of a burst
+    struct pyd1598_hybrid_stats stats;
+};
+#endif
+
+
+#ifdef CONFIG_PYD1598_OCCUPANCY
+struct pyd1598_occupancy {
+    struct k_work reset_work; // Resets the sensor after a trigger
+    struct k_work_delayable report_work; // Closes a period
+    struct k_spinlock lock; // The trigger interrupt updates the summary
+    pyd1598_occupancy_callback_t callback;
+    void *user_data;
+    uint32_t period_ms;
+    int64_t blind_us; // Blind time of the pushed configuration
+    int64_t gap_us; // Longest gap between two triggers of one visit
+    int64_t visit_start_us; // Start of the running visit, or of the period it goes on in
+    int64_t visit_last_us; // Last trigger of the running visit
+    bool visit_open;
+    bool active; // Started, holds a pm reference
+    struct pyd1598_occupancy_summary summary; // Of the running period
+};
+#endif
+
+
+#ifdef CONFIG_PYD1598_CAPTURE
+struct pyd1598_capture {
+    struct k_work work; // Hands a completed burst to the callback
+    struct k_spinlock lock; // Frames arrive from threads, work items and interrupts
+    struct pyd1598_capture_config config;
+    pyd1598_capture_callback_t callback;
+    void *user_data;
+    struct pyd1598_core_detect detect; // Wake-up detection model on the BPF frames
+    struct pyd1598_capture_burst *block; // Recording, NULL while no block is free
+    struct pyd1598_capture_burst *done; // Completed, not handed over yet
+    uint16_t head; // Next pre-trigger slot, the oldest frame once the ring is full
+    uint16_t filled; // Frames in the pre-trigger ring
+    uint16_t post; // Frames recorded after the trigger
+    uint16_t done_head; // head and filled of the completed burst
+    uint16_t done_filled;
+    bool triggered; // Ring frozen, recording the post-trigger window
+    bool active;
+    struct pyd1598_capture_stats stats;
+};
+#endif
+
+
+#ifdef CONFIG_PYD1598_INTERRUPT_READOUT
+// Sample queue item, the isr reads the configuration bits only every few readouts
+struct pyd1598_interrupt_sample {
+    struct pyd1598_frame frame;
+    bool full; // frame.sensor_conf was read back, else it is left to read()
+};
+#endif
+
+
+struct pyd1598_data {
+    uint32_t sensor_conf; // Desired configuration of the sensor
+    uint32_t measurement; // Measurement data from the sensor
+    uint32_t sensor_conf_readback; // Configuration read back by the last fetch, matching or not
+    int64_t timestamp_us; // Uptime when the measurement was sampled
+    const struct device *dev; // Back pointer, used by work items and gpio callbacks
+    struct k_mutex run_lock; // Held to check and change which of stream, scheduler, hybrid, occupancy, interrupt readout, sync and calibration run
+#ifdef CONFIG_PYD1598_TRIGGER
+    struct gpio_callback trigger_cb; // Edge on direct link while in wake-up mode
+    bool trigger_armed; // Interrupt is enabled outside of transactions
+    uint8_t trigger_paused; // Nesting depth of pyd1598_trigger_pause(), the interrupt is enabled at 0
+    pyd1598_trigger_callback_t trigger_callback; // Called from the interrupt, may be NULL
+    void *trigger_user_data;
+#endif
+#ifdef CONFIG_PYD1598_INTERRUPT_READOUT
+    struct gpio_callback interrupt_cb; // Direct link high while in interrupt readout mode
+    struct k_timer interrupt_timer; // Releases direct link after the hold time
+    struct k_msgq interrupt_queue; // Frames read by the interrupt
+    struct pyd1598_interrupt_sample interrupt_queue_buf[CONFIG_PYD1598_INTERRUPT_READOUT_QUEUE_LEN];
+    bool interrupt_running; // Interrupt readout started
+#endif
+#ifdef CONFIG_PYD1598_STREAM
+    struct k_work_delayable stream_work; // Periodic fetch
+    k_timeout_t stream_period; // Time between two fetches
+    bool stream_active; // Started, holds a pm reference
+#endif
+#ifdef CONFIG_PYD1598_STATS
+    struct pyd1598_stats stats; // Transaction counters
+#endif
+#ifdef CONFIG_PYD1598_CACHE
+    struct pyd1598_cache cache; // Shared fetch of pyd1598_fetch_if_older_than()
+#endif
+#ifdef CONFIG_PYD1598_ENERGY
+    struct pyd1598_energy energy; // Transaction time for the charge estimate
+#endif
+#ifdef CONFIG_PM_DEVICE
+    bool pm_restore; // Resumed, the configuration is not verified yet
+    int64_t pm_resume_us; // Uptime of the last resume, 0 once its first frame arrived
+#endif
+#ifdef CONFIG_PYD1598_PARTIAL_READOUT
+    uint16_t partial_left; // Measurement only readouts left before the configuration is verified again, irq locked
+#endif
+#ifdef CONFIG_PYD1598_SCHED
+    struct pyd1598_sched sched; // Signal source scheduler
+#endif
+#ifdef CONFIG_PYD1598_HYBRID
+    struct pyd1598_hybrid hybrid; // Wake-up mode with streamed bursts
+#endif
+#ifdef CONFIG_PYD1598_OCCUPANCY
+    struct pyd1598_occupancy occupancy; // Wake-up triggers folded into summaries
+#endif
+#ifdef CONFIG_PYD1598_CAPTURE
+    struct pyd1598_capture capture; // Pre/post-trigger bursts
+#endif
+#ifdef CONFIG_PYD1598_SYNC
+    bool sync_running; // Member of the running sync group, its timer drives direct link
+    uint32_t sync_edge; // Cycle count of the last sample point
+    struct pyd1598_sync_stats sync_stats;
+#endif
+#ifdef CONFIG_PYD1598_CALIB
+    struct k_work_delayable calib_work; // Periodic re-tuning
+    k_timeout_t calib_period; // Time between two calibrations
+    struct pyd1598_calib_result calib; // Result of the last successful calibration
+    bool calib_valid; // calib holds a result
+    bool calib_active; // pyd1598_calibrate() runs, under run_lock
+#endif
+};
+
+
+// Read only after configuration: https://docs.zephyrproject.org/latest/kernel/drivers/index.html
+struct pyd1598_bus_api;
+
+struct pyd1598_config {
+	int instance;
+	struct gpio_dt_spec serial_in;
+	struct gpio_dt_spec direct_link;
+	const struct pyd1598_bus_api *bus; // Serial in backend
+#ifdef CONFIG_PYD1598_FAST_GPIO
+	// Readout generated for the pins of the instance, pyd1598_fast.c
+	int (*readout)(const struct pyd1598_config *cfg, uint32_t *measurement, uint32_t *sensor_conf, int bits);
+#endif
+#ifdef CONFIG_PYD1598_BUS_SPI
+	const struct device *spi; // Controller whose MOSI drives serial in
+	struct spi_config spi_cfg;
+#endif
+};
+
+
+// Serial in backend, selected per instance from the devicetree
+// init: optional, check the backend at driver init
+// push: write the 25 configuration bits and hold for the latch time, direct link is low
+// irq_locked: push runs with irq locked for the bits and the latch time
+struct pyd1598_bus_api {
+    int (*init)(const struct device *dev);
+    int (*push)(const struct device *dev, uint32_t sensor_conf);
+    bool irq_locked;
+};
+
+// Bit banged serial in, pyd1598.c
+extern const struct pyd1598_bus_api pyd1598_bus_gpio;
+
+// Serial in waveform on the MOSI line of an spi controller, pyd1598_bus_spi.c
+#ifdef CONFIG_PYD1598_BUS_SPI
+extern const struct pyd1598_bus_api pyd1598_bus_spi;
+#endif
+
+
+// Readout shared by fetch and interrupt readout, pyd1598.c
+int pyd1598_readout_bits(const struct pyd1598_config *cfg, uint32_t *measurement, uint32_t *sensor_conf, int bits);
+
+// Readout of an instance, through constant port registers with CONFIG_PYD1598_FAST_GPIO
+#ifdef CONFIG_PYD1598_FAST_GPIO
+static inline int pyd1598_readout(const struct pyd1598_config *cfg, uint32_t *measurement, uint32_t *sensor_conf, int bits) { return cfg->readout(cfg, measurement, sensor_conf, bits); }
+#else
+static inline int pyd1598_readout(const struct pyd1598_config *cfg, uint32_t *measurement, uint32_t *sensor_conf, int bits) { return pyd1598_readout_bits(cfg, measurement, sensor_conf, bits); }
+#endif
+int pyd1598_accept_frame(const struct device *dev, const struct pyd1598_frame *frame, bool full);
+
+
+// Measurement only readouts, every CONFIG_PYD1598_PARTIAL_READOUT_INTERVAL readout is full
+// take: true if the next readout may skip the configuration bits
+// verified: a full readout matched the desired configuration
+// reset: verify on the next readout, after a push or a mismatch
+// The interrupt readout isr takes readouts too, every access locks irq
+#ifdef CONFIG_PYD1598_PARTIAL_READOUT
+static inline bool pyd1598_partial_take(struct pyd1598_data *data)
+{
+    unsigned int key = irq_lock();
+    bool partial = pyd1598_core_partial_take(&data->partial_left);
+
+    irq_unlock(key);
+    return partial;
+}
+static inline void pyd1598_partial_set(struct pyd1598_data *data, uint16_t left)
+{
+    unsigned int key = irq_lock();
+
+    data->partial_left = left;
+    irq_unlock(key);
+}
+static inline void pyd1598_partial_verified(struct pyd1598_data *data) { pyd1598_partial_set(data, CONFIG_PYD1598_PARTIAL_READOUT_INTERVAL - 1); }
+static inline void pyd1598_partial_reset(struct pyd1598_data *data) { pyd1598_partial_set(data, 0); }
+#else
+static inline bool pyd1598_partial_take(struct pyd1598_data *data) { ARG_UNUSED(data); return false; }
+static inline void pyd1598_partial_verified(struct pyd1598_data *data) { ARG_UNUSED(data); }
+static inline void pyd1598_partial_reset(struct pyd1598_data *data) { ARG_UNUSED(data); }
+#endif
+
+
+// Transaction counters, compiled out without CONFIG_PYD1598_STATS
+#ifdef CONFIG_PYD1598_STATS
+#define PYD1598_STATS_INC(data, counter) ((data)->stats.counter++)
+#else
+#define PYD1598_STATS_INC(data, counter) ((void)(data))
+#endif
+
+
+// Energy accounting, pyd1598_energy.c
+// One span per transaction in cycles, taken with pyd1598_energy_cycles() which is 0 and
+// compiled out without CONFIG_PYD1598_ENERGY
+enum pyd1598_energy_kind {
+    PYD1598_ENERGY_PUSH = 0,
+    PYD1598_ENERGY_FETCH,
+    PYD1598_ENERGY_READOUT, // Interrupt readout and synchronized sampling
+};
+
+struct pyd1598_energy_span {
+    uint32_t active; // CPU running for the transaction
+    uint32_t irq_locked; // Part of active with interrupts locked
+    uint32_t serial_in; // Serial in driven
+    uint32_t direct_link; // Direct link driven by the host
+};
+
+#ifdef CONFIG_PYD1598_ENERGY
+int pyd1598_energy_init(const struct device *dev);
+void pyd1598_energy_account(const struct device *dev, uint8_t kind, const struct pyd1598_energy_span *span);
+static inline uint32_t pyd1598_energy_cycles(void) { return k_cycle_get_32(); }
+#else
+static inline int pyd1598_energy_init(const struct device *dev) { ARG_UNUSED(dev); return 0; }
+static inline void pyd1598_energy_account(const struct device *dev, uint8_t kind, const struct pyd1598_energy_span *span) { ARG_UNUSED(dev); ARG_UNUSED(kind); ARG_UNUSED(span); }
+static inline uint32_t pyd1598_energy_cycles(void) { return 0; }
+#endif
+
+
+// Freshness bounded fetch, pyd1598_cache.c
+#ifdef CONFIG_PYD1598_CACHE
+int pyd1598_cache_init(const struct device *dev);
+void pyd1598_cache_frame(const struct device *dev, const struct pyd1598_frame *frame);
+#else
+static inline int pyd1598_cache_init(const struct device *dev) { ARG_UNUSED(dev); return 0; }
+static inline void pyd1598_cache_frame(const struct device *dev, const struct pyd1598_frame *frame) { ARG_UNUSED(dev); ARG_UNUSED(frame); }
+#endif
+
+// Wake-up trigger interrupt, pyd1598_trigger.c
+// pause/resume bracket every transaction, the host drives direct link during them
+#ifdef CONFIG_PYD1598_TRIGGER
+int pyd1598_trigger_init(const struct device *dev);
+void pyd1598_trigger_arm(const struct device *dev, bool arm);
+void pyd1598_trigger_pause(const struct device *dev);
+void pyd1598_trigger_resume(const struct device *dev);
+#else
+static inline int pyd1598_trigger_init(const struct device *dev) { ARG_UNUSED(dev); return 0; }
+static inline void pyd1598_trigger_arm(const struct device *dev, bool arm) { ARG_UNUSED(dev); ARG_UNUSED(arm); }
+static inline void pyd1598_trigger_pause(const struct device *dev) { ARG_UNUSED(dev); }
+static inline void pyd1598_trigger_resume(const struct device *dev) { ARG_UNUSED(dev); }
+#endif
+
+// Interrupt readout, pyd1598_interrupt.c
+// Push and fetch would drive direct link in between, they are refused while it runs
+#ifdef CONFIG_PYD1598_INTERRUPT_READOUT
+int pyd1598_interrupt_init(const struct device *dev);
+static inline bool pyd1598_interrupt_running(const struct device *dev)
+{
+    return ((struct pyd1598_data *)dev->data)->interrupt_running;
+}
+#else
+static inline int pyd1598_interrupt_init(const struct device *dev) { ARG_UNUSED(dev); return 0; }
+static inline bool pyd1598_interrupt_running(const struct device *dev) { ARG_UNUSED(dev); return false; }
+#endif
+
+// Synchronized sampling, pyd1598_sync.c
+// The group timer drives direct link of its members, push, fetch and suspend are refused
+#ifdef CONFIG_PYD1598_SYNC
+static inline bool pyd1598_sync_running(const struct device *dev)
+{
+    return ((struct pyd1598_data *)dev->data)->sync_running;
+}
+#else
+static inline bool pyd1598_sync_running(const struct device *dev) { ARG_UNUSED(dev); return false; }
+#endif
+
+// Driver managed streaming, pyd1598_stream.c
+// pm: stop on suspend and restart on resume, if started
+#ifdef CONFIG_PYD1598_STREAM
+int pyd1598_stream_init(const struct device *dev);
+void pyd1598_stream_pm(const struct device *dev, bool suspend);
+#else
+static inline int pyd1598_stream_init(const struct device *dev) { ARG_UNUSED(dev); return 0; }
+static inline void pyd1598_stream_pm(const struct device *dev, bool suspend) { ARG_UNUSED(dev); ARG_UNUSED(suspend); }
+#endif
+
+// Signal source scheduler, pyd1598_sched.c
+#ifdef CONFIG_PYD1598_SCHED
+int pyd1598_sched_init(const struct device *dev);
+void pyd1598_sched_pm(const struct device *dev, bool suspend);
+#else
+static inline int pyd1598_sched_init(const struct device *dev) { ARG_UNUSED(dev); return 0; }
+static inline void pyd1598_sched_pm(const struct device *dev, bool suspend) { ARG_UNUSED(dev); ARG_UNUSED(suspend); }
+#endif
+
+// Adaptive hybrid mode, pyd1598_hybrid.c
+// trigger: from the direct link interrupt, starts a burst
+// pm: pause a burst on suspend and continue it on resume, if started
+#ifdef CONFIG_PYD1598_HYBRID
+int pyd1598_hybrid_init(const struct device *dev);
+void pyd1598_hybrid_trigger(const struct device *dev);
+void pyd1598_hybrid_pm(const struct device *dev, bool suspend);
+#else
+static inline int pyd1598_hybrid_init(const struct device *dev) { ARG_UNUSED(dev); return 0; }
+static inline void pyd1598_hybrid_trigger(const struct device *dev) { ARG_UNUSED(dev); }
+static inline void pyd1598_hybrid_pm(const struct device *dev, bool suspend) { ARG_UNUSED(dev); ARG_UNUSED(suspend); }
+#endif
+
+// Wake-up occupancy aggregation, pyd1598_occupancy.c
+// trigger: from the direct link interrupt, counts the trigger and queues the reset
+#ifdef CONFIG_PYD1598_OCCUPANCY
+int pyd1598_occupancy_init(const struct device *dev);
+void pyd1598_occupancy_trigger(const struct device *dev, int64_t timestamp_us);
+#else
+static inline int pyd1598_occupancy_init(const struct device *dev) { ARG_UNUSED(dev); return 0; }
+static inline void pyd1598_occupancy_trigger(const struct device *dev, int64_t timestamp_us) { ARG_UNUSED(dev); ARG_UNUSED(timestamp_us); }
+#endif
+
+// Device power management, pyd1598.c
+// restore_pending: resumed and the configuration was not verified since
+// restored: a push or a full fetch verified the configuration
+// frame: the first frame after resume sets the resume latency
+#ifdef CONFIG_PM_DEVICE
+static inline bool pyd1598_pm_restore_pending(const struct device *dev)
+{
+    return ((struct pyd1598_data *)dev->data)->pm_restore;
+}
+static inline void pyd1598_pm_restored(const struct device *dev)
+{
+    ((struct pyd1598_data *)dev->data)->pm_restore = false;
+}
+static inline void pyd1598_pm_frame(struct pyd1598_data *data, const struct pyd1598_frame *frame)
+{
+    if (data->pm_resume_us == 0) {
+        return;
+    }
+#ifdef CONFIG_PYD1598_STATS
+    data->stats.resume_latency_us = (uint32_t)(frame->timestamp_us - data->pm_resume_us);
+#endif
+    data->pm_resume_us = 0;
+}
+#else
+static inline bool pyd1598_pm_restore_pending(const struct device *dev) { ARG_UNUSED(dev); return false; }
+static inline void pyd1598_pm_restored(const struct device *dev) { ARG_UNUSED(dev); }
+static inline void pyd1598_pm_frame(struct pyd1598_data *data, const struct pyd1598_frame *frame) { ARG_UNUSED(data); ARG_UNUSED(frame); }
+#endif
+
+// Binary transaction trace, pyd1598_trace.c
+#ifdef CONFIG_PYD1598_TRACE
+void pyd1598_trace(const struct device *dev, uint8_t id, uint16_t arg16, uint32_t arg32);
+#else
+static inline void pyd1598_trace(const struct device *dev, uint8_t id, uint16_t arg16, uint32_t arg32) { ARG_UNUSED(dev); ARG_UNUSED(id); ARG_UNUSED(arg16); ARG_UNUSED(arg32); }
+#endif
+
+// Protocol timing recorder, pyd1598_timing.c
+// pin: a pin action of a transaction, recorded while the device is being recorded
+#ifdef CONFIG_PYD1598_TIMING_CHECK
+void pyd1598_timing_pin(const struct pyd1598_config *cfg, uint8_t line, uint8_t action, uint8_t level);
+#else
+static inline void pyd1598_timing_pin(const struct pyd1598_config *cfg, uint8_t line, uint8_t action, uint8_t level) { ARG_UNUSED(cfg); ARG_UNUSED(line); ARG_UNUSED(action); ARG_UNUSED(level); }
+#endif
+
+// Sensor emulator on gpio_emul, pyd1598_emul.c
+// pin: answer a pin action of the host like the sensor would
+#ifdef CONFIG_PYD1598_EMUL
+int pyd1598_emul_init(const struct device *dev);
+void pyd1598_emul_pin(const struct pyd1598_config *cfg, uint8_t line, uint8_t action, uint8_t level);
+#else
+static inline int pyd1598_emul_init(const struct device *dev) { ARG_UNUSED(dev); return 0; }
+static inline void pyd1598_emul_pin(const struct pyd1598_config *cfg, uint8_t line, uint8_t action, uint8_t level) { ARG_UNUSED(cfg); ARG_UNUSED(line); ARG_UNUSED(action); ARG_UNUSED(level); }
+#endif
+
+// Every pin action of a transaction, reported next to the gpio call that did it
+static inline void pyd1598_timing_mark(const struct pyd1598_config *cfg, uint8_t line, uint8_t action, uint8_t level)
+{
+    pyd1598_timing_pin(cfg, line, action, level);
+    pyd1598_emul_pin(cfg, line, action, level);
+}
+
+// Threshold calibration, pyd1598_calib.c
+// Calibration pushes its own signal source and mode, the other modes are refused while it runs
+#ifdef CONFIG_PYD1598_CALIB
+int pyd1598_calib_init(const struct device *dev);
+static inline bool pyd1598_calib_running(const struct device *dev)
+{
+    return ((struct pyd1598_data *)dev->data)->calib_active;
+}
+#else
+static inline int pyd1598_calib_init(const struct device *dev) { ARG_UNUSED(dev); return 0; }
+static inline bool pyd1598_calib_running(const struct device *dev) { ARG_UNUSED(dev); return false; }
+#endif
+
+// zbus publication, pyd1598_zbus.c
+#ifdef CONFIG_PYD1598_ZBUS
+void pyd1598_zbus_publish_frame(const struct device *dev, const struct pyd1598_frame *frame);
+void pyd1598_zbus_publish_trigger(const struct device *dev, int64_t timestamp_us);
+#else
+static inline void pyd1598_zbus_publish_frame(const struct device *dev, const struct pyd1598_frame *frame) { ARG_UNUSED(dev); ARG_UNUSED(frame); }
+static inline void pyd1598_zbus_publish_trigger(const struct device *dev, int64_t timestamp_us) { ARG_UNUSED(dev); ARG_UNUSED(timestamp_us); }
+#endif
+#ifdef CONFIG_PYD1598_FUSION
+#ifdef CONFIG_PYD1598_ZBUS
+void pyd1598_zbus_publish_fusion(const struct pyd1598_fusion_event *event);
+#else
+static inline void pyd1598_zbus_publish_fusion(const struct pyd1598_fusion_event *event) { ARG_UNUSED(event); }
+#endif
+#endif
+
+#ifdef CONFIG_PYD1598_OCCUPANCY
+#ifdef CONFIG_PYD1598_ZBUS
+void pyd1598_zbus_publish_occupancy(const struct device *dev, const struct pyd1598_occupancy_summary *summary);
+#else
+static inline void pyd1598_zbus_publish_occupancy(const struct device *dev, const struct pyd1598_occupancy_summary *summary) { ARG_UNUSED(dev); ARG_UNUSED(summary); }
+#endif
+#endif
+
+// Zone and direction fusion, pyd1598_fusion.c
+// frame: every accepted frame, trigger: from the direct link interrupt
+#ifdef CONFIG_PYD1598_FUSION
+void pyd1598_fusion_frame(const struct device *dev, const struct pyd1598_frame *frame);
+void pyd1598_fusion_trigger(const struct device *dev, int64_t timestamp_us);
+#else
+static inline void pyd1598_fusion_frame(const struct device *dev, const struct pyd1598_frame *frame) { ARG_UNUSED(dev); ARG_UNUSED(frame); }
+static inline void pyd1598_fusion_trigger(const struct device *dev, int64_t timestamp_us) { ARG_UNUSED(dev); ARG_UNUSED(timestamp_us); }
+#endif
+
+// Pre/post-trigger burst capture, pyd1598_capture.c
+// frame: every accepted frame
+#ifdef CONFIG_PYD1598_CAPTURE
+int pyd1598_capture_init(const struct device *dev);
+void pyd1598_capture_frame(const struct device *dev, const struct pyd1598_frame *frame);
+#else
+static inline int pyd1598_capture_init(const struct device *dev) { ARG_UNUSED(dev); return 0; }
+static inline void pyd1598_capture_frame(const struct device *dev, const struct pyd1598_frame *frame) { ARG_UNUSED(dev); ARG_UNUSED(frame); }
+#endif
+
+// Persistent frame logger, pyd1598_logger.c
+#ifdef CONFIG_PYD1598_LOGGER
+void pyd1598_logger_frame(const struct device *dev, const struct pyd1598_frame *frame);
+#else
+static inline void pyd1598_logger_frame(const struct device *dev, const struct pyd1598_frame *frame) { ARG_UNUSED(dev); ARG_UNUSED(frame); }
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZEPHYR_DRIVERS_SENSOR_PYD1598_PYD1598_INTERNAL_H_ */
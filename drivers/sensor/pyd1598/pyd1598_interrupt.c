@@ -0,0 +1,324 @@
+/*
+PYD1598 interrupt readout
+
+In interrupt readout mode the sensor pulls direct link high whenever a new sample is
+ready, at its native rate. The interrupt reads the 40 bits out right away, without the
+start pulse of a forced readout, and puts the frame in a per instance sample queue.
+pyd1598_interrupt_readout_read() takes frames from the queue, checks and publishes
+them like pyd1598_fetch().
+
+Direct link has to stay low for 1250 us after a readout. A timer releases it instead
+of a busy wait, so a sample costs the 40 bit clocking in the isr and nothing else.
+The interrupt is level triggered and disabled from the isr until the timer releases
+the pin, a sample that is already waiting then fires it at once instead of being
+missed like an edge would.
+*/
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/irq.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/kernel.h>
+#include <zephyr/pm/device_runtime.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pyd1598.h>
+#include "pyd1598_internal.h"
+
+LOG_MODULE_DECLARE(PYD1598, PYD1598_LOG_LEVEL);
+
+
+// Runs in interrupt context, the sensor has a sample ready
+static void pyd1598_interrupt_callback(const struct device *port, struct gpio_callback *cb, uint32_t pins)
+{
+    // Variables
+    const struct pyd1598_config *cfg;
+    struct pyd1598_data *data;
+    struct pyd1598_interrupt_sample sample;
+    struct pyd1598_energy_span span = {0};
+    uint32_t energy_start;
+    uint32_t energy_lock;
+    uint32_t measurement = 0;
+    uint32_t sensor_conf = 0;
+    int key;
+    int ret;
+    bool full;
+
+    ARG_UNUSED(port);
+    ARG_UNUSED(pins);
+
+    // Declare the variables
+    data = CONTAINER_OF(cb, struct pyd1598_data, interrupt_cb);
+    cfg = data->dev->config;
+
+    if (!data->interrupt_running) {
+        return;
+    }
+
+    energy_start = pyd1598_energy_cycles();
+    gpio_pin_interrupt_configure_dt(&cfg->direct_link, GPIO_INT_DISABLE);
+    full = !pyd1598_partial_take(data);
+    PYD1598_STATS_INC(data, fetch_count);
+
+    // The sensor latched the sample when it raised direct link
+    sample.frame.timestamp_us = k_ticks_to_us_floor64(k_uptime_ticks());
+
+    key = irq_lock();
+    energy_lock = pyd1598_energy_cycles();
+    ret = pyd1598_readout(cfg, &measurement, &sensor_conf, full ? PYD1598_READOUT_BITS : PYD1598_MEASUREMENT_BITS);
+
+    // Hold direct link low, the timer releases it
+    gpio_pin_configure_dt(&cfg->direct_link, GPIO_OUTPUT_LOW);
+    irq_unlock(key);
+
+    k_timer_start(&data->interrupt_timer, K_USEC(1500), K_NO_WAIT);
+
+    // The hold time costs the pin, not the CPU
+    span.irq_locked = pyd1598_energy_cycles() - energy_lock;
+    span.direct_link = k_us_to_cyc_ceil32(1500);
+    span.active = pyd1598_energy_cycles() - energy_start;
+    pyd1598_energy_account(data->dev, PYD1598_ENERGY_READOUT, &span);
+
+    if (ret != 0) {
+        return;
+    }
+    pyd1598_trace(data->dev, PYD1598_TRACE_READOUT, (uint16_t)measurement,
+                  sensor_conf | ((uint32_t)(full ? PYD1598_READOUT_BITS : PYD1598_MEASUREMENT_BITS) << 25));
+
+    // read() fills in the desired configuration of partial frames
+    sample.frame.sensor_conf = sensor_conf;
+    sample.frame.measurement = (uint16_t)measurement;
+    sample.full = full;
+    if (k_msgq_put(&data->interrupt_queue, &sample, K_NO_WAIT) != 0) {
+        PYD1598_STATS_INC(data, readout_dropped);
+    }
+}
+
+
+// Runs in interrupt context, the hold time after a readout has passed
+static void pyd1598_interrupt_release(struct k_timer *timer)
+{
+    // Variables
+    const struct pyd1598_config *cfg;
+    struct pyd1598_data *data;
+
+    // Declare the variables
+    data = CONTAINER_OF(timer, struct pyd1598_data, interrupt_timer);
+    cfg = data->dev->config;
+
+    gpio_pin_configure_dt(&cfg->direct_link, GPIO_INPUT);
+    if (data->interrupt_running) {
+        gpio_pin_interrupt_configure_dt(&cfg->direct_link, GPIO_INT_LEVEL_ACTIVE);
+    }
+}
+
+
+/**
+ * @brief Register the direct link callback and the sample queue, the interrupt stays
+ * disabled until started.
+ *
+ * @param dev Pointer to the sensor device
+ *
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_interrupt_init(const struct device *dev)
+{
+    // Variables
+    const struct pyd1598_config *cfg;
+    struct pyd1598_data *data;
+    int ret;
+
+    // Declare the variables
+    cfg = dev->config;
+    data = dev->data;
+    data->interrupt_running = false;
+
+    k_msgq_init(&data->interrupt_queue, (char *)data->interrupt_queue_buf, sizeof(struct pyd1598_interrupt_sample),
+                ARRAY_SIZE(data->interrupt_queue_buf));
+    k_timer_init(&data->interrupt_timer, pyd1598_interrupt_release, NULL);
+
+    gpio_init_callback(&data->interrupt_cb, pyd1598_interrupt_callback, BIT(cfg->direct_link.pin));
+    ret = gpio_add_callback(cfg->direct_link.port, &data->interrupt_cb);
+    if (ret != 0) {
+        LOG_ERR("Failed to add direct link callback on pin %d", cfg->direct_link.pin);
+        return ret;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Start reading out every sample the sensor signals into the sample queue.
+ *
+ * The configuration must have been pushed in interrupt readout mode. push and fetch
+ * return -EBUSY until pyd1598_interrupt_readout_stop() is called.
+ *
+ * @param dev Pointer to the sensor device
+ *
+ * @return 0 if successful, -EBUSY if the device is already reading out, streaming, scheduled,
+ * in hybrid mode, in a sync group or calibrating, negative errno code if failure.
+ */
+int pyd1598_interrupt_readout_start(const struct device *dev)
+{
+    // Variables
+    const struct pyd1598_config *cfg;
+    struct pyd1598_data *data;
+    enum pyd1598_operation_mode operation_mode;
+    int ret;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_interrupt_readout_start");
+    if (dev == NULL || dev->data == NULL) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    cfg = dev->config;
+    data = dev->data;
+
+    ret = pyd1598_get_operation_mode(dev, &operation_mode);
+    if (ret != 0) {
+        return ret;
+    }
+    if (operation_mode != PYD1598_INTERRUPT_READOUT) {
+        LOG_ERR("Sensor is not in interrupt readout mode");
+        return -EIO;
+    }
+
+    // The modules that read the sensor out on their own, checked and claimed under the lock
+    k_mutex_lock(&data->run_lock, K_FOREVER);
+    if (data->interrupt_running || pyd1598_sync_running(dev) || pyd1598_calib_running(dev)) {
+        k_mutex_unlock(&data->run_lock);
+        return -EBUSY;
+    }
+#ifdef CONFIG_PYD1598_STREAM
+    if (data->stream_active) {
+        k_mutex_unlock(&data->run_lock);
+        return -EBUSY;
+    }
+#endif
+#ifdef CONFIG_PYD1598_SCHED
+    if (data->sched.active) {
+        k_mutex_unlock(&data->run_lock);
+        return -EBUSY;
+    }
+#endif
+#ifdef CONFIG_PYD1598_HYBRID
+    if (data->hybrid.active) {
+        k_mutex_unlock(&data->run_lock);
+        return -EBUSY;
+    }
+#endif
+
+    // The isr reads out on its own, keep the device resumed until stopped
+    ret = pm_device_runtime_get(dev);
+    if (ret < 0) {
+        k_mutex_unlock(&data->run_lock);
+        return ret;
+    }
+
+    k_msgq_purge(&data->interrupt_queue);
+    data->interrupt_running = true;
+
+    ret = gpio_pin_interrupt_configure_dt(&cfg->direct_link, GPIO_INT_LEVEL_ACTIVE);
+    if (ret != 0) {
+        data->interrupt_running = false;
+        pm_device_runtime_put(dev);
+        k_mutex_unlock(&data->run_lock);
+        LOG_ERR("Failed to enable direct link interrupt on pin %d", cfg->direct_link.pin);
+        return ret;
+    }
+    k_mutex_unlock(&data->run_lock);
+
+    return 0;
+}
+
+
+/**
+ * @brief Stop interrupt readout, frames still in the sample queue can be read.
+ *
+ * @param dev Pointer to the sensor device
+ *
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_interrupt_readout_stop(const struct device *dev)
+{
+    // Variables
+    const struct pyd1598_config *cfg;
+    struct pyd1598_data *data;
+    int key;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_interrupt_readout_stop");
+    if (dev == NULL || dev->data == NULL) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    cfg = dev->config;
+    data = dev->data;
+
+    k_mutex_lock(&data->run_lock, K_FOREVER);
+    if (!data->interrupt_running) {
+        k_mutex_unlock(&data->run_lock);
+        return 0;
+    }
+
+    // Not in the middle of a readout or a release, neither can start again afterwards
+    key = irq_lock();
+    data->interrupt_running = false;
+    k_timer_stop(&data->interrupt_timer);
+    gpio_pin_interrupt_configure_dt(&cfg->direct_link, GPIO_INT_DISABLE);
+    irq_unlock(key);
+
+    // Release the pin now, the next push clocks serial in for longer than the rest of the hold time
+    gpio_pin_configure_dt(&cfg->direct_link, GPIO_INPUT);
+    pm_device_runtime_put(dev);
+    k_mutex_unlock(&data->run_lock);
+
+    return 0;
+}
+
+
+/**
+ * @brief Take the next frame from the sample queue, check it against the desired
+ * configuration and save and publish it like pyd1598_fetch().
+ *
+ * @param dev Pointer to the sensor device
+ * @param frame Pointer to where the frame should be stored
+ * @param timeout Time to wait for a frame
+ *
+ * @return 0 if successful, -EAGAIN on timeout, -EIO if the read back configuration
+ * does not match, negative errno code if failure.
+ */
+int pyd1598_interrupt_readout_read(const struct device *dev, struct pyd1598_frame *frame, k_timeout_t timeout)
+{
+    // Variables
+    struct pyd1598_data *data;
+    struct pyd1598_interrupt_sample sample;
+    int ret;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_interrupt_readout_read");
+    if (dev == NULL || dev->data == NULL || frame == NULL) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+
+    ret = k_msgq_get(&data->interrupt_queue, &sample, timeout);
+    if (ret != 0) {
+        return (ret == -ENOMSG) ? -EAGAIN : ret;
+    }
+
+    // Partial frames carry the desired configuration
+    *frame = sample.frame;
+    if (!sample.full) {
+        frame->sensor_conf = data->sensor_conf;
+    }
+
+    return pyd1598_accept_frame(dev, frame, sample.full);
+}
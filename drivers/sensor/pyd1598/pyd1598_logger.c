@@ -0,0 +1,420 @@
+/*
+PYD1598 persistent frame logger
+
+Frames of all instances are encoded into a RAM block and the block is appended to a
+littlefs file when it is full, so the flash only sees large block-aligned writes.
+Two blocks are used, one is filled by fetch while the other is written by a work
+item. A frame that arrives while both are busy is dropped and counted.
+
+The file is a sequence of CONFIG_PYD1598_LOGGER_BLOCK_SIZE byte blocks in the format
+of pyd1598_core.h, written with the same core functions replay reads them with.
+
+Every block is self contained: the first record of an instance in a block is a time
+record followed by a config record, later frames only carry the timestamp delta to
+the previous frame of the same instance, and a config record is only written again
+when the read back config changes. A frame at 100 Hz takes 5 bytes instead of 14.
+
+With CONFIG_PYD1598_LOGGER_FILE_SIZE the log is a ring of two files: a block that
+would take the file past the size renames it to the path with ".old" appended,
+replacing the previous one, and starts a new file.
+*/
+
+#define DT_DRV_COMPAT excelitas_pyd1598
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/fs/fs.h>
+#include <zephyr/init.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/kernel.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pyd1598.h>
+#include "pyd1598_internal.h"
+
+LOG_MODULE_DECLARE(PYD1598, PYD1598_LOG_LEVEL);
+
+
+#define PYD1598_LOGGER_INSTANCES DT_NUM_INST_STATUS_OKAY(DT_DRV_COMPAT)
+BUILD_ASSERT(PYD1598_LOGGER_INSTANCES < PYD1598_LOG_INSTANCES, "Logger record tags hold instance 0-62");
+
+BUILD_ASSERT(CONFIG_PYD1598_LOGGER_BLOCK_SIZE >= PYD1598_LOG_HEADER_SIZE + PYD1598_LOG_RECORD_MAX,
+             "Logger block too small for one frame");
+BUILD_ASSERT(CONFIG_PYD1598_LOGGER_FILE_SIZE == 0 || CONFIG_PYD1598_LOGGER_FILE_SIZE >= CONFIG_PYD1598_LOGGER_BLOCK_SIZE,
+             "Log file size below one block");
+
+#define PYD1598_LOGGER_OLD_PATH CONFIG_PYD1598_LOGGER_PATH ".old"
+
+
+struct pyd1598_logger_block {
+    uint8_t buf[CONFIG_PYD1598_LOGGER_BLOCK_SIZE];
+    size_t len;
+};
+
+struct pyd1598_logger {
+    struct k_spinlock lock; // Protects everything below except the file
+    struct pyd1598_logger_block blocks[2];
+    struct pyd1598_logger_block *active; // Filled by fetch
+    struct pyd1598_logger_block *pending; // Written by the work item, NULL when idle
+    uint32_t sequence; // Sequence number of the active block
+    bool running;
+
+    // Per instance delta state, reset at every block start
+    struct pyd1598_core_log_instance instances[PYD1598_LOGGER_INSTANCES];
+
+    struct pyd1598_logger_stats stats;
+    struct fs_file_t file;
+    size_t file_size; // Bytes in the open file
+    struct k_work flush_work;
+    struct k_mutex file_lock; // Serialises the work item with start/stop/flush
+};
+
+static struct pyd1598_logger logger;
+
+
+// Called with the lock held
+static void pyd1598_logger_block_begin(struct pyd1598_logger_block *block)
+{
+    block->len = pyd1598_core_log_begin(block->buf, logger.sequence);
+
+    logger.sequence++;
+    for (int i = 0; i < PYD1598_LOGGER_INSTANCES; i++) {
+        logger.instances[i].in_block = false;
+    }
+}
+
+
+// Called with the lock held, pads the block so every write is block sized
+static void pyd1598_logger_block_pad(struct pyd1598_logger_block *block)
+{
+    memset(&block->buf[block->len], PYD1598_LOG_PAD, sizeof(block->buf) - block->len);
+}
+
+
+// Called with the file lock held, the open file becomes the old one and a new file is started
+static int pyd1598_logger_rotate(void)
+{
+    k_spinlock_key_t key;
+    int ret;
+
+    ret = fs_close(&logger.file);
+    if (ret != 0) {
+        return ret;
+    }
+
+    ret = fs_unlink(PYD1598_LOGGER_OLD_PATH);
+    if (ret != 0 && ret != -ENOENT) {
+        return ret;
+    }
+    ret = fs_rename(CONFIG_PYD1598_LOGGER_PATH, PYD1598_LOGGER_OLD_PATH);
+    if (ret != 0) {
+        return ret;
+    }
+
+    fs_file_t_init(&logger.file);
+    ret = fs_open(&logger.file, CONFIG_PYD1598_LOGGER_PATH, FS_O_CREATE | FS_O_WRITE | FS_O_APPEND);
+    if (ret != 0) {
+        return ret;
+    }
+    logger.file_size = 0;
+
+    key = k_spin_lock(&logger.lock);
+    logger.stats.files_rotated++;
+    k_spin_unlock(&logger.lock, key);
+
+    return 0;
+}
+
+
+// Called with the file lock held
+static int pyd1598_logger_write(struct pyd1598_logger_block *block)
+{
+    ssize_t written;
+    int ret;
+
+    if (CONFIG_PYD1598_LOGGER_FILE_SIZE > 0 &&
+        logger.file_size + sizeof(block->buf) > CONFIG_PYD1598_LOGGER_FILE_SIZE) {
+        ret = pyd1598_logger_rotate();
+        if (ret != 0) {
+            return ret;
+        }
+    }
+
+    written = fs_write(&logger.file, block->buf, sizeof(block->buf));
+    if (written != (ssize_t)sizeof(block->buf)) {
+        return (written < 0) ? (int)written : -ENOSPC;
+    }
+    logger.file_size += sizeof(block->buf);
+
+    ret = fs_sync(&logger.file);
+    if (ret != 0) {
+        return ret;
+    }
+
+    return 0;
+}
+
+
+static void pyd1598_logger_flush_work_handler(struct k_work *work)
+{
+    struct pyd1598_logger_block *block;
+    k_spinlock_key_t key;
+    int ret;
+
+    ARG_UNUSED(work);
+
+    k_mutex_lock(&logger.file_lock, K_FOREVER);
+
+    key = k_spin_lock(&logger.lock);
+    block = logger.pending;
+    k_spin_unlock(&logger.lock, key);
+
+    if (block != NULL) {
+        ret = pyd1598_logger_write(block);
+
+        key = k_spin_lock(&logger.lock);
+        if (ret == 0) {
+            logger.stats.blocks_written++;
+            logger.stats.bytes_written += sizeof(block->buf);
+        }
+        else {
+            logger.stats.write_errors++;
+        }
+        logger.pending = NULL;
+        k_spin_unlock(&logger.lock, key);
+
+        if (ret != 0) {
+            LOG_ERR("Failed to write log block: %d", ret);
+        }
+    }
+
+    k_mutex_unlock(&logger.file_lock);
+}
+
+
+/**
+ * @brief Encode a frame into the active block, called by fetch for every frame.
+ *
+ * @param dev Pointer to the sensor device
+ * @param frame Frame to log
+ */
+void pyd1598_logger_frame(const struct device *dev, const struct pyd1598_frame *frame)
+{
+    const struct pyd1598_config *cfg;
+    struct pyd1598_logger_block *block;
+    k_spinlock_key_t key;
+    int instance;
+    bool submit = false;
+
+    cfg = dev->config;
+    instance = cfg->instance;
+
+    key = k_spin_lock(&logger.lock);
+
+    if (!logger.running) {
+        k_spin_unlock(&logger.lock, key);
+        return;
+    }
+
+    // Hand a full block to the work item, or drop the frame if it is still busy
+    block = logger.active;
+    if (sizeof(block->buf) - block->len < PYD1598_LOG_RECORD_MAX) {
+        if (logger.pending != NULL) {
+            logger.stats.frames_dropped++;
+            k_spin_unlock(&logger.lock, key);
+            return;
+        }
+        pyd1598_logger_block_pad(block);
+        logger.pending = block;
+        logger.active = (block == &logger.blocks[0]) ? &logger.blocks[1] : &logger.blocks[0];
+        block = logger.active;
+        pyd1598_logger_block_begin(block);
+        submit = true;
+    }
+
+    block->len += pyd1598_core_log_frame(&block->buf[block->len], &logger.instances[instance], instance,
+                                         frame->timestamp_us, frame->sensor_conf, frame->measurement);
+    logger.stats.frames_logged++;
+
+    k_spin_unlock(&logger.lock, key);
+
+    if (submit) {
+        k_work_submit(&logger.flush_work);
+    }
+}
+
+
+/**
+ * @brief Open the log file and start logging every fetched frame.
+ *
+ * The file system holding CONFIG_PYD1598_LOGGER_PATH must be mounted.
+ *
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_logger_start(void)
+{
+    struct fs_dirent entry;
+    k_spinlock_key_t key;
+    int ret;
+
+    LOG_DBG("pyd1598_logger_start");
+
+    k_mutex_lock(&logger.file_lock, K_FOREVER);
+
+    if (logger.running) {
+        k_mutex_unlock(&logger.file_lock);
+        return -EALREADY;
+    }
+
+    fs_file_t_init(&logger.file);
+    ret = fs_open(&logger.file, CONFIG_PYD1598_LOGGER_PATH, FS_O_CREATE | FS_O_WRITE | FS_O_APPEND);
+    if (ret != 0) {
+        k_mutex_unlock(&logger.file_lock);
+        LOG_ERR("Failed to open %s: %d", CONFIG_PYD1598_LOGGER_PATH, ret);
+        return ret;
+    }
+
+    // Appending to a log of an earlier run counts its size
+    ret = fs_stat(CONFIG_PYD1598_LOGGER_PATH, &entry);
+    logger.file_size = (ret == 0) ? entry.size : 0;
+
+    key = k_spin_lock(&logger.lock);
+    logger.active = &logger.blocks[0];
+    logger.pending = NULL;
+    pyd1598_logger_block_begin(logger.active);
+    logger.running = true;
+    k_spin_unlock(&logger.lock, key);
+
+    k_mutex_unlock(&logger.file_lock);
+
+    return 0;
+}
+
+
+/**
+ * @brief Write the partially filled block, padded to a full block.
+ *
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_logger_flush(void)
+{
+    struct k_work_sync sync;
+    struct pyd1598_logger_block *block;
+    k_spinlock_key_t key;
+    int ret = 0;
+
+    LOG_DBG("pyd1598_logger_flush");
+
+    // Let a pending full block go first so the file stays in order
+    k_work_flush(&logger.flush_work, &sync);
+
+    k_mutex_lock(&logger.file_lock, K_FOREVER);
+
+    key = k_spin_lock(&logger.lock);
+    if (!logger.running || logger.pending != NULL) {
+        k_spin_unlock(&logger.lock, key);
+        k_mutex_unlock(&logger.file_lock);
+        return logger.running ? -EBUSY : -EINVAL;
+    }
+    block = logger.active;
+    if (block->len == PYD1598_LOG_HEADER_SIZE) {
+        // Nothing logged since the last block
+        k_spin_unlock(&logger.lock, key);
+        k_mutex_unlock(&logger.file_lock);
+        return 0;
+    }
+    pyd1598_logger_block_pad(block);
+    logger.pending = block;
+    logger.active = (block == &logger.blocks[0]) ? &logger.blocks[1] : &logger.blocks[0];
+    pyd1598_logger_block_begin(logger.active);
+    k_spin_unlock(&logger.lock, key);
+
+    ret = pyd1598_logger_write(block);
+
+    key = k_spin_lock(&logger.lock);
+    if (ret == 0) {
+        logger.stats.blocks_written++;
+        logger.stats.bytes_written += sizeof(block->buf);
+    }
+    else {
+        logger.stats.write_errors++;
+    }
+    logger.pending = NULL;
+    k_spin_unlock(&logger.lock, key);
+
+    k_mutex_unlock(&logger.file_lock);
+
+    return ret;
+}
+
+
+/**
+ * @brief Flush, stop logging and close the log file.
+ *
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_logger_stop(void)
+{
+    k_spinlock_key_t key;
+    int ret;
+
+    LOG_DBG("pyd1598_logger_stop");
+
+    ret = pyd1598_logger_flush();
+    if (ret != 0 && ret != -EINVAL) {
+        LOG_ERR("Failed to flush log: %d", ret);
+    }
+
+    k_mutex_lock(&logger.file_lock, K_FOREVER);
+
+    key = k_spin_lock(&logger.lock);
+    if (!logger.running) {
+        k_spin_unlock(&logger.lock, key);
+        k_mutex_unlock(&logger.file_lock);
+        return -EINVAL;
+    }
+    logger.running = false;
+    k_spin_unlock(&logger.lock, key);
+
+    ret = fs_close(&logger.file);
+
+    k_mutex_unlock(&logger.file_lock);
+
+    return ret;
+}
+
+
+/**
+ * @brief Get the logger counters.
+ *
+ * @param stats Pointer to where the counters should be stored
+ *
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_logger_get_stats(struct pyd1598_logger_stats *stats)
+{
+    k_spinlock_key_t key;
+
+    if (stats == NULL) {
+        return -EINVAL;
+    }
+
+    key = k_spin_lock(&logger.lock);
+    *stats = logger.stats;
+    k_spin_unlock(&logger.lock, key);
+
+    return 0;
+}
+
+
+static int pyd1598_logger_init(void)
+{
+    k_work_init(&logger.flush_work, pyd1598_logger_flush_work_handler);
+    k_mutex_init(&logger.file_lock);
+
+    return 0;
+}
+
+SYS_INIT(pyd1598_logger_init, POST_KERNEL, CONFIG_SENSOR_INIT_PRIORITY);
@@ -0,0 +1,361 @@
+/*
+PYD1598 wake-up occupancy aggregation
+
+In wake-up mode every trigger holds direct link high until the host resets the sensor,
+and an application that resets and reports every trigger wakes up and sends a message
+per trigger. The aggregation resets the sensor itself and folds the triggers of a
+reporting period into one summary:
+
+  triggers  wake-ups in the period
+  visits    runs of triggers with gaps of at most blind time + window time, the
+            longest a sensor that keeps seeing motion stays quiet between two triggers
+  first     first and last trigger of the period
+  last
+  dwell     time covered by visits, a visit lasts from its first trigger to the end of
+            the blind time after its last one, a visit still going at the end of the
+            period counts up to the end and goes on in the next one without being
+            counted again
+
+The blind and window time come from the configuration pushed in wake-up mode when the
+aggregation is started. The trigger interrupt only updates the counters and queues the
+reset, the reset runs on the system work queue. Summaries go to a callback and with
+CONFIG_PYD1598_ZBUS to pyd1598_occupancy_chan once per period, empty periods included
+so a missing summary means a missing node, not an empty room.
+*/
+
+#include <zephyr/device.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/kernel.h>
+#include <zephyr/pm/device_runtime.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pyd1598.h>
+#include "pyd1598_internal.h"
+
+LOG_MODULE_DECLARE(PYD1598, PYD1598_LOG_LEVEL);
+
+
+// Dwell of the running visit up to now_us, call with the lock held
+static uint32_t occupancy_dwell_ms(const struct pyd1598_occupancy *occ, int64_t now_us)
+{
+    // Variables
+    int64_t visit_end_us;
+
+    // Up to now while the next trigger can still continue it, else to the end of the blind time
+    if (now_us - occ->visit_last_us <= occ->gap_us) {
+        visit_end_us = now_us;
+    }
+    else {
+        visit_end_us = MIN(occ->visit_last_us + occ->blind_us, now_us);
+    }
+
+    // The start moves to the period boundary, which may be after the blind time
+    return (uint32_t)(MAX(visit_end_us - occ->visit_start_us, 0) / USEC_PER_MSEC);
+}
+
+
+// Resets the sensor after every trigger so it can trigger again after the blind time
+static void pyd1598_occupancy_reset_handler(struct k_work *work)
+{
+    // Variables
+    struct pyd1598_data *data;
+    k_spinlock_key_t key;
+    int ret;
+
+    // Declare the variables
+    data = CONTAINER_OF(work, struct pyd1598_data, occupancy.reset_work);
+
+    ret = pyd1598_reset(data->dev);
+    if (ret != 0) {
+        LOG_DBG("Occupancy reset failed: %d", ret);
+        key = k_spin_lock(&data->occupancy.lock);
+        data->occupancy.summary.reset_errors++;
+        k_spin_unlock(&data->occupancy.lock, key);
+    }
+}
+
+
+static void pyd1598_occupancy_report_handler(struct k_work *work)
+{
+    // Variables
+    struct k_work_delayable *dwork;
+    struct pyd1598_data *data;
+    struct pyd1598_occupancy *occ;
+    struct pyd1598_occupancy_summary summary;
+    k_spinlock_key_t key;
+    int64_t now_us;
+
+    // Declare the variables
+    dwork = k_work_delayable_from_work(work);
+    data = CONTAINER_OF(dwork, struct pyd1598_data, occupancy.report_work);
+    occ = &data->occupancy;
+
+    // Reschedule first so the period does not drift with the callback
+    k_work_schedule(dwork, K_MSEC(occ->period_ms));
+
+    key = k_spin_lock(&occ->lock);
+    now_us = k_ticks_to_us_floor64(k_uptime_ticks());
+    if (occ->visit_open) {
+        occ->summary.dwell_ms += occupancy_dwell_ms(occ, now_us);
+        occ->visit_start_us = now_us;
+
+        // Still going, the next period continues the visit from here
+        occ->visit_open = (now_us - occ->visit_last_us <= occ->gap_us);
+    }
+    occ->summary.end_us = now_us;
+    occ->summary.occupied = occ->visit_open;
+    summary = occ->summary;
+
+    memset(&occ->summary, 0, sizeof(occ->summary));
+    occ->summary.start_us = now_us;
+    k_spin_unlock(&occ->lock, key);
+
+    pyd1598_zbus_publish_occupancy(data->dev, &summary);
+    if (occ->callback != NULL) {
+        occ->callback(data->dev, &summary, occ->user_data);
+    }
+}
+
+
+int pyd1598_occupancy_init(const struct device *dev)
+{
+    // Variables
+    struct pyd1598_data *data;
+
+    // Declare the variables
+    data = dev->data;
+    memset(&data->occupancy, 0, sizeof(data->occupancy));
+
+    k_work_init(&data->occupancy.reset_work, pyd1598_occupancy_reset_handler);
+    k_work_init_delayable(&data->occupancy.report_work, pyd1598_occupancy_report_handler);
+
+    return 0;
+}
+
+
+/**
+ * @brief Count a wake-up trigger and queue the reset, called from the direct link interrupt.
+ *
+ * @param dev Pointer to the sensor device
+ * @param timestamp_us Uptime of the trigger
+ */
+void pyd1598_occupancy_trigger(const struct device *dev, int64_t timestamp_us)
+{
+    // Variables
+    struct pyd1598_data *data;
+    struct pyd1598_occupancy *occ;
+    k_spinlock_key_t key;
+
+    // Declare the variables
+    data = dev->data;
+    occ = &data->occupancy;
+
+    if (!occ->active) {
+        return;
+    }
+
+    key = k_spin_lock(&occ->lock);
+    if (occ->summary.triggers == 0) {
+        occ->summary.first_us = timestamp_us;
+    }
+    occ->summary.triggers++;
+    occ->summary.last_us = timestamp_us;
+
+    if (occ->visit_open && timestamp_us - occ->visit_last_us <= occ->gap_us) {
+        occ->visit_last_us = timestamp_us;
+    }
+    else {
+        if (occ->visit_open) {
+            occ->summary.dwell_ms += occupancy_dwell_ms(occ, timestamp_us);
+        }
+        occ->visit_open = true;
+        occ->visit_start_us = timestamp_us;
+        occ->visit_last_us = timestamp_us;
+        occ->summary.visits++;
+    }
+    k_spin_unlock(&occ->lock, key);
+
+    k_work_submit(&occ->reset_work);
+}
+
+
+/**
+ * @brief Reset the sensor on every trigger and report one summary per period.
+ *
+ * The sensor must be pushed in wake-up mode, its blind and window time are taken from
+ * the desired configuration. The callback runs on the system work queue.
+ *
+ * @param dev Pointer to the sensor device
+ * @param period_ms Reporting period in ms
+ * @param callback Called with every summary, may be NULL
+ * @param user_data Passed to callback
+ *
+ * @return 0 if successful, -EIO if the sensor is not in wake-up mode, -EBUSY in hybrid mode or while calibrating, negative errno code if failure.
+ */
+int pyd1598_occupancy_start(const struct device *dev, uint32_t period_ms,
+                            pyd1598_occupancy_callback_t callback, void *user_data)
+{
+    // Variables
+    struct pyd1598_data *data;
+    struct pyd1598_occupancy *occ;
+    struct pyd1598_core_detect timing;
+    enum pyd1598_operation_mode operation_mode;
+    k_spinlock_key_t key;
+    int64_t now_us;
+    int ret;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_occupancy_start");
+    if (dev == NULL || dev->data == NULL || period_ms == 0) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+    occ = &data->occupancy;
+
+    // Triggers only come in wake-up mode
+    ret = pyd1598_get_operation_mode(dev, &operation_mode);
+    if (ret != 0) {
+        return ret;
+    }
+    if (operation_mode != PYD1598_WAKE_UP) {
+        LOG_ERR("Sensor is not in wake-up mode, occupancy is only counted in wake-up mode");
+        return -EIO;
+    }
+
+    k_mutex_lock(&data->run_lock, K_FOREVER);
+#ifdef CONFIG_PYD1598_HYBRID
+    // The hybrid mode leaves wake-up mode on a trigger
+    if (data->hybrid.active) {
+        k_mutex_unlock(&data->run_lock);
+        return -EBUSY;
+    }
+#endif
+    // Calibration pushes other modes until it is done
+    if (pyd1598_calib_running(dev)) {
+        k_mutex_unlock(&data->run_lock);
+        return -EBUSY;
+    }
+
+    // Keep the device resumed, direct link has to stay connected for the triggers
+    if (!occ->active) {
+        ret = pm_device_runtime_get(dev);
+        if (ret < 0) {
+            k_mutex_unlock(&data->run_lock);
+            return ret;
+        }
+    }
+
+    pyd1598_core_detect_init(&timing, data->sensor_conf);
+    now_us = k_ticks_to_us_floor64(k_uptime_ticks());
+
+    key = k_spin_lock(&occ->lock);
+    occ->period_ms = period_ms;
+    occ->callback = callback;
+    occ->user_data = user_data;
+    occ->blind_us = timing.blind_us;
+    occ->gap_us = timing.blind_us + timing.window_us;
+    occ->visit_open = false;
+    memset(&occ->summary, 0, sizeof(occ->summary));
+    occ->summary.start_us = now_us;
+    occ->active = true;
+    k_spin_unlock(&occ->lock, key);
+    k_mutex_unlock(&data->run_lock);
+
+    ret = k_work_reschedule(&occ->report_work, K_MSEC(period_ms));
+    if (ret < 0) {
+        return ret;
+    }
+
+    // A trigger that came before the start would hold direct link high forever
+    k_work_submit(&occ->reset_work);
+
+    return 0;
+}
+
+
+/**
+ * @brief Stop the aggregation, the summary of the running period is dropped.
+ *
+ * @param dev Pointer to the sensor device
+ *
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_occupancy_stop(const struct device *dev)
+{
+    // Variables
+    struct pyd1598_data *data;
+    struct pyd1598_occupancy *occ;
+    struct k_work_sync sync;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_occupancy_stop");
+    if (dev == NULL || dev->data == NULL) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+    occ = &data->occupancy;
+
+    k_mutex_lock(&data->run_lock, K_FOREVER);
+    if (!occ->active) {
+        k_mutex_unlock(&data->run_lock);
+        return 0;
+    }
+    occ->active = false;
+    k_work_cancel_delayable_sync(&occ->report_work, &sync);
+    k_work_cancel_sync(&occ->reset_work, &sync);
+    pm_device_runtime_put(dev);
+    k_mutex_unlock(&data->run_lock);
+
+    return 0;
+}
+
+
+/**
+ * @brief Get the summary of the running period so far.
+ *
+ * @param dev Pointer to the sensor device
+ * @param summary Pointer to where the summary should be stored, end_us is now and dwell
+ * includes the running visit
+ *
+ * @return 0 if successful, -ENODATA if the aggregation is not started, negative errno code if failure.
+ */
+int pyd1598_occupancy_get(const struct device *dev, struct pyd1598_occupancy_summary *summary)
+{
+    // Variables
+    struct pyd1598_data *data;
+    struct pyd1598_occupancy *occ;
+    k_spinlock_key_t key;
+    int64_t now_us;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_occupancy_get");
+    if (dev == NULL || dev->data == NULL || summary == NULL) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+    occ = &data->occupancy;
+
+    if (!occ->active) {
+        return -ENODATA;
+    }
+
+    key = k_spin_lock(&occ->lock);
+    now_us = k_ticks_to_us_floor64(k_uptime_ticks());
+    *summary = occ->summary;
+    summary->end_us = now_us;
+    summary->occupied = occ->visit_open && now_us - occ->visit_last_us <= occ->gap_us;
+    if (occ->visit_open) {
+        summary->dwell_ms += occupancy_dwell_ms(occ, now_us);
+    }
+    k_spin_unlock(&occ->lock, key);
+
+    return 0;
+}
@@ -0,0 +1,296 @@
+/*
+PYD1598 offline replay
+
+Recorded traces are fed through the wake-up detection model of the driver core and
+published on zbus like fetched frames, as fast as the frames can be processed. A
+corpus of field recordings can so be run against a new threshold, blind time, pulse
+counter, window time or count mode, or a new build, in a fraction of the recorded
+time, on hardware, on native_sim or in qemu.
+
+The detection parameters are taken from the desired configuration of the device when
+the replay starts, the device itself is not touched: no push, no fetch, no pm. Only
+PIR BPF frames run through the detection model, frames of other signal sources are
+published only. Every wake-up decision is handed to the callback and published on the
+trigger channel with the time of the frame that caused it.
+
+Captures:
+
+  csv   one frame per line: time s, BPF counts, optional out of range flag,
+        lines that do not start with a time are skipped
+  log   blocks of the frame logger file, each block is self contained
+
+The report holds the decisions, the latency from the first counted pulse to the
+decision and the cycles spent per frame on detection and publishing.
+
+Replays run one at a time.
+*/
+
+#include <zephyr/device.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/kernel.h>
+#include <zephyr/timing/timing.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pyd1598.h>
+#include "pyd1598_internal.h"
+
+LOG_MODULE_DECLARE(PYD1598, PYD1598_LOG_LEVEL);
+
+
+// Replay of one device at a time
+static const struct device *replay_dev;
+static pyd1598_replay_callback_t replay_callback;
+static void *replay_user_data;
+static struct pyd1598_core_detect replay_detect;
+static struct pyd1598_replay_report replay_report;
+static int64_t replay_first_us;
+static int64_t replay_last_us;
+
+
+/**
+ * @brief Start a replay with the desired configuration of a device.
+ *
+ * @param dev Pointer to the sensor device, published as the source of the frames
+ * @param callback Called for every wake-up decision, may be NULL
+ * @param user_data Passed to callback
+ *
+ * @return 0 if successful, -EBUSY if a replay is running, negative errno code if failure.
+ */
+int pyd1598_replay_start(const struct device *dev, pyd1598_replay_callback_t callback, void *user_data)
+{
+    // Variables
+    struct pyd1598_data *data;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_replay_start");
+    if (dev == NULL || dev->data == NULL) {
+        return -EINVAL;
+    }
+    if (replay_dev != NULL) {
+        return -EBUSY;
+    }
+
+    // Declare the variables
+    data = dev->data;
+
+    pyd1598_core_detect_init(&replay_detect, data->sensor_conf);
+    memset(&replay_report, 0, sizeof(replay_report));
+    replay_report.latency_min_us = UINT32_MAX;
+    replay_first_us = INT64_MIN;
+    replay_last_us = INT64_MIN;
+    replay_callback = callback;
+    replay_user_data = user_data;
+
+    timing_init();
+    timing_start();
+
+    replay_dev = dev;
+
+    return 0;
+}
+
+
+// Detection of one frame, true if it is a wake-up decision
+static bool replay_detect_frame(const struct pyd1598_frame *frame)
+{
+    if (PYD1598_FIELD_GET(frame->sensor_conf, SIGNAL_SOURCE) != PYD1598_PIR_BPF) {
+        return false;
+    }
+
+    return pyd1598_core_detect_sample(&replay_detect, frame->timestamp_us, pyd1598_bpf_counts(frame->measurement));
+}
+
+
+/**
+ * @brief Replay frames, in recording order.
+ *
+ * @param frames Frames of the capture, sensor_conf carries the signal source
+ * @param count Number of frames
+ *
+ * @return 0 if successful, -EALREADY if no replay is running, negative errno code if failure.
+ */
+int pyd1598_replay_feed(const struct pyd1598_frame *frames, size_t count)
+{
+    // Variables
+    const struct pyd1598_frame *frame;
+    timing_t start;
+    timing_t end;
+    uint64_t cycles;
+    bool trigger;
+
+    if (frames == NULL && count > 0) {
+        return -EINVAL;
+    }
+    if (replay_dev == NULL) {
+        return -EALREADY;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        frame = &frames[i];
+
+        start = timing_counter_get();
+        trigger = replay_detect_frame(frame);
+        pyd1598_zbus_publish_frame(replay_dev, frame);
+        if (trigger) {
+            pyd1598_zbus_publish_trigger(replay_dev, frame->timestamp_us);
+        }
+        end = timing_counter_get();
+
+        cycles = timing_cycles_get(&start, &end);
+        replay_report.cycles += cycles;
+        replay_report.cycles_max = MAX(replay_report.cycles_max, (uint32_t)MIN(cycles, UINT32_MAX));
+        replay_report.samples++;
+
+        if (replay_first_us == INT64_MIN) {
+            replay_first_us = frame->timestamp_us;
+        }
+        replay_last_us = frame->timestamp_us;
+
+        if (!trigger) {
+            continue;
+        }
+        replay_report.triggers++;
+        replay_report.latency_min_us = MIN(replay_report.latency_min_us, replay_detect.latency_us);
+        replay_report.latency_max_us = MAX(replay_report.latency_max_us, replay_detect.latency_us);
+        replay_report.latency_sum_us += replay_detect.latency_us;
+        if (replay_callback != NULL) {
+            replay_callback(replay_dev, frame->timestamp_us, replay_detect.latency_us, replay_user_data);
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Stop the replay.
+ *
+ * @param report Pointer to where the report should be stored, may be NULL
+ *
+ * @return 0 if successful, -EALREADY if no replay is running.
+ */
+int pyd1598_replay_stop(struct pyd1598_replay_report *report)
+{
+    if (replay_dev == NULL) {
+        return -EALREADY;
+    }
+
+    timing_stop();
+
+    replay_report.pulses = replay_detect.counted;
+    replay_report.span_us = (replay_report.samples > 0) ? replay_last_us - replay_first_us : 0;
+    if (replay_report.triggers == 0) {
+        replay_report.latency_min_us = 0;
+    }
+    if (report != NULL) {
+        *report = replay_report;
+    }
+
+    replay_dev = NULL;
+
+    return 0;
+}
+
+
+/**
+ * @brief Parse one line of a csv capture into a PIR BPF frame.
+ *
+ * Lines are "time s,BPF counts" with an optional ",out of range" flag, header lines
+ * are skipped.
+ *
+ * @param line One line of the capture
+ * @param frames Frame buffer
+ * @param size Size of frames
+ * @param count Number of frames in the buffer, updated
+ *
+ * @return 0 if successful, -EINVAL for a malformed line, -ENOMEM if frames is full.
+ */
+int pyd1598_replay_parse_csv(const char *line, struct pyd1598_frame *frames, size_t size, size_t *count)
+{
+    // Variables
+    struct pyd1598_frame *frame;
+    int64_t time_ns;
+    const char *str;
+    char *end;
+    long counts;
+    bool out_of_range = false;
+
+    if (line == NULL || frames == NULL || count == NULL) {
+        return -EINVAL;
+    }
+
+    // Header, or anything else that does not start with a time
+    str = pyd1598_core_parse_seconds(line, &time_ns);
+    if (str == NULL) {
+        return 0;
+    }
+    if (*str != ',') {
+        return -EINVAL;
+    }
+    counts = strtol(str + 1, &end, 10);
+    if (end == str + 1 || counts < -8192 || counts > 8191) {
+        return -EINVAL;
+    }
+    if (end[0] == ',' && (end[1] == '0' || end[1] == '1')) {
+        out_of_range = (end[1] == '1');
+    }
+    if (*count >= size) {
+        return -ENOMEM;
+    }
+
+    frame = &frames[*count];
+    frame->timestamp_us = time_ns / NSEC_PER_USEC;
+    frame->sensor_conf = PYD1598_FIELD_SET(0, SIGNAL_SOURCE, PYD1598_PIR_BPF);
+    frame->measurement = (uint16_t)(PYD1598_FIELD_SET(0, ADC_COUNTS, (uint32_t)counts) |
+                                    PYD1598_FIELD_SET(0, OUT_OF_RANGE, out_of_range));
+    (*count)++;
+
+    return 0;
+}
+
+
+/**
+ * @brief Decode the frames of one instance from one block of a frame logger file.
+ *
+ * @param block One block of the log file
+ * @param len Length of the block
+ * @param instance Instance whose frames are decoded
+ * @param frames Frame buffer
+ * @param size Size of frames
+ * @param count Number of frames in the buffer, updated
+ *
+ * @return 0 if successful, -EINVAL if the block is not a log block or is corrupt,
+ * -ENOMEM if frames is full.
+ */
+int pyd1598_replay_parse_log(const uint8_t *block, size_t len, int instance,
+                             struct pyd1598_frame *frames, size_t size, size_t *count)
+{
+    // Variables
+    struct pyd1598_core_log_reader rd;
+    struct pyd1598_frame frame;
+    int ret;
+
+    if (block == NULL || frames == NULL || count == NULL) {
+        return -EINVAL;
+    }
+
+    // The frame logger file format of the driver core
+    ret = pyd1598_core_log_open(&rd, block, len, instance);
+    if (ret != 0) {
+        return ret;
+    }
+
+    for (;;) {
+        ret = pyd1598_core_log_next(&rd, &frame.timestamp_us, &frame.sensor_conf, &frame.measurement);
+        if (ret <= 0) {
+            return ret;
+        }
+        if (*count >= size) {
+            return -ENOMEM;
+        }
+        frames[(*count)++] = frame;
+    }
+}
@@ -0,0 +1,341 @@
+/*
+PYD1598 signal source scheduler
+
+The sensor outputs one signal source at a time, PIR BPF, PIR LPF or temperature.
+The scheduler samples every enabled source at its own period and hands the samples
+to one callback as a single stream, tagged with their source.
+
+Switching the source costs a push and a settle time, so the scheduler stays on the
+source with the shortest period, the home source. Other sources are visited only
+when they are due, due sources are served back to back, then the scheduler returns
+home. Temperature every minute and LPF at 50 Hz costs two pushes a minute.
+
+Runs on the system work queue in forced readout mode, like streaming, and excludes
+streaming, hybrid mode, interrupt readout, sync groups and calibration on the same
+device, each start checks the others under the run lock of the device. Like streaming it keeps the device
+resumed while started and pauses while the device is suspended.
+*/
+
+#include <zephyr/device.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/kernel.h>
+#include <zephyr/pm/device_runtime.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pyd1598.h>
+#include "pyd1598_internal.h"
+
+LOG_MODULE_DECLARE(PYD1598, PYD1598_LOG_LEVEL);
+
+
+// Fetch and deliver a sample of the pushed source
+static void sched_sample(struct pyd1598_data *data, int64_t now_ms)
+{
+    // Variables
+    struct pyd1598_sched *sched;
+    struct pyd1598_sample sample;
+    int ch;
+    int ret;
+
+    // Declare the variables
+    sched = &data->sched;
+    ch = sched->plan.current;
+
+    ret = pyd1598_fetch(data->dev);
+    if (ret == 0) {
+        sample.timestamp_us = data->timestamp_us;
+        sample.source = (enum pyd1598_signal_source)pyd1598_core_sched_source(ch);
+        sample.adc_counts = pyd1598_signal_counts(data->measurement, (uint32_t)sample.source);
+        sample.out_of_range = pyd1598_out_of_range(data->measurement);
+
+        sched->stats.samples++;
+        sched->callback(data->dev, &sample, sched->user_data);
+    } else {
+        LOG_DBG("Scheduled fetch failed: %d", ret);
+    }
+
+    // Skip samples that can not be caught up with instead of bursting
+    if (pyd1598_core_sched_sampled(&sched->plan, now_ms)) {
+        sched->stats.missed++;
+    }
+}
+
+
+// Push another signal source, its samples are valid after the settle time
+static void sched_switch(struct pyd1598_data *data, int ch, int64_t now_ms)
+{
+    // Variables
+    struct pyd1598_sched *sched;
+    int ret;
+
+    // Declare the variables
+    sched = &data->sched;
+
+    pyd1598_set_signal_source(data->dev, (enum pyd1598_signal_source)pyd1598_core_sched_source(ch));
+    ret = pyd1598_push(data->dev);
+    if (ret != 0) {
+        // Try again from scratch on the next run
+        LOG_DBG("Scheduled push failed: %d", ret);
+        sched->plan.current = -1;
+        return;
+    }
+
+    sched->stats.switches++;
+    pyd1598_core_sched_switched(&sched->plan, ch, now_ms, CONFIG_PYD1598_SCHED_SETTLE_MS);
+}
+
+
+static void pyd1598_sched_work_handler(struct k_work *work)
+{
+    // Variables
+    struct k_work_delayable *dwork;
+    struct pyd1598_data *data;
+    struct pyd1598_sched *sched;
+    int64_t now_ms;
+    int64_t wake_ms;
+    int next;
+
+    // Declare the variables
+    dwork = k_work_delayable_from_work(work);
+    data = CONTAINER_OF(dwork, struct pyd1598_data, sched.work);
+    sched = &data->sched;
+    now_ms = k_uptime_get();
+
+    // Serve the pushed source first, it costs no switch
+    if (pyd1598_core_sched_sample_due(&sched->plan, now_ms)) {
+        sched_sample(data, now_ms);
+    }
+
+    // Then the most overdue other source, or home once the visit is done
+    next = pyd1598_core_sched_next(&sched->plan, now_ms);
+    if (next >= 0) {
+        sched_switch(data, next, now_ms);
+    }
+
+    // Sleep until the pushed source is due, or until another source is due once
+    // the pushed source is served
+    wake_ms = pyd1598_core_sched_wake(&sched->plan, now_ms, CONFIG_PYD1598_SCHED_SETTLE_MS);
+
+    k_work_schedule(dwork, K_MSEC(MAX(wake_ms - now_ms, 0)));
+}
+
+
+int pyd1598_sched_init(const struct device *dev)
+{
+    // Variables
+    struct pyd1598_data *data;
+
+    // Declare the variables
+    data = dev->data;
+    memset(&data->sched, 0, sizeof(data->sched));
+    data->sched.plan.current = -1;
+
+    k_work_init_delayable(&data->sched.work, pyd1598_sched_work_handler);
+
+    return 0;
+}
+
+
+/**
+ * @brief Set how often a signal source is sampled by the scheduler.
+ *
+ * @param dev Pointer to the sensor device
+ * @param source Signal source
+ * @param period_ms Time between two samples of source in ms, 0 to not sample it
+ *
+ * @return 0 if successful, -EBUSY if the scheduler is running, negative errno code if failure.
+ */
+int pyd1598_sched_set_period(const struct device *dev, enum pyd1598_signal_source source, uint32_t period_ms)
+{
+    // Variables
+    struct pyd1598_data *data;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_sched_set_period");
+    if (dev == NULL || dev->data == NULL || pyd1598_core_sched_channel((uint32_t)source) < 0) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+
+    k_mutex_lock(&data->run_lock, K_FOREVER);
+    if (data->sched.active) {
+        k_mutex_unlock(&data->run_lock);
+        return -EBUSY;
+    }
+
+    data->sched.plan.period_ms[pyd1598_core_sched_channel((uint32_t)source)] = period_ms;
+    k_mutex_unlock(&data->run_lock);
+
+    return 0;
+}
+
+
+/**
+ * @brief Start sampling the signal sources with a period set, in forced readout mode.
+ *
+ * The callback runs on the system work queue for every sample.
+ *
+ * @param dev Pointer to the sensor device
+ * @param callback Called with every sample
+ * @param user_data Passed to callback
+ *
+ * @return 0 if successful, -EBUSY if the device is streaming, in hybrid mode, interrupt readout, a sync group or calibrating, negative errno code if failure.
+ */
+int pyd1598_sched_start(const struct device *dev, pyd1598_sample_callback_t callback, void *user_data)
+{
+    // Variables
+    struct pyd1598_data *data;
+    struct pyd1598_sched *sched;
+    int64_t now_ms;
+    int ret;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_sched_start");
+    if (dev == NULL || dev->data == NULL || callback == NULL) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+    sched = &data->sched;
+
+    // The periods and the modules that read the sensor out on their own, checked and claimed under the lock
+    k_mutex_lock(&data->run_lock, K_FOREVER);
+    if (pyd1598_core_sched_home(&sched->plan) < 0) {
+        k_mutex_unlock(&data->run_lock);
+        LOG_ERR("No signal source has a period");
+        return -EINVAL;
+    }
+#ifdef CONFIG_PYD1598_STREAM
+    if (data->stream_active) {
+        k_mutex_unlock(&data->run_lock);
+        return -EBUSY;
+    }
+#endif
+#ifdef CONFIG_PYD1598_HYBRID
+    if (data->hybrid.active) {
+        k_mutex_unlock(&data->run_lock);
+        return -EBUSY;
+    }
+#endif
+    if (pyd1598_interrupt_running(dev) || pyd1598_sync_running(dev) || pyd1598_calib_running(dev)) {
+        k_mutex_unlock(&data->run_lock);
+        return -EBUSY;
+    }
+
+    ret = pyd1598_set_operation_mode(dev, PYD1598_FORCED_READOUT);
+    if (ret != 0) {
+        k_mutex_unlock(&data->run_lock);
+        return ret;
+    }
+
+    // Every source is due right away, the first run pushes home
+    now_ms = k_uptime_get();
+    pyd1598_core_sched_start(&sched->plan, now_ms);
+    sched->callback = callback;
+    sched->user_data = user_data;
+
+    if (!sched->active) {
+        ret = pm_device_runtime_get(dev);
+        if (ret < 0) {
+            k_mutex_unlock(&data->run_lock);
+            return ret;
+        }
+        sched->active = true;
+    }
+
+    ret = k_work_reschedule(&sched->work, K_NO_WAIT);
+    k_mutex_unlock(&data->run_lock);
+    if (ret < 0) {
+        return ret;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Stop the scheduler, waits for a running sample to complete.
+ *
+ * @param dev Pointer to the sensor device
+ *
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_sched_stop(const struct device *dev)
+{
+    // Variables
+    struct pyd1598_data *data;
+    struct k_work_sync sync;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_sched_stop");
+    if (dev == NULL || dev->data == NULL) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+
+    k_mutex_lock(&data->run_lock, K_FOREVER);
+    k_work_cancel_delayable_sync(&data->sched.work, &sync);
+
+    if (data->sched.active) {
+        data->sched.active = false;
+        pm_device_runtime_put(dev);
+    }
+    k_mutex_unlock(&data->run_lock);
+
+    return 0;
+}
+
+
+void pyd1598_sched_pm(const struct device *dev, bool suspend)
+{
+    // Variables
+    struct pyd1598_data *data;
+
+    // Declare the variables
+    data = dev->data;
+
+    if (!data->sched.active) {
+        return;
+    }
+    if (suspend) {
+        k_work_cancel_delayable(&data->sched.work);
+    } else {
+        // The sensor may have lost the signal source, push it again
+        data->sched.plan.current = -1;
+        k_work_reschedule(&data->sched.work, K_NO_WAIT);
+    }
+}
+
+
+/**
+ * @brief Get the scheduler counters of the sensor.
+ *
+ * @param dev Pointer to the sensor device
+ * @param stats Pointer to where the counters should be stored
+ *
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_sched_get_stats(const struct device *dev, struct pyd1598_sched_stats *stats)
+{
+    // Variables
+    struct pyd1598_data *data;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_sched_get_stats");
+    if (dev == NULL || dev->data == NULL || stats == NULL) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+    *stats = data->sched.stats;
+
+    return 0;
+}
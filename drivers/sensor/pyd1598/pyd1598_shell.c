@@ -0,0 +1,1311 @@
+/*
+PYD1598 shell commands
+
+  pyd1598 list                          list the okay excelitas,pyd1598 nodes, their memory
+                                        and the init time of the cluster
+  pyd1598 config <device>               desired and read back configuration words
+  pyd1598 push <device>                 push the desired configuration
+  pyd1598 fetch <device>                fetch and print one frame
+  pyd1598 cache <device> [<max age us>] fetch unless the last frame is fresh, without an
+                                        age print the hit and coalesce counters
+  pyd1598 stats <device> [reset]        transaction counters
+  pyd1598 energy <device> [reset]       transaction time and estimated charge
+  pyd1598 bench fetch|push <device> <n> throughput and cycle percentiles of n transactions
+  pyd1598 bench scan <n>                same for n scans, one scan fetches every device
+  pyd1598 logger                        logger counters and flash bytes per frame
+  pyd1598 capture <device> [<pre> <post>|trigger|stop]
+                                        capture pre and post frames around detected
+                                        triggers, without arguments print the last burst
+  pyd1598 calib <device> [<s>|stop]     calibrate the threshold, optionally every s seconds
+  pyd1598 sched <device> [<bpf ms> <lpf ms> <temperature ms>|stop]
+                                        run the signal source scheduler, 0 ms skips a source,
+                                        without arguments print its counters
+  pyd1598 hybrid <device> [<period ms> <window ms> <quiet ms> <threshold>|stop]
+                                        idle in wake-up mode and stream after triggers,
+                                        without arguments print the switch cost and duty cycle
+  pyd1598 occupancy <device> [<period s>|stop]
+                                        reset wake-up triggers and report once per period,
+                                        without arguments print the running period
+  pyd1598 sync [<period ms>|stop]       sample every device at the same instants, without
+                                        arguments print the skew and period jitter of each
+  pyd1598 fusion                        occupied zones and the last direction of travel
+  pyd1598 bench encode <samples>        payload bytes per sample and encode cycles of one batch
+  pyd1598 bench resume <device> <n>     suspend, resume and fetch n times, resume to first sample
+  pyd1598 timing <device> [<n>]         record a push and n fetches, slack of every timing constraint
+  pyd1598 trace                         drain and print the binary transaction trace
+  pyd1598 replay <device> <file> [<instance>]
+                                        replay a csv or frame log capture through the
+                                        wake-up detection with the device configuration
+
+The bench commands run the transactions back to back from the shell thread, the
+numbers include the busy waits of the protocol and are meant to compare boards and
+builds, not to stream. With CONFIG_THREAD_RUNTIME_STATS they also print the CPU time
+of the shell thread, which drops below the wall time when a push is sent by spi.
+*/
+
+#define DT_DRV_COMPAT excelitas_pyd1598
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/kernel.h>
+#include <zephyr/pm/device.h>
+#include <zephyr/timing/timing.h>
+#if defined(CONFIG_PYD1598_REPLAY) && defined(CONFIG_FILE_SYSTEM)
+#include <zephyr/fs/fs.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pyd1598.h>
+#include "pyd1598_internal.h"
+
+
+#define PYD1598_SHELL_DEVICE_GET(index) DEVICE_DT_INST_GET(index),
+
+static const struct device *const pyd1598_devices[] = {
+    DT_INST_FOREACH_STATUS_OKAY(PYD1598_SHELL_DEVICE_GET)
+};
+
+// Cycle count per transaction, shared by the bench commands
+static uint32_t bench_cycles[CONFIG_PYD1598_SHELL_BENCH_MAX_SAMPLES];
+
+
+// Only accept the pyd1598 instances, every other device has a different data layout
+static const struct device *pyd1598_shell_device(const struct shell *sh, const char *name)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(pyd1598_devices); i++) {
+        if (strcmp(pyd1598_devices[i]->name, name) == 0) {
+            if (!device_is_ready(pyd1598_devices[i])) {
+                shell_error(sh, "%s is not ready", name);
+                return NULL;
+            }
+            return pyd1598_devices[i];
+        }
+    }
+
+    shell_error(sh, "%s is not a pyd1598 device, see: pyd1598 list", name);
+    return NULL;
+}
+
+
+static void pyd1598_shell_print_conf(const struct shell *sh, const char *label, uint32_t sensor_conf)
+{
+    shell_print(sh, "%s 0x%07x: threshold %u| blind_time %u| pulse_counter %u| window_time %u| "
+                "mode %u| source %u| hpf %u| count_mode %u",
+                label, sensor_conf,
+                PYD1598_FIELD_GET(sensor_conf, THRESHOLD), PYD1598_FIELD_GET(sensor_conf, BLIND_TIME),
+                PYD1598_FIELD_GET(sensor_conf, PULSE_COUNTER), PYD1598_FIELD_GET(sensor_conf, WINDOW_TIME),
+                PYD1598_FIELD_GET(sensor_conf, OPERATION_MODE), PYD1598_FIELD_GET(sensor_conf, SIGNAL_SOURCE),
+                PYD1598_FIELD_GET(sensor_conf, HPF_CUT_OFF), PYD1598_FIELD_GET(sensor_conf, COUNT_MODE));
+}
+
+
+static int cmd_pyd1598_list(const struct shell *sh, size_t argc, char **argv)
+{
+    const struct pyd1598_config *cfg;
+    size_t ram;
+    size_t rom;
+#ifdef CONFIG_PYD1598_STATS
+    struct pyd1598_stats stats;
+    uint32_t init_total_us = 0;
+    uint32_t init_max_us = 0;
+#endif
+
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    for (size_t i = 0; i < ARRAY_SIZE(pyd1598_devices); i++) {
+        cfg = pyd1598_devices[i]->config;
+        shell_print(sh, "%s: %s| serial_in %s.%u| direct_link %s.%u",
+                    pyd1598_devices[i]->name,
+                    device_is_ready(pyd1598_devices[i]) ? "ready" : "not ready",
+                    cfg->serial_in.port->name, cfg->serial_in.pin,
+                    cfg->direct_link.port->name, cfg->direct_link.pin);
+#ifdef CONFIG_PYD1598_STATS
+        if (pyd1598_get_stats(pyd1598_devices[i], &stats) == 0) {
+            init_total_us += stats.init_us;
+            init_max_us = MAX(init_max_us, stats.init_us);
+        }
+#endif
+    }
+#ifdef CONFIG_PYD1598_STATS
+    shell_print(sh, "init: total %u us| max %u us| mean %u us", init_total_us, init_max_us,
+                (unsigned int)(init_total_us / MAX(ARRAY_SIZE(pyd1598_devices), 1)));
+#endif
+
+    // What every instance adds, the code is shared
+    ram = sizeof(struct pyd1598_data);
+    rom = sizeof(struct pyd1598_config) + sizeof(struct device);
+    shell_print(sh, "%u devices| per device: %u B ram, %u B rom| total: %u B ram, %u B rom",
+                (unsigned int)ARRAY_SIZE(pyd1598_devices), (unsigned int)ram, (unsigned int)rom,
+                (unsigned int)(ram * ARRAY_SIZE(pyd1598_devices)), (unsigned int)(rom * ARRAY_SIZE(pyd1598_devices)));
+
+    return 0;
+}
+
+
+static int cmd_pyd1598_config(const struct shell *sh, size_t argc, char **argv)
+{
+    const struct device *dev;
+    struct pyd1598_data *data;
+
+    ARG_UNUSED(argc);
+
+    dev = pyd1598_shell_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+    data = dev->data;
+
+    pyd1598_shell_print_conf(sh, "desired  ", data->sensor_conf);
+    pyd1598_shell_print_conf(sh, "read back", data->sensor_conf_readback);
+    shell_print(sh, "%s", (data->sensor_conf == data->sensor_conf_readback) ? "match" : "MISMATCH");
+
+    return 0;
+}
+
+
+static int cmd_pyd1598_push(const struct shell *sh, size_t argc, char **argv)
+{
+    const struct device *dev;
+    int ret;
+
+    ARG_UNUSED(argc);
+
+    dev = pyd1598_shell_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+
+    ret = pyd1598_push(dev);
+    if (ret != 0) {
+        shell_error(sh, "push failed: %d", ret);
+        return ret;
+    }
+
+    return 0;
+}
+
+
+static int cmd_pyd1598_fetch(const struct shell *sh, size_t argc, char **argv)
+{
+    const struct device *dev;
+    struct pyd1598_frame frame;
+    int ret;
+
+    ARG_UNUSED(argc);
+
+    dev = pyd1598_shell_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+
+    ret = pyd1598_fetch(dev);
+    if (ret != 0) {
+        shell_error(sh, "fetch failed: %d", ret);
+        return ret;
+    }
+
+    pyd1598_get_frame(dev, &frame);
+    shell_print(sh, "t %lld us| out_of_range %u| adc_counts %u",
+                frame.timestamp_us, PYD1598_FIELD_GET(frame.measurement, OUT_OF_RANGE),
+                PYD1598_FIELD_GET(frame.measurement, ADC_COUNTS));
+
+    return 0;
+}
+
+
+#ifdef CONFIG_PYD1598_CACHE
+static int cmd_pyd1598_cache(const struct shell *sh, size_t argc, char **argv)
+{
+    const struct device *dev;
+    struct pyd1598_frame frame;
+    struct pyd1598_cache_stats stats;
+    unsigned long max_age_us;
+    char *arg_end;
+    int ret;
+
+    dev = pyd1598_shell_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+
+    if (argc == 2) {
+        pyd1598_cache_get_stats(dev, &stats);
+        shell_print(sh, "hits %u| fetches %u| coalesced %u| errors %u", stats.hits, stats.fetches,
+                    stats.coalesced, stats.errors);
+        return 0;
+    }
+
+    max_age_us = strtoul(argv[2], &arg_end, 10);
+    if (*arg_end != '\0' || max_age_us > UINT32_MAX) {
+        shell_error(sh, "invalid age %s", argv[2]);
+        return -EINVAL;
+    }
+
+    ret = pyd1598_fetch_if_older_than(dev, (uint32_t)max_age_us, &frame);
+    if (ret != 0) {
+        shell_error(sh, "fetch failed: %d", ret);
+        return ret;
+    }
+    shell_print(sh, "t %lld us| age %lld us| out_of_range %u| adc_counts %u", frame.timestamp_us,
+                k_ticks_to_us_floor64(k_uptime_ticks()) - frame.timestamp_us,
+                PYD1598_FIELD_GET(frame.measurement, OUT_OF_RANGE), PYD1598_FIELD_GET(frame.measurement, ADC_COUNTS));
+
+    return 0;
+}
+#endif
+
+
+#ifdef CONFIG_PYD1598_STATS
+static int cmd_pyd1598_stats(const struct shell *sh, size_t argc, char **argv)
+{
+    const struct device *dev;
+    struct pyd1598_stats stats;
+
+    dev = pyd1598_shell_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+
+    if (argc > 2) {
+        if (strcmp(argv[2], "reset") != 0) {
+            shell_error(sh, "unknown argument %s", argv[2]);
+            return -EINVAL;
+        }
+        return pyd1598_reset_stats(dev);
+    }
+
+    pyd1598_get_stats(dev, &stats);
+    shell_print(sh, "push          %u", stats.push_count);
+    shell_print(sh, "fetch         %u", stats.fetch_count);
+    shell_print(sh, "fetch ok      %u", stats.fetch_ok);
+    shell_print(sh, "fetch partial %u", stats.fetch_partial);
+    shell_print(sh, "conf mismatch %u", stats.conf_mismatch);
+    shell_print(sh, "trigger       %u", stats.trigger_count);
+    shell_print(sh, "dropped       %u", stats.readout_dropped);
+    shell_print(sh, "init us       %u", stats.init_us);
+#ifdef CONFIG_PM_DEVICE
+    shell_print(sh, "resume us     %u", stats.resume_latency_us);
+#endif
+
+    return 0;
+}
+#endif
+
+
+#ifdef CONFIG_PYD1598_ENERGY
+static int cmd_pyd1598_energy(const struct shell *sh, size_t argc, char **argv)
+{
+    const struct device *dev;
+    struct pyd1598_energy_stats stats;
+
+    dev = pyd1598_shell_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+
+    if (argc > 2) {
+        if (strcmp(argv[2], "reset") != 0) {
+            shell_error(sh, "unknown argument %s", argv[2]);
+            return -EINVAL;
+        }
+        return pyd1598_energy_reset(dev);
+    }
+
+    pyd1598_energy_get(dev, &stats);
+    shell_print(sh, "push %u| fetch %u| readout %u| over %u ms", stats.pushes, stats.fetches, stats.readouts,
+                stats.elapsed_ms);
+    shell_print(sh, "active %llu us| irq locked %llu us", stats.active_us, stats.irq_locked_us);
+    shell_print(sh, "serial in %llu us| direct link %llu us", stats.serial_in_us, stats.direct_link_us);
+    shell_print(sh, "charge %llu nAh| %u nAh per hour", stats.charge_nah, stats.nah_per_hour);
+
+    return 0;
+}
+#endif
+
+
+#ifdef CONFIG_PYD1598_LOGGER
+static int cmd_pyd1598_logger(const struct shell *sh, size_t argc, char **argv)
+{
+    struct pyd1598_logger_stats stats;
+
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    pyd1598_logger_get_stats(&stats);
+    shell_print(sh, "frames logged  %u", stats.frames_logged);
+    shell_print(sh, "frames dropped %u", stats.frames_dropped);
+    shell_print(sh, "blocks written %u", stats.blocks_written);
+    shell_print(sh, "bytes written  %u", stats.bytes_written);
+    shell_print(sh, "write errors   %u", stats.write_errors);
+    shell_print(sh, "files rotated  %u", stats.files_rotated);
+    if (stats.frames_logged > 0) {
+        // A raw frame is 40 bits, ignoring the timestamp
+        shell_print(sh, "flash bytes per frame %u.%02u (raw 5)",
+                    stats.bytes_written / stats.frames_logged,
+                    ((stats.bytes_written % stats.frames_logged) * 100) / stats.frames_logged);
+    }
+
+    return 0;
+}
+#endif
+
+
+#ifdef CONFIG_PYD1598_CAPTURE
+// Last burst of any device, the shell only keeps its shape and releases the block
+static struct {
+    const struct device *dev;
+    int64_t trigger_us;
+    uint16_t pre;
+    uint16_t post;
+    int16_t peak; // Largest |BPF| in the burst
+    bool detected;
+} pyd1598_shell_burst;
+
+
+static void pyd1598_shell_capture(const struct device *dev, struct pyd1598_capture_burst *burst, void *user_data)
+{
+    int16_t peak = 0;
+    int16_t bpf;
+
+    ARG_UNUSED(user_data);
+
+    for (uint32_t i = 0; i < (uint32_t)burst->pre + burst->post; i++) {
+        if (burst->samples[i].signal_source != PYD1598_PIR_BPF) {
+            continue;
+        }
+        bpf = pyd1598_bpf_counts(burst->samples[i].measurement);
+        peak = MAX(peak, (bpf < 0) ? -bpf : bpf);
+    }
+    pyd1598_shell_burst.dev = dev;
+    pyd1598_shell_burst.trigger_us = burst->trigger_us;
+    pyd1598_shell_burst.pre = burst->pre;
+    pyd1598_shell_burst.post = burst->post;
+    pyd1598_shell_burst.peak = peak;
+    pyd1598_shell_burst.detected = burst->detected;
+
+    pyd1598_capture_release(burst);
+}
+
+
+static int cmd_pyd1598_capture(const struct shell *sh, size_t argc, char **argv)
+{
+    const struct device *dev;
+    struct pyd1598_capture_config config;
+    struct pyd1598_capture_stats stats;
+    unsigned long depth[2];
+    char *arg_end;
+
+    dev = pyd1598_shell_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+
+    if (argc == 2) {
+        pyd1598_capture_get_stats(dev, &stats);
+        shell_print(sh, "frames %u| triggers %u| bursts %u| dropped %u", stats.frames, stats.triggers,
+                    stats.bursts, stats.dropped);
+        shell_print(sh, "capacity %u frames| free blocks %u", stats.capacity, stats.free_blocks);
+        if (pyd1598_shell_burst.dev == dev) {
+            shell_print(sh, "last burst %s| %lld ms ago| pre %u| post %u| peak BPF %d",
+                        pyd1598_shell_burst.detected ? "detected" : "requested",
+                        (k_ticks_to_us_floor64(k_uptime_ticks()) - pyd1598_shell_burst.trigger_us) / USEC_PER_MSEC,
+                        pyd1598_shell_burst.pre, pyd1598_shell_burst.post, pyd1598_shell_burst.peak);
+        }
+        return 0;
+    }
+    if (argc == 3 && strcmp(argv[2], "stop") == 0) {
+        return pyd1598_capture_stop(dev);
+    }
+    if (argc == 3 && strcmp(argv[2], "trigger") == 0) {
+        return pyd1598_capture_trigger(dev);
+    }
+    if (argc != 4) {
+        shell_error(sh, "expected <pre> <post>, trigger or stop");
+        return -EINVAL;
+    }
+
+    for (int i = 0; i < ARRAY_SIZE(depth); i++) {
+        depth[i] = strtoul(argv[2 + i], &arg_end, 10);
+        if (*arg_end != '\0' || depth[i] == 0 || depth[i] > UINT16_MAX) {
+            shell_error(sh, "invalid depth %s", argv[2 + i]);
+            return -EINVAL;
+        }
+    }
+    config.pre_frames = (uint16_t)depth[0];
+    config.post_frames = (uint16_t)depth[1];
+    config.detect = true;
+
+    return pyd1598_capture_start(dev, &config, pyd1598_shell_capture, NULL);
+}
+#endif
+
+
+#ifdef CONFIG_PYD1598_TIMING_CHECK
+static int cmd_pyd1598_timing(const struct shell *sh, size_t argc, char **argv)
+{
+    static struct pyd1598_timing_report report;
+    const struct pyd1598_timing_event *events;
+    const struct pyd1598_timing_result *result;
+    const struct pyd1598_timing_limit *limit;
+    const struct device *dev;
+    unsigned long n = 1;
+    size_t count;
+    char *arg_end;
+    int ret;
+
+    dev = pyd1598_shell_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+    if (argc > 2) {
+        n = strtoul(argv[2], &arg_end, 0);
+        if (*arg_end != '\0' || n == 0) {
+            shell_error(sh, "n must be a positive number");
+            return -EINVAL;
+        }
+    }
+
+    ret = pyd1598_timing_record_start(dev);
+    if (ret != 0) {
+        shell_error(sh, "record failed: %d", ret);
+        return ret;
+    }
+    ret = pyd1598_push(dev);
+    for (unsigned long i = 0; i < n && ret == 0; i++) {
+        ret = pyd1598_fetch(dev);
+    }
+    if (ret != 0) {
+        shell_warn(sh, "transaction failed: %d", ret);
+    }
+    if (pyd1598_timing_record_stop(&events, &count) == -ENOSPC) {
+        shell_warn(sh, "event buffer full after %u events", (unsigned int)count);
+    }
+
+    pyd1598_timing_check(events, count, &pyd1598_timing_datasheet, &report);
+
+    shell_print(sh, "%u events, %u pushes, %u fetches, %u decode errors",
+                (unsigned int)count, report.pushes, report.fetches, report.errors);
+    for (int i = 0; i < PYD1598_TIMING_CONSTRAINTS; i++) {
+        result = &report.results[i];
+        limit = &pyd1598_timing_datasheet.limits[i];
+        if (result->count == 0) {
+            shell_print(sh, "%-18s not measured", limit->name);
+            continue;
+        }
+        shell_print(sh, "%-18s n %4u| min %8u| max %8u| limit %u-%u| slack %8d ns%s",
+                    limit->name, result->count, result->min_ns, result->max_ns,
+                    limit->min_ns, limit->max_ns, result->slack_ns,
+                    (result->violations > 0) ? " VIOLATED" : "");
+    }
+
+    return 0;
+}
+#endif
+
+
+#ifdef CONFIG_PYD1598_TRACE
+static int cmd_pyd1598_trace(const struct shell *sh, size_t argc, char **argv)
+{
+    struct pyd1598_trace_record records[16];
+    const struct pyd1598_trace_record *record;
+    int count;
+
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    shell_print(sh, "%10s %-9s %4s %6s %s", "cycles", "id", "inst", "arg16", "arg32");
+    do {
+        count = pyd1598_trace_read(records, ARRAY_SIZE(records));
+        for (int i = 0; i < count; i++) {
+            record = &records[i];
+            shell_print(sh, "%10u %-9s %4u %6u 0x%08x", record->timestamp,
+                        (record->id < PYD1598_TRACE_IDS) ? pyd1598_trace_names[record->id] : "?",
+                        record->instance, record->arg16, record->arg32);
+        }
+    } while (count == ARRAY_SIZE(records));
+
+    return 0;
+}
+#endif
+
+
+#if defined(CONFIG_PYD1598_REPLAY) && defined(CONFIG_FILE_SYSTEM)
+// Longest csv line
+#define PYD1598_SHELL_REPLAY_LINE 64
+
+static uint8_t replay_block[CONFIG_PYD1598_REPLAY_BLOCK_SIZE];
+static struct pyd1598_frame replay_frames[CONFIG_PYD1598_REPLAY_BLOCK_SIZE / 4];
+
+
+// Parse one csv line, feed the buffered frames when it is full
+static int replay_csv_line(char *line, size_t *line_len, size_t *count)
+{
+    int ret;
+
+    line[*line_len] = '\0';
+    *line_len = 0;
+
+    ret = pyd1598_replay_parse_csv(line, replay_frames, ARRAY_SIZE(replay_frames), count);
+    if (ret == -ENOMEM) {
+        pyd1598_replay_feed(replay_frames, *count);
+        *count = 0;
+        ret = pyd1598_replay_parse_csv(line, replay_frames, ARRAY_SIZE(replay_frames), count);
+    }
+
+    return ret;
+}
+
+
+// Parse and feed a csv capture, line by line
+static int replay_csv(struct fs_file_t *file)
+{
+    char line[PYD1598_SHELL_REPLAY_LINE];
+    size_t line_len = 0;
+    size_t count = 0;
+    ssize_t len;
+    int ret;
+
+    do {
+        len = fs_read(file, replay_block, sizeof(replay_block));
+        if (len < 0) {
+            return (int)len;
+        }
+        for (ssize_t i = 0; i < len; i++) {
+            if (replay_block[i] != '\n') {
+                if (line_len < sizeof(line) - 1) {
+                    line[line_len++] = (char)replay_block[i];
+                }
+                continue;
+            }
+            ret = replay_csv_line(line, &line_len, &count);
+            if (ret != 0) {
+                return ret;
+            }
+        }
+    } while (len > 0);
+
+    // Last line without a newline
+    if (line_len > 0) {
+        ret = replay_csv_line(line, &line_len, &count);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+
+    return pyd1598_replay_feed(replay_frames, count);
+}
+
+
+// Decode and feed a frame log, block by block
+static int replay_log(struct fs_file_t *file, int instance)
+{
+    size_t count;
+    ssize_t len;
+    int ret;
+
+    while (true) {
+        len = fs_read(file, replay_block, sizeof(replay_block));
+        if (len <= 0) {
+            return (int)len;
+        }
+        count = 0;
+        ret = pyd1598_replay_parse_log(replay_block, (size_t)len, instance, replay_frames,
+                                       ARRAY_SIZE(replay_frames), &count);
+        if (ret != 0) {
+            return ret;
+        }
+        pyd1598_replay_feed(replay_frames, count);
+    }
+}
+
+
+static int cmd_pyd1598_replay(const struct shell *sh, size_t argc, char **argv)
+{
+    const struct pyd1598_config *cfg;
+    struct pyd1598_replay_report report;
+    const struct device *dev;
+    struct fs_file_t file;
+    unsigned long instance;
+    uint64_t total_ns;
+    char *arg_end;
+    size_t name_len;
+    bool csv;
+    int ret;
+
+    dev = pyd1598_shell_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+    cfg = dev->config;
+    instance = (unsigned long)cfg->instance;
+    if (argc > 3) {
+        instance = strtoul(argv[3], &arg_end, 0);
+        if (*arg_end != '\0' || instance > 62) {
+            shell_error(sh, "instance must be 0-62");
+            return -EINVAL;
+        }
+    }
+    name_len = strlen(argv[2]);
+    csv = (name_len > 4 && strcmp(&argv[2][name_len - 4], ".csv") == 0);
+
+    fs_file_t_init(&file);
+    ret = fs_open(&file, argv[2], FS_O_READ);
+    if (ret != 0) {
+        shell_error(sh, "open %s failed: %d", argv[2], ret);
+        return ret;
+    }
+
+    ret = pyd1598_replay_start(dev, NULL, NULL);
+    if (ret != 0) {
+        fs_close(&file);
+        shell_error(sh, "replay failed: %d", ret);
+        return ret;
+    }
+    ret = csv ? replay_csv(&file) : replay_log(&file, (int)instance);
+    pyd1598_replay_stop(&report);
+    fs_close(&file);
+    if (ret != 0) {
+        shell_warn(sh, "capture ends early: %d", ret);
+    }
+
+    shell_print(sh, "%u frames over %lld ms, %u pulses, %u triggers", report.samples,
+                report.span_us / USEC_PER_MSEC, report.pulses, report.triggers);
+    if (report.triggers > 0) {
+        shell_print(sh, "latency min %u| avg %u| max %u ms", report.latency_min_us / USEC_PER_MSEC,
+                    (uint32_t)(report.latency_sum_us / report.triggers / USEC_PER_MSEC),
+                    report.latency_max_us / USEC_PER_MSEC);
+    }
+    if (report.samples > 0) {
+        total_ns = MAX(timing_cycles_to_ns(report.cycles), 1);
+        shell_print(sh, "cycles per frame avg %u| max %u, %llu x real time",
+                    (uint32_t)(report.cycles / report.samples), report.cycles_max,
+                    (uint64_t)report.span_us * NSEC_PER_USEC / total_ns);
+    }
+
+    return 0;
+}
+#endif
+
+
+#ifdef CONFIG_PYD1598_CALIB
+static int cmd_pyd1598_calib(const struct shell *sh, size_t argc, char **argv)
+{
+    const struct device *dev;
+    struct pyd1598_calib_result result;
+    unsigned long period_s;
+    char *arg_end;
+    int ret;
+
+    dev = pyd1598_shell_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+
+    if (argc > 2) {
+        if (strcmp(argv[2], "stop") == 0) {
+            return pyd1598_calibrate_periodic(dev, K_FOREVER);
+        }
+        period_s = strtoul(argv[2], &arg_end, 10);
+        if (*arg_end != '\0' || period_s == 0) {
+            shell_error(sh, "period must be a number of seconds or stop");
+            return -EINVAL;
+        }
+        return pyd1598_calibrate_periodic(dev, K_SECONDS(period_s));
+    }
+
+    shell_print(sh, "sampling, keep the field of view empty");
+    ret = pyd1598_calibrate(dev, &result);
+    if (ret != 0) {
+        shell_error(sh, "calibration failed: %d", ret);
+        return ret;
+    }
+
+    shell_print(sh, "samples       %u", result.samples);
+    shell_print(sh, "offset        %d", result.offset);
+    shell_print(sh, "noise         %u", result.noise);
+    shell_print(sh, "peak          %u", result.peak);
+    shell_print(sh, "drift         %d", result.drift);
+    shell_print(sh, "temperature   %u -> %u", result.temperature_start, result.temperature_end);
+    shell_print(sh, "false pulses  %u", result.false_pulses);
+    shell_print(sh, "threshold     %u", result.threshold);
+    shell_print(sh, "pulse counter %u", result.pulse_counter);
+    shell_print(sh, "window time   %u", result.window_time);
+
+    return 0;
+}
+#endif
+
+
+#ifdef CONFIG_PYD1598_SCHED
+// The counters of the scheduler are enough here
+static void pyd1598_shell_sample(const struct device *dev, const struct pyd1598_sample *sample, void *user_data)
+{
+    ARG_UNUSED(dev);
+    ARG_UNUSED(sample);
+    ARG_UNUSED(user_data);
+}
+
+
+static int cmd_pyd1598_sched(const struct shell *sh, size_t argc, char **argv)
+{
+    static const enum pyd1598_signal_source sources[] = {
+        PYD1598_PIR_BPF, PYD1598_PIR_LPF, PYD1598_TEMPERATURE_SENSOR,
+    };
+    const struct device *dev;
+    struct pyd1598_sched_stats stats;
+    unsigned long period_ms;
+    char *arg_end;
+    int ret;
+
+    dev = pyd1598_shell_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+
+    if (argc == 2) {
+        pyd1598_sched_get_stats(dev, &stats);
+        shell_print(sh, "samples  %u", stats.samples);
+        shell_print(sh, "switches %u", stats.switches);
+        shell_print(sh, "missed   %u", stats.missed);
+        return 0;
+    }
+    if (argc == 3 && strcmp(argv[2], "stop") == 0) {
+        return pyd1598_sched_stop(dev);
+    }
+    if (argc != 5) {
+        shell_error(sh, "expected <bpf ms> <lpf ms> <temperature ms> or stop");
+        return -EINVAL;
+    }
+
+    pyd1598_sched_stop(dev);
+    for (int i = 0; i < ARRAY_SIZE(sources); i++) {
+        period_ms = strtoul(argv[2 + i], &arg_end, 10);
+        if (*arg_end != '\0') {
+            shell_error(sh, "invalid period %s", argv[2 + i]);
+            return -EINVAL;
+        }
+        ret = pyd1598_sched_set_period(dev, sources[i], period_ms);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+
+    return pyd1598_sched_start(dev, pyd1598_shell_sample, NULL);
+}
+#endif
+
+
+#ifdef CONFIG_PYD1598_HYBRID
+static int cmd_pyd1598_hybrid(const struct shell *sh, size_t argc, char **argv)
+{
+    const struct device *dev;
+    struct pyd1598_hybrid_config config;
+    struct pyd1598_hybrid_stats stats;
+    unsigned long values[4];
+    uint64_t total_ms;
+    char *arg_end;
+
+    dev = pyd1598_shell_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+
+    if (argc == 2) {
+        pyd1598_hybrid_get_stats(dev, &stats);
+        total_ms = stats.wake_up_ms + stats.streaming_ms;
+        shell_print(sh, "triggers %u| bursts %u| frames %u", stats.triggers, stats.bursts, stats.frames);
+        shell_print(sh, "switches %u| errors %u| verify errors %u| avg %u us", stats.switches,
+                    stats.switch_errors, stats.verify_errors,
+                    (stats.switches > 0) ? stats.switch_us / stats.switches : 0);
+        shell_print(sh, "wake-up %llu ms| streaming %llu ms| duty %llu.%llu%%", stats.wake_up_ms,
+                    stats.streaming_ms, (total_ms > 0) ? stats.streaming_ms * 100 / total_ms : 0,
+                    (total_ms > 0) ? stats.streaming_ms * 1000 / total_ms % 10 : 0);
+        return 0;
+    }
+    if (argc == 3 && strcmp(argv[2], "stop") == 0) {
+        return pyd1598_hybrid_stop(dev);
+    }
+    if (argc != 6) {
+        shell_error(sh, "expected <period ms> <window ms> <quiet ms> <threshold> or stop");
+        return -EINVAL;
+    }
+
+    for (int i = 0; i < ARRAY_SIZE(values); i++) {
+        values[i] = strtoul(argv[2 + i], &arg_end, 10);
+        if (*arg_end != '\0') {
+            shell_error(sh, "invalid value %s", argv[2 + i]);
+            return -EINVAL;
+        }
+    }
+    config.period_ms = (uint32_t)values[0];
+    config.window_ms = (uint32_t)values[1];
+    config.quiet_ms = (uint32_t)values[2];
+    config.threshold = (uint16_t)MIN(values[3], UINT16_MAX);
+
+    return pyd1598_hybrid_start(dev, &config);
+}
+#endif
+
+
+#ifdef CONFIG_PYD1598_OCCUPANCY
+static int cmd_pyd1598_occupancy(const struct shell *sh, size_t argc, char **argv)
+{
+    const struct device *dev;
+    struct pyd1598_occupancy_summary summary;
+    unsigned long period_s;
+    char *arg_end;
+    int ret;
+
+    dev = pyd1598_shell_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+
+    if (argc == 2) {
+        ret = pyd1598_occupancy_get(dev, &summary);
+        if (ret != 0) {
+            shell_error(sh, "not started");
+            return ret;
+        }
+        shell_print(sh, "period %lld ms| triggers %u| visits %u| dwell %u ms| %s",
+                    (summary.end_us - summary.start_us) / USEC_PER_MSEC, summary.triggers, summary.visits,
+                    summary.dwell_ms, summary.occupied ? "occupied" : "empty");
+        if (summary.triggers > 0) {
+            shell_print(sh, "first %lld ms ago| last %lld ms ago| reset errors %u",
+                        (summary.end_us - summary.first_us) / USEC_PER_MSEC,
+                        (summary.end_us - summary.last_us) / USEC_PER_MSEC, summary.reset_errors);
+        }
+        return 0;
+    }
+    if (strcmp(argv[2], "stop") == 0) {
+        return pyd1598_occupancy_stop(dev);
+    }
+
+    period_s = strtoul(argv[2], &arg_end, 10);
+    if (*arg_end != '\0' || period_s == 0 || period_s > 86400) {
+        shell_error(sh, "invalid period %s", argv[2]);
+        return -EINVAL;
+    }
+
+    return pyd1598_occupancy_start(dev, (uint32_t)period_s * MSEC_PER_SEC, NULL, NULL);
+}
+#endif
+
+
+#ifdef CONFIG_PYD1598_SYNC
+static int cmd_pyd1598_sync(const struct shell *sh, size_t argc, char **argv)
+{
+    const struct device *devs[CONFIG_PYD1598_SYNC_MAX_SENSORS];
+    struct pyd1598_sync_stats stats;
+    unsigned long period_ms;
+    size_t count = 0;
+    char *arg_end;
+
+    if (argc == 1) {
+        shell_print(sh, "%-16s %8s %6s %8s %5s %9s %9s %9s %10s %9s %10s %10s %10s", "device", "samples", "errors", "overruns",
+                    "late", "sample ns", "skew ns", "max", "latency us", "max", "jitter min", "max", "mean abs");
+        for (size_t i = 0; i < ARRAY_SIZE(pyd1598_devices); i++) {
+            pyd1598_sync_get_stats(pyd1598_devices[i], &stats);
+            if (stats.samples == 0) {
+                continue;
+            }
+            shell_print(sh, "%-16s %8u %6u %8u %5u %9u %9d %9d %10u %9u %10d %10d %10llu", pyd1598_devices[i]->name,
+                        stats.samples, stats.errors, stats.overruns, stats.late, stats.sample_delay_max_ns,
+                        stats.skew_ns, stats.skew_max_ns, stats.readout_latency_us, stats.readout_latency_max_us,
+                        stats.jitter_min_ns, stats.jitter_max_ns,
+                        (stats.samples > 1) ? stats.jitter_abs_ns / (stats.samples - 1) : 0);
+        }
+        return 0;
+    }
+    if (strcmp(argv[1], "stop") == 0) {
+        return pyd1598_sync_stop();
+    }
+
+    period_ms = strtoul(argv[1], &arg_end, 10);
+    if (*arg_end != '\0' || period_ms == 0 || period_ms > 10000) {
+        shell_error(sh, "invalid period %s", argv[1]);
+        return -EINVAL;
+    }
+
+    // Every ready device, in devicetree order, the first one is the skew reference
+    for (size_t i = 0; i < ARRAY_SIZE(pyd1598_devices) && count < ARRAY_SIZE(devs); i++) {
+        if (device_is_ready(pyd1598_devices[i])) {
+            devs[count++] = pyd1598_devices[i];
+        }
+    }
+    if (count < ARRAY_SIZE(pyd1598_devices)) {
+        shell_warn(sh, "sampling %zu of %zu devices", count, ARRAY_SIZE(pyd1598_devices));
+    }
+
+    pyd1598_sync_stop();
+    return pyd1598_sync_start(devs, count, (uint32_t)period_ms * USEC_PER_MSEC, NULL, NULL);
+}
+#endif
+
+
+#ifdef CONFIG_PYD1598_FUSION
+static int cmd_pyd1598_fusion(const struct shell *sh, size_t argc, char **argv)
+{
+    struct pyd1598_fusion_event travel;
+    uint32_t zones;
+    int ret;
+
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    pyd1598_fusion_get_zones(&zones);
+    shell_print(sh, "zones 0x%08x", zones);
+
+    ret = pyd1598_fusion_get_travel(&travel);
+    if (ret == -ENODATA) {
+        shell_print(sh, "no travel yet");
+        return 0;
+    }
+    shell_print(sh, "travel %u -> %u| zone %u -> %u| %lld ms ago", travel.from_instance, travel.to_instance,
+                travel.from_zone, travel.to_zone,
+                (k_ticks_to_us_floor64(k_uptime_ticks()) - travel.timestamp_us) / USEC_PER_MSEC);
+    shell_print(sh, "dx %d| dy %d mm| %u ms| %u mm/s| correlation %u", travel.dx_mm, travel.dy_mm,
+                travel.delay_us / USEC_PER_MSEC, travel.speed_mm_s, travel.confidence);
+
+    return ret;
+}
+#endif
+
+
+static void bench_sort(uint32_t *cycles, size_t n)
+{
+    uint32_t value;
+    size_t j;
+
+    // Insertion sort, n is bounded by CONFIG_PYD1598_SHELL_BENCH_MAX_SAMPLES
+    for (size_t i = 1; i < n; i++) {
+        value = cycles[i];
+        for (j = i; j > 0 && cycles[j - 1] > value; j--) {
+            cycles[j] = cycles[j - 1];
+        }
+        cycles[j] = value;
+    }
+}
+
+
+static uint32_t bench_percentile(const uint32_t *sorted, size_t n, unsigned int percent)
+{
+    return sorted[((n - 1) * percent) / 100];
+}
+
+
+// Runs transaction(dev) n times, n given as a string argument
+static int pyd1598_shell_bench(const struct shell *sh, const struct device *dev, const char *n_arg,
+                               int (*transaction)(const struct device *dev))
+{
+    unsigned long n;
+    timing_t start;
+    timing_t end;
+    timing_t total_start;
+    uint64_t total_ns;
+    uint32_t failed = 0;
+    char *arg_end;
+#ifdef CONFIG_THREAD_RUNTIME_STATS
+    k_thread_runtime_stats_t cpu_start;
+    k_thread_runtime_stats_t cpu_end;
+    uint64_t cpu_us;
+#endif
+
+    n = strtoul(n_arg, &arg_end, 0);
+    if (*arg_end != '\0' || n == 0 || n > CONFIG_PYD1598_SHELL_BENCH_MAX_SAMPLES) {
+        shell_error(sh, "n must be 1-%d", CONFIG_PYD1598_SHELL_BENCH_MAX_SAMPLES);
+        return -EINVAL;
+    }
+
+    // CPU cycle counter, the kernel cycle counter is too coarse on some boards
+    timing_init();
+    timing_start();
+
+#ifdef CONFIG_THREAD_RUNTIME_STATS
+    k_thread_runtime_stats_get(k_current_get(), &cpu_start);
+#endif
+    total_start = timing_counter_get();
+    for (size_t i = 0; i < n; i++) {
+        start = timing_counter_get();
+        if (transaction(dev) != 0) {
+            failed++;
+        }
+        end = timing_counter_get();
+        bench_cycles[i] = (uint32_t)timing_cycles_get(&start, &end);
+    }
+    end = timing_counter_get();
+    total_ns = timing_cycles_to_ns(timing_cycles_get(&total_start, &end));
+#ifdef CONFIG_THREAD_RUNTIME_STATS
+    k_thread_runtime_stats_get(k_current_get(), &cpu_end);
+    cpu_us = k_cyc_to_us_floor64(cpu_end.execution_cycles - cpu_start.execution_cycles);
+#endif
+
+    timing_stop();
+
+    bench_sort(bench_cycles, n);
+
+    shell_print(sh, "%lu transactions, %u failed, %llu us", n, failed, total_ns / NSEC_PER_USEC);
+    if (total_ns > 0) {
+        shell_print(sh, "throughput %llu /s", ((uint64_t)n * NSEC_PER_SEC) / total_ns);
+    }
+    shell_print(sh, "cycles min %u| p50 %u| p90 %u| p99 %u| max %u",
+                bench_cycles[0],
+                bench_percentile(bench_cycles, n, 50),
+                bench_percentile(bench_cycles, n, 90),
+                bench_percentile(bench_cycles, n, 99),
+                bench_cycles[n - 1]);
+    shell_print(sh, "us     min %llu| p50 %llu| max %llu",
+                timing_cycles_to_ns(bench_cycles[0]) / NSEC_PER_USEC,
+                timing_cycles_to_ns(bench_percentile(bench_cycles, n, 50)) / NSEC_PER_USEC,
+                timing_cycles_to_ns(bench_cycles[n - 1]) / NSEC_PER_USEC);
+#ifdef CONFIG_THREAD_RUNTIME_STATS
+    shell_print(sh, "cpu %llu us, %llu us per transaction", cpu_us, cpu_us / n);
+#endif
+
+    return 0;
+}
+
+
+// One full cluster scan, fails if any device failed
+static int pyd1598_shell_scan(const struct device *dev)
+{
+    int ret = 0;
+
+    ARG_UNUSED(dev);
+
+    for (size_t i = 0; i < ARRAY_SIZE(pyd1598_devices); i++) {
+        if (pyd1598_fetch(pyd1598_devices[i]) != 0) {
+            ret = -EIO;
+        }
+    }
+
+    return ret;
+}
+
+
+#ifdef CONFIG_PM_DEVICE
+// Resume to first sample, suspending first so every run resumes
+static int pyd1598_shell_resume_fetch(const struct device *dev)
+{
+    int ret;
+
+    ret = pm_device_action_run(dev, PM_DEVICE_ACTION_SUSPEND);
+    if (ret != 0 && ret != -EALREADY) {
+        return ret;
+    }
+    ret = pm_device_action_run(dev, PM_DEVICE_ACTION_RESUME);
+    if (ret != 0 && ret != -EALREADY) {
+        return ret;
+    }
+
+    return pyd1598_fetch(dev);
+}
+
+
+static int cmd_pyd1598_bench_resume(const struct shell *sh, size_t argc, char **argv)
+{
+    const struct device *dev;
+
+    ARG_UNUSED(argc);
+
+    dev = pyd1598_shell_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+
+    return pyd1598_shell_bench(sh, dev, argv[2], pyd1598_shell_resume_fetch);
+}
+#endif
+
+
+#ifdef CONFIG_PYD1598_ENCODER
+// One batch of synthetic LPF frames, round robin over the instances at 100 Hz each
+static int cmd_pyd1598_bench_encode(const struct shell *sh, size_t argc, char **argv)
+{
+    static uint8_t stream[CONFIG_PYD1598_SHELL_BENCH_ENCODE_SIZE];
+    static uint8_t payload[CONFIG_PYD1598_SHELL_BENCH_ENCODE_SIZE];
+    static struct pyd1598_encoder enc;
+    struct pyd1598_frame frame;
+    unsigned long samples;
+    unsigned long added = 0;
+    uint32_t seed = 1;
+    uint8_t instances;
+    size_t payload_len = 0;
+    timing_t start;
+    timing_t end;
+    uint64_t cycles;
+    char *arg_end;
+    int ret;
+
+    ARG_UNUSED(argc);
+
+    samples = strtoul(argv[1], &arg_end, 0);
+    if (*arg_end != '\0' || samples == 0) {
+        shell_error(sh, "samples must be a positive number");
+        return -EINVAL;
+    }
+    instances = (uint8_t)MIN(MAX(ARRAY_SIZE(pyd1598_devices), 1), CONFIG_PYD1598_ENCODER_MAX_INSTANCES);
+
+    frame.timestamp_us = 0;
+    frame.sensor_conf = 0x3ec0a1;
+    frame.measurement = 8192;
+
+    timing_init();
+    timing_start();
+    start = timing_counter_get();
+
+    pyd1598_encoder_init(&enc, stream, sizeof(stream));
+    for (added = 0; added < samples; added++) {
+        // Slow random walk, like an LPF readout of an empty room
+        seed = seed * 1103515245u + 12345u;
+        frame.measurement = (uint16_t)(frame.measurement + ((seed >> 16) % 7) - 3);
+        frame.timestamp_us += 10000 / instances;
+        ret = pyd1598_encoder_add_frame(&enc, (uint8_t)(added % instances), &frame);
+        if (ret != 0) {
+            break;
+        }
+    }
+    ret = pyd1598_encoder_finish(&enc, payload, sizeof(payload), &payload_len);
+
+    end = timing_counter_get();
+    cycles = timing_cycles_get(&start, &end);
+    timing_stop();
+
+    if (ret != 0) {
+        shell_error(sh, "finish failed: %d", ret);
+        return ret;
+    }
+    if (added == 0) {
+        shell_error(sh, "no sample fits in %u B", (unsigned int)sizeof(stream));
+        return -ENOMEM;
+    }
+    if (added < samples) {
+        shell_warn(sh, "batch full after %lu samples", added);
+    }
+
+    shell_print(sh, "%lu samples, %u instances, %u B payload (%u B as struct pyd1598_frame)",
+                added, instances, (unsigned int)payload_len, (unsigned int)(added * sizeof(frame)));
+    shell_print(sh, "bytes per sample %u.%02u",
+                (unsigned int)(payload_len / added), (unsigned int)(((payload_len % added) * 100) / added));
+    shell_print(sh, "encode %llu cycles per batch, %llu per sample", cycles, cycles / added);
+
+    return 0;
+}
+#endif
+
+
+static int cmd_pyd1598_bench_fetch(const struct shell *sh, size_t argc, char **argv)
+{
+    const struct device *dev;
+
+    ARG_UNUSED(argc);
+
+    dev = pyd1598_shell_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+
+    return pyd1598_shell_bench(sh, dev, argv[2], pyd1598_fetch);
+}
+
+
+static int cmd_pyd1598_bench_push(const struct shell *sh, size_t argc, char **argv)
+{
+    const struct device *dev;
+
+    ARG_UNUSED(argc);
+
+    dev = pyd1598_shell_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+
+    return pyd1598_shell_bench(sh, dev, argv[2], pyd1598_push);
+}
+
+
+static int cmd_pyd1598_bench_scan(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+
+    shell_print(sh, "scanning %u devices", (unsigned int)ARRAY_SIZE(pyd1598_devices));
+
+    return pyd1598_shell_bench(sh, NULL, argv[1], pyd1598_shell_scan);
+}
+
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_pyd1598_bench,
+    SHELL_CMD_ARG(fetch, NULL, "<device> <n>", cmd_pyd1598_bench_fetch, 3, 0),
+    SHELL_CMD_ARG(push, NULL, "<device> <n>", cmd_pyd1598_bench_push, 3, 0),
+    SHELL_CMD_ARG(scan, NULL, "<n> Fetch every device, n times", cmd_pyd1598_bench_scan, 2, 0),
+#ifdef CONFIG_PYD1598_ENCODER
+    SHELL_CMD_ARG(encode, NULL, "<samples> Encode one synthetic batch", cmd_pyd1598_bench_encode, 2, 0),
+#endif
+#ifdef CONFIG_PM_DEVICE
+    SHELL_CMD_ARG(resume, NULL, "<device> <n> Suspend, resume and fetch", cmd_pyd1598_bench_resume, 3, 0),
+#endif
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_pyd1598,
+    SHELL_CMD_ARG(list, NULL, "List pyd1598 devices", cmd_pyd1598_list, 1, 0),
+    SHELL_CMD_ARG(config, NULL, "<device> Desired and read back configuration", cmd_pyd1598_config, 2, 0),
+    SHELL_CMD_ARG(push, NULL, "<device> Push the desired configuration", cmd_pyd1598_push, 2, 0),
+    SHELL_CMD_ARG(fetch, NULL, "<device> Fetch one frame", cmd_pyd1598_fetch, 2, 0),
+#ifdef CONFIG_PYD1598_CACHE
+    SHELL_CMD_ARG(cache, NULL, "<device> [<max age us>] Fetch unless the last frame is fresh", cmd_pyd1598_cache, 2, 1),
+#endif
+#ifdef CONFIG_PYD1598_STATS
+    SHELL_CMD_ARG(stats, NULL, "<device> [reset] Transaction counters", cmd_pyd1598_stats, 2, 1),
+#endif
+#ifdef CONFIG_PYD1598_ENERGY
+    SHELL_CMD_ARG(energy, NULL, "<device> [reset] Transaction time and estimated charge", cmd_pyd1598_energy, 2, 1),
+#endif
+#ifdef CONFIG_PYD1598_LOGGER
+    SHELL_CMD_ARG(logger, NULL, "Logger counters", cmd_pyd1598_logger, 1, 0),
+#endif
+#ifdef CONFIG_PYD1598_CAPTURE
+    SHELL_CMD_ARG(capture, NULL, "<device> [<pre> <post>|trigger|stop] Frames around triggers", cmd_pyd1598_capture,
+                  2, 2),
+#endif
+#ifdef CONFIG_PYD1598_SCHED
+    SHELL_CMD_ARG(sched, NULL, "<device> [<bpf ms> <lpf ms> <temperature ms>|stop] Signal source scheduler",
+                  cmd_pyd1598_sched, 2, 3),
+#endif
+#ifdef CONFIG_PYD1598_HYBRID
+    SHELL_CMD_ARG(hybrid, NULL, "<device> [<period ms> <window ms> <quiet ms> <threshold>|stop] Wake-up mode with bursts",
+                  cmd_pyd1598_hybrid, 2, 4),
+#endif
+#ifdef CONFIG_PYD1598_OCCUPANCY
+    SHELL_CMD_ARG(occupancy, NULL, "<device> [<period s>|stop] Wake-up triggers per period", cmd_pyd1598_occupancy,
+                  2, 1),
+#endif
+#ifdef CONFIG_PYD1598_SYNC
+    SHELL_CMD_ARG(sync, NULL, "[<period ms>|stop] Sample every device at the same instants", cmd_pyd1598_sync, 1, 1),
+#endif
+#ifdef CONFIG_PYD1598_FUSION
+    SHELL_CMD_ARG(fusion, NULL, "Occupied zones and last direction of travel", cmd_pyd1598_fusion, 1, 0),
+#endif
+#ifdef CONFIG_PYD1598_TIMING_CHECK
+    SHELL_CMD_ARG(timing, NULL, "<device> [<n>] Check the timing of a push and n fetches", cmd_pyd1598_timing, 2, 1),
+#endif
+#ifdef CONFIG_PYD1598_TRACE
+    SHELL_CMD_ARG(trace, NULL, "Drain and print the transaction trace", cmd_pyd1598_trace, 1, 0),
+#endif
+#if defined(CONFIG_PYD1598_REPLAY) && defined(CONFIG_FILE_SYSTEM)
+    SHELL_CMD_ARG(replay, NULL, "<device> <file> [<instance>] Replay a capture through the wake-up detection",
+                  cmd_pyd1598_replay, 3, 1),
+#endif
+#ifdef CONFIG_PYD1598_CALIB
+    SHELL_CMD_ARG(calib, NULL, "<device> [<s>|stop] Calibrate the wake-up threshold", cmd_pyd1598_calib, 2, 1),
+#endif
+    SHELL_CMD(bench, &sub_pyd1598_bench, "Transaction micro-benchmarks", NULL),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(pyd1598, &sub_pyd1598, "PYD1598 motion sensor commands", NULL);
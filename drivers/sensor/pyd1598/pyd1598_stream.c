@@ -0,0 +1,188 @@
+/*
+PYD1598 driver managed streaming
+
+A delayable work item fetches at a fixed period, so applications consume frames
+(for example from zbus) instead of running their own fetch loop.
+The sensor must be pushed into forced readout mode before streaming is started.
+A started stream keeps the device resumed, suspending it stops the stream until resume.
+*/
+
+#include <zephyr/device.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/kernel.h>
+#include <zephyr/pm/device_runtime.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pyd1598.h>
+#include "pyd1598_internal.h"
+
+LOG_MODULE_DECLARE(PYD1598, PYD1598_LOG_LEVEL);
+
+
+static void pyd1598_stream_work_handler(struct k_work *work)
+{
+    // Variables
+    struct k_work_delayable *dwork;
+    struct pyd1598_data *data;
+    int ret;
+
+    // Declare the variables
+    dwork = k_work_delayable_from_work(work);
+    data = CONTAINER_OF(dwork, struct pyd1598_data, stream_work);
+
+    // Reschedule first so the period does not drift with the transaction time
+    k_work_schedule(dwork, data->stream_period);
+
+    // The frame is handed to the optional modules by fetch
+    ret = pyd1598_fetch(data->dev);
+    if (ret != 0) {
+        LOG_DBG("Stream fetch failed: %d", ret);
+    }
+}
+
+
+int pyd1598_stream_init(const struct device *dev)
+{
+    // Variables
+    struct pyd1598_data *data;
+
+    // Declare the variables
+    data = dev->data;
+    data->stream_period = K_NO_WAIT;
+    data->stream_active = false;
+
+    k_work_init_delayable(&data->stream_work, pyd1598_stream_work_handler);
+
+    return 0;
+}
+
+
+/**
+ * @brief Start fetching from the sensor at a fixed period on the system work queue.
+ *
+ * @param dev Pointer to the sensor device
+ * @param period Time between two fetches
+ *
+ * @return 0 if successful, -EBUSY if the device is scheduled, in hybrid mode, interrupt readout, a sync group or calibrating, negative errno code if failure.
+ */
+int pyd1598_stream_start(const struct device *dev, k_timeout_t period)
+{
+    // Variables
+    struct pyd1598_data *data;
+    enum pyd1598_operation_mode operation_mode;
+    int ret;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_stream_start");
+    if (dev == NULL || dev->data == NULL || K_TIMEOUT_EQ(period, K_NO_WAIT) || K_TIMEOUT_EQ(period, K_FOREVER)) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+
+    // Streaming is only meaningful in forced readout mode
+    ret = pyd1598_get_operation_mode(dev, &operation_mode);
+    if (ret != 0) {
+        return ret;
+    }
+    if (operation_mode != PYD1598_FORCED_READOUT) {
+        LOG_ERR("Sensor is not in forced readout mode, streaming is only possible in forced readout mode");
+        return -EIO;
+    }
+
+    // The modules that read the sensor out on their own, checked and claimed under the lock
+    k_mutex_lock(&data->run_lock, K_FOREVER);
+#ifdef CONFIG_PYD1598_SCHED
+    // The scheduler fetches on its own
+    if (data->sched.active) {
+        k_mutex_unlock(&data->run_lock);
+        return -EBUSY;
+    }
+#endif
+#ifdef CONFIG_PYD1598_HYBRID
+    // So does the hybrid mode, and it pushes the operation mode
+    if (data->hybrid.active) {
+        k_mutex_unlock(&data->run_lock);
+        return -EBUSY;
+    }
+#endif
+    if (pyd1598_interrupt_running(dev) || pyd1598_sync_running(dev) || pyd1598_calib_running(dev)) {
+        k_mutex_unlock(&data->run_lock);
+        return -EBUSY;
+    }
+
+    // Keep the device resumed between the fetches
+    if (!data->stream_active) {
+        ret = pm_device_runtime_get(dev);
+        if (ret < 0) {
+            k_mutex_unlock(&data->run_lock);
+            return ret;
+        }
+        data->stream_active = true;
+    }
+
+    data->stream_period = period;
+    ret = k_work_reschedule(&data->stream_work, K_NO_WAIT);
+    k_mutex_unlock(&data->run_lock);
+    if (ret < 0) {
+        return ret;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Stop streaming, waits for a running fetch to complete.
+ *
+ * @param dev Pointer to the sensor device
+ *
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_stream_stop(const struct device *dev)
+{
+    // Variables
+    struct pyd1598_data *data;
+    struct k_work_sync sync;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_stream_stop");
+    if (dev == NULL || dev->data == NULL) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+
+    k_mutex_lock(&data->run_lock, K_FOREVER);
+    k_work_cancel_delayable_sync(&data->stream_work, &sync);
+
+    if (data->stream_active) {
+        data->stream_active = false;
+        pm_device_runtime_put(dev);
+    }
+    k_mutex_unlock(&data->run_lock);
+
+    return 0;
+}
+
+
+void pyd1598_stream_pm(const struct device *dev, bool suspend)
+{
+    // Variables
+    struct pyd1598_data *data;
+
+    // Declare the variables
+    data = dev->data;
+
+    if (!data->stream_active) {
+        return;
+    }
+    if (suspend) {
+        k_work_cancel_delayable(&data->stream_work);
+    } else {
+        k_work_reschedule(&data->stream_work, K_NO_WAIT);
+    }
+}
@@ -0,0 +1,581 @@
+/*
+PYD1598 synchronized sampling
+
+All sensors of a group are sampled at the same instants from one timebase, a periodic
+k_timer. Its expiry raises direct link of every member back to back with irq locked,
+which starts a forced readout on each of them, and stamps every rising edge with the
+cycle counter. A frame so carries the sample point of its own sensor, and the skew of
+every member to the first one of the group is known, independent of the loop order of
+the application and of how late the readout runs.
+
+The work item of the tick clocks the bits out of all members in lockstep, bit by bit:
+every member is pulsed, released and sampled 3 us after its own release before the
+next member is pulsed, so the release to sample time is the same for every member and
+does not depend on the size of the group. The longest one is kept per member next to
+the 22 us limit of the sensor. The setup and hold times are shared by the group, the
+bits are clocked per member. Direct link is then held low and a one shot timer releases
+all members after the hold time, nothing busy waits for it.
+
+Per member the driver keeps the skew of its sample point to the group reference and
+the deviation of every sample interval from the period, the period jitter. Both are
+taken from the rising edges of the timer interrupt and do not include the time until
+the readout runs. The readout runs on its own cooperative work queue at
+CONFIG_PYD1598_SYNC_THREAD_PRIORITY so the system work queue and application threads
+do not delay it, and the start of the readout of every member is stamped: the readout
+latency from the rising edge to the first clock of the member, setup time and queue
+latency included, is kept next to skew and jitter. Frames are
+checked, saved and published like fetched ones and handed to the callback as one group.
+A tick that comes while the previous readout still runs is skipped and counted.
+
+Members must be pushed into forced readout mode. Push, fetch and suspend return -EBUSY
+for members while the group runs. One group at a time.
+*/
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/init.h>
+#include <zephyr/irq.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/kernel.h>
+#include <zephyr/pm/device_runtime.h>
+#include <zephyr/sys/util.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pyd1598.h>
+#include "pyd1598_internal.h"
+
+LOG_MODULE_DECLARE(PYD1598, PYD1598_LOG_LEVEL);
+
+
+// Direct link high before the first clock, 120 us + 20%, and low after the readout, 1250 us + 20%
+#define PYD1598_SYNC_SETUP_US 168
+#define PYD1598_SYNC_HOLD_US 1500
+
+// Release to sample time of every bit, and the limit of the sensor
+#define PYD1598_SYNC_SAMPLE_US 3
+#define PYD1598_SYNC_SAMPLE_MAX_US 22
+
+// Bit of one member, pulse, release, sample wait and sample, with margin for the gpio calls
+#define PYD1598_SYNC_BIT_US 6
+
+// Shortest period, setup, readout of a full group and hold
+#define PYD1598_SYNC_PERIOD_MIN_US 5000
+#define PYD1598_SYNC_READOUT_US(count) \
+    (PYD1598_SYNC_SETUP_US + (count) * PYD1598_READOUT_BITS * PYD1598_SYNC_BIT_US + PYD1598_SYNC_HOLD_US)
+// Longest period, sample intervals are measured with the 32 bit cycle counter
+#define PYD1598_SYNC_PERIOD_MAX_US 10000000
+
+// The running group
+static const struct device *sync_devs[CONFIG_PYD1598_SYNC_MAX_SENSORS];
+static struct pyd1598_sync_sample sync_samples[CONFIG_PYD1598_SYNC_MAX_SENSORS];
+static uint32_t sync_edges[CONFIG_PYD1598_SYNC_MAX_SENSORS];
+static uint64_t sync_raw[CONFIG_PYD1598_SYNC_MAX_SENSORS];
+static uint32_t sync_released[CONFIG_PYD1598_SYNC_MAX_SENSORS]; // Cycle count of the last release
+static uint32_t sync_readout[CONFIG_PYD1598_SYNC_MAX_SENSORS]; // Cycle count of the first clock of the readout
+static uint32_t sync_sample_delay[CONFIG_PYD1598_SYNC_MAX_SENSORS]; // Longest release to sample of the tick, cycles
+static size_t sync_count;
+static uint32_t sync_period_us;
+static pyd1598_sync_callback_t sync_callback;
+static void *sync_user_data;
+static int64_t sync_base_us; // Uptime of the first sample point of the tick
+static bool sync_busy; // From the tick to the release, set and cleared in interrupt context
+static bool sync_first; // No sample interval yet
+
+static void pyd1598_sync_tick(struct k_timer *timer);
+static void pyd1598_sync_release(struct k_timer *timer);
+static void pyd1598_sync_work_handler(struct k_work *work);
+
+// Starting and stopping a group, the members are claimed under their own run lock
+static K_MUTEX_DEFINE(sync_lock);
+
+static K_TIMER_DEFINE(sync_timer, pyd1598_sync_tick, NULL);
+static K_TIMER_DEFINE(sync_release_timer, pyd1598_sync_release, NULL);
+static K_WORK_DEFINE(sync_work, pyd1598_sync_work_handler);
+
+// Readouts of the group, ahead of the system work queue
+static K_THREAD_STACK_DEFINE(sync_stack, CONFIG_PYD1598_SYNC_STACK_SIZE);
+static struct k_work_q sync_work_q;
+
+
+// Runs in interrupt context, the sample instant of the group
+static void pyd1598_sync_tick(struct k_timer *timer)
+{
+    // Variables
+    const struct pyd1598_config *cfg;
+    struct pyd1598_data *data;
+    int key;
+
+    ARG_UNUSED(timer);
+
+    if (sync_busy) {
+        for (size_t m = 0; m < sync_count; m++) {
+            data = sync_devs[m]->data;
+            data->sync_stats.overruns++;
+        }
+        return;
+    }
+    sync_busy = true;
+
+    // Rising edges back to back, the sensors latch their sample here
+    key = irq_lock();
+    sync_base_us = k_ticks_to_us_floor64(k_uptime_ticks());
+    for (size_t m = 0; m < sync_count; m++) {
+        cfg = sync_devs[m]->config;
+        gpio_pin_configure_dt(&cfg->direct_link, GPIO_OUTPUT_LOW);
+        pyd1598_timing_mark(cfg, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_LEVEL, 0);
+        gpio_pin_set_dt(&cfg->direct_link, 1);
+        sync_edges[m] = k_cycle_get_32();
+        pyd1598_timing_mark(cfg, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_LEVEL, 1);
+    }
+    irq_unlock(key);
+
+    k_work_submit_to_queue(&sync_work_q, &sync_work);
+}
+
+
+// Runs in interrupt context, the hold time after the readout has passed
+static void pyd1598_sync_release(struct k_timer *timer)
+{
+    // Variables
+    const struct pyd1598_config *cfg;
+
+    ARG_UNUSED(timer);
+
+    for (size_t m = 0; m < sync_count; m++) {
+        cfg = sync_devs[m]->config;
+        gpio_pin_configure_dt(&cfg->direct_link, GPIO_INPUT);
+        pyd1598_timing_mark(cfg, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_RELEASE, 0);
+    }
+    sync_busy = false;
+}
+
+
+// Clock the bits of all members in lockstep, call with irq locked
+static int pyd1598_sync_readout_bits(int bits)
+{
+    // Variables
+    const struct pyd1598_config *cfg;
+    uint32_t sample_cyc;
+    uint32_t waited;
+    uint32_t bit;
+    int ret;
+
+    // Declare the variables
+    sample_cyc = k_us_to_cyc_ceil32(PYD1598_SYNC_SAMPLE_US);
+
+    memset(sync_raw, 0, sizeof(sync_raw));
+    memset(sync_sample_delay, 0, sizeof(sync_sample_delay));
+    memcpy(sync_readout, sync_edges, sizeof(sync_readout)); // A member that is not reached has no latency
+
+    for (int i = PYD1598_READOUT_BITS - 1; i >= PYD1598_READOUT_BITS - bits; i--) {
+
+        // Per member a low and high pulse of 200 ns - 2000 ns, release, and the sample 3 us later
+        for (size_t m = 0; m < sync_count; m++) {
+            cfg = sync_devs[m]->config;
+            if (i == PYD1598_READOUT_BITS - 1) {
+                sync_readout[m] = k_cycle_get_32();
+            }
+            ret = gpio_pin_configure_dt(&cfg->direct_link, GPIO_OUTPUT_LOW);
+            if (ret != 0) {
+                LOG_ERR("Failed to configure direct link GPIO pin %d", cfg->direct_link.pin);
+                return ret;
+            }
+            pyd1598_timing_mark(cfg, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_LEVEL, 0);
+            gpio_pin_set_dt(&cfg->direct_link, 1);
+            pyd1598_timing_mark(cfg, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_LEVEL, 1);
+            ret = gpio_pin_configure_dt(&cfg->direct_link, GPIO_INPUT);
+            if (ret != 0) {
+                LOG_ERR("Failed to configure direct link GPIO pin %d", cfg->direct_link.pin);
+                return ret;
+            }
+            sync_released[m] = k_cycle_get_32();
+            pyd1598_timing_mark(cfg, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_RELEASE, 0);
+
+            waited = k_cycle_get_32() - sync_released[m];
+            if (waited < sample_cyc) {
+                k_busy_wait(k_cyc_to_us_ceil32(sample_cyc - waited));
+            }
+            bit = (uint32_t)gpio_pin_get_dt(&cfg->direct_link);
+            sync_sample_delay[m] = MAX(sync_sample_delay[m], k_cycle_get_32() - sync_released[m]);
+            pyd1598_timing_mark(cfg, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_SAMPLE, (uint8_t)bit);
+            sync_raw[m] = (sync_raw[m] << 1) | (bit & 1U);
+        }
+    }
+
+    return 0;
+}
+
+
+// Skew of the member to the group reference and deviation of its sample interval from the period
+static void pyd1598_sync_metrics(size_t m)
+{
+    // Variables
+    struct pyd1598_data *data;
+    struct pyd1598_sync_stats *stats;
+    int64_t interval_ns;
+    int64_t period_ns;
+    int64_t periods;
+    int32_t deviation_ns;
+
+    // Declare the variables
+    data = sync_devs[m]->data;
+    stats = &data->sync_stats;
+    period_ns = (int64_t)sync_period_us * NSEC_PER_USEC;
+
+    stats->samples++;
+    stats->skew_ns = (int32_t)k_cyc_to_ns_floor64(sync_edges[m] - sync_edges[0]);
+    stats->skew_max_ns = MAX(stats->skew_max_ns, stats->skew_ns);
+
+    // From the sample point to the first clock of the readout of this member
+    stats->readout_latency_us = k_cyc_to_us_floor32(sync_readout[m] - sync_edges[m]);
+    stats->readout_latency_max_us = MAX(stats->readout_latency_max_us, stats->readout_latency_us);
+
+    // A bit sampled past the limit of the sensor may be wrong, the readout is counted late
+    stats->sample_delay_max_ns = MAX(stats->sample_delay_max_ns,
+                                     (uint32_t)k_cyc_to_ns_ceil64(sync_sample_delay[m]));
+    if (sync_sample_delay[m] > k_us_to_cyc_floor32(PYD1598_SYNC_SAMPLE_MAX_US)) {
+        stats->late++;
+    }
+
+    if (!sync_first) {
+        // Against the nearest whole number of periods, an overrun is counted, not jitter
+        interval_ns = (int64_t)k_cyc_to_ns_floor64(sync_edges[m] - data->sync_edge);
+        periods = MAX((interval_ns + period_ns / 2) / period_ns, 1);
+        deviation_ns = (int32_t)(interval_ns - periods * period_ns);
+        stats->jitter_min_ns = MIN(stats->jitter_min_ns, deviation_ns);
+        stats->jitter_max_ns = MAX(stats->jitter_max_ns, deviation_ns);
+        stats->jitter_abs_ns += (uint64_t)((deviation_ns < 0) ? -(int64_t)deviation_ns : deviation_ns);
+    }
+    data->sync_edge = sync_edges[m];
+}
+
+
+static void pyd1598_sync_work_handler(struct k_work *work)
+{
+    // Variables
+    const struct pyd1598_config *cfg;
+    struct pyd1598_data *data;
+    struct pyd1598_sync_sample *sample;
+    struct pyd1598_energy_span span = {0};
+    uint32_t energy_start;
+    uint32_t energy_lock;
+    uint32_t measurement;
+    uint32_t sensor_conf;
+    uint32_t elapsed_us;
+    int bits = PYD1598_MEASUREMENT_BITS;
+    int key;
+    int ret;
+
+    ARG_UNUSED(work);
+    energy_start = pyd1598_energy_cycles();
+
+    // A full readout for the group if any member is due to verify its configuration
+    for (size_t m = 0; m < sync_count; m++) {
+        data = sync_devs[m]->data;
+        PYD1598_STATS_INC(data, fetch_count);
+        if (!pyd1598_partial_take(data)) {
+            bits = PYD1598_READOUT_BITS;
+        }
+    }
+
+    // Direct link of the last member went high last
+    elapsed_us = k_cyc_to_us_floor32(k_cycle_get_32() - sync_edges[sync_count - 1]);
+    if (elapsed_us < PYD1598_SYNC_SETUP_US) {
+        k_busy_wait(PYD1598_SYNC_SETUP_US - elapsed_us);
+    }
+
+    key = irq_lock();
+    energy_lock = pyd1598_energy_cycles();
+    ret = pyd1598_sync_readout_bits(bits);
+
+    // Hold direct link low, the release timer lets go of the group
+    for (size_t m = 0; m < sync_count; m++) {
+        cfg = sync_devs[m]->config;
+        gpio_pin_configure_dt(&cfg->direct_link, GPIO_OUTPUT_LOW);
+        pyd1598_timing_mark(cfg, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_LEVEL, 0);
+    }
+    irq_unlock(key);
+    k_timer_start(&sync_release_timer, K_USEC(PYD1598_SYNC_HOLD_US), K_NO_WAIT);
+
+    // One readout for the group, its cycles are shared out, every member drives its own line
+    span.irq_locked = (pyd1598_energy_cycles() - energy_lock) / sync_count;
+    span.active = (pyd1598_energy_cycles() - energy_start) / sync_count;
+
+    for (size_t m = 0; m < sync_count; m++) {
+        data = sync_devs[m]->data;
+        sample = &sync_samples[m];
+        sample->dev = sync_devs[m];
+        sample->frame.timestamp_us = sync_base_us + (int64_t)k_cyc_to_us_floor64(sync_edges[m] - sync_edges[0]);
+
+        pyd1598_sync_metrics(m);
+        span.direct_link = (energy_lock - sync_edges[m]) + k_us_to_cyc_ceil32(PYD1598_SYNC_HOLD_US);
+        pyd1598_energy_account(sync_devs[m], PYD1598_ENERGY_READOUT, &span);
+
+        if (ret != 0) {
+            sample->ret = ret;
+            data->sync_stats.errors++;
+            continue;
+        }
+
+        pyd1598_core_decode_readout(sync_raw[m], bits, &measurement, &sensor_conf);
+        pyd1598_trace(sync_devs[m], PYD1598_TRACE_READOUT, (uint16_t)measurement,
+                      sensor_conf | ((uint32_t)bits << 25));
+
+        // Check, save and publish the frame like a fetch
+        sample->frame.sensor_conf = (bits == PYD1598_READOUT_BITS) ? sensor_conf : data->sensor_conf;
+        sample->frame.measurement = (uint16_t)measurement;
+        sample->ret = pyd1598_accept_frame(sync_devs[m], &sample->frame, bits == PYD1598_READOUT_BITS);
+        if (sample->ret != 0) {
+            data->sync_stats.errors++;
+        }
+    }
+    sync_first = false;
+
+    if (sync_callback != NULL) {
+        sync_callback(sync_samples, sync_count, sync_user_data);
+    }
+}
+
+
+// Make the device a member if nothing else reads it out on its own, under its run lock
+static bool sync_claim(const struct device *dev)
+{
+    // Variables
+    struct pyd1598_data *data;
+    bool busy;
+
+    // Declare the variables
+    data = dev->data;
+
+    k_mutex_lock(&data->run_lock, K_FOREVER);
+    busy = data->sync_running || pyd1598_interrupt_running(dev) || pyd1598_calib_running(dev);
+#ifdef CONFIG_PYD1598_STREAM
+    busy = busy || data->stream_active;
+#endif
+#ifdef CONFIG_PYD1598_SCHED
+    busy = busy || data->sched.active;
+#endif
+#ifdef CONFIG_PYD1598_HYBRID
+    busy = busy || data->hybrid.active;
+#endif
+    if (!busy) {
+        data->sync_running = true;
+    }
+    k_mutex_unlock(&data->run_lock);
+
+    return !busy;
+}
+
+
+static void sync_unclaim(const struct device *dev)
+{
+    // Variables
+    struct pyd1598_data *data;
+
+    // Declare the variables
+    data = dev->data;
+
+    k_mutex_lock(&data->run_lock, K_FOREVER);
+    data->sync_running = false;
+    k_mutex_unlock(&data->run_lock);
+}
+
+
+/**
+ * @brief Sample a group of sensors at the same instants, from one timer.
+ *
+ * Every member must have been pushed in forced readout mode and must not stream, run
+ * the scheduler, the hybrid mode or interrupt readout. Push, fetch and suspend return
+ * -EBUSY for the members until pyd1598_sync_stop() is called.
+ *
+ * @param devs Sensor devices of the group, the first one is the skew reference
+ * @param count Number of devices, up to CONFIG_PYD1598_SYNC_MAX_SENSORS
+ * @param period_us Time between two sample points, 5 ms to 10 s, and at least the setup,
+ * 40 bits of every member and the hold time, 240 us per member
+ * @param callback Called from the sync work queue with the frames of every tick, may be NULL
+ * @param user_data Passed to callback
+ *
+ * @return 0 if successful, -EBUSY if a group is running or a member is busy, negative errno code if failure.
+ */
+int pyd1598_sync_start(const struct device *const *devs, size_t count, uint32_t period_us,
+                       pyd1598_sync_callback_t callback, void *user_data)
+{
+    // Variables
+    struct pyd1598_data *data;
+    enum pyd1598_operation_mode operation_mode;
+    size_t claimed = 0;
+    size_t resumed = 0;
+    int ret = 0;
+
+    // Check if the devices are null
+    LOG_DBG("pyd1598_sync_start");
+    if (devs == NULL || count == 0 || count > CONFIG_PYD1598_SYNC_MAX_SENSORS ||
+        period_us < PYD1598_SYNC_PERIOD_MIN_US || period_us > PYD1598_SYNC_PERIOD_MAX_US) {
+        return -EINVAL;
+    }
+    if (period_us < PYD1598_SYNC_READOUT_US(count)) {
+        LOG_ERR("A group of %u needs a period of at least %u us", (unsigned int)count,
+                (unsigned int)PYD1598_SYNC_READOUT_US(count));
+        return -EINVAL;
+    }
+
+    for (size_t m = 0; m < count; m++) {
+        if (devs[m] == NULL || devs[m]->data == NULL) {
+            return -EINVAL;
+        }
+        ret = pyd1598_get_operation_mode(devs[m], &operation_mode);
+        if (ret != 0) {
+            return ret;
+        }
+        if (operation_mode != PYD1598_FORCED_READOUT) {
+            LOG_ERR("%s is not in forced readout mode", devs[m]->name);
+            return -EIO;
+        }
+    }
+
+    k_mutex_lock(&sync_lock, K_FOREVER);
+    if (sync_count != 0) {
+        k_mutex_unlock(&sync_lock);
+        return -EBUSY;
+    }
+
+    // Claim the members one by one, a member listed twice is busy the second time
+    for (claimed = 0; claimed < count; claimed++) {
+        if (!sync_claim(devs[claimed])) {
+            break;
+        }
+    }
+    if (claimed < count) {
+        while (claimed-- > 0) {
+            sync_unclaim(devs[claimed]);
+        }
+        k_mutex_unlock(&sync_lock);
+        return -EBUSY;
+    }
+
+    // The timer drives direct link on its own, keep the members resumed until stopped
+    for (resumed = 0; resumed < count; resumed++) {
+        ret = pm_device_runtime_get(devs[resumed]);
+        if (ret < 0) {
+            break;
+        }
+    }
+    if (ret < 0) {
+        while (resumed-- > 0) {
+            pm_device_runtime_put(devs[resumed]);
+        }
+        for (size_t m = 0; m < count; m++) {
+            sync_unclaim(devs[m]);
+        }
+        k_mutex_unlock(&sync_lock);
+        return ret;
+    }
+
+    for (size_t m = 0; m < count; m++) {
+        data = devs[m]->data;
+        memset(&data->sync_stats, 0, sizeof(data->sync_stats));
+        data->sync_stats.jitter_min_ns = INT32_MAX;
+        data->sync_stats.jitter_max_ns = INT32_MIN;
+        sync_devs[m] = devs[m];
+    }
+    sync_count = count;
+    sync_period_us = period_us;
+    sync_callback = callback;
+    sync_user_data = user_data;
+    sync_busy = false;
+    sync_first = true;
+
+    k_timer_start(&sync_timer, K_USEC(period_us), K_USEC(period_us));
+    k_mutex_unlock(&sync_lock);
+
+    return 0;
+}
+
+
+/**
+ * @brief Stop the running group, waits for a running readout to complete.
+ *
+ * @return 0 if successful, -EALREADY if no group is running.
+ */
+int pyd1598_sync_stop(void)
+{
+    // Variables
+    const struct pyd1598_config *cfg;
+    struct k_work_sync sync;
+
+    LOG_DBG("pyd1598_sync_stop");
+    k_mutex_lock(&sync_lock, K_FOREVER);
+    if (sync_count == 0) {
+        k_mutex_unlock(&sync_lock);
+        return -EALREADY;
+    }
+
+    k_timer_stop(&sync_timer);
+    k_work_cancel_sync(&sync_work, &sync);
+
+    // The readout that ran last started the release timer, wait for it to end the hold time
+    k_timer_status_sync(&sync_release_timer);
+
+    for (size_t m = 0; m < sync_count; m++) {
+        cfg = sync_devs[m]->config;
+        gpio_pin_configure_dt(&cfg->direct_link, GPIO_INPUT);
+        pm_device_runtime_put(sync_devs[m]);
+        sync_unclaim(sync_devs[m]);
+    }
+    sync_count = 0;
+    sync_busy = false;
+    k_mutex_unlock(&sync_lock);
+
+    return 0;
+}
+
+
+/**
+ * @brief Get the skew and period jitter of a sensor of the running or the last group.
+ *
+ * @param dev Pointer to the sensor device
+ * @param stats Pointer to where the stats should be stored
+ *
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_sync_get_stats(const struct device *dev, struct pyd1598_sync_stats *stats)
+{
+    // Variables
+    struct pyd1598_data *data;
+    int key;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_sync_get_stats");
+    if (dev == NULL || dev->data == NULL || stats == NULL) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+
+    // The tick counts overruns in interrupt context
+    key = irq_lock();
+    *stats = data->sync_stats;
+    irq_unlock(key);
+
+    if (stats->samples < 2) {
+        stats->jitter_min_ns = 0;
+        stats->jitter_max_ns = 0;
+    }
+
+    return 0;
+}
+
+
+static int pyd1598_sync_queue_init(void)
+{
+    k_work_queue_init(&sync_work_q);
+    k_work_queue_start(&sync_work_q, sync_stack, K_THREAD_STACK_SIZEOF(sync_stack),
+                       CONFIG_PYD1598_SYNC_THREAD_PRIORITY, NULL);
+
+    return 0;
+}
+
+SYS_INIT(pyd1598_sync_queue_init, POST_KERNEL, 0);
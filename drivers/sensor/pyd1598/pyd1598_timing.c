@@ -0,0 +1,124 @@
+/*
+PYD1598 protocol timing recorder
+
+The recorder timestamps every pin action of the push and fetch transactions of one
+device with the cycle counter: lines driven low or high, released to the sensor, and
+sampled. It works on hardware and on gpio_emul alike, the timestamps are taken next to
+the gpio calls so they include the gpio driver but not the pin rise time. The events
+go to the checker in pyd1598_timing_check.c.
+*/
+
+#include <zephyr/device.h>
+#include <zephyr/irq.h>
+#include <zephyr/kernel.h>
+#include <zephyr/timing/timing.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pyd1598.h>
+#include "pyd1598_internal.h"
+
+
+// Recording, of one device at a time
+static const struct pyd1598_config *timing_cfg;
+static struct pyd1598_timing_event timing_events[CONFIG_PYD1598_TIMING_CHECK_EVENTS];
+static size_t timing_count;
+static bool timing_overflow;
+static timing_t timing_start_cycles;
+
+
+void pyd1598_timing_pin(const struct pyd1598_config *cfg, uint8_t line, uint8_t action, uint8_t level)
+{
+    // Variables
+    timing_t now;
+
+    if (cfg != timing_cfg) {
+        return;
+    }
+    if (timing_count >= ARRAY_SIZE(timing_events)) {
+        timing_overflow = true;
+        return;
+    }
+
+    // Cycles until the recording stops, converted to ns then
+    now = timing_counter_get();
+    timing_events[timing_count].time_ns = (uint32_t)timing_cycles_get(&timing_start_cycles, &now);
+    timing_events[timing_count].line = line;
+    timing_events[timing_count].action = action;
+    timing_events[timing_count].level = level;
+    timing_count++;
+}
+
+
+/**
+ * @brief Start recording the pin actions of the transactions of a device.
+ *
+ * @param dev Pointer to the sensor device
+ *
+ * @return 0 if successful, -EBUSY if a recording is running, negative errno code if failure.
+ */
+int pyd1598_timing_record_start(const struct device *dev)
+{
+    // Variables
+    int key;
+
+    // Check if the device is null
+    if (dev == NULL || dev->config == NULL) {
+        return -EINVAL;
+    }
+    if (timing_cfg != NULL) {
+        return -EBUSY;
+    }
+
+    timing_init();
+    timing_start();
+
+    // The marks run with irq locked
+    key = irq_lock();
+    timing_count = 0;
+    timing_overflow = false;
+    timing_start_cycles = timing_counter_get();
+    timing_cfg = dev->config;
+    irq_unlock(key);
+
+    return 0;
+}
+
+
+/**
+ * @brief Stop recording.
+ *
+ * @param events Pointer to where a pointer to the recorded events should be stored,
+ * valid until the next recording starts
+ * @param count Pointer to where the number of recorded events should be stored
+ *
+ * @return 0 if successful, -ENOSPC if the buffer was full and later events were dropped,
+ * negative errno code if failure.
+ */
+int pyd1598_timing_record_stop(const struct pyd1598_timing_event **events, size_t *count)
+{
+    // Variables
+    int key;
+
+    if (events == NULL || count == NULL) {
+        return -EINVAL;
+    }
+    if (timing_cfg == NULL) {
+        return -EALREADY;
+    }
+
+    key = irq_lock();
+    timing_cfg = NULL;
+    irq_unlock(key);
+
+    for (size_t i = 0; i < timing_count; i++) {
+        timing_events[i].time_ns = (uint32_t)timing_cycles_to_ns(timing_events[i].time_ns);
+    }
+    timing_stop();
+
+    *events = timing_events;
+    *count = timing_count;
+
+    return timing_overflow ? -ENOSPC : 0;
+}
@@ -0,0 +1,95 @@
+/*
+PYD1598 protocol timing checker
+
+Pin events of push and fetch transactions, the timing spec they are checked against
+and the report. Only the C library is included, the checker in pyd1598_timing_check.c
+builds on a host as well as with the driver; the recorder that produces the events on
+a device is in pyd1598_timing.c.
+*/
+
+#ifndef ZEPHYR_DRIVERS_SENSOR_PYD1598_PYD1598_TIMING_H_
+#define ZEPHYR_DRIVERS_SENSOR_PYD1598_PYD1598_TIMING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum pyd1598_timing_line {
+    PYD1598_TIMING_SERIAL_IN = 0,
+    PYD1598_TIMING_DIRECT_LINK = 1,
+};
+
+enum pyd1598_timing_action {
+    PYD1598_TIMING_LEVEL = 0, // The line is driven to or seen at level
+    PYD1598_TIMING_RELEASE = 1, // The host stops driving the line
+    PYD1598_TIMING_SAMPLE = 2, // The host reads level from the line
+};
+
+struct pyd1598_timing_event {
+    uint32_t time_ns; // Differences are taken modulo 2^32, intervals up to 4.29 s
+    uint8_t line; // enum pyd1598_timing_line
+    uint8_t action; // enum pyd1598_timing_action
+    uint8_t level;
+};
+
+enum pyd1598_timing_constraint {
+    PYD1598_TIMING_SERIAL_IN_PULSE = 0, // Low and high pulse that start a bit
+    PYD1598_TIMING_SERIAL_IN_SLOT, // Rising edge to rising edge of two bits
+    PYD1598_TIMING_SERIAL_IN_LATCH, // From the end of the last bit slot to the release
+    PYD1598_TIMING_FETCH_START, // Direct link high before the first readout bit
+    PYD1598_TIMING_DIRECT_LINK_PULSE, // Low and high pulse that start a readout bit
+    PYD1598_TIMING_DIRECT_LINK_SAMPLE, // Rising edge of a readout bit to its sample
+    PYD1598_TIMING_END_HOLD, // Direct link low after the last readout bit
+    PYD1598_TIMING_CONSTRAINTS,
+};
+
+struct pyd1598_timing_limit {
+    const char *name;
+    uint32_t min_ns;
+    uint32_t max_ns; // 0 for no upper limit
+};
+
+struct pyd1598_timing_spec {
+    struct pyd1598_timing_limit limits[PYD1598_TIMING_CONSTRAINTS];
+    uint32_t pulse_window_ns; // Shorter direct link runs are pulses, for captures without release events
+    uint32_t gap_ns; // A longer gap between two rising edges ends a transaction
+};
+
+struct pyd1598_timing_result {
+    uint32_t count; // Measurements
+    uint32_t violations; // Measurements outside the limits
+    uint32_t min_ns;
+    uint32_t max_ns;
+    int32_t slack_ns; // Worst distance to a limit, negative if violated
+};
+
+struct pyd1598_timing_report {
+    uint32_t pushes;
+    uint32_t fetches;
+    uint32_t errors; // Transactions with an unexpected number of bits
+    struct pyd1598_timing_result results[PYD1598_TIMING_CONSTRAINTS];
+};
+
+// State of the csv parser between two lines
+struct pyd1598_timing_csv {
+    int64_t first_ns;
+    int8_t level[2];
+    bool started;
+};
+
+extern const struct pyd1598_timing_spec pyd1598_timing_datasheet;
+
+int pyd1598_timing_check(const struct pyd1598_timing_event *events, size_t count,
+                         const struct pyd1598_timing_spec *spec, struct pyd1598_timing_report *report);
+int pyd1598_timing_parse_csv(struct pyd1598_timing_csv *csv, const char *line,
+                             struct pyd1598_timing_event *events, size_t size, size_t *count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZEPHYR_DRIVERS_SENSOR_PYD1598_PYD1598_TIMING_H_ */
@@ -0,0 +1,443 @@
+/*
+PYD1598 protocol timing conformance checker
+
+The checker decodes a sequence of pin events into pushes and fetches and measures
+every timing constraint of a pyd1598_timing_spec. Each result holds the measured range
+and the worst slack, the distance to the closer limit, so a change of the busy waits
+can be checked against the margin it takes away.
+
+Logic analyzer captures are fed through pyd1598_timing_parse_csv(), one line per level
+change: time in s, serial in level, direct link level. They only carry levels, so a
+direct link pulse is recognised by being shorter than pulse_window_ns and the sample
+time is not measured.
+
+Constraints, datasheet limits in pyd1598_timing_datasheet:
+
+  serial in pulse      200 - 2000 ns   low and high pulse that start a bit
+  serial in slot      >= 80 us         rising edge to rising edge
+  serial in latch     >= 650 us        end of the last bit slot to the release
+  fetch start         >= 120 us        direct link high before the first bit
+  direct link pulse    200 - 2000 ns   low and high pulse that start a readout bit
+  direct link sample  <= 22 us         rising edge of a readout bit to its sample
+  end hold            >= 1250 us       direct link low after the last bit
+
+Only the C library is included, the checker runs on recordings of the device and on a
+host alike.
+*/
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "pyd1598_core.h"
+#include "pyd1598_timing.h"
+
+
+#define PYD1598_TIMING_PUSH_BITS 25
+
+enum timing_phase {
+    TIMING_IDLE = 0,
+    TIMING_PUSH, // Serial in bits
+    TIMING_START, // Direct link high, a fetch start if long enough
+    TIMING_STARTED, // Fetch start ended, waiting for the first readout bit
+    TIMING_READOUT, // Direct link readout bits
+};
+
+// Decoder state of one line
+struct timing_line {
+    int8_t level; // -1 until known
+    bool pulse_pending; // Rising edge whose high pulse is not measured yet
+    bool released; // Released since the last level event
+    bool released_bit; // Released since the last rising edge
+    bool sampled; // Sampled since the last rising edge
+    bool hold; // Driven low since the last rising edge
+    bool low; // Driven low since the last rising edge, not just low since the capture started
+    uint8_t phase;
+    uint16_t bits;
+    uint32_t rise_ns;
+    uint32_t fall_ns;
+    uint32_t low_ns; // Last time the line was driven low
+    uint32_t release_ns;
+    uint32_t start_ns;
+    uint32_t start_high_ns;
+    uint32_t hold_ns;
+};
+
+const struct pyd1598_timing_spec pyd1598_timing_datasheet = {
+    .limits = {
+        [PYD1598_TIMING_SERIAL_IN_PULSE] = { "serial in pulse", 200, 2000 },
+        [PYD1598_TIMING_SERIAL_IN_SLOT] = { "serial in slot", 80000, 0 },
+        [PYD1598_TIMING_SERIAL_IN_LATCH] = { "serial in latch", 650000, 0 },
+        [PYD1598_TIMING_FETCH_START] = { "fetch start", 120000, 0 },
+        [PYD1598_TIMING_DIRECT_LINK_PULSE] = { "direct link pulse", 200, 2000 },
+        [PYD1598_TIMING_DIRECT_LINK_SAMPLE] = { "direct link sample", 0, 22000 },
+        [PYD1598_TIMING_END_HOLD] = { "end hold", 1250000, 0 },
+    },
+    .pulse_window_ns = 3000,
+    .gap_ns = 300000,
+};
+
+static void timing_measure(struct pyd1598_timing_report *report, const struct pyd1598_timing_spec *spec,
+                           int constraint, uint32_t value_ns)
+{
+    // Variables
+    struct pyd1598_timing_result *result;
+    const struct pyd1598_timing_limit *limit;
+    int64_t slack;
+
+    // Declare the variables
+    result = &report->results[constraint];
+    limit = &spec->limits[constraint];
+
+    slack = (int64_t)value_ns - limit->min_ns;
+    if (limit->max_ns != 0 && (int64_t)limit->max_ns - value_ns < slack) {
+        slack = (int64_t)limit->max_ns - value_ns;
+    }
+    if (slack < INT32_MIN) {
+        slack = INT32_MIN;
+    }
+    else if (slack > INT32_MAX) {
+        slack = INT32_MAX;
+    }
+
+    if (result->count == 0) {
+        result->min_ns = value_ns;
+        result->max_ns = value_ns;
+        result->slack_ns = (int32_t)slack;
+    } else {
+        if (value_ns < result->min_ns) {
+            result->min_ns = value_ns;
+        }
+        if (value_ns > result->max_ns) {
+            result->max_ns = value_ns;
+        }
+        if ((int32_t)slack < result->slack_ns) {
+            result->slack_ns = (int32_t)slack;
+        }
+    }
+    result->count++;
+    if (slack < 0) {
+        result->violations++;
+    }
+}
+
+
+// A push ends with the release of serial in or with the gap to the next push
+static void timing_push_end(struct timing_line *si, const struct pyd1598_timing_spec *spec,
+                            struct pyd1598_timing_report *report, bool has_end, uint32_t end_ns)
+{
+    // Variables
+    uint32_t slot_ns;
+    uint32_t latch_ns;
+
+    // Declare the variables
+    slot_ns = spec->limits[PYD1598_TIMING_SERIAL_IN_SLOT].min_ns;
+
+    if (si->bits != PYD1598_TIMING_PUSH_BITS) {
+        report->errors++;
+    }
+    if (has_end) {
+        latch_ns = end_ns - si->rise_ns;
+        timing_measure(report, spec, PYD1598_TIMING_SERIAL_IN_LATCH, (latch_ns > slot_ns) ? latch_ns - slot_ns : 0);
+    }
+    si->phase = TIMING_IDLE;
+}
+
+
+static void timing_serial_in_level(struct timing_line *si, const struct pyd1598_timing_spec *spec,
+                                   struct pyd1598_timing_report *report, uint32_t time_ns, uint8_t level)
+{
+    // Variables
+    uint32_t window_ns;
+    bool changed;
+
+    // Declare the variables
+    // Serial in data phases last a bit slot, anything below half of it is a pulse
+    window_ns = spec->limits[PYD1598_TIMING_SERIAL_IN_SLOT].min_ns / 2;
+    changed = (si->level >= 0 && si->level != level);
+    si->released = false;
+
+    if (level == 0) {
+        if (si->level >= 0) {
+            si->low = true;
+            si->low_ns = time_ns;
+        }
+        if (changed && si->pulse_pending && time_ns - si->rise_ns < window_ns) {
+            timing_measure(report, spec, PYD1598_TIMING_SERIAL_IN_PULSE, time_ns - si->rise_ns);
+        }
+        if (changed) {
+            si->pulse_pending = false;
+            si->fall_ns = time_ns;
+        }
+    }
+    else if (changed) {
+        if (si->low && time_ns - si->low_ns < window_ns) {
+            timing_measure(report, spec, PYD1598_TIMING_SERIAL_IN_PULSE, time_ns - si->low_ns);
+        }
+        si->low = false;
+        if (si->phase == TIMING_PUSH && time_ns - si->rise_ns >= spec->gap_ns) {
+            timing_push_end(si, spec, report, true, time_ns);
+        }
+        if (si->phase == TIMING_PUSH) {
+            timing_measure(report, spec, PYD1598_TIMING_SERIAL_IN_SLOT, time_ns - si->rise_ns);
+            si->bits++;
+        } else {
+            report->pushes++;
+            si->phase = TIMING_PUSH;
+            si->bits = 1;
+        }
+        si->rise_ns = time_ns;
+        si->pulse_pending = true;
+    }
+
+    si->level = (int8_t)level;
+}
+
+
+// A fetch ends with the release after the end hold, or with the gap to the next fetch
+static void timing_fetch_end(struct timing_line *dl, const struct pyd1598_timing_spec *spec,
+                             struct pyd1598_timing_report *report, bool has_end, uint32_t end_ns)
+{
+    if (dl->bits != PYD1598_READOUT_BITS && dl->bits != PYD1598_MEASUREMENT_BITS) {
+        report->errors++;
+    }
+    if (has_end && dl->hold) {
+        timing_measure(report, spec, PYD1598_TIMING_END_HOLD, end_ns - dl->hold_ns);
+    }
+    dl->phase = TIMING_IDLE;
+}
+
+
+static void timing_direct_link_level(struct timing_line *dl, const struct pyd1598_timing_spec *spec,
+                                     struct pyd1598_timing_report *report, uint32_t time_ns, uint8_t level)
+{
+    // Variables
+    bool changed;
+    bool first = false;
+
+    // Declare the variables
+    changed = (dl->level >= 0 && dl->level != level);
+    dl->released = false;
+
+    if (level == 0) {
+        dl->low_ns = time_ns;
+        if (dl->phase == TIMING_READOUT) {
+            dl->hold = true;
+            dl->hold_ns = time_ns;
+        }
+        if (changed) {
+            if (dl->phase == TIMING_START) {
+                // Shorter highs are pulses of a readout that started before the capture
+                dl->start_high_ns = time_ns - dl->start_ns;
+                dl->phase = (dl->start_high_ns >= spec->pulse_window_ns) ? TIMING_STARTED : TIMING_IDLE;
+            }
+            else if (dl->phase == TIMING_READOUT && dl->pulse_pending && time_ns - dl->rise_ns < spec->pulse_window_ns) {
+                timing_measure(report, spec, PYD1598_TIMING_DIRECT_LINK_PULSE, time_ns - dl->rise_ns);
+            }
+            dl->pulse_pending = false;
+            dl->fall_ns = time_ns;
+        }
+        dl->level = 0;
+        return;
+    }
+    dl->level = 1;
+    if (!changed) {
+        return;
+    }
+
+    if (dl->phase == TIMING_READOUT && time_ns - dl->rise_ns >= spec->gap_ns) {
+        timing_fetch_end(dl, spec, report, true, time_ns);
+    }
+    if (dl->phase == TIMING_STARTED) {
+        if (time_ns - dl->fall_ns < spec->gap_ns) {
+            timing_measure(report, spec, PYD1598_TIMING_FETCH_START, dl->start_high_ns);
+            report->fetches++;
+            dl->phase = TIMING_READOUT;
+            dl->bits = 0;
+            first = true;
+        } else {
+            dl->phase = TIMING_IDLE;
+        }
+    }
+    if (dl->phase != TIMING_READOUT) {
+        dl->phase = TIMING_START;
+        dl->start_ns = time_ns;
+        return;
+    }
+
+    // A readout bit, the low pulse is known when the previous bit was released
+    // to the sensor, otherwise only a short low is a pulse
+    if (first || dl->released_bit || time_ns - dl->low_ns < spec->pulse_window_ns) {
+        timing_measure(report, spec, PYD1598_TIMING_DIRECT_LINK_PULSE, time_ns - dl->low_ns);
+    }
+    dl->bits++;
+    dl->rise_ns = time_ns;
+    dl->pulse_pending = true;
+    dl->released_bit = false;
+    dl->sampled = false;
+    dl->hold = false;
+}
+
+
+static void timing_direct_link_release(struct timing_line *dl, const struct pyd1598_timing_spec *spec,
+                                       struct pyd1598_timing_report *report, uint32_t time_ns)
+{
+    if (dl->phase == TIMING_READOUT) {
+        if (dl->hold) {
+            timing_fetch_end(dl, spec, report, true, time_ns);
+        }
+        else if (dl->pulse_pending) {
+            timing_measure(report, spec, PYD1598_TIMING_DIRECT_LINK_PULSE, time_ns - dl->rise_ns);
+            dl->pulse_pending = false;
+            dl->released_bit = true;
+        }
+    }
+    dl->released = true;
+    dl->release_ns = time_ns;
+}
+
+
+static void timing_direct_link_sample(struct timing_line *dl, const struct pyd1598_timing_spec *spec,
+                                      struct pyd1598_timing_report *report, uint32_t time_ns, uint8_t level)
+{
+    // The sensor drove the bit since the release
+    if (dl->released && dl->level >= 0 && dl->level != level) {
+        timing_direct_link_level(dl, spec, report, dl->release_ns, level);
+        dl->released = true;
+    }
+    if (dl->phase == TIMING_READOUT && !dl->sampled) {
+        timing_measure(report, spec, PYD1598_TIMING_DIRECT_LINK_SAMPLE, time_ns - dl->rise_ns);
+        dl->sampled = true;
+    }
+}
+
+
+/**
+ * @brief Decode pin events into pushes and fetches and check them against a timing spec.
+ *
+ * @param events Pin events in time order, recorded or parsed from a capture
+ * @param count Number of events
+ * @param spec Timing spec, pyd1598_timing_datasheet or a tightened copy of it
+ * @param report Pointer to where the measured ranges and slack should be stored
+ *
+ * @return 0 if successful, -EINVAL for an event of an unknown line or action.
+ */
+int pyd1598_timing_check(const struct pyd1598_timing_event *events, size_t count,
+                         const struct pyd1598_timing_spec *spec, struct pyd1598_timing_report *report)
+{
+    // Variables
+    struct timing_line si = { .level = -1 };
+    struct timing_line dl = { .level = -1 };
+    const struct pyd1598_timing_event *event;
+
+    if ((events == NULL && count > 0) || spec == NULL || report == NULL) {
+        return -EINVAL;
+    }
+
+    memset(report, 0, sizeof(*report));
+
+    for (size_t i = 0; i < count; i++) {
+        event = &events[i];
+        if (event->line > PYD1598_TIMING_DIRECT_LINK || event->action > PYD1598_TIMING_SAMPLE) {
+            return -EINVAL;
+        }
+
+        if (event->line == PYD1598_TIMING_SERIAL_IN) {
+            if (event->action == PYD1598_TIMING_LEVEL) {
+                timing_serial_in_level(&si, spec, report, event->time_ns, event->level ? 1 : 0);
+            }
+            else if (event->action == PYD1598_TIMING_RELEASE && si.phase == TIMING_PUSH) {
+                timing_push_end(&si, spec, report, true, event->time_ns);
+            }
+            continue;
+        }
+
+        switch (event->action) {
+        case PYD1598_TIMING_LEVEL:
+            timing_direct_link_level(&dl, spec, report, event->time_ns, event->level ? 1 : 0);
+            break;
+        case PYD1598_TIMING_RELEASE:
+            timing_direct_link_release(&dl, spec, report, event->time_ns);
+            break;
+        default:
+            timing_direct_link_sample(&dl, spec, report, event->time_ns, event->level ? 1 : 0);
+            break;
+        }
+    }
+
+    // Transactions cut off by the end of the capture count, their end is not measured
+    if (si.phase == TIMING_PUSH) {
+        timing_push_end(&si, spec, report, false, 0);
+    }
+    if (dl.phase == TIMING_READOUT) {
+        timing_fetch_end(&dl, spec, report, false, 0);
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Parse one line of a logic analyzer csv export into pin events.
+ *
+ * Lines are "time s,serial in,direct link", header lines are skipped. A level event
+ * is added for every line that changed, the first line sets the levels and the time 0.
+ *
+ * @param csv Parser state, zero initialised before the first line
+ * @param line One line of the capture
+ * @param events Event buffer
+ * @param size Size of events
+ * @param count Number of events in the buffer, updated
+ *
+ * @return 0 if successful, -EINVAL for a malformed line, -ENOMEM if events is full.
+ */
+int pyd1598_timing_parse_csv(struct pyd1598_timing_csv *csv, const char *line,
+                             struct pyd1598_timing_event *events, size_t size, size_t *count)
+{
+    // Variables
+    int64_t time_ns;
+    uint8_t level[2];
+    const char *str;
+
+    if (csv == NULL || line == NULL || events == NULL || count == NULL) {
+        return -EINVAL;
+    }
+
+    // Header, or anything else that does not start with a time
+    str = pyd1598_core_parse_seconds(line, &time_ns);
+    if (str == NULL) {
+        return 0;
+    }
+    for (int i = 0; i < 2; i++) {
+        if (str[0] != ',' || (str[1] != '0' && str[1] != '1')) {
+            return -EINVAL;
+        }
+        level[i] = (uint8_t)(str[1] - '0');
+        str += 2;
+    }
+
+    if (!csv->started) {
+        csv->first_ns = time_ns;
+        csv->level[0] = -1;
+        csv->level[1] = -1;
+        csv->started = true;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (csv->level[i] == level[i]) {
+            continue;
+        }
+        if (*count >= size) {
+            return -ENOMEM;
+        }
+        events[*count].time_ns = (uint32_t)(time_ns - csv->first_ns);
+        events[*count].line = (uint8_t)i;
+        events[*count].action = PYD1598_TIMING_LEVEL;
+        events[*count].level = level[i];
+        csv->level[i] = (int8_t)level[i];
+        (*count)++;
+    }
+
+    return 0;
+}
@@ -0,0 +1,144 @@
+/*
+PYD1598 binary transaction trace
+
+Every push and fetch writes fixed size records into one ring buffer shared by all
+instances: transaction begin and end, one record with all sampled readout bits,
+configuration mismatches and wake-up triggers. A record is a cycle counter read and a
+12 byte copy under irq lock, cheap enough for the readout isr, nothing is formatted.
+
+Record layout, little endian, can be described in CTF metadata as is:
+
+  uint32_t timestamp   k_cycle_get_32()
+  uint8_t  id          enum pyd1598_trace_id
+  uint8_t  instance    devicetree instance
+  uint16_t arg16       measurement bits or return value
+  uint32_t arg32       configuration bits, bit count in bits 25 - 30 of a readout
+
+When the ring is full the oldest record is overwritten. pyd1598_trace_read() drains
+oldest first and starts with a PYD1598_TRACE_LOST record if records were overwritten
+since the last read. With CONFIG_PYD1598_TRACE_CTF every record is also emitted as a
+CTF named event.
+*/
+
+#include <zephyr/device.h>
+#include <zephyr/irq.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pyd1598.h>
+#include "pyd1598_internal.h"
+
+#ifdef CONFIG_PYD1598_TRACE_CTF
+#include <zephyr/tracing/tracing.h>
+#endif
+
+LOG_MODULE_DECLARE(PYD1598, PYD1598_LOG_LEVEL);
+
+
+#define PYD1598_TRACE_MASK (CONFIG_PYD1598_TRACE_RECORDS - 1)
+
+BUILD_ASSERT(IS_POWER_OF_TWO(CONFIG_PYD1598_TRACE_RECORDS), "CONFIG_PYD1598_TRACE_RECORDS must be a power of two");
+BUILD_ASSERT(sizeof(struct pyd1598_trace_record) == 12, "Trace records must stay 12 bytes");
+
+const char *const pyd1598_trace_names[PYD1598_TRACE_IDS] = {
+    [PYD1598_TRACE_LOST] = "lost",
+    [PYD1598_TRACE_PUSH_BEGIN] = "push",
+    [PYD1598_TRACE_PUSH_END] = "push_end",
+    [PYD1598_TRACE_FETCH_BEGIN] = "fetch",
+    [PYD1598_TRACE_FETCH_END] = "fetch_end",
+    [PYD1598_TRACE_READOUT] = "readout",
+    [PYD1598_TRACE_MISMATCH] = "mismatch",
+    [PYD1598_TRACE_TRIGGER] = "trigger",
+};
+
+// Free running indexes, head - tail is the fill level
+static struct pyd1598_trace_record trace_ring[CONFIG_PYD1598_TRACE_RECORDS];
+static uint32_t trace_head;
+static uint32_t trace_tail;
+static uint32_t trace_lost;
+
+
+/**
+ * @brief Write one trace record, callable from interrupt context.
+ *
+ * @param dev Pointer to the sensor device
+ * @param id Record id, enum pyd1598_trace_id
+ * @param arg16 First argument
+ * @param arg32 Second argument
+ */
+void pyd1598_trace(const struct device *dev, uint8_t id, uint16_t arg16, uint32_t arg32)
+{
+    // Variables
+    const struct pyd1598_config *cfg;
+    struct pyd1598_trace_record *record;
+    uint32_t timestamp;
+    int key;
+
+    // Declare the variables
+    cfg = dev->config;
+    timestamp = k_cycle_get_32();
+
+    key = irq_lock();
+    if (trace_head - trace_tail == CONFIG_PYD1598_TRACE_RECORDS) {
+        trace_tail++;
+        trace_lost++;
+    }
+    record = &trace_ring[trace_head & PYD1598_TRACE_MASK];
+    record->timestamp = timestamp;
+    record->id = id;
+    record->instance = (uint8_t)cfg->instance;
+    record->arg16 = arg16;
+    record->arg32 = arg32;
+    trace_head++;
+    irq_unlock(key);
+
+#ifdef CONFIG_PYD1598_TRACE_CTF
+    sys_trace_named_event(pyd1598_trace_names[id], ((uint32_t)cfg->instance << 16) | arg16, arg32);
+#endif
+}
+
+
+/**
+ * @brief Take the trace records written since the last read, oldest first.
+ *
+ * If records were overwritten the first one is a PYD1598_TRACE_LOST record with the
+ * number of lost records in arg32.
+ *
+ * @param records Array to store the records in
+ * @param size Number of records the array holds
+ *
+ * @return Number of records stored, negative errno code if failure.
+ */
+int pyd1598_trace_read(struct pyd1598_trace_record *records, size_t size)
+{
+    // Variables
+    size_t count = 0;
+    int key;
+
+    // Check if the records are null
+    LOG_DBG("pyd1598_trace_read");
+    if (records == NULL || size == 0) {
+        return -EINVAL;
+    }
+
+    key = irq_lock();
+    if (trace_lost != 0) {
+        records[count].timestamp = k_cycle_get_32();
+        records[count].id = PYD1598_TRACE_LOST;
+        records[count].instance = 0;
+        records[count].arg16 = 0;
+        records[count].arg32 = trace_lost;
+        trace_lost = 0;
+        count++;
+    }
+    while (count < size && trace_tail != trace_head) {
+        records[count++] = trace_ring[trace_tail & PYD1598_TRACE_MASK];
+        trace_tail++;
+    }
+    irq_unlock(key);
+
+    return (int)count;
+}
@@ -0,0 +1,225 @@
+/*
+PYD1598 wake-up trigger interrupt
+
+In wake-up mode the sensor pulls direct link high when motion is detected and keeps it
+high until the host resets it. An edge interrupt on direct link reports the trigger
+without polling. The host drives the same pin during push, fetch and reset, so the
+interrupt is paused for the duration of every transaction. Pauses nest, a transaction
+made of others, like reset and fetch, pauses once around all of them.
+
+Triggers are handed to the callback set with pyd1598_trigger_set_callback(), in
+interrupt context, and queued for zbus, which publishes them from the system work
+queue.
+*/
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/irq.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/kernel.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pyd1598.h>
+#include "pyd1598_internal.h"
+
+LOG_MODULE_DECLARE(PYD1598, PYD1598_LOG_LEVEL);
+
+
+// Runs in interrupt context, keep it short
+static void pyd1598_trigger_callback(const struct device *port, struct gpio_callback *cb, uint32_t pins)
+{
+    // Variables
+    struct pyd1598_data *data;
+    pyd1598_trigger_callback_t callback;
+    int64_t timestamp_us;
+
+    ARG_UNUSED(port);
+    ARG_UNUSED(pins);
+
+    // Declare the variables
+    data = CONTAINER_OF(cb, struct pyd1598_data, trigger_cb);
+
+    // Interrupt readout shares the pin
+    if (!data->trigger_armed) {
+        return;
+    }
+
+    timestamp_us = k_ticks_to_us_floor64(k_uptime_ticks());
+    PYD1598_STATS_INC(data, trigger_count);
+    pyd1598_trace(data->dev, PYD1598_TRACE_TRIGGER, 0, 0);
+
+    pyd1598_zbus_publish_trigger(data->dev, timestamp_us);
+    pyd1598_fusion_trigger(data->dev, timestamp_us);
+    pyd1598_hybrid_trigger(data->dev);
+    pyd1598_occupancy_trigger(data->dev, timestamp_us);
+
+    callback = data->trigger_callback;
+    if (callback != NULL) {
+        callback(data->dev, timestamp_us, data->trigger_user_data);
+    }
+}
+
+
+// Enable or disable the edge interrupt on direct link
+static void trigger_enable(const struct device *dev, bool enable)
+{
+    // Variables
+    const struct pyd1598_config *cfg;
+    int ret;
+
+    // Declare the variables
+    cfg = dev->config;
+
+    ret = gpio_pin_interrupt_configure_dt(&cfg->direct_link, enable ? GPIO_INT_EDGE_TO_ACTIVE : GPIO_INT_DISABLE);
+    if (ret != 0) {
+        LOG_ERR("Failed to %s direct link interrupt on pin %d", enable ? "enable" : "disable", cfg->direct_link.pin);
+    }
+}
+
+
+/**
+ * @brief Register the direct link callback, the interrupt stays disabled until armed.
+ *
+ * @param dev Pointer to the sensor device
+ *
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_trigger_init(const struct device *dev)
+{
+    // Variables
+    const struct pyd1598_config *cfg;
+    struct pyd1598_data *data;
+    int ret;
+
+    // Declare the variables
+    cfg = dev->config;
+    data = dev->data;
+    data->trigger_armed = false;
+    data->trigger_paused = 0;
+    data->trigger_callback = NULL;
+    data->trigger_user_data = NULL;
+
+    gpio_init_callback(&data->trigger_cb, pyd1598_trigger_callback, BIT(cfg->direct_link.pin));
+    ret = gpio_add_callback(cfg->direct_link.port, &data->trigger_cb);
+    if (ret != 0) {
+        LOG_ERR("Failed to add direct link callback on pin %d", cfg->direct_link.pin);
+        return ret;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Set the function called from the direct link interrupt on every wake-up trigger.
+ *
+ * The callback runs in interrupt context after the trigger was published, it may
+ * replace or clear itself.
+ *
+ * @param dev Pointer to the sensor device
+ * @param callback Called with the uptime of the trigger, NULL to clear it
+ * @param user_data Passed to callback
+ *
+ * @return 0 if successful, negative errno code if failure.
+ */
+int pyd1598_trigger_set_callback(const struct device *dev, pyd1598_trigger_callback_t callback, void *user_data)
+{
+    // Variables
+    struct pyd1598_data *data;
+    int key;
+
+    // Check if the device is null
+    LOG_DBG("pyd1598_trigger_set_callback");
+    if (dev == NULL || dev->data == NULL) {
+        return -EINVAL;
+    }
+
+    // Declare the variables
+    data = dev->data;
+
+    // Never a callback with the user data of another one
+    key = irq_lock();
+    data->trigger_callback = callback;
+    data->trigger_user_data = user_data;
+    irq_unlock(key);
+
+    return 0;
+}
+
+
+/**
+ * @brief Enable or disable the trigger interrupt outside of transactions.
+ *
+ * Called after every push with whether the pushed configuration is wake-up mode.
+ *
+ * @param dev Pointer to the sensor device
+ * @param arm True to enable the interrupt
+ */
+void pyd1598_trigger_arm(const struct device *dev, bool arm)
+{
+    // Variables
+    struct pyd1598_data *data;
+
+    // Declare the variables
+    data = dev->data;
+    data->trigger_armed = arm;
+
+    // A paused interrupt is enabled by the last resume
+    if (!arm || data->trigger_paused == 0) {
+        trigger_enable(dev, arm);
+    }
+}
+
+
+/**
+ * @brief Disable the trigger interrupt while the host drives direct link. Calls nest,
+ * every pause needs its pyd1598_trigger_resume().
+ *
+ * @param dev Pointer to the sensor device
+ */
+void pyd1598_trigger_pause(const struct device *dev)
+{
+    // Variables
+    struct pyd1598_data *data;
+    int key;
+
+    // Declare the variables
+    data = dev->data;
+
+    key = irq_lock();
+    data->trigger_paused++;
+    irq_unlock(key);
+
+    trigger_enable(dev, false);
+}
+
+
+/**
+ * @brief Enable the trigger interrupt again after a transaction, if armed.
+ *
+ * @param dev Pointer to the sensor device
+ */
+void pyd1598_trigger_resume(const struct device *dev)
+{
+    // Variables
+    struct pyd1598_data *data;
+    bool paused;
+    int key;
+
+    // Declare the variables
+    data = dev->data;
+
+    key = irq_lock();
+    if (data->trigger_paused > 0) {
+        data->trigger_paused--;
+    }
+    paused = (data->trigger_paused > 0);
+    irq_unlock(key);
+
+    if (paused || !data->trigger_armed) {
+        return;
+    }
+
+    trigger_enable(dev, true);
+}
@@ -0,0 +1,211 @@
+/*
+PYD1598 zbus publication
+
+Every decoded frame is published on pyd1598_frame_chan and every wake-up trigger on
+pyd1598_trigger_chan, for all instances, with CONFIG_PYD1598_FUSION every zone and
+travel event on pyd1598_fusion_chan, and with CONFIG_PYD1598_OCCUPANCY every occupancy
+summary on pyd1598_occupancy_chan. The channels are defined without static
+observers, consumers attach at runtime with zbus_chan_add_obs. Use message subscribers
+so a slow consumer works on its own copy and never holds the channel.
+
+Publishing never waits, the readout path must not block. zbus guards every channel
+with a mutex and asserts it is not used from an interrupt, so triggers and the fusion
+events they cause are not published from the direct link interrupt. They are queued
+on a message queue of CONFIG_PYD1598_ZBUS_ISR_QUEUE_LEN and published from the system
+work queue, in order, a full queue drops the newest one. Publications from threads
+go out directly.
+*/
+
+#include <zephyr/device.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/kernel.h>
+#include <zephyr/zbus/zbus.h>
+#include <errno.h>
+#include <stdint.h>
+#include <pyd1598.h>
+#include "pyd1598_internal.h"
+
+LOG_MODULE_DECLARE(PYD1598, PYD1598_LOG_LEVEL);
+
+
+ZBUS_CHAN_DEFINE(pyd1598_frame_chan,
+                 struct pyd1598_frame_msg,
+                 NULL,
+                 NULL,
+                 ZBUS_OBSERVERS_EMPTY,
+                 ZBUS_MSG_INIT(0));
+
+ZBUS_CHAN_DEFINE(pyd1598_trigger_chan,
+                 struct pyd1598_trigger_msg,
+                 NULL,
+                 NULL,
+                 ZBUS_OBSERVERS_EMPTY,
+                 ZBUS_MSG_INIT(0));
+
+#ifdef CONFIG_PYD1598_FUSION
+ZBUS_CHAN_DEFINE(pyd1598_fusion_chan,
+                 struct pyd1598_fusion_event,
+                 NULL,
+                 NULL,
+                 ZBUS_OBSERVERS_EMPTY,
+                 ZBUS_MSG_INIT(0));
+#endif
+
+#ifdef CONFIG_PYD1598_OCCUPANCY
+ZBUS_CHAN_DEFINE(pyd1598_occupancy_chan,
+                 struct pyd1598_occupancy_msg,
+                 NULL,
+                 NULL,
+                 ZBUS_OBSERVERS_EMPTY,
+                 ZBUS_MSG_INIT(0));
+#endif
+
+// Publication queued from interrupt context
+enum zbus_deferred_type {
+    ZBUS_DEFERRED_TRIGGER,
+    ZBUS_DEFERRED_FUSION,
+};
+
+struct zbus_deferred {
+    uint8_t type;
+    union {
+        struct pyd1598_trigger_msg trigger;
+#ifdef CONFIG_PYD1598_FUSION
+        struct pyd1598_fusion_event fusion;
+#endif
+    };
+};
+
+K_MSGQ_DEFINE(pyd1598_zbus_deferred_msgq, sizeof(struct zbus_deferred), CONFIG_PYD1598_ZBUS_ISR_QUEUE_LEN, 8);
+
+static void pyd1598_zbus_deferred_handler(struct k_work *work);
+static K_WORK_DEFINE(zbus_deferred_work, pyd1598_zbus_deferred_handler);
+
+
+// Drain the queue in thread context, where zbus may take the channel mutex
+static void pyd1598_zbus_deferred_handler(struct k_work *work)
+{
+    // Variables
+    struct zbus_deferred item;
+    int ret;
+
+    ARG_UNUSED(work);
+
+    while (k_msgq_get(&pyd1598_zbus_deferred_msgq, &item, K_NO_WAIT) == 0) {
+        switch (item.type) {
+        case ZBUS_DEFERRED_TRIGGER:
+            ret = zbus_chan_pub(&pyd1598_trigger_chan, &item.trigger, K_NO_WAIT);
+            break;
+#ifdef CONFIG_PYD1598_FUSION
+        case ZBUS_DEFERRED_FUSION:
+            ret = zbus_chan_pub(&pyd1598_fusion_chan, &item.fusion, K_NO_WAIT);
+            break;
+#endif
+        default:
+            ret = -EINVAL;
+            break;
+        }
+        if (ret != 0) {
+            LOG_DBG("Deferred publication %d dropped, zbus publish failed: %d", item.type, ret);
+        }
+    }
+}
+
+
+// Queue a publication from interrupt context
+static void pyd1598_zbus_defer(const struct zbus_deferred *item)
+{
+    // Variables
+    int ret;
+
+    ret = k_msgq_put(&pyd1598_zbus_deferred_msgq, item, K_NO_WAIT);
+    if (ret != 0) {
+        LOG_DBG("Deferred publication %d dropped, queue full", item->type);
+        return;
+    }
+    k_work_submit(&zbus_deferred_work);
+}
+
+
+void pyd1598_zbus_publish_frame(const struct device *dev, const struct pyd1598_frame *frame)
+{
+    // Variables
+    struct pyd1598_frame_msg msg;
+    int ret;
+
+    // Declare the variables
+    msg.dev = dev;
+    msg.frame = *frame;
+
+    ret = zbus_chan_pub(&pyd1598_frame_chan, &msg, K_NO_WAIT);
+    if (ret != 0) {
+        LOG_DBG("Frame dropped, zbus publish failed: %d", ret);
+    }
+}
+
+
+// Called from the direct link interrupt, or from replay in a thread
+void pyd1598_zbus_publish_trigger(const struct device *dev, int64_t timestamp_us)
+{
+    // Variables
+    struct zbus_deferred item;
+    int ret;
+
+    // Declare the variables
+    item.type = ZBUS_DEFERRED_TRIGGER;
+    item.trigger.dev = dev;
+    item.trigger.timestamp_us = timestamp_us;
+
+    if (k_is_in_isr()) {
+        pyd1598_zbus_defer(&item);
+        return;
+    }
+
+    ret = zbus_chan_pub(&pyd1598_trigger_chan, &item.trigger, K_NO_WAIT);
+    if (ret != 0) {
+        LOG_DBG("Trigger dropped, zbus publish failed: %d", ret);
+    }
+}
+
+
+#ifdef CONFIG_PYD1598_FUSION
+// Called from the readout path or the direct link interrupt
+void pyd1598_zbus_publish_fusion(const struct pyd1598_fusion_event *event)
+{
+    // Variables
+    struct zbus_deferred item;
+    int ret;
+
+    if (k_is_in_isr()) {
+        item.type = ZBUS_DEFERRED_FUSION;
+        item.fusion = *event;
+        pyd1598_zbus_defer(&item);
+        return;
+    }
+
+    ret = zbus_chan_pub(&pyd1598_fusion_chan, event, K_NO_WAIT);
+    if (ret != 0) {
+        LOG_DBG("Fusion event dropped, zbus publish failed: %d", ret);
+    }
+}
+#endif
+
+
+#ifdef CONFIG_PYD1598_OCCUPANCY
+// Called from the system work queue at the end of every period
+void pyd1598_zbus_publish_occupancy(const struct device *dev, const struct pyd1598_occupancy_summary *summary)
+{
+    // Variables
+    struct pyd1598_occupancy_msg msg;
+    int ret;
+
+    // Declare the variables
+    msg.dev = dev;
+    msg.summary = *summary;
+
+    ret = zbus_chan_pub(&pyd1598_occupancy_chan, &msg, K_NO_WAIT);
+    if (ret != 0) {
+        LOG_DBG("Occupancy summary dropped, zbus publish failed: %d", ret);
+    }
+}
+#endif
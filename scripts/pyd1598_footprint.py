@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+"""
+PYD1598 driver footprint report
+
+Sums the flash and RAM of every symbol the linker placed from drivers/sensor/pyd1598,
+using the file and line nm reads from the debug information, and the RAM of one
+instance, the size of pyd1598_data_0. Appends the numbers to a csv history and prints
+them with the difference to the last row of the same board and build, so a change that
+grows the driver shows up next to the commit that made it.
+
+Run it through the build system after a build:
+
+  west build -t pyd1598_footprint
+
+or on any elf with symbols:
+
+  scripts/pyd1598_footprint.py --elf build/zephyr/zephyr.elf --nm arm-zephyr-eabi-nm
+
+rom_report and ram_report of Zephyr break the same image down per file and symbol.
+"""
+
+import argparse
+import csv
+import os
+import re
+import subprocess
+import sys
+from datetime import datetime, timezone
+
+DRIVER_PATH = "drivers/sensor/pyd1598"
+FIELDS = ["date", "revision", "board", "build", "rom", "ram", "instance_ram", "instances"]
+
+# nm --print-size --line-numbers: address size type name [tab file:line]
+NM_LINE = re.compile(r"^[0-9a-fA-F]+\s+([0-9a-fA-F]+)\s+(\w)\s+(\S+)(?:\t(.*))?$")
+
+
+def symbols(nm, elf):
+    out = subprocess.run([nm, "--print-size", "--line-numbers", "--defined-only", elf],
+                         check=True, capture_output=True, text=True).stdout
+    for line in out.splitlines():
+        m = NM_LINE.match(line)
+        if m:
+            yield int(m.group(1), 16), m.group(2), m.group(3), (m.group(4) or "").replace("\\", "/")
+
+
+def measure(nm, elf):
+    rom = 0
+    ram = 0
+    instance_ram = 0
+    instances = 0
+
+    for size, kind, name, location in symbols(nm, elf):
+        if re.fullmatch(r"pyd1598_data_\d+", name):
+            instances += 1
+            if name == "pyd1598_data_0":
+                instance_ram = size
+        if DRIVER_PATH not in location:
+            continue
+        # Text and read only data in flash, initialized and zeroed data in RAM
+        if kind in "TtRr":
+            rom += size
+        elif kind in "DdBb":
+            ram += size
+
+    return {"rom": rom, "ram": ram, "instance_ram": instance_ram, "instances": instances}
+
+
+def revision(source_dir):
+    try:
+        return subprocess.run(["git", "-C", source_dir, "describe", "--always", "--dirty"],
+                              check=True, capture_output=True, text=True).stdout.strip()
+    except (OSError, subprocess.CalledProcessError):
+        return "unknown"
+
+
+def last_row(history, board, build):
+    if not os.path.exists(history):
+        return None
+    with open(history, newline="") as f:
+        rows = [row for row in csv.DictReader(f) if row["board"] == board and row["build"] == build]
+    return rows[-1] if rows else None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--elf", required=True, help="linked image with symbols")
+    parser.add_argument("--nm", default="nm", help="nm of the toolchain that built the image")
+    parser.add_argument("--board", default="unknown")
+    parser.add_argument("--build", default="default", help="name of the configuration, e.g. compact")
+    parser.add_argument("--history", help="csv file the numbers are appended to")
+    parser.add_argument("--source-dir", default=os.getcwd(), help="git tree for the revision")
+    args = parser.parse_args()
+
+    numbers = measure(args.nm, args.elf)
+    if numbers["instances"] == 0:
+        print("no pyd1598 instance in %s" % args.elf, file=sys.stderr)
+        return 1
+
+    previous = last_row(args.history, args.board, args.build) if args.history else None
+    print("pyd1598 footprint, %s %s" % (args.board, args.build))
+    for key, label in (("rom", "driver rom"), ("ram", "driver ram"), ("instance_ram", "ram per instance")):
+        delta = ""
+        if previous is not None:
+            delta = " (%+d since %s)" % (numbers[key] - int(previous[key]), previous["revision"])
+        print("  %-17s %7d bytes%s" % (label, numbers[key], delta))
+    print("  %-17s %7d" % ("instances", numbers["instances"]))
+
+    if args.history:
+        new_file = not os.path.exists(args.history)
+        with open(args.history, "a", newline="") as f:
+            writer = csv.DictWriter(f, fieldnames=FIELDS)
+            if new_file:
+                writer.writeheader()
+            writer.writerow(dict(numbers,
+                                 date=datetime.now(timezone.utc).strftime("%Y-%m-%d"),
+                                 revision=revision(args.source_dir),
+                                 board=args.board,
+                                 build=args.build))
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -4,19 +4,25 @@
 #include <zephyr/device.h>
 #include <zephyr/pm/device.h>
 #include <zephyr/sys/poweroff.h>
-#include <soc.h>
-#include <hal/nrf_gpio.h>
-#include <hal/nrf_regulators.h>
 #include <string.h>
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/devicetree.h>
 #include <zephyr/drivers/sensor.h>
+#include <zephyr/zbus/zbus.h>
 #include <pyd1598.h>
 #include <errno.h> // std error codes : https://github.com/zephyrproject-rtos/zephyr/blob/main/lib/libc/minimal/include/errno.h
 #include <stdint.h>
 #include <stdbool.h>
 #include <float.h>
 
+#ifdef CONFIG_PYD1598_CORO
+#include <pyd1598.hpp>
+#endif
+
+#if defined(CONFIG_PYD1598_LOGGER) && defined(CONFIG_FLASH_SIMULATOR_STATS)
+#include <zephyr/stats/stats.h>
+#endif
+
 
 LOG_MODULE_REGISTER(main, LOG_LEVEL_DBG);
 
@@ -24,6 +30,231 @@ LOG_MODULE_REGISTER(main, LOG_LEVEL_DBG);
 #define COUNT_CHILDREN_OKAY(child) +1
 #define NUM_PYD1598_OKAY (0 DT_FOREACH_CHILD_STATUS_OKAY(DT_ALIAS(pir_master), COUNT_CHILDREN_OKAY))
 
+// Receives its own copy of every published frame and trigger
+ZBUS_MSG_SUBSCRIBER_DEFINE(pir_sub);
+
+// Large enough for a message from any of the subscribed channels
+union pir_msg {
+    struct pyd1598_frame_msg frame;
+    struct pyd1598_trigger_msg trigger;
+};
+
+
+#ifdef CONFIG_PYD1598_CORO
+// One coroutine per sensor, suspended until its wake-up trigger, no thread and no stack of its own
+static pyd1598::task pir_watch(const struct device *dev)
+{
+    int ret;
+
+    ret = pyd1598_set_default_config(dev);
+    if (ret == 0)
+    {
+        ret = pyd1598_set_operation_mode(dev, PYD1598_WAKE_UP);
+    }
+    if (ret == 0)
+    {
+        ret = co_await pyd1598::push(dev);
+    }
+    if (ret != 0)
+    {
+        LOG_INF("%s: configuration failed: %d", dev->name, ret);
+        co_return;
+    }
+
+    while (true)
+    {
+        int64_t timestamp_us = co_await pyd1598::trigger(dev);
+        if (timestamp_us < 0)
+        {
+            LOG_INF("%s: pyd1598_trigger_set_callback: %lld", dev->name, timestamp_us);
+            co_return;
+        }
+
+        // Reset direct link so the sensor can trigger again
+        pyd1598::fetch_result result = co_await pyd1598::reset_and_fetch(dev);
+        if (result.ret != 0)
+        {
+            LOG_INF("%s: pyd1598_reset_and_fetch: %d", dev->name, result.ret);
+            continue;
+        }
+        LOG_INF("%s: triggered at %lld us| measurement %u", dev->name, timestamp_us, result.frame.measurement);
+    }
+}
+#endif
+
+
+#if defined(CONFIG_PYD1598_EMUL) && defined(CONFIG_PYD1598_BUS_SPI)
+#define SPI_CHECK_PUSHES 8
+
+// Configurations pushed through the spi backend, every field at its low, high and a mixed value
+static const struct
+{
+    uint8_t threshold;
+    uint8_t blind_time;
+    uint8_t pulse_counter;
+    uint8_t window_time;
+    enum pyd1598_signal_source source;
+    enum pyd1598_hpf_cutoff cutoff;
+    enum pyd1598_count_mode count_mode;
+} spi_check_confs[] = {
+    {31, 6, 0, 0, PYD1598_PIR_LPF, PYD1598_HPF_CUTOFF_0_4HZ, PYD1598_COUNT_ALL},
+    {0, 0, 0, 0, PYD1598_PIR_BPF, PYD1598_HPF_CUTOFF_0_4HZ, PYD1598_COUNT_SIGN_CHANGE},
+    {255, 15, 3, 3, PYD1598_TEMPERATURE_SENSOR, PYD1598_HPF_CUTOFF_0_2HZ, PYD1598_COUNT_ALL},
+    {0xaa, 0x5, 2, 1, PYD1598_PIR_LPF, PYD1598_HPF_CUTOFF_0_2HZ, PYD1598_COUNT_SIGN_CHANGE},
+};
+
+
+// Pushes every configuration through the spi emulator, the fetch after it reads the latched word back over
+// direct link and fails if it differs. Then the CPU time of a push on the spi and on the gpio backend.
+static void spi_push_check(const struct device *spi_dev, const struct device *gpio_dev)
+{
+    int ok = 0;
+    int ret;
+
+    for (size_t i = 0; i < ARRAY_SIZE(spi_check_confs); i++)
+    {
+        ret = pyd1598_set_default_config(spi_dev);
+        ret = ret != 0 ? ret : pyd1598_set_threshold(spi_dev, spi_check_confs[i].threshold);
+        ret = ret != 0 ? ret : pyd1598_set_blind_time(spi_dev, spi_check_confs[i].blind_time);
+        ret = ret != 0 ? ret : pyd1598_set_pulse_counter(spi_dev, spi_check_confs[i].pulse_counter);
+        ret = ret != 0 ? ret : pyd1598_set_window_time(spi_dev, spi_check_confs[i].window_time);
+        ret = ret != 0 ? ret : pyd1598_set_operation_mode(spi_dev, PYD1598_FORCED_READOUT);
+        ret = ret != 0 ? ret : pyd1598_set_signal_source(spi_dev, spi_check_confs[i].source);
+        ret = ret != 0 ? ret : pyd1598_set_hpf_cutoff(spi_dev, spi_check_confs[i].cutoff);
+        ret = ret != 0 ? ret : pyd1598_set_count_mode(spi_dev, spi_check_confs[i].count_mode);
+        ret = ret != 0 ? ret : pyd1598_push(spi_dev);
+        ret = ret != 0 ? ret : pyd1598_fetch(spi_dev);
+        if (ret != 0)
+        {
+            LOG_INF("spi push: config %d failed: %d", (int)i, ret);
+            continue;
+        }
+        ok++;
+    }
+    LOG_INF("spi push: %d/%d configs latched", ok, (int)ARRAY_SIZE(spi_check_confs));
+
+#ifdef CONFIG_THREAD_RUNTIME_STATS
+    // The gpio push busy waits with irq locked, the spi push sleeps in the transfer
+    const struct device *push_devs[] = {spi_dev, gpio_dev};
+    uint64_t cpu_us[2];
+    uint64_t wall_us[2];
+    k_thread_runtime_stats_t cpu_start;
+    k_thread_runtime_stats_t cpu_end;
+    int64_t wall_start_us;
+
+    pyd1598_set_default_config(spi_dev);
+    pyd1598_set_operation_mode(spi_dev, PYD1598_FORCED_READOUT);
+    for (int b = 0; b < 2; b++)
+    {
+        k_thread_runtime_stats_get(k_current_get(), &cpu_start);
+        wall_start_us = k_ticks_to_us_floor64(k_uptime_ticks());
+        for (int n = 0; n < SPI_CHECK_PUSHES; n++)
+        {
+            pyd1598_push(push_devs[b]);
+        }
+        wall_us[b] = k_ticks_to_us_floor64(k_uptime_ticks()) - wall_start_us;
+        k_thread_runtime_stats_get(k_current_get(), &cpu_end);
+        cpu_us[b] = k_cyc_to_us_floor64(cpu_end.execution_cycles - cpu_start.execution_cycles);
+    }
+    LOG_INF("push cpu: spi %llu us| gpio %llu us per push", cpu_us[0] / SPI_CHECK_PUSHES, cpu_us[1] / SPI_CHECK_PUSHES);
+    LOG_INF("push wall: spi %llu us| gpio %llu us per push", wall_us[0] / SPI_CHECK_PUSHES, wall_us[1] / SPI_CHECK_PUSHES);
+#else
+    ARG_UNUSED(gpio_dev);
+#endif
+
+    // Back to the configuration the sample streams with
+    pyd1598_set_default_config(spi_dev);
+    pyd1598_set_operation_mode(spi_dev, PYD1598_FORCED_READOUT);
+    pyd1598_push(spi_dev);
+}
+#endif
+
+
+
+#if defined(CONFIG_PYD1598_LOGGER) && defined(CONFIG_FLASH_SIMULATOR_STATS) && DT_NODE_EXISTS(DT_NODELABEL(lfs_partition))
+// Every synced block append makes littlefs copy the last, partly written block of the file into a freshly
+// erased one, so about one erase per 512 byte block of ~98 frames plus the metadata compactions
+#define LOGGER_WEAR_ERASES_PER_1000 12
+
+struct wear_stat
+{
+    const char *name;
+    uint32_t value;
+};
+
+
+static int wear_stat_walk(struct stats_hdr *hdr, void *arg, const char *name, uint16_t off)
+{
+    struct wear_stat *stat = (struct wear_stat *)arg;
+
+    if (strcmp(name, stat->name) == 0)
+    {
+        stat->value = *(uint32_t *)((uint8_t *)hdr + off);
+    }
+
+    return 0;
+}
+
+
+// Counter of the flash simulator, 0 if the group or the counter is not there
+static uint32_t wear_stat_get(const char *name)
+{
+    struct stats_hdr *hdr = stats_group_find("flash_sim_stats");
+    struct wear_stat stat = {name, 0};
+
+    if (hdr != NULL)
+    {
+        stats_walk(hdr, wear_stat_walk, &stat);
+    }
+
+    return stat.value;
+}
+
+
+// Streams into the log until the logger has written as many bytes as the littlefs partition holds, so with the
+// two file ring of CONFIG_PYD1598_LOGGER_FILE_SIZE the block allocator has gone round every block once. Then the
+// flash erases and bytes per logged record against the littlefs append cost.
+static void logger_wear_check(void)
+{
+    const uint32_t wrap_bytes = DT_REG_SIZE(DT_NODELABEL(lfs_partition));
+    struct pyd1598_logger_stats start;
+    struct pyd1598_logger_stats end;
+    uint32_t erases;
+    uint32_t flash_bytes;
+    uint32_t records;
+    uint32_t per_1000;
+
+    pyd1598_logger_get_stats(&start);
+    erases = wear_stat_get("flash_erase_calls");
+    flash_bytes = wear_stat_get("bytes_written");
+
+    do
+    {
+        k_sleep(K_SECONDS(10));
+        pyd1598_logger_get_stats(&end);
+    } while (end.bytes_written - start.bytes_written < wrap_bytes && end.write_errors == start.write_errors);
+
+    erases = wear_stat_get("flash_erase_calls") - erases;
+    flash_bytes = wear_stat_get("bytes_written") - flash_bytes;
+    records = end.frames_logged - start.frames_logged;
+    if (end.write_errors != start.write_errors || records == 0)
+    {
+        LOG_INF("logger wear: %u write errors after %u records", end.write_errors - start.write_errors, records);
+        return;
+    }
+
+    per_1000 = (uint32_t)(((uint64_t)erases * 1000 + records - 1) / records);
+    LOG_INF("logger wear: %u records, %u log bytes, %u files rotated", records, end.bytes_written - start.bytes_written,
+            end.files_rotated - start.files_rotated);
+    LOG_INF("logger wear: %u erases, %u flash bytes written, %u.%02u flash bytes per record", erases, flash_bytes,
+            flash_bytes / records, ((flash_bytes % records) * 100) / records);
+    LOG_INF("logger wear: %u erases per 1000 records, limit %u", per_1000, LOGGER_WEAR_ERASES_PER_1000);
+    if (per_1000 <= LOGGER_WEAR_ERASES_PER_1000)
+    {
+        LOG_INF("logger wear: ok");
+    }
+}
+#endif
 
 
 int main(void)
@@ -34,72 +265,157 @@ int main(void)
     // * - blind_time: 6 (0.5 s + 0.5 s * blind_time, range 0-15)
     // * - pulse_counter: 0 (1 + pulse_counter, range 0-3)
     // * - window_time: 0 (2s + 2s * window_time, range 0-3)
-    // * - operation_mode: 2 (0: Forced Readout, 1: Interrupt Readout, 2: Wake-up Mode): Only Wake-up Mode is supported
+    // * - operation_mode: 2 (0: Forced Readout, 1: Interrupt Readout, 2: Wake-up Mode): Interrupt Readout needs CONFIG_PYD1598_INTERRUPT_READOUT
     // * - signal_source: 1 (0: PIR(BRF), 1: PIR(LPF), 2: Not Allowed, 3: Temperature Sensor)
     // * - HPF_Cut_Off: 0 (0: 0.4 Hz, 1: 0.2 Hz)
     // * - Count_Mode: 1 (0: count with (0), or without (1) BPF sign change)
 
 
     int ret = 1;
-    while (ret != 0)
+
+#ifdef CONFIG_PYD1598_CORO
+    // Every sensor runs as a coroutine on the system work queue, main only starts them
+    static pyd1598::executor exec;
+    for (int i = 0; i < NUM_PYD1598_OKAY; i++)
     {
-        ret = pyd1598_set_default_config(devices[0]);
-        if (ret != 0)
-        {
-            LOG_INF("pyd1598_set_default_configuration: %d", ret);
-        }
-        // Set mode 
-        ret = pyd1598_set_operation_mode(devices[0], PYD1598_FORCED_READOUT);
+        ret = exec.spawn(pir_watch(devices[i]));
         if (ret != 0)
         {
-            LOG_INF("pyd1598_get_operation_mode: %d", ret);
+            LOG_INF("spawn %s: %d", devices[i]->name, ret);
         }
     }
+    return 0;
+#endif
 
-
-    // Push the configuration to the sensor
-    ret = pyd1598_push(devices[0]);
-    if (ret != 0)
+    for (int i = 0; i < NUM_PYD1598_OKAY; i++)
     {
-        LOG_INF("pyd1598_push: %d", ret);
-    }
+        ret = 1;
+        while (ret != 0)
+        {
+            ret = pyd1598_set_default_config(devices[i]);
+            if (ret != 0)
+            {
+                LOG_INF("pyd1598_set_default_configuration: %d", ret);
+            }
+            // Set mode 
+            ret = pyd1598_set_operation_mode(devices[i], PYD1598_FORCED_READOUT);
+            if (ret != 0)
+            {
+                LOG_INF("pyd1598_get_operation_mode: %d", ret);
+            }
+        }
 
 
-    // Create a float
-    float success = 0.5;
+        // Push the configuration to the sensor
+        ret = pyd1598_push(devices[i]);
+        if (ret != 0)
+        {
+            LOG_INF("pyd1598_push: %d", ret);
+        }
+    }
 
-    while (true)
+#if defined(CONFIG_PYD1598_EMUL) && defined(CONFIG_PYD1598_STATS)
+    // Cluster report on native_sim, init time of every instance and one scan answered by the emulator
     {
-    
-
-
+        struct pyd1598_stats stats;
+        uint32_t init_total_us = 0;
+        uint32_t init_max_us = 0;
+        int scan_ok = 0;
+        int64_t scan_start_us;
 
-        // Fetch the data from the sensor
-        ret = pyd1598_fetch(devices[0]);
-        if (ret != 0)
+        for (int i = 0; i < NUM_PYD1598_OKAY; i++)
         {
-            success = success*0.99;
+            ret = pyd1598_get_stats(devices[i], &stats);
+            if (ret != 0)
+            {
+                continue;
+            }
+            init_total_us += stats.init_us;
+            init_max_us = MAX(init_max_us, stats.init_us);
         }
-        else
+        LOG_INF("cluster %d: init total %u us| max %u us", NUM_PYD1598_OKAY, init_total_us, init_max_us);
+
+        scan_start_us = k_ticks_to_us_floor64(k_uptime_ticks());
+        for (int i = 0; i < NUM_PYD1598_OKAY; i++)
         {
-        success = success*0.99 + 0.01;
+            if (pyd1598_fetch(devices[i]) == 0)
+            {
+                scan_ok++;
+            }
         }
+        LOG_INF("cluster %d: scan %d/%d ok in %lld us", NUM_PYD1598_OKAY, scan_ok, NUM_PYD1598_OKAY,
+                (int64_t)k_ticks_to_us_floor64(k_uptime_ticks()) - scan_start_us);
+    }
+#endif
 
+#if defined(CONFIG_PYD1598_EMUL) && defined(CONFIG_PYD1598_BUS_SPI)
+    // pyd1598_0 pushes through the spi emulator of native_sim_spi.overlay, pyd1598_1 bit bangs
+    if (NUM_PYD1598_OKAY >= 2)
+    {
+        spi_push_check(devices[0], devices[1]);
+    }
+#endif
 
-        // Sleep for 10 ms
-        k_msleep(10);
-
-        // make float to string
-        char success_str[10];
-        snprintf(success_str, 10, "%f", success);
-        LOG_INF("Success: %s", success_str);
+    // Subscribe to frames and triggers, the driver publishes one message per event
+    ret = zbus_chan_add_obs(&pyd1598_frame_chan, &pir_sub, K_MSEC(100));
+    if (ret != 0)
+    {
+        LOG_INF("zbus_chan_add_obs frame: %d", ret);
+    }
+    ret = zbus_chan_add_obs(&pyd1598_trigger_chan, &pir_sub, K_MSEC(100));
+    if (ret != 0)
+    {
+        LOG_INF("zbus_chan_add_obs trigger: %d", ret);
+    }
 
+#ifdef CONFIG_PYD1598_LOGGER
+    // Every fetched frame goes to the log file, the file system is mounted from the fstab
+    ret = pyd1598_logger_start();
+    if (ret != 0)
+    {
+        LOG_INF("pyd1598_logger_start: %d", ret);
+    }
+#endif
 
+    // Let the driver fetch every sensor, a fetch busy waits ~2 ms so the period grows with the cluster
+    for (int i = 0; i < NUM_PYD1598_OKAY; i++)
+    {
+        ret = pyd1598_stream_start(devices[i], K_MSEC(10 * NUM_PYD1598_OKAY));
+        if (ret != 0)
+        {
+            LOG_INF("pyd1598_stream_start: %d", ret);
+        }
+    }
 
 
+#if defined(CONFIG_PYD1598_LOGGER) && defined(CONFIG_FLASH_SIMULATOR_STATS) && DT_NODE_EXISTS(DT_NODELABEL(lfs_partition))
+    // Frames published meanwhile are dropped by zbus, the subscriber only drains after the check
+    logger_wear_check();
+#endif
 
+    const struct zbus_channel *chan;
+    union pir_msg msg;
 
+    while (true)
+    {
+        // Wait for the next frame or trigger, the message is a copy owned by this thread
+        ret = zbus_sub_wait_msg(&pir_sub, &chan, &msg, K_FOREVER);
+        if (ret != 0)
+        {
+            continue;
+        }
 
+        if (chan == &pyd1598_frame_chan)
+        {
+            LOG_INF("%s: t %lld us| conf %u| measurement %u", msg.frame.dev->name,
+                    msg.frame.frame.timestamp_us, msg.frame.frame.sensor_conf, msg.frame.frame.measurement);
+        }
+        else if (chan == &pyd1598_trigger_chan)
+        {
+            // Fan-in latency, from the direct link interrupt to this thread
+            int64_t latency_us = (int64_t)k_ticks_to_us_floor64(k_uptime_ticks()) - msg.trigger.timestamp_us;
+            LOG_INF("%s: triggered at %lld us, latency %lld us", msg.trigger.dev->name, msg.trigger.timestamp_us, latency_us);
+        }
     }
 
 
@@ -0,0 +1,203 @@
+/*
+PYD1598 driver core decode benchmark
+
+Compares the per bit decode the readout loop used to do against the raw word and
+pyd1598_core_decode_readout(), and the FIELD_GET macro against the descriptor table.
+Also the CPU cost of building the MOSI bytes of an spi push and of encoding a batch
+payload, with the record stream raw and LZ4 compressed when the host has liblz4.
+Host numbers only, they rank the paths, the pin waveform dominates a readout on target.
+*/
+
+#include <benchmark/benchmark.h>
+#include <stdint.h>
+#include <vector>
+#include "pyd1598_core.h"
+#ifdef PYD1598_HOST_LZ4
+#include <lz4.h>
+#endif
+
+
+// Sampled bits of a readout, most significant first
+static int readout_bit(uint64_t word, int i)
+{
+    return (int)((word >> i) & 1U);
+}
+
+
+static uint64_t readout_word(uint32_t seed)
+{
+    return ((uint64_t)seed * 0x9e3779b97f4a7c15ULL) & ((1ULL << PYD1598_READOUT_BITS) - 1);
+}
+
+
+// Decode as the readout loop did before the raw word, a branch per sampled bit
+static void BM_DecodeLegacy(benchmark::State &state)
+{
+    const int bits = (int)state.range(0);
+    uint32_t seed = 1;
+
+    for (auto _ : state) {
+        uint64_t word = readout_word(seed++);
+        uint32_t measurement = 0;
+        uint32_t sensor_conf = 0;
+
+        for (int i = PYD1598_READOUT_BITS - 1; i >= PYD1598_READOUT_BITS - bits; i--) {
+            uint32_t bit = (uint32_t)readout_bit(word, i);
+            if (i >= PYD1598_READOUT_BITS - PYD1598_MEASUREMENT_BITS) {
+                measurement |= bit << (i - (PYD1598_READOUT_BITS - PYD1598_MEASUREMENT_BITS));
+            }
+            else {
+                sensor_conf |= bit << i;
+            }
+        }
+        benchmark::DoNotOptimize(measurement);
+        benchmark::DoNotOptimize(sensor_conf);
+    }
+}
+BENCHMARK(BM_DecodeLegacy)->Arg(PYD1598_READOUT_BITS)->Arg(PYD1598_MEASUREMENT_BITS);
+
+
+// Shift every bit into the raw word, split once at the end
+static void BM_DecodeRaw(benchmark::State &state)
+{
+    const int bits = (int)state.range(0);
+    uint32_t seed = 1;
+
+    for (auto _ : state) {
+        uint64_t word = readout_word(seed++);
+        uint64_t raw = 0;
+        uint32_t measurement;
+        uint32_t sensor_conf;
+
+        for (int i = PYD1598_READOUT_BITS - 1; i >= PYD1598_READOUT_BITS - bits; i--) {
+            raw = (raw << 1) | (uint64_t)readout_bit(word, i);
+        }
+        pyd1598_core_decode_readout(raw, bits, &measurement, &sensor_conf);
+        benchmark::DoNotOptimize(measurement);
+        benchmark::DoNotOptimize(sensor_conf);
+    }
+}
+BENCHMARK(BM_DecodeRaw)->Arg(PYD1598_READOUT_BITS)->Arg(PYD1598_MEASUREMENT_BITS);
+
+
+static void BM_FieldGetMacro(benchmark::State &state)
+{
+    uint32_t word = pyd1598_core_conf_default();
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(word);
+        uint32_t sum = PYD1598_FIELD_GET(word, THRESHOLD) + PYD1598_FIELD_GET(word, BLIND_TIME) +
+                       PYD1598_FIELD_GET(word, PULSE_COUNTER) + PYD1598_FIELD_GET(word, WINDOW_TIME) +
+                       PYD1598_FIELD_GET(word, OPERATION_MODE) + PYD1598_FIELD_GET(word, SIGNAL_SOURCE) +
+                       PYD1598_FIELD_GET(word, HPF_CUT_OFF) + PYD1598_FIELD_GET(word, COUNT_MODE);
+        benchmark::DoNotOptimize(sum);
+    }
+}
+BENCHMARK(BM_FieldGetMacro);
+
+
+static void BM_FieldGetTable(benchmark::State &state)
+{
+    uint32_t word = pyd1598_core_conf_default();
+
+    for (auto _ : state) {
+        uint32_t sum = 0;
+        uint32_t value;
+
+        benchmark::DoNotOptimize(word);
+        for (int f = 0; f < PYD1598_CORE_FIELDS; f++) {
+            if (pyd1598_core_field_get(word, (enum pyd1598_core_field)f, &value) == 0) {
+                sum += value;
+            }
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+}
+BENCHMARK(BM_FieldGetTable);
+
+
+// Waveform of one push through the spi backend, the CPU part of an spi push before the transfer
+static void BM_SpiWaveform(benchmark::State &state)
+{
+    static uint8_t out[2048];
+    uint32_t sensor_conf = pyd1598_core_conf_default();
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(pyd1598_core_spi_waveform(out, sizeof(out), (uint32_t)state.range(0), sensor_conf));
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_SpiWaveform)->Arg(600000)->Arg(1000000)->Arg(4000000);
+
+
+// Record stream of a 100 Hz LPF frame stream of four instances, a slow random walk
+static size_t bench_stream(uint8_t *out, int frames)
+{
+    size_t len = 0;
+    uint32_t seed = 1;
+
+    for (int instance = 0; instance < 4; instance++) {
+        len += pyd1598_core_encode_config(&out[len], (uint8_t)instance, pyd1598_core_conf_default());
+    }
+    for (int i = 0; i < frames; i++) {
+        seed = seed * 1103515245u + 12345u;
+        len += pyd1598_core_encode_frame(&out[len], (uint8_t)(i % 4), (int64_t)((seed >> 16) % 3) - 1,
+                                         (int64_t)((seed >> 8) % 7) - 3);
+    }
+
+    return len;
+}
+
+
+#ifdef PYD1598_HOST_LZ4
+static size_t bench_lz4(const uint8_t *src, size_t len, uint8_t *dst, size_t size)
+{
+    int lz4_len = LZ4_compress_default((const char *)src, (char *)dst, (int)len, (int)size);
+
+    return lz4_len > 0 ? (size_t)lz4_len : 0;
+}
+#endif
+
+
+// Records of one batch, what pyd1598_encoder_add_frame() writes per frame
+static void BM_EncodeRecords(benchmark::State &state)
+{
+    std::vector<uint8_t> stream((size_t)state.range(0) * PYD1598_ENCODER_RECORD_MAX);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(bench_stream(stream.data(), (int)state.range(0)));
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_EncodeRecords)->Arg(256)->Arg(1024);
+
+
+// CBOR payload of a batch, range(1) 1 compresses the record stream
+static void BM_EncodePayload(benchmark::State &state)
+{
+    std::vector<uint8_t> stream((size_t)state.range(0) * PYD1598_ENCODER_RECORD_MAX);
+    std::vector<uint8_t> out(PYD1598_ENCODER_HEADER_MAX + stream.size());
+    pyd1598_core_compress_t compress = nullptr;
+    size_t stream_len;
+    size_t out_len = 0;
+
+    stream_len = bench_stream(stream.data(), (int)state.range(0));
+    if (state.range(1) != 0) {
+#ifdef PYD1598_HOST_LZ4
+        compress = bench_lz4;
+#else
+        state.SkipWithError("liblz4 not found on the host");
+        return;
+#endif
+    }
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(pyd1598_core_encode_payload(out.data(), out.size(), 0, (uint32_t)state.range(0),
+                                                             stream.data(), stream_len, compress, &out_len));
+        benchmark::ClobberMemory();
+    }
+    state.counters["stream_bytes"] = (double)stream_len;
+    state.counters["payload_bytes"] = (double)out_len;
+}
+BENCHMARK(BM_EncodePayload)->Args({1024, 0})->Args({1024, 1});
@@ -0,0 +1,591 @@
+/*
+PYD1598 driver core unit tests
+
+Readout decoding, field packing, configuration checks, the serial in spi waveform,
+csv time parsing, the wake-up detection model and the signal source scheduler
+decisions, on the host.
+*/
+
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <string.h>
+#include <vector>
+#include <stdint.h>
+#include "pyd1598_core.h"
+
+
+// Valid word with every field 0 and the reserved bits set
+static uint32_t conf_zero(void)
+{
+    return pyd1598_core_conf_reserved(0);
+}
+
+
+// Raw word of a readout, measurement first, as the sampled bits arrive
+static uint64_t readout_raw(uint32_t measurement, uint32_t sensor_conf)
+{
+    return ((uint64_t)measurement << (PYD1598_READOUT_BITS - PYD1598_MEASUREMENT_BITS)) | sensor_conf;
+}
+
+
+TEST(DecodeReadout, FullReadoutSplitsMeasurementAndConf)
+{
+    uint32_t measurement;
+    uint32_t sensor_conf;
+
+    pyd1598_core_decode_readout(readout_raw(0x5a5a, 0x1abcdef), PYD1598_READOUT_BITS, &measurement, &sensor_conf);
+
+    EXPECT_EQ(measurement, 0x5a5au);
+    EXPECT_EQ(sensor_conf, 0x1abcdefu);
+}
+
+
+TEST(DecodeReadout, FirstSampledBitIsMostSignificant)
+{
+    uint32_t measurement;
+    uint32_t sensor_conf;
+
+    // Only the first of 40 bits high
+    pyd1598_core_decode_readout((uint64_t)1 << (PYD1598_READOUT_BITS - 1), PYD1598_READOUT_BITS, &measurement,
+                                &sensor_conf);
+    EXPECT_EQ(measurement, 1u << (PYD1598_MEASUREMENT_BITS - 1));
+    EXPECT_EQ(sensor_conf, 0u);
+
+    // Only the last one
+    pyd1598_core_decode_readout(1, PYD1598_READOUT_BITS, &measurement, &sensor_conf);
+    EXPECT_EQ(measurement, 0u);
+    EXPECT_EQ(sensor_conf, 1u);
+}
+
+
+TEST(DecodeReadout, PartialReadoutLeavesConfZero)
+{
+    uint32_t measurement;
+    uint32_t sensor_conf = 0xffffffff;
+
+    pyd1598_core_decode_readout(0x7fff, PYD1598_MEASUREMENT_BITS, &measurement, &sensor_conf);
+
+    EXPECT_EQ(measurement, 0x7fffu);
+    EXPECT_EQ(sensor_conf, 0u);
+}
+
+
+TEST(DecodeReadout, MeasurementFields)
+{
+    // Out of range flag and a negative BPF value
+    uint32_t measurement = (1u << PYD1598_OUT_OF_RANGE_SHIFT) | (0x3fffu & (uint32_t)-100);
+
+    EXPECT_TRUE(pyd1598_out_of_range(measurement));
+    EXPECT_EQ(pyd1598_bpf_counts(measurement), -100);
+    EXPECT_EQ(pyd1598_adc_counts(measurement), 0x3fffu & (uint32_t)-100);
+}
+
+
+TEST(DecodeReadout, NegativeBpfReadout)
+{
+    const int16_t counts[] = {-8192, -100, -1, 0, 1, 8191};
+
+    // Full readouts as the BPF getter and the scheduler see them, the adc counts sign extended from bit 13
+    for (int16_t value : counts) {
+        uint64_t raw = readout_raw((uint16_t)value & 0x3fffu, pyd1598_core_conf_default());
+        uint32_t measurement;
+        uint32_t sensor_conf;
+
+        pyd1598_core_decode_readout(raw, PYD1598_READOUT_BITS, &measurement, &sensor_conf);
+        EXPECT_FALSE(pyd1598_out_of_range(measurement)) << value;
+        EXPECT_EQ(pyd1598_bpf_counts(measurement), value);
+        EXPECT_EQ(pyd1598_signal_counts(measurement, 0), value);
+        EXPECT_EQ(pyd1598_signal_counts(measurement, 1), (int16_t)((uint16_t)value & 0x3fffu));
+    }
+}
+
+
+TEST(Field, MacroRoundTripKeepsOtherBits)
+{
+    const uint32_t words[] = {0, PYD1598_CONF_MASK, 0x0aaaaaa, 0x1555555};
+
+    for (uint32_t word : words) {
+        for (uint32_t v = 0; v <= PYD1598_THRESHOLD_MASK; v++) {
+            uint32_t set = PYD1598_FIELD_SET(word, THRESHOLD, v);
+            EXPECT_EQ(PYD1598_FIELD_GET(set, THRESHOLD), v);
+            EXPECT_EQ(set & ~(PYD1598_THRESHOLD_MASK << PYD1598_THRESHOLD_SHIFT),
+                      word & ~(PYD1598_THRESHOLD_MASK << PYD1598_THRESHOLD_SHIFT));
+        }
+        for (uint32_t v = 0; v <= PYD1598_BLIND_TIME_MASK; v++) {
+            EXPECT_EQ(PYD1598_FIELD_GET(PYD1598_FIELD_SET(word, BLIND_TIME, v), BLIND_TIME), v);
+        }
+        for (uint32_t v = 0; v <= PYD1598_WINDOW_TIME_MASK; v++) {
+            EXPECT_EQ(PYD1598_FIELD_GET(PYD1598_FIELD_SET(word, WINDOW_TIME, v), WINDOW_TIME), v);
+            EXPECT_EQ(PYD1598_FIELD_GET(PYD1598_FIELD_SET(word, PULSE_COUNTER, v), PULSE_COUNTER), v);
+            EXPECT_EQ(PYD1598_FIELD_GET(PYD1598_FIELD_SET(word, OPERATION_MODE, v), OPERATION_MODE), v);
+            EXPECT_EQ(PYD1598_FIELD_GET(PYD1598_FIELD_SET(word, SIGNAL_SOURCE, v), SIGNAL_SOURCE), v);
+        }
+        for (uint32_t v = 0; v <= 1; v++) {
+            EXPECT_EQ(PYD1598_FIELD_GET(PYD1598_FIELD_SET(word, HPF_CUT_OFF, v), HPF_CUT_OFF), v);
+            EXPECT_EQ(PYD1598_FIELD_GET(PYD1598_FIELD_SET(word, COUNT_MODE, v), COUNT_MODE), v);
+        }
+    }
+}
+
+
+TEST(Field, MacroSetMasksTheValue)
+{
+    // Bits of the value above the field are dropped, not spilled into the next field
+    uint32_t set = PYD1598_FIELD_SET(0, PULSE_COUNTER, 0xff);
+
+    EXPECT_EQ(set, PYD1598_PULSE_COUNTER_MASK << PYD1598_PULSE_COUNTER_SHIFT);
+}
+
+
+TEST(Field, TableMatchesMacros)
+{
+    uint32_t word = pyd1598_core_conf_default();
+    uint32_t value;
+
+    ASSERT_EQ(pyd1598_core_field_set(&word, PYD1598_CORE_THRESHOLD, 200), 0);
+    EXPECT_EQ(PYD1598_FIELD_GET(word, THRESHOLD), 200u);
+    ASSERT_EQ(pyd1598_core_field_set(&word, PYD1598_CORE_BLIND_TIME, 15), 0);
+    EXPECT_EQ(PYD1598_FIELD_GET(word, BLIND_TIME), 15u);
+    ASSERT_EQ(pyd1598_core_field_set(&word, PYD1598_CORE_SIGNAL_SOURCE, 3), 0);
+    EXPECT_EQ(PYD1598_FIELD_GET(word, SIGNAL_SOURCE), 3u);
+
+    for (int f = 0; f < PYD1598_CORE_FIELDS; f++) {
+        ASSERT_EQ(pyd1598_core_field_get(word, (enum pyd1598_core_field)f, &value), 0);
+        EXPECT_EQ(value, (word >> pyd1598_core_fields[f].shift) & pyd1598_core_fields[f].mask);
+    }
+}
+
+
+TEST(Field, TableRejectsValuesThatDoNotFit)
+{
+    uint32_t word = conf_zero();
+    uint32_t value;
+
+    EXPECT_EQ(pyd1598_core_field_set(&word, PYD1598_CORE_THRESHOLD, 256), -EINVAL);
+    EXPECT_EQ(pyd1598_core_field_set(&word, PYD1598_CORE_OPERATION_MODE, PYD1598_OPERATION_MODE_INVALID), -EINVAL);
+    EXPECT_EQ(pyd1598_core_field_set(&word, PYD1598_CORE_SIGNAL_SOURCE, PYD1598_SIGNAL_SOURCE_INVALID), -EINVAL);
+    EXPECT_EQ(pyd1598_core_field_set(&word, PYD1598_CORE_FIELDS, 0), -EINVAL);
+    EXPECT_EQ(word, conf_zero());
+
+    EXPECT_EQ(pyd1598_core_field_get(PYD1598_FIELD_SET(word, SIGNAL_SOURCE, 2), PYD1598_CORE_SIGNAL_SOURCE, &value),
+              -EIO);
+    EXPECT_EQ(pyd1598_core_field_get(word, PYD1598_CORE_FIELDS, &value), -EINVAL);
+}
+
+
+TEST(ConfValidate, AcceptsDefaultAndEveryAllowedMode)
+{
+    EXPECT_EQ(pyd1598_core_conf_validate(pyd1598_core_conf_default()), 0);
+    EXPECT_EQ(pyd1598_core_conf_validate(conf_zero()), 0);
+    for (uint32_t mode = 0; mode < PYD1598_OPERATION_MODE_INVALID; mode++) {
+        EXPECT_EQ(pyd1598_core_conf_validate(PYD1598_FIELD_SET(conf_zero(), OPERATION_MODE, mode)), 0);
+    }
+    EXPECT_EQ(pyd1598_core_conf_validate(PYD1598_FIELD_SET(conf_zero(), SIGNAL_SOURCE, 3)), 0);
+}
+
+
+TEST(ConfValidate, Rejects)
+{
+    // Bits above the 25 configuration bits
+    EXPECT_EQ(pyd1598_core_conf_validate(conf_zero() | (1u << 25)), -EINVAL);
+    // Reserved bits
+    EXPECT_EQ(pyd1598_core_conf_validate(PYD1598_FIELD_SET(conf_zero(), RESERVED_2, 0)), -EINVAL);
+    EXPECT_EQ(pyd1598_core_conf_validate(PYD1598_FIELD_SET(conf_zero(), RESERVED_1, 1)), -EINVAL);
+    EXPECT_EQ(pyd1598_core_conf_validate(0), -EINVAL);
+    // Not allowed values
+    EXPECT_EQ(pyd1598_core_conf_validate(PYD1598_FIELD_SET(conf_zero(), OPERATION_MODE, 3)), -EINVAL);
+    EXPECT_EQ(pyd1598_core_conf_validate(PYD1598_FIELD_SET(conf_zero(), SIGNAL_SOURCE, 2)), -EINVAL);
+}
+
+
+TEST(ConfValidate, DefaultFields)
+{
+    uint32_t word = pyd1598_core_conf_default();
+
+    EXPECT_EQ(PYD1598_FIELD_GET(word, THRESHOLD), 31u);
+    EXPECT_EQ(PYD1598_FIELD_GET(word, BLIND_TIME), 6u);
+    EXPECT_EQ(PYD1598_FIELD_GET(word, OPERATION_MODE), 2u);
+    EXPECT_EQ(PYD1598_FIELD_GET(word, SIGNAL_SOURCE), 1u);
+    EXPECT_EQ(PYD1598_FIELD_GET(word, COUNT_MODE), 1u);
+    EXPECT_EQ(PYD1598_FIELD_GET(word, RESERVED_2), PYD1598_RESERVED_2_DEC_VALUE);
+}
+
+
+// MOSI bytes of a push written out by hand: per bit 0x40 or 0x7f and the bit value, then the latch
+static std::vector<uint8_t> spi_expected(uint32_t sensor_conf, size_t slot_bytes, size_t latch_bytes)
+{
+    std::vector<uint8_t> bytes;
+
+    for (int i = 24; i >= 0; i--) {
+        bool one = ((sensor_conf >> i) & 1U) != 0;
+        bytes.push_back(one ? 0x7f : 0x40);
+        bytes.insert(bytes.end(), slot_bytes - 1, one ? 0xff : 0x00);
+    }
+    bytes.insert(bytes.end(), latch_bytes, 0x00);
+
+    return bytes;
+}
+
+
+TEST(SpiWaveform, LengthAtEveryFrequency)
+{
+    // 96 us slots and 780 us latch, rounded up to whole bytes
+    EXPECT_EQ(pyd1598_core_spi_waveform_len(PYD1598_SPI_FREQUENCY_MIN), 25u * 8 + 59);
+    EXPECT_EQ(pyd1598_core_spi_waveform_len(1000000), 25u * 12 + 98);
+    EXPECT_EQ(pyd1598_core_spi_waveform_len(1000000), 398u);
+    EXPECT_EQ(pyd1598_core_spi_waveform_len(PYD1598_SPI_FREQUENCY_MAX), 25u * 48 + 390);
+}
+
+
+TEST(SpiWaveform, MosiBytesOfKnownConfigs)
+{
+    const uint32_t confs[] = {
+        pyd1598_core_conf_default(),
+        conf_zero(),
+        PYD1598_CONF_MASK,
+        0x1555555,
+        0x0aaaaaa,
+    };
+    uint8_t out[512];
+
+    for (uint32_t sensor_conf : confs) {
+        std::vector<uint8_t> expected = spi_expected(sensor_conf, 12, 98);
+
+        memset(out, 0xa5, sizeof(out));
+        ASSERT_EQ(pyd1598_core_spi_waveform(out, sizeof(out), 1000000, sensor_conf), expected.size());
+        EXPECT_EQ(std::vector<uint8_t>(out, out + expected.size()), expected) << std::hex << sensor_conf;
+        EXPECT_EQ(out[expected.size()], 0xa5); // Nothing written past the waveform
+    }
+}
+
+
+TEST(SpiWaveform, FirstSlotsOfTheDefaultConfig)
+{
+    // Threshold 31 = 0b00011111, the first 3 bits sent are 0
+    uint8_t out[512];
+    const uint8_t zero_slot[12] = {0x40, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    const uint8_t one_slot[12] = {0x7f, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+
+    ASSERT_EQ(pyd1598_core_spi_waveform(out, sizeof(out), 1000000, pyd1598_core_conf_default()), 398u);
+    EXPECT_EQ(memcmp(out, zero_slot, 12), 0);
+    EXPECT_EQ(memcmp(out + 24, zero_slot, 12), 0);
+    EXPECT_EQ(memcmp(out + 36, one_slot, 12), 0);
+}
+
+
+TEST(SpiWaveform, RejectsFrequencyAndBuffer)
+{
+    uint8_t out[512];
+
+    EXPECT_EQ(pyd1598_core_spi_waveform(out, sizeof(out), 599999, 0), 0u);
+    EXPECT_EQ(pyd1598_core_spi_waveform(out, sizeof(out), 4000001, 0), 0u);
+    EXPECT_NE(pyd1598_core_spi_waveform(out, sizeof(out), 600000, 0), 0u);
+    EXPECT_EQ(pyd1598_core_spi_waveform(out, 397, 1000000, 0), 0u);
+    EXPECT_EQ(pyd1598_core_spi_waveform(out, sizeof(out), 2000000, 0), 0u); // 796 bytes
+}
+
+
+TEST(SpiWaveform, DecodeRoundTrip)
+{
+    const uint32_t frequencies[] = {600000, 1000000, 2000000, 4000000};
+    const uint32_t confs[] = {pyd1598_core_conf_default(), 0, PYD1598_CONF_MASK, 0x1234567 & PYD1598_CONF_MASK};
+    static uint8_t out[2048];
+    uint32_t sensor_conf;
+
+    for (uint32_t frequency : frequencies) {
+        for (uint32_t conf : confs) {
+            size_t len = pyd1598_core_spi_waveform(out, sizeof(out), frequency, conf);
+            ASSERT_NE(len, 0u);
+            ASSERT_EQ(pyd1598_core_spi_decode(out, len, frequency, &sensor_conf), 0);
+            EXPECT_EQ(sensor_conf, conf);
+        }
+    }
+}
+
+
+TEST(SpiWaveform, DecodeRejectsOtherBytes)
+{
+    uint8_t out[512];
+    uint32_t sensor_conf = 42;
+    size_t len = pyd1598_core_spi_waveform(out, sizeof(out), 1000000, pyd1598_core_conf_default());
+
+    // Wrong length or frequency
+    EXPECT_EQ(pyd1598_core_spi_decode(out, len - 1, 1000000, &sensor_conf), -EINVAL);
+    EXPECT_EQ(pyd1598_core_spi_decode(out, len, 2000000, &sensor_conf), -EINVAL);
+
+    // No pulses at the start of a slot
+    out[12] = 0x00;
+    EXPECT_EQ(pyd1598_core_spi_decode(out, len, 1000000, &sensor_conf), -EIO);
+    out[12] = 0x40;
+
+    // Bit value changes within the slot
+    out[13 + 5] = 0xff;
+    EXPECT_EQ(pyd1598_core_spi_decode(out, len, 1000000, &sensor_conf), -EIO);
+    out[13 + 5] = 0x00;
+
+    // Serial in high during the latch time
+    out[len - 1] = 0x01;
+    EXPECT_EQ(pyd1598_core_spi_decode(out, len, 1000000, &sensor_conf), -EIO);
+    out[len - 1] = 0x00;
+
+    EXPECT_EQ(sensor_conf, 42u);
+    EXPECT_EQ(pyd1598_core_spi_decode(out, len, 1000000, &sensor_conf), 0);
+    EXPECT_EQ(sensor_conf, pyd1598_core_conf_default());
+}
+
+
+TEST(ParseSeconds, WholeAndFraction)
+{
+    int64_t time_ns = 0;
+    const char *end;
+
+    end = pyd1598_core_parse_seconds("12.5,1", &time_ns);
+    ASSERT_NE(end, nullptr);
+    EXPECT_EQ(time_ns, 12500000000LL);
+    EXPECT_EQ(*end, ',');
+
+    end = pyd1598_core_parse_seconds("7", &time_ns);
+    ASSERT_NE(end, nullptr);
+    EXPECT_EQ(time_ns, 7 * PYD1598_NSEC_PER_SEC);
+    EXPECT_EQ(*end, '\0');
+
+    ASSERT_NE(pyd1598_core_parse_seconds(".000000001", &time_ns), nullptr);
+    EXPECT_EQ(time_ns, 1);
+}
+
+
+TEST(ParseSeconds, NegativeAndDigitsBeyondNs)
+{
+    int64_t time_ns = 0;
+
+    ASSERT_NE(pyd1598_core_parse_seconds("-0.25", &time_ns), nullptr);
+    EXPECT_EQ(time_ns, -250000000LL);
+
+    // Digits past ns resolution are consumed and dropped
+    const char *end = pyd1598_core_parse_seconds("1.0000000019;", &time_ns);
+    ASSERT_NE(end, nullptr);
+    EXPECT_EQ(time_ns, 1000000001LL);
+    EXPECT_EQ(*end, ';');
+}
+
+
+TEST(ParseSeconds, RejectsNonNumbers)
+{
+    int64_t time_ns = 42;
+
+    EXPECT_EQ(pyd1598_core_parse_seconds("abc", &time_ns), nullptr);
+    EXPECT_EQ(pyd1598_core_parse_seconds("-", &time_ns), nullptr);
+    EXPECT_EQ(pyd1598_core_parse_seconds(".", &time_ns), nullptr);
+    EXPECT_EQ(pyd1598_core_parse_seconds("", &time_ns), nullptr);
+    EXPECT_EQ(time_ns, 42);
+}
+
+
+TEST(PartialTake, CountsDown)
+{
+    uint16_t left = 2;
+
+    EXPECT_TRUE(pyd1598_core_partial_take(&left));
+    EXPECT_TRUE(pyd1598_core_partial_take(&left));
+    EXPECT_FALSE(pyd1598_core_partial_take(&left));
+    EXPECT_EQ(left, 0);
+}
+
+
+// Configuration of the detection model tests, count every pulse unless sign_change
+static uint32_t detect_conf(uint32_t threshold, uint32_t pulse_counter, uint32_t window_time, uint32_t blind_time,
+                            bool sign_change)
+{
+    uint32_t word = conf_zero();
+
+    word = PYD1598_FIELD_SET(word, THRESHOLD, threshold);
+    word = PYD1598_FIELD_SET(word, PULSE_COUNTER, pulse_counter);
+    word = PYD1598_FIELD_SET(word, WINDOW_TIME, window_time);
+    word = PYD1598_FIELD_SET(word, BLIND_TIME, blind_time);
+    word = PYD1598_FIELD_SET(word, COUNT_MODE, sign_change ? 0 : 1);
+
+    return word;
+}
+
+
+TEST(Detect, InitFromConf)
+{
+    struct pyd1598_core_detect det;
+
+    pyd1598_core_detect_init(&det, detect_conf(80, 3, 2, 4, true));
+
+    EXPECT_EQ(det.threshold, 80u);
+    EXPECT_EQ(det.pulses_needed, 4);
+    EXPECT_EQ(det.window_us, 6000000);
+    EXPECT_EQ(det.blind_us, 2500000);
+    EXPECT_TRUE(det.sign_change);
+}
+
+
+TEST(Detect, SinglePulseTriggersOnTheRiseOnly)
+{
+    struct pyd1598_core_detect det;
+
+    pyd1598_core_detect_init(&det, detect_conf(50, 0, 0, 0, false));
+
+    EXPECT_FALSE(pyd1598_core_detect_sample(&det, 0, 50)); // Not above
+    EXPECT_TRUE(pyd1598_core_detect_sample(&det, 1000, 60));
+    EXPECT_EQ(det.latency_us, 0u);
+    EXPECT_FALSE(pyd1598_core_detect_sample(&det, 2000, 70)); // Still above, no new pulse
+
+    // Blind for 0.5 s after the trigger
+    EXPECT_FALSE(pyd1598_core_detect_sample(&det, 3000, 0));
+    EXPECT_FALSE(pyd1598_core_detect_sample(&det, 4000, -60));
+    EXPECT_FALSE(pyd1598_core_detect_sample(&det, 600000, 0));
+    EXPECT_TRUE(pyd1598_core_detect_sample(&det, 700000, -60));
+    EXPECT_EQ(det.counted, 2u);
+}
+
+
+TEST(Detect, PulsesWithinTheWindow)
+{
+    struct pyd1598_core_detect det;
+
+    // 2 pulses in 2 s
+    pyd1598_core_detect_init(&det, detect_conf(50, 1, 0, 0, false));
+
+    EXPECT_FALSE(pyd1598_core_detect_sample(&det, 0, 60));
+    EXPECT_FALSE(pyd1598_core_detect_sample(&det, 100000, 0));
+    EXPECT_TRUE(pyd1598_core_detect_sample(&det, 1000000, 60));
+    EXPECT_EQ(det.latency_us, 1000000u);
+}
+
+
+TEST(Detect, WindowExpiresAndRestarts)
+{
+    struct pyd1598_core_detect det;
+
+    pyd1598_core_detect_init(&det, detect_conf(50, 1, 0, 0, false));
+
+    EXPECT_FALSE(pyd1598_core_detect_sample(&det, 0, 60));
+    EXPECT_FALSE(pyd1598_core_detect_sample(&det, 100000, 0));
+    // Past the 2 s window, this pulse opens a new one
+    EXPECT_FALSE(pyd1598_core_detect_sample(&det, 2500000, 60));
+    EXPECT_FALSE(pyd1598_core_detect_sample(&det, 2600000, 0));
+    EXPECT_TRUE(pyd1598_core_detect_sample(&det, 3000000, 60));
+    EXPECT_EQ(det.latency_us, 500000u);
+}
+
+
+TEST(Detect, SignChangeModeSkipsPulsesOfTheSameSign)
+{
+    struct pyd1598_core_detect det;
+
+    pyd1598_core_detect_init(&det, detect_conf(50, 1, 0, 0, true));
+
+    EXPECT_FALSE(pyd1598_core_detect_sample(&det, 0, 60));
+    EXPECT_FALSE(pyd1598_core_detect_sample(&det, 50000, 0));
+    EXPECT_FALSE(pyd1598_core_detect_sample(&det, 100000, 60)); // Same sign
+    EXPECT_FALSE(pyd1598_core_detect_sample(&det, 150000, 0));
+    EXPECT_TRUE(pyd1598_core_detect_sample(&det, 200000, -60));
+    EXPECT_EQ(det.latency_us, 200000u);
+}
+
+
+// BPF every 100 ms, LPF not sampled, temperature every 1 s
+static struct pyd1598_core_sched sched_plan(void)
+{
+    struct pyd1598_core_sched plan = {};
+
+    plan.period_ms[pyd1598_core_sched_channel(0)] = 100;
+    plan.period_ms[pyd1598_core_sched_channel(3)] = 1000;
+
+    return plan;
+}
+
+
+TEST(Sched, ChannelsAndSources)
+{
+    EXPECT_EQ(pyd1598_core_sched_channel(0), 0);
+    EXPECT_EQ(pyd1598_core_sched_channel(1), 1);
+    EXPECT_EQ(pyd1598_core_sched_channel(2), -1);
+    EXPECT_EQ(pyd1598_core_sched_channel(3), 2);
+    EXPECT_EQ(pyd1598_core_sched_channel(4), -1);
+    for (int ch = 0; ch < PYD1598_SCHED_CHANNELS; ch++) {
+        EXPECT_EQ(pyd1598_core_sched_channel(pyd1598_core_sched_source(ch)), ch);
+    }
+}
+
+
+TEST(Sched, HomeIsTheShortestPeriod)
+{
+    struct pyd1598_core_sched plan = sched_plan();
+    struct pyd1598_core_sched none = {};
+
+    EXPECT_EQ(pyd1598_core_sched_home(&plan), 0);
+    EXPECT_EQ(pyd1598_core_sched_home(&none), -1);
+    plan.period_ms[1] = 10;
+    EXPECT_EQ(pyd1598_core_sched_home(&plan), 1);
+}
+
+
+TEST(Sched, VisitsTheOverdueChannelAndReturnsHome)
+{
+    struct pyd1598_core_sched plan = sched_plan();
+
+    pyd1598_core_sched_start(&plan, 0);
+    EXPECT_EQ(plan.current, -1);
+    EXPECT_EQ(pyd1598_core_sched_wake(&plan, 0, 50), 50);
+
+    // First run pushes home
+    EXPECT_EQ(pyd1598_core_sched_next(&plan, 0), 0);
+    pyd1598_core_sched_switched(&plan, 0, 0, 50);
+    EXPECT_FALSE(pyd1598_core_sched_sample_due(&plan, 10)); // Settling
+    EXPECT_EQ(pyd1598_core_sched_next(&plan, 10), -1); // Not left while its sample is due
+    EXPECT_TRUE(pyd1598_core_sched_sample_due(&plan, 50));
+    EXPECT_FALSE(pyd1598_core_sched_sampled(&plan, 50));
+    EXPECT_EQ(plan.next_ms[0], 100);
+
+    // Temperature is overdue since the start
+    EXPECT_EQ(pyd1598_core_sched_next(&plan, 50), 2);
+    pyd1598_core_sched_switched(&plan, 2, 50, 50);
+    EXPECT_FALSE(pyd1598_core_sched_sample_due(&plan, 60));
+    EXPECT_EQ(pyd1598_core_sched_wake(&plan, 60, 50), 100);
+    EXPECT_TRUE(pyd1598_core_sched_sample_due(&plan, 100));
+    EXPECT_FALSE(pyd1598_core_sched_sampled(&plan, 100));
+    EXPECT_EQ(plan.next_ms[2], 1000);
+
+    // Visit done, back home
+    EXPECT_EQ(pyd1598_core_sched_next(&plan, 100), 0);
+    pyd1598_core_sched_switched(&plan, 0, 100, 50);
+    EXPECT_EQ(pyd1598_core_sched_next(&plan, 120), -1);
+}
+
+
+TEST(Sched, SkipsSamplesThatCanNotBeCaughtUp)
+{
+    struct pyd1598_core_sched plan = sched_plan();
+
+    pyd1598_core_sched_start(&plan, 0);
+    pyd1598_core_sched_switched(&plan, 0, 0, 0);
+    plan.next_ms[0] = 100;
+    plan.next_ms[2] = 1000;
+
+    EXPECT_TRUE(pyd1598_core_sched_sampled(&plan, 350));
+    EXPECT_EQ(plan.next_ms[0], 450);
+}
+
+
+TEST(Sched, WakesForTheEarliestDueChannel)
+{
+    struct pyd1598_core_sched plan = sched_plan();
+
+    pyd1598_core_sched_start(&plan, 0);
+    pyd1598_core_sched_switched(&plan, 0, 0, 0);
+    plan.next_ms[0] = 450;
+    plan.next_ms[2] = 1000;
+    EXPECT_EQ(pyd1598_core_sched_wake(&plan, 350, 50), 450);
+
+    plan.next_ms[2] = 400;
+    EXPECT_EQ(pyd1598_core_sched_wake(&plan, 350, 50), 400);
+
+    // Still settling, the sample waits for the settle time
+    pyd1598_core_sched_switched(&plan, 0, 440, 50);
+    plan.next_ms[2] = 1000;
+    EXPECT_EQ(pyd1598_core_sched_wake(&plan, 440, 50), 490);
+}
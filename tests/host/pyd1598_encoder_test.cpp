@@ -0,0 +1,435 @@
+/*
+PYD1598 batch encoder payload tests
+
+Varints and CBOR heads at their length boundaries, and whole payloads decoded again
+with a CBOR reader written from RFC 8949 independently of the encoder, the record
+stream raw and, when the host has liblz4, LZ4 compressed.
+*/
+
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <string.h>
+#include <map>
+#include <vector>
+#include <stdint.h>
+#include "pyd1598_core.h"
+#ifdef PYD1598_HOST_LZ4
+#include <lz4.h>
+#endif
+
+
+// CBOR data item of a payload, an unsigned integer or a byte string
+struct cbor_item {
+    int major;
+    uint64_t value;
+    std::vector<uint8_t> bytes;
+};
+
+
+// Head at pos, false if the buffer ends or the additional information is not a length
+static bool cbor_read_head(const std::vector<uint8_t> &in, size_t &pos, int &major, uint64_t &value)
+{
+    static const size_t arg_len[] = {1, 2, 4, 8};
+    uint8_t info;
+
+    if (pos >= in.size()) {
+        return false;
+    }
+    major = in[pos] >> 5;
+    info = in[pos] & 0x1f;
+    pos++;
+
+    if (info < 24) {
+        value = info;
+        return true;
+    }
+    if (info > 27 || pos + arg_len[info - 24] > in.size()) {
+        return false;
+    }
+    value = 0;
+    for (size_t i = 0; i < arg_len[info - 24]; i++) {
+        value = (value << 8) | in[pos++];
+    }
+    return true;
+}
+
+
+// Payload map, key to item, false on anything but a map of unsigned keys to integers and byte strings
+static bool cbor_read_payload(const std::vector<uint8_t> &in, std::map<uint64_t, cbor_item> &items)
+{
+    size_t pos = 0;
+    int major;
+    uint64_t pairs;
+
+    if (!cbor_read_head(in, pos, major, pairs) || major != PYD1598_CBOR_MAJOR_MAP) {
+        return false;
+    }
+    for (uint64_t i = 0; i < pairs; i++) {
+        uint64_t key;
+        cbor_item item;
+
+        if (!cbor_read_head(in, pos, major, key) || major != PYD1598_CBOR_MAJOR_UINT) {
+            return false;
+        }
+        if (!cbor_read_head(in, pos, item.major, item.value)) {
+            return false;
+        }
+        if (item.major == PYD1598_CBOR_MAJOR_BSTR) {
+            if (pos + item.value > in.size()) {
+                return false;
+            }
+            item.bytes.assign(in.begin() + pos, in.begin() + pos + item.value);
+            pos += item.value;
+        } else if (item.major != PYD1598_CBOR_MAJOR_UINT) {
+            return false;
+        }
+        items[key] = item;
+    }
+
+    // Nothing behind the map
+    return pos == in.size();
+}
+
+
+// Record of the stream as written, the signed values unzigzagged
+struct record {
+    int type;
+    int instance;
+    int64_t a;
+    int64_t b;
+
+    bool operator==(const record &other) const
+    {
+        return type == other.type && instance == other.instance && a == other.a && b == other.b;
+    }
+};
+
+
+static int64_t unzigzag(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+
+static bool read_records(const std::vector<uint8_t> &stream, std::vector<record> &records)
+{
+    size_t pos = 0;
+
+    while (pos < stream.size()) {
+        record r = {stream[pos] >> 6, stream[pos] & 0x3f, 0, 0};
+        uint64_t value;
+        size_t used;
+
+        pos++;
+        used = pyd1598_get_varint(&stream[pos], stream.size() - pos, &value);
+        if (used == 0) {
+            return false;
+        }
+        pos += used;
+        r.a = (r.type == PYD1598_ENCODER_TYPE_CONFIG) ? (int64_t)value : unzigzag(value);
+
+        if (r.type == PYD1598_ENCODER_TYPE_FRAME) {
+            used = pyd1598_get_varint(&stream[pos], stream.size() - pos, &value);
+            if (used == 0) {
+                return false;
+            }
+            pos += used;
+            r.b = unzigzag(value);
+        } else if (r.type != PYD1598_ENCODER_TYPE_CONFIG && r.type != PYD1598_ENCODER_TYPE_TRIGGER) {
+            return false;
+        }
+        records.push_back(r);
+    }
+
+    return true;
+}
+
+
+// Record stream of a batch the encoder would write: configs, a steady 100 Hz frame
+// stream of four instances with a jittered and a changed config, and triggers
+static std::vector<uint8_t> batch_stream(std::vector<record> &records)
+{
+    std::vector<uint8_t> stream(64 * 1024);
+    size_t len = 0;
+    uint32_t seed = 1;
+
+    for (int instance = 0; instance < 4; instance++) {
+        uint32_t sensor_conf = pyd1598_core_conf_default() ^ (uint32_t)instance;
+
+        len += pyd1598_core_encode_config(&stream[len], (uint8_t)instance, sensor_conf);
+        records.push_back({PYD1598_ENCODER_TYPE_CONFIG, instance, (int64_t)sensor_conf, 0});
+    }
+    for (int i = 0; i < 1000; i++) {
+        int instance = i % 4;
+        int64_t period_change = (i == 0) ? 10000 : (int64_t)((seed >> 16) % 5) - 2;
+        int64_t measurement_delta = (int64_t)((seed >> 8) % 41) - 20;
+
+        seed = seed * 1103515245u + 12345u;
+        len += pyd1598_core_encode_frame(&stream[len], (uint8_t)instance, period_change, measurement_delta);
+        records.push_back({PYD1598_ENCODER_TYPE_FRAME, instance, period_change, measurement_delta});
+
+        if (i == 500) {
+            len += pyd1598_core_encode_config(&stream[len], (uint8_t)instance, pyd1598_core_conf_default());
+            records.push_back({PYD1598_ENCODER_TYPE_CONFIG, instance, (int64_t)pyd1598_core_conf_default(), 0});
+        }
+        if (i % 250 == 3) {
+            len += pyd1598_core_encode_trigger(&stream[len], (uint8_t)instance, 1234);
+            records.push_back({PYD1598_ENCODER_TYPE_TRIGGER, instance, 1234, 0});
+        }
+    }
+    stream.resize(len);
+
+    return stream;
+}
+
+
+#ifdef PYD1598_HOST_LZ4
+static size_t compress_lz4(const uint8_t *src, size_t len, uint8_t *dst, size_t size)
+{
+    int lz4_len = LZ4_compress_default((const char *)src, (char *)dst, (int)len, (int)size);
+
+    return lz4_len > 0 ? (size_t)lz4_len : 0;
+}
+#endif
+
+
+// Never smaller, the payload keeps the stream as it is
+static size_t compress_none(const uint8_t *src, size_t len, uint8_t *dst, size_t size)
+{
+    (void)src;
+    (void)dst;
+    (void)size;
+
+    return len;
+}
+
+
+TEST(Varint, LengthAtEveryBoundary)
+{
+    static const struct {
+        uint64_t value;
+        size_t len;
+    } cases[] = {
+        {0, 1}, {127, 1}, {128, 2}, {16383, 2}, {16384, 3}, {(1ULL << 21) - 1, 3}, {1ULL << 21, 4},
+        {(1ULL << 28) - 1, 4}, {1ULL << 28, 5}, {UINT32_MAX, PYD1598_VARINT32_MAX}, {1ULL << 35, 6},
+        {(1ULL << 63) - 1, 9}, {1ULL << 63, 10}, {UINT64_MAX, PYD1598_VARINT64_MAX},
+    };
+
+    for (const auto &c : cases) {
+        uint8_t buf[PYD1598_VARINT64_MAX];
+        uint64_t value = 0;
+
+        EXPECT_EQ(pyd1598_put_varint(buf, c.value), c.len) << c.value;
+        EXPECT_EQ(pyd1598_get_varint(buf, c.len, &value), c.len) << c.value;
+        EXPECT_EQ(value, c.value);
+        for (size_t i = 0; i < c.len; i++) {
+            EXPECT_EQ((buf[i] & 0x80) != 0, i + 1 < c.len) << c.value << " byte " << i;
+        }
+    }
+}
+
+
+TEST(Varint, ZigzagKeepsSmallDeltasShort)
+{
+    static const struct {
+        int64_t value;
+        uint64_t zigzag;
+    } cases[] = {
+        {0, 0}, {-1, 1}, {1, 2}, {-64, 127}, {63, 126}, {64, 128}, {INT64_MAX, UINT64_MAX - 1}, {INT64_MIN, UINT64_MAX},
+    };
+
+    for (const auto &c : cases) {
+        uint8_t buf[PYD1598_VARINT64_MAX];
+        uint64_t value = 0;
+        size_t len;
+
+        EXPECT_EQ(pyd1598_zigzag(c.value), c.zigzag) << c.value;
+        len = pyd1598_put_svarint(buf, c.value);
+        ASSERT_EQ(pyd1598_get_varint(buf, len, &value), len);
+        EXPECT_EQ(unzigzag(value), c.value);
+    }
+}
+
+
+TEST(Varint, SignedLengthAtTheOneByteBoundary)
+{
+    uint8_t buf[PYD1598_VARINT64_MAX];
+
+    EXPECT_EQ(pyd1598_put_svarint(buf, -64), 1u);
+    EXPECT_EQ(pyd1598_put_svarint(buf, 63), 1u);
+    EXPECT_EQ(pyd1598_put_svarint(buf, 64), 2u);
+    EXPECT_EQ(pyd1598_put_svarint(buf, -65), 2u);
+}
+
+
+TEST(Varint, GetRejectsTruncatedAndOverlong)
+{
+    uint8_t buf[PYD1598_VARINT64_MAX + 1];
+    uint64_t value = 0;
+    size_t len;
+
+    len = pyd1598_put_varint(buf, 1ULL << 40);
+    EXPECT_EQ(pyd1598_get_varint(buf, len - 1, &value), 0u);
+    EXPECT_EQ(pyd1598_get_varint(buf, 0, &value), 0u);
+
+    memset(buf, 0x80, sizeof(buf));
+    buf[PYD1598_VARINT64_MAX] = 0;
+    EXPECT_EQ(pyd1598_get_varint(buf, sizeof(buf), &value), 0u);
+}
+
+
+TEST(CborHead, ShortestEncodingAtEveryBoundary)
+{
+    static const struct {
+        uint64_t value;
+        size_t len;
+    } cases[] = {
+        {0, 1}, {23, 1}, {24, 2}, {UINT8_MAX, 2}, {UINT8_MAX + 1, 3}, {UINT16_MAX, 3}, {UINT16_MAX + 1, 5},
+        {UINT32_MAX, 5}, {(uint64_t)UINT32_MAX + 1, 9}, {UINT64_MAX, 9},
+    };
+
+    for (const auto &c : cases) {
+        std::vector<uint8_t> buf(9);
+        size_t pos = 0;
+        int major;
+        uint64_t value;
+
+        buf.resize(pyd1598_core_cbor_head(buf.data(), PYD1598_CBOR_MAJOR_BSTR, c.value));
+        EXPECT_EQ(buf.size(), c.len) << c.value;
+        ASSERT_TRUE(cbor_read_head(buf, pos, major, value));
+        EXPECT_EQ(major, PYD1598_CBOR_MAJOR_BSTR);
+        EXPECT_EQ(value, c.value);
+        EXPECT_EQ(pos, buf.size());
+    }
+}
+
+
+TEST(EncoderPayload, RecordsWithinTheirWorstCase)
+{
+    uint8_t buf[PYD1598_ENCODER_RECORD_MAX];
+    size_t len;
+
+    len = pyd1598_core_encode_config(buf, 63, UINT32_MAX);
+    EXPECT_EQ(len, 1u + PYD1598_VARINT32_MAX);
+    EXPECT_EQ(buf[0], PYD1598_ENCODER_TAG(PYD1598_ENCODER_TYPE_CONFIG, 63));
+
+    len += pyd1598_core_encode_frame(&buf[len], 63, INT64_MIN, INT32_MIN);
+    EXPECT_EQ(len, (size_t)PYD1598_ENCODER_RECORD_MAX);
+
+    // Steady stream, one byte of time and one of measurement
+    EXPECT_EQ(pyd1598_core_encode_frame(buf, 0, 0, -3), 3u);
+    EXPECT_EQ(pyd1598_core_encode_trigger(buf, 5, 0), 2u);
+    EXPECT_EQ(buf[0], PYD1598_ENCODER_TAG(PYD1598_ENCODER_TYPE_TRIGGER, 5));
+}
+
+
+TEST(EncoderPayload, EmptyBatch)
+{
+    std::vector<uint8_t> out(PYD1598_ENCODER_HEADER_MAX);
+    std::map<uint64_t, cbor_item> items;
+    size_t out_len = 0;
+
+    ASSERT_EQ(pyd1598_core_encode_payload(out.data(), out.size(), 0, 0, nullptr, 0, nullptr, &out_len), 0);
+    out.resize(out_len);
+    ASSERT_TRUE(cbor_read_payload(out, items));
+    EXPECT_EQ(items.size(), 4u);
+    EXPECT_EQ(items[4].major, PYD1598_CBOR_MAJOR_BSTR);
+    EXPECT_TRUE(items[4].bytes.empty());
+}
+
+
+TEST(EncoderPayload, FullBatchRawRoundTrip)
+{
+    std::vector<record> expected;
+    std::vector<record> records;
+    std::vector<uint8_t> stream = batch_stream(expected);
+    std::vector<uint8_t> out(PYD1598_ENCODER_HEADER_MAX + stream.size());
+    std::map<uint64_t, cbor_item> items;
+    int64_t base_us = 1700000000123456LL;
+    size_t out_len = 0;
+
+    ASSERT_EQ(pyd1598_core_encode_payload(out.data(), out.size(), base_us, (uint32_t)expected.size(), stream.data(),
+                                          stream.size(), nullptr, &out_len),
+              0);
+    out.resize(out_len);
+    ASSERT_TRUE(cbor_read_payload(out, items));
+
+    EXPECT_EQ(items.size(), 4u);
+    EXPECT_EQ(items[0].value, (uint64_t)PYD1598_ENCODER_VERSION);
+    EXPECT_EQ(items[1].value, (uint64_t)base_us);
+    EXPECT_EQ(items[2].value, expected.size());
+    EXPECT_EQ(items.count(3), 0u);
+    ASSERT_EQ(items[4].bytes, stream);
+
+    ASSERT_TRUE(read_records(items[4].bytes, records));
+    EXPECT_EQ(records, expected);
+}
+
+
+TEST(EncoderPayload, CompressorThatDoesNotHelpKeepsTheStreamRaw)
+{
+    std::vector<record> expected;
+    std::vector<uint8_t> stream = batch_stream(expected);
+    std::vector<uint8_t> out(PYD1598_ENCODER_HEADER_MAX + stream.size());
+    std::map<uint64_t, cbor_item> items;
+    size_t out_len = 0;
+
+    ASSERT_EQ(pyd1598_core_encode_payload(out.data(), out.size(), 0, 1, stream.data(), stream.size(), compress_none,
+                                          &out_len),
+              0);
+    out.resize(out_len);
+    ASSERT_TRUE(cbor_read_payload(out, items));
+    EXPECT_EQ(items.count(3), 0u);
+    EXPECT_EQ(items[4].bytes, stream);
+}
+
+
+TEST(EncoderPayload, FullBatchLz4RoundTrip)
+{
+#ifdef PYD1598_HOST_LZ4
+    std::vector<record> expected;
+    std::vector<record> records;
+    std::vector<uint8_t> stream = batch_stream(expected);
+    std::vector<uint8_t> out(PYD1598_ENCODER_HEADER_MAX + stream.size());
+    std::vector<uint8_t> decompressed;
+    std::map<uint64_t, cbor_item> items;
+    size_t out_len = 0;
+    int len;
+
+    ASSERT_EQ(pyd1598_core_encode_payload(out.data(), out.size(), 42, (uint32_t)expected.size(), stream.data(),
+                                          stream.size(), compress_lz4, &out_len),
+              0);
+    out.resize(out_len);
+    ASSERT_TRUE(cbor_read_payload(out, items));
+
+    EXPECT_EQ(items.size(), 5u);
+    EXPECT_EQ(items[1].value, 42u);
+    EXPECT_EQ(items[2].value, expected.size());
+    ASSERT_EQ(items[3].value, stream.size());
+    EXPECT_LT(items[4].bytes.size(), stream.size());
+
+    decompressed.resize(items[3].value);
+    len = LZ4_decompress_safe((const char *)items[4].bytes.data(), (char *)decompressed.data(),
+                              (int)items[4].bytes.size(), (int)decompressed.size());
+    ASSERT_EQ(len, (int)stream.size());
+    EXPECT_EQ(decompressed, stream);
+
+    ASSERT_TRUE(read_records(decompressed, records));
+    EXPECT_EQ(records, expected);
+#else
+    GTEST_SKIP() << "liblz4 not found on the host";
+#endif
+}
+
+
+TEST(EncoderPayload, RejectsTooSmallOutput)
+{
+    std::vector<record> expected;
+    std::vector<uint8_t> stream = batch_stream(expected);
+    std::vector<uint8_t> out(stream.size());
+    size_t out_len = 0;
+
+    EXPECT_EQ(pyd1598_core_encode_payload(out.data(), out.size(), 0, 1, stream.data(), stream.size(), nullptr, &out_len),
+              -ENOMEM);
+    EXPECT_EQ(out_len, 0u);
+}
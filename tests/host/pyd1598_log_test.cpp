@@ -0,0 +1,260 @@
+/*
+PYD1598 frame logger file tests
+
+Blocks written the way pyd1598_logger_frame() fills them and read back the way
+pyd1598_replay_parse_log() does, both through the core functions they share.
+*/
+
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <string.h>
+#include <vector>
+#include <stdint.h>
+#include "pyd1598_core.h"
+
+
+#define LOG_BLOCK_SIZE 512
+#define LOG_INSTANCES 3
+
+struct log_frame {
+    int instance;
+    int64_t timestamp_us;
+    uint32_t sensor_conf;
+    uint16_t measurement;
+};
+
+
+// Logger as pyd1598_logger.c runs it: a block is padded and a new one begun when the next frame may not fit
+struct log_writer {
+    std::vector<std::vector<uint8_t>> blocks;
+    std::vector<uint8_t> block;
+    size_t len;
+    uint32_t sequence;
+    struct pyd1598_core_log_instance instances[LOG_INSTANCES];
+
+    log_writer() : sequence(0)
+    {
+        begin();
+    }
+
+    void begin()
+    {
+        block.assign(LOG_BLOCK_SIZE, 0);
+        len = pyd1598_core_log_begin(block.data(), sequence++);
+        for (auto &inst : instances) {
+            inst.in_block = false;
+        }
+    }
+
+    void pad()
+    {
+        memset(&block[len], PYD1598_LOG_PAD, block.size() - len);
+        blocks.push_back(block);
+    }
+
+    void frame(const log_frame &f)
+    {
+        if (block.size() - len < PYD1598_LOG_RECORD_MAX) {
+            pad();
+            begin();
+        }
+        len += pyd1598_core_log_frame(&block[len], &instances[f.instance], (uint8_t)f.instance, f.timestamp_us,
+                                      f.sensor_conf, f.measurement);
+    }
+
+    void flush()
+    {
+        if (len > PYD1598_LOG_HEADER_SIZE) {
+            pad();
+            begin();
+        }
+    }
+};
+
+
+// Frames of one instance in every block, as replay reads a log file
+static int read_instance(const std::vector<std::vector<uint8_t>> &blocks, int instance, std::vector<log_frame> &frames)
+{
+    for (const auto &block : blocks) {
+        struct pyd1598_core_log_reader rd;
+        log_frame f = {instance, 0, 0, 0};
+        int ret;
+
+        ret = pyd1598_core_log_open(&rd, block.data(), block.size(), instance);
+        if (ret != 0) {
+            return ret;
+        }
+        for (;;) {
+            ret = pyd1598_core_log_next(&rd, &f.timestamp_us, &f.sensor_conf, &f.measurement);
+            if (ret < 0) {
+                return ret;
+            }
+            if (ret == 0) {
+                break;
+            }
+            frames.push_back(f);
+        }
+    }
+
+    return 0;
+}
+
+
+static bool operator==(const log_frame &a, const log_frame &b)
+{
+    return a.instance == b.instance && a.timestamp_us == b.timestamp_us && a.sensor_conf == b.sensor_conf &&
+           a.measurement == b.measurement;
+}
+
+
+// Three sensors at 100 Hz, one changing its config halfway, one with a gap longer than a u32 delta
+static std::vector<log_frame> log_frames(void)
+{
+    std::vector<log_frame> frames;
+    uint32_t seed = 7;
+
+    for (int i = 0; i < 600; i++) {
+        int instance = i % LOG_INSTANCES;
+        int64_t timestamp_us = 1000000 + (int64_t)i * 3333;
+        uint32_t sensor_conf = pyd1598_core_conf_default();
+
+        seed = seed * 1103515245u + 12345u;
+        if (instance == 1 && i > 300) {
+            sensor_conf = PYD1598_FIELD_SET(sensor_conf, SIGNAL_SOURCE, 0);
+        }
+        if (instance == 2 && i > 450) {
+            timestamp_us += 5000000000LL;
+        }
+        frames.push_back({instance, timestamp_us, sensor_conf, (uint16_t)((seed >> 12) & 0x7fff)});
+    }
+
+    return frames;
+}
+
+
+TEST(Log, HeaderAndFrameRecords)
+{
+    uint8_t block[LOG_BLOCK_SIZE];
+    struct pyd1598_core_log_instance inst = {};
+    size_t len;
+
+    EXPECT_EQ(pyd1598_core_log_begin(block, 0x01020304), (size_t)PYD1598_LOG_HEADER_SIZE);
+    EXPECT_EQ(block[0], 'P');
+    EXPECT_EQ(block[1], 'Y');
+    EXPECT_EQ(block[2], PYD1598_LOG_VERSION);
+    EXPECT_EQ(block[4], 0x04);
+    EXPECT_EQ(block[7], 0x01);
+
+    // First frame of an instance: time, config and frame, then only a 5 byte frame at 100 Hz
+    len = pyd1598_core_log_frame(block, &inst, 5, 1000000, 0x123456, 0x2abc);
+    EXPECT_EQ(len, (1u + 8) + (1 + 4) + (1 + 1 + 2));
+    EXPECT_EQ(block[0], PYD1598_LOG_TAG(PYD1598_LOG_TYPE_TIME, 5));
+    EXPECT_EQ(block[9], PYD1598_LOG_TAG(PYD1598_LOG_TYPE_CONFIG, 5));
+    EXPECT_EQ(block[14], PYD1598_LOG_TAG(PYD1598_LOG_TYPE_FRAME, 5));
+    EXPECT_EQ(pyd1598_core_log_frame(block, &inst, 5, 1010000, 0x123456, 0x2abc), 5u);
+
+    // Config change, then a step back in time needs a new base
+    EXPECT_EQ(pyd1598_core_log_frame(block, &inst, 5, 1020000, 0x123457, 0), 5u + 5);
+    EXPECT_EQ(pyd1598_core_log_frame(block, &inst, 5, 1000000, 0x123457, 0), (1u + 8) + (1 + 4) + (1 + 1 + 2));
+    EXPECT_LE(pyd1598_core_log_frame(block, &inst, 5, 1000000 + UINT32_MAX, 0x123457, 0),
+              (size_t)PYD1598_LOG_RECORD_MAX);
+}
+
+
+TEST(Log, LoggerWriteReplayReadRoundTrip)
+{
+    std::vector<log_frame> written = log_frames();
+    log_writer writer;
+
+    for (const auto &f : written) {
+        writer.frame(f);
+    }
+    writer.flush();
+    ASSERT_GT(writer.blocks.size(), 2u);
+
+    for (int instance = 0; instance < LOG_INSTANCES; instance++) {
+        std::vector<log_frame> expected;
+        std::vector<log_frame> read;
+
+        for (const auto &f : written) {
+            if (f.instance == instance) {
+                expected.push_back(f);
+            }
+        }
+        ASSERT_EQ(read_instance(writer.blocks, instance, read), 0) << instance;
+        EXPECT_EQ(read, expected) << instance;
+    }
+}
+
+
+TEST(Log, EveryBlockIsSelfContained)
+{
+    std::vector<log_frame> written = log_frames();
+    log_writer writer;
+    std::vector<log_frame> read;
+
+    for (const auto &f : written) {
+        writer.frame(f);
+    }
+    writer.flush();
+
+    // The last block alone still has a base for every instance in it
+    ASSERT_EQ(read_instance({writer.blocks.back()}, 0, read), 0);
+    ASSERT_FALSE(read.empty());
+    EXPECT_EQ(read.back(), written[written.size() - LOG_INSTANCES]);
+}
+
+
+TEST(Log, ReaderRejectsOtherBlocks)
+{
+    std::vector<uint8_t> block(LOG_BLOCK_SIZE, PYD1598_LOG_PAD);
+    struct pyd1598_core_log_reader rd;
+
+    pyd1598_core_log_begin(block.data(), 0);
+    EXPECT_EQ(pyd1598_core_log_open(&rd, block.data(), PYD1598_LOG_HEADER_SIZE - 1, 0), -EINVAL);
+    EXPECT_EQ(pyd1598_core_log_open(&rd, block.data(), block.size(), PYD1598_LOG_INSTANCES), -EINVAL);
+    EXPECT_EQ(pyd1598_core_log_open(&rd, block.data(), block.size(), -1), -EINVAL);
+    block[2] = PYD1598_LOG_VERSION + 1;
+    EXPECT_EQ(pyd1598_core_log_open(&rd, block.data(), block.size(), 0), -EINVAL);
+    block[0] = 'X';
+    block[2] = PYD1598_LOG_VERSION;
+    EXPECT_EQ(pyd1598_core_log_open(&rd, block.data(), block.size(), 0), -EINVAL);
+}
+
+
+TEST(Log, ReaderRejectsCorruptRecords)
+{
+    uint8_t block[LOG_BLOCK_SIZE];
+    struct pyd1598_core_log_instance inst = {};
+    struct pyd1598_core_log_reader rd;
+    int64_t timestamp_us;
+    uint32_t sensor_conf;
+    uint16_t measurement;
+    size_t len;
+
+    // Truncated in the middle of the time record
+    len = pyd1598_core_log_begin(block, 0);
+    len += pyd1598_core_log_frame(&block[len], &inst, 0, 42, 0, 0);
+    ASSERT_EQ(pyd1598_core_log_open(&rd, block, PYD1598_LOG_HEADER_SIZE + 5, 0), 0);
+    EXPECT_EQ(pyd1598_core_log_next(&rd, &timestamp_us, &sensor_conf, &measurement), -EINVAL);
+
+    // The whole frame reads back, then the end of the block
+    ASSERT_EQ(pyd1598_core_log_open(&rd, block, len, 0), 0);
+    EXPECT_EQ(pyd1598_core_log_next(&rd, &timestamp_us, &sensor_conf, &measurement), 1);
+    EXPECT_EQ(timestamp_us, 42);
+    EXPECT_EQ(pyd1598_core_log_next(&rd, &timestamp_us, &sensor_conf, &measurement), 0);
+
+    // Frame without a time record, and an unknown record type
+    len = pyd1598_core_log_begin(block, 0);
+    block[len++] = PYD1598_LOG_TAG(PYD1598_LOG_TYPE_FRAME, 0);
+    block[len++] = 0;
+    block[len++] = 0;
+    block[len++] = 0;
+    ASSERT_EQ(pyd1598_core_log_open(&rd, block, len, 0), 0);
+    EXPECT_EQ(pyd1598_core_log_next(&rd, &timestamp_us, &sensor_conf, &measurement), -EINVAL);
+
+    len = pyd1598_core_log_begin(block, 0);
+    block[len++] = PYD1598_LOG_TAG(3, 0);
+    ASSERT_EQ(pyd1598_core_log_open(&rd, block, len, 0), 0);
+    EXPECT_EQ(pyd1598_core_log_next(&rd, &timestamp_us, &sensor_conf, &measurement), -EINVAL);
+}
@@ -0,0 +1,372 @@
+/*
+PYD1598 protocol timing checker tests
+
+Pushes and fetches built event by event the way the recorder sees the driver run
+them, at the datasheet limits and one ns past them, plus traces the checker has to
+count as errors or reject, and logic analyzer csv lines.
+*/
+
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+#include <stdint.h>
+#include "pyd1598_core.h"
+#include "pyd1598_timing.h"
+
+
+// Pin timing of one transaction, all in ns
+struct timing_trace {
+    uint32_t low_ns; // Low pulse before each rising edge
+    uint32_t high_ns; // High pulse after each rising edge
+    uint32_t slot_ns; // Serial in rising edge to rising edge
+    uint32_t latch_ns; // Serial in low after the last bit slot
+    uint32_t start_ns; // Direct link high before the first bit
+    uint32_t sample_ns; // Direct link rising edge to the sample
+    uint32_t hold_ns; // Direct link low after the last bit
+    int bits;
+};
+
+static const timing_trace trace_datasheet_min = {200, 200, 80000, 650000, 120000, 200, 1250000, 0};
+static const timing_trace trace_datasheet_max = {2000, 2000, 80000, 650000, 120000, 22000, 1250000, 0};
+
+
+static void trace_event(std::vector<pyd1598_timing_event> &events, uint32_t time_ns, uint8_t line, uint8_t action,
+                        uint8_t level)
+{
+    events.push_back({time_ns, line, action, level});
+}
+
+
+// Serial in push as pyd1598 pushes a config: pulse low, rise, pulse high, data 0 for a slot, latch, release
+static uint32_t trace_push(std::vector<pyd1598_timing_event> &events, uint32_t time_ns, const timing_trace &t)
+{
+    uint32_t rise_ns = 0;
+
+    for (int i = 0; i < t.bits; i++) {
+        trace_event(events, time_ns, PYD1598_TIMING_SERIAL_IN, PYD1598_TIMING_LEVEL, 0);
+        rise_ns = time_ns + t.low_ns;
+        trace_event(events, rise_ns, PYD1598_TIMING_SERIAL_IN, PYD1598_TIMING_LEVEL, 1);
+        trace_event(events, rise_ns + t.high_ns, PYD1598_TIMING_SERIAL_IN, PYD1598_TIMING_LEVEL, 0);
+        time_ns = rise_ns + t.slot_ns - t.low_ns;
+    }
+    // The latch counts from the end of a slot of the minimum length
+    time_ns = rise_ns + pyd1598_timing_datasheet.limits[PYD1598_TIMING_SERIAL_IN_SLOT].min_ns + t.latch_ns;
+    trace_event(events, time_ns, PYD1598_TIMING_SERIAL_IN, PYD1598_TIMING_RELEASE, 0);
+
+    return time_ns;
+}
+
+
+// Direct link fetch as pyd1598 reads out: fetch start, then per bit pulse low, rise, pulse high,
+// release and sample, the end hold and the release
+static uint32_t trace_fetch(std::vector<pyd1598_timing_event> &events, uint32_t time_ns, const timing_trace &t)
+{
+    trace_event(events, time_ns, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_LEVEL, 1);
+    time_ns += t.start_ns;
+    for (int i = 0; i < t.bits; i++) {
+        uint32_t rise_ns = time_ns + t.low_ns;
+
+        trace_event(events, time_ns, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_LEVEL, 0);
+        trace_event(events, rise_ns, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_LEVEL, 1);
+        trace_event(events, rise_ns + t.high_ns, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_RELEASE, 0);
+        trace_event(events, rise_ns + t.sample_ns, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_SAMPLE, 1);
+        time_ns = rise_ns + 30000;
+    }
+    trace_event(events, time_ns, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_LEVEL, 0);
+    time_ns += t.hold_ns;
+    trace_event(events, time_ns, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_RELEASE, 0);
+
+    return time_ns;
+}
+
+
+// Both lines known low before the first transaction
+static std::vector<pyd1598_timing_event> trace_idle(void)
+{
+    std::vector<pyd1598_timing_event> events;
+
+    trace_event(events, 0, PYD1598_TIMING_SERIAL_IN, PYD1598_TIMING_LEVEL, 0);
+    trace_event(events, 0, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_LEVEL, 0);
+
+    return events;
+}
+
+
+static pyd1598_timing_report trace_check(const std::vector<pyd1598_timing_event> &events)
+{
+    pyd1598_timing_report report;
+
+    EXPECT_EQ(pyd1598_timing_check(events.data(), events.size(), &pyd1598_timing_datasheet, &report), 0);
+
+    return report;
+}
+
+
+static void expect_result(const pyd1598_timing_report &report, int constraint, uint32_t count, uint32_t violations,
+                          uint32_t min_ns, uint32_t max_ns, int32_t slack_ns)
+{
+    const pyd1598_timing_result &result = report.results[constraint];
+
+    EXPECT_EQ(result.count, count) << pyd1598_timing_datasheet.limits[constraint].name;
+    EXPECT_EQ(result.violations, violations) << pyd1598_timing_datasheet.limits[constraint].name;
+    EXPECT_EQ(result.min_ns, min_ns) << pyd1598_timing_datasheet.limits[constraint].name;
+    EXPECT_EQ(result.max_ns, max_ns) << pyd1598_timing_datasheet.limits[constraint].name;
+    EXPECT_EQ(result.slack_ns, slack_ns) << pyd1598_timing_datasheet.limits[constraint].name;
+}
+
+
+TEST(Timing, PushAtTheDatasheetLimits)
+{
+    for (const timing_trace &limits : {trace_datasheet_min, trace_datasheet_max}) {
+        std::vector<pyd1598_timing_event> events = trace_idle();
+        timing_trace t = limits;
+        pyd1598_timing_report report;
+
+        t.bits = 25;
+        trace_push(events, 10000, t);
+        report = trace_check(events);
+
+        EXPECT_EQ(report.pushes, 1u);
+        EXPECT_EQ(report.fetches, 0u);
+        EXPECT_EQ(report.errors, 0u);
+        expect_result(report, PYD1598_TIMING_SERIAL_IN_PULSE, 2 * 25, 0, t.low_ns, t.high_ns, 0);
+        expect_result(report, PYD1598_TIMING_SERIAL_IN_SLOT, 24, 0, 80000, 80000, 0);
+        expect_result(report, PYD1598_TIMING_SERIAL_IN_LATCH, 1, 0, 650000, 650000, 0);
+    }
+}
+
+
+TEST(Timing, PushOneNanosecondPastTheLimits)
+{
+    std::vector<pyd1598_timing_event> events = trace_idle();
+    timing_trace t = {199, 2001, 79999, 649999, 0, 0, 0, 25};
+    pyd1598_timing_report report;
+
+    trace_push(events, 10000, t);
+    report = trace_check(events);
+
+    EXPECT_EQ(report.pushes, 1u);
+    EXPECT_EQ(report.errors, 0u);
+    expect_result(report, PYD1598_TIMING_SERIAL_IN_PULSE, 2 * 25, 2 * 25, 199, 2001, -1);
+    expect_result(report, PYD1598_TIMING_SERIAL_IN_SLOT, 24, 24, 79999, 79999, -1);
+    expect_result(report, PYD1598_TIMING_SERIAL_IN_LATCH, 1, 1, 649999, 649999, -1);
+}
+
+
+TEST(Timing, FetchAtTheDatasheetLimits)
+{
+    for (int bits : {PYD1598_READOUT_BITS, PYD1598_MEASUREMENT_BITS}) {
+        for (const timing_trace &limits : {trace_datasheet_min, trace_datasheet_max}) {
+            std::vector<pyd1598_timing_event> events = trace_idle();
+            timing_trace t = limits;
+            pyd1598_timing_report report;
+
+            t.bits = bits;
+            trace_fetch(events, 10000, t);
+            report = trace_check(events);
+
+            EXPECT_EQ(report.pushes, 0u);
+            EXPECT_EQ(report.fetches, 1u);
+            EXPECT_EQ(report.errors, 0u);
+            expect_result(report, PYD1598_TIMING_FETCH_START, 1, 0, 120000, 120000, 0);
+            expect_result(report, PYD1598_TIMING_DIRECT_LINK_PULSE, 2 * bits, 0, t.low_ns, t.high_ns, 0);
+            expect_result(report, PYD1598_TIMING_DIRECT_LINK_SAMPLE, bits, 0, t.sample_ns, t.sample_ns,
+                          std::min((int32_t)t.sample_ns, 22000 - (int32_t)t.sample_ns));
+            expect_result(report, PYD1598_TIMING_END_HOLD, 1, 0, 1250000, 1250000, 0);
+        }
+    }
+}
+
+
+TEST(Timing, FetchOneNanosecondPastTheLimits)
+{
+    std::vector<pyd1598_timing_event> events = trace_idle();
+    timing_trace t = {199, 2001, 0, 0, 119999, 22001, 1249999, PYD1598_READOUT_BITS};
+    pyd1598_timing_report report;
+
+    trace_fetch(events, 10000, t);
+    report = trace_check(events);
+
+    EXPECT_EQ(report.fetches, 1u);
+    EXPECT_EQ(report.errors, 0u);
+    expect_result(report, PYD1598_TIMING_FETCH_START, 1, 1, 119999, 119999, -1);
+    expect_result(report, PYD1598_TIMING_DIRECT_LINK_PULSE, 2 * PYD1598_READOUT_BITS, 2 * PYD1598_READOUT_BITS, 199,
+                  2001, -1);
+    expect_result(report, PYD1598_TIMING_DIRECT_LINK_SAMPLE, PYD1598_READOUT_BITS, PYD1598_READOUT_BITS, 22001, 22001,
+                  -1);
+    expect_result(report, PYD1598_TIMING_END_HOLD, 1, 1, 1249999, 1249999, -1);
+}
+
+
+TEST(Timing, PushThenFetchInOneTrace)
+{
+    std::vector<pyd1598_timing_event> events = trace_idle();
+    timing_trace push = trace_datasheet_max;
+    timing_trace fetch = trace_datasheet_min;
+    pyd1598_timing_report report;
+    uint32_t time_ns;
+
+    push.bits = 25;
+    fetch.bits = PYD1598_READOUT_BITS;
+    time_ns = trace_push(events, 10000, push);
+    time_ns = trace_fetch(events, time_ns + 1000000, fetch);
+    trace_fetch(events, time_ns + 1000000, fetch);
+    report = trace_check(events);
+
+    EXPECT_EQ(report.pushes, 1u);
+    EXPECT_EQ(report.fetches, 2u);
+    EXPECT_EQ(report.errors, 0u);
+    expect_result(report, PYD1598_TIMING_SERIAL_IN_LATCH, 1, 0, 650000, 650000, 0);
+    expect_result(report, PYD1598_TIMING_END_HOLD, 2, 0, 1250000, 1250000, 0);
+}
+
+
+TEST(Timing, WrongBitCountsAreErrors)
+{
+    std::vector<pyd1598_timing_event> events = trace_idle();
+    timing_trace push = trace_datasheet_max;
+    timing_trace fetch = trace_datasheet_max;
+    uint32_t time_ns;
+
+    push.bits = 24;
+    fetch.bits = PYD1598_READOUT_BITS - 1;
+    time_ns = trace_push(events, 10000, push);
+    trace_fetch(events, time_ns + 1000000, fetch);
+
+    EXPECT_EQ(trace_check(events).errors, 2u);
+}
+
+
+TEST(Timing, CutOffTransactionsCountWithoutTheirEnd)
+{
+    std::vector<pyd1598_timing_event> events = trace_idle();
+    timing_trace t = trace_datasheet_max;
+    pyd1598_timing_report report;
+
+    // Push without its release, the capture ends in the latch
+    t.bits = 25;
+    trace_push(events, 10000, t);
+    events.pop_back();
+    report = trace_check(events);
+    EXPECT_EQ(report.pushes, 1u);
+    EXPECT_EQ(report.errors, 0u);
+    EXPECT_EQ(report.results[PYD1598_TIMING_SERIAL_IN_LATCH].count, 0u);
+
+    // Fetch without its end hold
+    events = trace_idle();
+    t.bits = PYD1598_MEASUREMENT_BITS;
+    trace_fetch(events, 10000, t);
+    events.resize(events.size() - 2);
+    report = trace_check(events);
+    EXPECT_EQ(report.fetches, 1u);
+    EXPECT_EQ(report.errors, 0u);
+    EXPECT_EQ(report.results[PYD1598_TIMING_END_HOLD].count, 0u);
+}
+
+
+TEST(Timing, ShortHighIsNotAFetchStart)
+{
+    std::vector<pyd1598_timing_event> events = trace_idle();
+    timing_trace t = trace_datasheet_max;
+    pyd1598_timing_report report;
+
+    // A high shorter than the pulse window is a readout bit of a fetch before the capture
+    trace_event(events, 10000, PYD1598_TIMING_DIRECT_LINK, PYD1598_TIMING_LEVEL, 1);
+    trace_event(events, 10000 + pyd1598_timing_datasheet.pulse_window_ns - 1, PYD1598_TIMING_DIRECT_LINK,
+                PYD1598_TIMING_LEVEL, 0);
+    report = trace_check(events);
+    EXPECT_EQ(report.fetches, 0u);
+    EXPECT_EQ(report.results[PYD1598_TIMING_FETCH_START].count, 0u);
+
+    // Only the fetch start of the next fetch is measured
+    t.bits = PYD1598_READOUT_BITS;
+    trace_fetch(events, 100000, t);
+    report = trace_check(events);
+    EXPECT_EQ(report.fetches, 1u);
+    EXPECT_EQ(report.errors, 0u);
+    expect_result(report, PYD1598_TIMING_FETCH_START, 1, 0, 120000, 120000, 0);
+}
+
+
+TEST(Timing, RejectsUnknownEvents)
+{
+    std::vector<pyd1598_timing_event> events = trace_idle();
+    pyd1598_timing_report report;
+
+    EXPECT_EQ(pyd1598_timing_check(nullptr, 0, &pyd1598_timing_datasheet, &report), 0);
+    EXPECT_EQ(pyd1598_timing_check(nullptr, 1, &pyd1598_timing_datasheet, &report), -EINVAL);
+    EXPECT_EQ(pyd1598_timing_check(events.data(), events.size(), nullptr, &report), -EINVAL);
+    EXPECT_EQ(pyd1598_timing_check(events.data(), events.size(), &pyd1598_timing_datasheet, nullptr), -EINVAL);
+
+    trace_event(events, 10, PYD1598_TIMING_DIRECT_LINK + 1, PYD1598_TIMING_LEVEL, 1);
+    EXPECT_EQ(pyd1598_timing_check(events.data(), events.size(), &pyd1598_timing_datasheet, &report), -EINVAL);
+    events.back().line = PYD1598_TIMING_SERIAL_IN;
+    events.back().action = PYD1598_TIMING_SAMPLE + 1;
+    EXPECT_EQ(pyd1598_timing_check(events.data(), events.size(), &pyd1598_timing_datasheet, &report), -EINVAL);
+}
+
+
+TEST(Timing, CsvLinesToLevelEvents)
+{
+    pyd1598_timing_csv csv = {};
+    pyd1598_timing_event events[4];
+    size_t count = 0;
+
+    EXPECT_EQ(pyd1598_timing_parse_csv(&csv, "Time [s],SERIN,DL", events, 4, &count), 0);
+    EXPECT_EQ(count, 0u);
+
+    // The first line sets both levels and the time 0, then only changes
+    EXPECT_EQ(pyd1598_timing_parse_csv(&csv, "1.5,0,1", events, 4, &count), 0);
+    EXPECT_EQ(pyd1598_timing_parse_csv(&csv, "1.500000200,1,1", events, 4, &count), 0);
+    ASSERT_EQ(count, 3u);
+    EXPECT_EQ(events[0].time_ns, 0u);
+    EXPECT_EQ(events[0].line, PYD1598_TIMING_SERIAL_IN);
+    EXPECT_EQ(events[0].level, 0);
+    EXPECT_EQ(events[1].line, PYD1598_TIMING_DIRECT_LINK);
+    EXPECT_EQ(events[1].level, 1);
+    EXPECT_EQ(events[2].time_ns, 200u);
+    EXPECT_EQ(events[2].line, PYD1598_TIMING_SERIAL_IN);
+    EXPECT_EQ(events[2].action, PYD1598_TIMING_LEVEL);
+    EXPECT_EQ(events[2].level, 1);
+
+    EXPECT_EQ(pyd1598_timing_parse_csv(&csv, "1.6,1,2", events, 4, &count), -EINVAL);
+    EXPECT_EQ(pyd1598_timing_parse_csv(&csv, "1.6;1;0", events, 4, &count), -EINVAL);
+    EXPECT_EQ(pyd1598_timing_parse_csv(&csv, "1.6,1", events, 4, &count), -EINVAL);
+    EXPECT_EQ(pyd1598_timing_parse_csv(&csv, "1.6,0,0", events, 4, &count), -ENOMEM);
+    EXPECT_EQ(count, 4u);
+}
+
+
+TEST(Timing, CsvCaptureOfAPush)
+{
+    std::vector<pyd1598_timing_event> pushed = trace_idle();
+    std::vector<pyd1598_timing_event> events(256);
+    pyd1598_timing_csv csv = {};
+    timing_trace t = trace_datasheet_max;
+    pyd1598_timing_report report;
+    int serial_in = 0;
+    size_t count = 0;
+    char line[64];
+
+    // The analyzer sees the levels of the push, not the release
+    t.bits = 25;
+    trace_push(pushed, 10000, t);
+    for (const auto &event : pushed) {
+        if (event.line != PYD1598_TIMING_SERIAL_IN || event.action != PYD1598_TIMING_LEVEL) {
+            continue;
+        }
+        serial_in = event.level;
+        snprintf(line, sizeof(line), "%u.%09u,%d,0", event.time_ns / 1000000000u, event.time_ns % 1000000000u,
+                 serial_in);
+        ASSERT_EQ(pyd1598_timing_parse_csv(&csv, line, events.data(), events.size(), &count), 0) << line;
+    }
+
+    // Serial in stays low from a 0 data phase into the next low pulse, only the high pulses show
+    ASSERT_EQ(pyd1598_timing_check(events.data(), count, &pyd1598_timing_datasheet, &report), 0);
+    EXPECT_EQ(report.pushes, 1u);
+    EXPECT_EQ(report.errors, 0u);
+    expect_result(report, PYD1598_TIMING_SERIAL_IN_PULSE, 25, 0, 2000, 2000, 0);
+    expect_result(report, PYD1598_TIMING_SERIAL_IN_SLOT, 24, 0, 80000, 80000, 0);
+}